@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Lớp I/O bất đồng bộ cho persistence: io_uring (gọi syscall trực tiếp, không
+// cần liburing) hoặc, khi kernel không cho io_uring / không có
+// IORING_OP_WRITE, FSYNC (uring_probe) / MAILSTORE_AIO=threads, một thread
+// pool nhỏ làm pwrite/fdatasync. Request được xếp hàng rồi gửi theo
+// lô (aio_submit: một io_uring_enter cho cả lô). fdatasync là barrier: chỉ bắt
+// đầu sau khi mọi request gửi trước nó đã xong. Callback không bao giờ chạy
+// trong thread của kernel/worker mà trong aio_poll/aio_wait_all của caller;
+// aio_event_fd() readable khi có completion để gắn vào epoll. Trạng thái là
+// riêng của process, process con sau fork khởi tạo lại.
+
+#define AIO_OP_WRITE 1
+#define AIO_OP_SYNC 2
+
+typedef struct AioRequest {
+    int op;
+    int fd;
+    const void* buf;
+    size_t len;
+    off_t offset;
+    int result;
+    aio_callback cb;
+    void* arg;
+    struct AioRequest* next;
+} AioRequest;
+
+typedef struct {
+    int backend;                 // AIO_BACKEND_*, NONE = chưa khởi tạo
+    int event_fd;
+    int inflight;                // đã xếp hàng/gửi, chưa vào danh sách done
+    AioRequest* done_head;
+    AioRequest* done_tail;
+    
+    // io_uring
+    int ring_fd;
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned to_submit;
+    
+    // thread pool
+    pthread_t threads[AIO_THREADS];
+    int nthreads;
+    AioRequest* queue_head;
+    AioRequest* queue_tail;
+    int active;
+    int sync_active;
+    pthread_cond_t queue_cond;
+    pthread_cond_t done_cond;
+} AioState;
+
+static AioState g_aio = { .backend = AIO_BACKEND_NONE, .event_fd = -1, .ring_fd = -1 };
+static pthread_mutex_t g_aio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_aio_once = PTHREAD_ONCE_INIT;
+
+static void push_done(AioRequest* req) {
+    req->next = NULL;
+    if (g_aio.done_tail != NULL) {
+        g_aio.done_tail->next = req;
+    } else {
+        g_aio.done_head = req;
+    }
+    g_aio.done_tail = req;
+    g_aio.inflight--;
+}
+
+static int execute_request(AioRequest* req);
+
+static void wake_event_fd() {
+    unsigned long long one = 1;
+    if (write(g_aio.event_fd, &one, sizeof(one)) < 0) {
+        // eventfd chỉ để đánh thức, aio_poll vẫn thấy danh sách done
+    }
+}
+
+// ---- io_uring backend ----
+
+static int uring_enter(unsigned to_submit, unsigned min_complete) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int rc;
+    do {
+        rc = (int)syscall(__NR_io_uring_enter, g_aio.ring_fd, to_submit, min_complete, flags, NULL, 0);
+    } while (rc == -1 && errno == EINTR);
+    return rc;
+}
+
+// Kernel có io_uring nhưng chưa chắc có IORING_OP_WRITE (5.6+) / FSYNC: hỏi qua
+// IORING_REGISTER_PROBE (5.6+, kernel cũ hơn trả lỗi = cũng không có OP_WRITE).
+static int uring_probe(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    if (probe == NULL) {
+        return -1;
+    }
+    int rc = (int)syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256);
+    int ok = (rc == 0 &&
+              probe->ops_len > IORING_OP_WRITE && probe->ops_len > IORING_OP_FSYNC &&
+              (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) &&
+              (probe->ops[IORING_OP_FSYNC].flags & IO_URING_OP_SUPPORTED));
+    free(probe);
+    return ok ? 0 : -1;
+}
+
+static int uring_setup() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, AIO_QUEUE_DEPTH, &p);
+    if (fd == -1) {
+        return -1;
+    }
+    if (uring_probe(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    g_aio.ring_fd = fd;
+    g_aio.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    g_aio.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (g_aio.cq_size > g_aio.sq_size) {
+            g_aio.sq_size = g_aio.cq_size;
+        }
+        g_aio.cq_size = g_aio.sq_size;
+    }
+    
+    g_aio.sq_ptr = mmap(NULL, g_aio.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQ_RING);
+    if (g_aio.sq_ptr == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        g_aio.cq_ptr = g_aio.sq_ptr;
+    } else {
+        g_aio.cq_ptr = mmap(NULL, g_aio.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, IORING_OFF_CQ_RING);
+        if (g_aio.cq_ptr == MAP_FAILED) {
+            munmap(g_aio.sq_ptr, g_aio.sq_size);
+            close(fd);
+            return -1;
+        }
+    }
+    g_aio.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    g_aio.sqes = mmap(NULL, g_aio.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (g_aio.sqes == MAP_FAILED) {
+        if (g_aio.cq_ptr != g_aio.sq_ptr) {
+            munmap(g_aio.cq_ptr, g_aio.cq_size);
+        }
+        munmap(g_aio.sq_ptr, g_aio.sq_size);
+        close(fd);
+        return -1;
+    }
+    
+    char* sq = g_aio.sq_ptr;
+    char* cq = g_aio.cq_ptr;
+    g_aio.sq_head = (unsigned*)(sq + p.sq_off.head);
+    g_aio.sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    g_aio.sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    g_aio.sq_array = (unsigned*)(sq + p.sq_off.array);
+    g_aio.sq_entries = p.sq_entries;
+    g_aio.cq_head = (unsigned*)(cq + p.cq_off.head);
+    g_aio.cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    g_aio.cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    g_aio.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    g_aio.to_submit = 0;
+    
+    // Completion đánh thức eventfd để caller có thể chờ bằng epoll
+    syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD, &g_aio.event_fd, 1);
+    return 0;
+}
+
+// Chuyển CQE đã xong sang danh sách done (giữ g_aio_mutex)
+static int uring_reap() {
+    unsigned head = *g_aio.cq_head;
+    unsigned tail = __atomic_load_n(g_aio.cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &g_aio.cqes[head & *g_aio.cq_mask];
+        AioRequest* req = (AioRequest*)(uintptr_t)cqe->user_data;
+        req->result = cqe->res;
+        push_done(req);
+        head++;
+        n++;
+    }
+    __atomic_store_n(g_aio.cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+// io_uring_enter không nhận các SQE còn lại (EAGAIN / EBUSY: kernel thiếu tài
+// nguyên hoặc CQ tràn): kernel không có gì để hoàn thành nên không được chờ
+// completion của chúng. Rút các SQE đó khỏi ring (không dùng SQPOLL nên kernel
+// chỉ đọc ring trong io_uring_enter) và làm đồng bộ như thread pool, sau khi
+// request đã vào kernel xong để fdatasync vẫn là barrier (giữ g_aio_mutex).
+static void uring_run_unsubmitted() {
+    unsigned head = __atomic_load_n(g_aio.sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *g_aio.sq_tail;
+    int in_kernel = g_aio.inflight - (int)(tail - head);
+    int drained = 1;
+    while ((in_kernel -= uring_reap()) > 0) {
+        if (uring_enter(0, 1) < 0) {
+            drained = 0;
+            break;
+        }
+    }
+    
+    for (unsigned i = head; i != tail; i++) {
+        struct io_uring_sqe* sqe = &g_aio.sqes[g_aio.sq_array[i & *g_aio.sq_mask]];
+        AioRequest* req = (AioRequest*)(uintptr_t)sqe->user_data;
+        req->result = (req->op == AIO_OP_SYNC && !drained) ? -EIO : execute_request(req);
+        push_done(req);
+    }
+    __atomic_store_n(g_aio.sq_tail, head, __ATOMIC_RELEASE);
+    g_aio.to_submit = 0;
+    wake_event_fd();
+}
+
+// Gửi các SQE đang xếp hàng. Lỗi: các SQE đó đã được làm đồng bộ (kết quả
+// trong callback), trả về MS_ERR_SYS.
+static int uring_flush() {
+    while (g_aio.to_submit > 0) {
+        int rc = uring_enter(g_aio.to_submit, 0);
+        if (rc <= 0) {
+            uring_run_unsubmitted();
+            return MS_ERR_SYS;
+        }
+        g_aio.to_submit -= rc;
+    }
+    return MS_OK;
+}
+
+static int uring_queue(AioRequest* req) {
+    // Không để số request chưa reap vượt quá CQ: chờ bớt trước
+    while (g_aio.inflight >= AIO_QUEUE_DEPTH) {
+        if (uring_flush() != MS_OK) {
+            continue;            // đã xong đồng bộ, inflight đã giảm
+        }
+        if (uring_enter(0, 1) < 0) {
+            return MS_ERR_SYS;
+        }
+        uring_reap();
+    }
+    
+    // SQ đầy: gửi bớt (lỗi thì các SQE đã được rút khỏi ring)
+    if (*g_aio.sq_tail - __atomic_load_n(g_aio.sq_head, __ATOMIC_ACQUIRE) == g_aio.sq_entries) {
+        uring_flush();
+    }
+    
+    unsigned tail = *g_aio.sq_tail;
+    unsigned index = tail & *g_aio.sq_mask;
+    struct io_uring_sqe* sqe = &g_aio.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = req->fd;
+    sqe->user_data = (unsigned long long)(uintptr_t)req;
+    if (req->op == AIO_OP_WRITE) {
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->addr = (unsigned long long)(uintptr_t)req->buf;
+        sqe->len = (unsigned)req->len;
+        sqe->off = (unsigned long long)req->offset;
+    } else {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->flags = IOSQE_IO_DRAIN;
+    }
+    g_aio.sq_array[index] = index;
+    __atomic_store_n(g_aio.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    g_aio.to_submit++;
+    g_aio.inflight++;
+    return MS_OK;
+}
+
+// ---- thread pool backend ----
+
+static int execute_request(AioRequest* req) {
+    if (req->op == AIO_OP_SYNC) {
+        return fdatasync(req->fd) == 0 ? 0 : -errno;
+    }
+    
+    size_t done = 0;
+    while (done < req->len) {
+        ssize_t n = pwrite(req->fd, (const char*)req->buf + done, req->len - done, req->offset + done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0 ? -EIO : -errno;
+        }
+        done += n;
+    }
+    return (int)done;
+}
+
+static void* aio_thread(void* unused) {
+    (void)unused;
+    pthread_mutex_lock(&g_aio_mutex);
+    while (g_aio.backend == AIO_BACKEND_THREADS) {
+        AioRequest* req = g_aio.queue_head;
+        // FIFO với barrier: sync chờ mọi request trước nó, request sau chờ sync
+        if (req == NULL || g_aio.sync_active || (req->op == AIO_OP_SYNC && g_aio.active > 0)) {
+            pthread_cond_wait(&g_aio.queue_cond, &g_aio_mutex);
+            continue;
+        }
+        
+        g_aio.queue_head = req->next;
+        if (g_aio.queue_head == NULL) {
+            g_aio.queue_tail = NULL;
+        }
+        g_aio.active++;
+        if (req->op == AIO_OP_SYNC) {
+            g_aio.sync_active = 1;
+        }
+        pthread_mutex_unlock(&g_aio_mutex);
+        
+        int result = execute_request(req);
+        
+        pthread_mutex_lock(&g_aio_mutex);
+        req->result = result;
+        g_aio.active--;
+        if (req->op == AIO_OP_SYNC) {
+            g_aio.sync_active = 0;
+        }
+        push_done(req);
+        wake_event_fd();
+        pthread_cond_broadcast(&g_aio.queue_cond);
+        pthread_cond_broadcast(&g_aio.done_cond);
+    }
+    pthread_mutex_unlock(&g_aio_mutex);
+    return NULL;
+}
+
+static int threads_setup() {
+    pthread_cond_init(&g_aio.queue_cond, NULL);
+    pthread_cond_init(&g_aio.done_cond, NULL);
+    g_aio.queue_head = g_aio.queue_tail = NULL;
+    g_aio.active = g_aio.sync_active = 0;
+    g_aio.nthreads = 0;
+    g_aio.backend = AIO_BACKEND_THREADS;
+    for (int i = 0; i < AIO_THREADS; i++) {
+        if (pthread_create(&g_aio.threads[i], NULL, aio_thread, NULL) == 0) {
+            pthread_detach(g_aio.threads[i]);
+            g_aio.nthreads++;
+        }
+    }
+    if (g_aio.nthreads == 0) {
+        g_aio.backend = AIO_BACKEND_NONE;
+        return -1;
+    }
+    return 0;
+}
+
+// ---- chung ----
+
+// Process con không dùng ring/thread của cha (thread không tồn tại sau fork)
+static void aio_after_fork() {
+    pthread_mutex_init(&g_aio_mutex, NULL);
+    if (g_aio.backend == AIO_BACKEND_URING) {
+        munmap(g_aio.sqes, g_aio.sqes_size);
+        if (g_aio.cq_ptr != g_aio.sq_ptr) {
+            munmap(g_aio.cq_ptr, g_aio.cq_size);
+        }
+        munmap(g_aio.sq_ptr, g_aio.sq_size);
+        close(g_aio.ring_fd);
+    }
+    if (g_aio.event_fd != -1) {
+        close(g_aio.event_fd);
+    }
+    memset(&g_aio, 0, sizeof(g_aio));
+    g_aio.backend = AIO_BACKEND_NONE;
+    g_aio.event_fd = -1;
+    g_aio.ring_fd = -1;
+}
+
+static void register_fork_handler() {
+    pthread_atfork(NULL, NULL, aio_after_fork);
+}
+
+// Khởi tạo (giữ g_aio_mutex). Trả về backend đang dùng.
+static int ensure_backend() {
+    if (g_aio.backend != AIO_BACKEND_NONE) {
+        return g_aio.backend;
+    }
+    
+    g_aio.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_aio.event_fd == -1) {
+        return AIO_BACKEND_NONE;
+    }
+    
+    const char* mode = getenv("MAILSTORE_AIO");
+    if ((mode == NULL || strcmp(mode, "threads") != 0) && uring_setup() == 0) {
+        g_aio.backend = AIO_BACKEND_URING;
+    } else if (threads_setup() != 0) {
+        close(g_aio.event_fd);
+        g_aio.event_fd = -1;
+    }
+    return g_aio.backend;
+}
+
+static int queue_request(int op, int fd, const void* buf, size_t len, off_t offset,
+                         aio_callback cb, void* arg) {
+    if (fd < 0) {
+        return MS_ERR_INVALID;
+    }
+    AioRequest* req = malloc(sizeof(AioRequest));
+    if (req == NULL) {
+        return MS_ERR_SYS;
+    }
+    req->op = op;
+    req->fd = fd;
+    req->buf = buf;
+    req->len = len;
+    req->offset = offset;
+    req->result = 0;
+    req->cb = cb;
+    req->arg = arg;
+    req->next = NULL;
+    
+    pthread_once(&g_aio_once, register_fork_handler);
+    pthread_mutex_lock(&g_aio_mutex);
+    int rc = MS_OK;
+    int backend = ensure_backend();
+    if (backend == AIO_BACKEND_URING) {
+        rc = uring_queue(req);
+    } else if (backend == AIO_BACKEND_THREADS) {
+        if (g_aio.queue_tail != NULL) {
+            g_aio.queue_tail->next = req;
+        } else {
+            g_aio.queue_head = req;
+        }
+        g_aio.queue_tail = req;
+        g_aio.inflight++;
+    } else {
+        rc = MS_ERR_SYS;
+    }
+    pthread_mutex_unlock(&g_aio_mutex);
+    
+    if (rc != MS_OK) {
+        free(req);
+    }
+    return rc;
+}
+
+// Xếp hàng ghi len byte tại offset. buf phải còn sống đến khi callback chạy.
+// callback nhận số byte đã ghi hoặc -errno.
+int aio_write(int fd, const void* buf, size_t len, off_t offset, aio_callback cb, void* arg) {
+    return queue_request(AIO_OP_WRITE, fd, buf, len, offset, cb, arg);
+}
+
+// Xếp hàng fdatasync sau mọi request đã xếp trước đó. callback nhận 0 hoặc -errno.
+int aio_fdatasync(int fd, aio_callback cb, void* arg) {
+    return queue_request(AIO_OP_SYNC, fd, NULL, 0, 0, cb, arg);
+}
+
+// Gửi cả lô đang xếp hàng (một syscall với io_uring)
+int aio_submit() {
+    pthread_mutex_lock(&g_aio_mutex);
+    int rc = MS_OK;
+    if (g_aio.backend == AIO_BACKEND_URING) {
+        rc = uring_flush();
+    } else if (g_aio.backend == AIO_BACKEND_THREADS && g_aio.queue_head != NULL) {
+        pthread_cond_broadcast(&g_aio.queue_cond);
+    }
+    pthread_mutex_unlock(&g_aio_mutex);
+    return rc;
+}
+
+// Chạy callback của các request đã xong, không chặn. Trả về số callback đã chạy.
+int aio_poll() {
+    pthread_mutex_lock(&g_aio_mutex);
+    if (g_aio.backend == AIO_BACKEND_NONE) {
+        pthread_mutex_unlock(&g_aio_mutex);
+        return 0;
+    }
+    unsigned long long count;
+    if (read(g_aio.event_fd, &count, sizeof(count)) < 0) {
+        // EAGAIN: chưa có completion mới
+    }
+    if (g_aio.backend == AIO_BACKEND_URING) {
+        uring_reap();
+    }
+    AioRequest* done = g_aio.done_head;
+    g_aio.done_head = g_aio.done_tail = NULL;
+    pthread_mutex_unlock(&g_aio_mutex);
+    
+    int n = 0;
+    while (done != NULL) {
+        AioRequest* next = done->next;
+        if (done->cb != NULL) {
+            done->cb(done->arg, done->result);
+        }
+        free(done);
+        done = next;
+        n++;
+    }
+    return n;
+}
+
+// Gửi và chờ đến khi không còn request nào (kể cả request do callback tạo thêm).
+// MS_ERR_SYS nếu io_uring không chờ được completion (request còn trong kernel).
+int aio_wait_all() {
+    int rc = aio_submit();
+    while (1) {
+        pthread_mutex_lock(&g_aio_mutex);
+        int inflight = g_aio.inflight;
+        int has_done = (g_aio.done_head != NULL);
+        int stuck = 0;
+        if (inflight > 0 && !has_done) {
+            if (g_aio.backend == AIO_BACKEND_URING) {
+                // Lỗi gửi: request chưa gửi đã xong đồng bộ, chỉ chờ phần trong kernel
+                if (uring_flush() != MS_OK) {
+                    rc = MS_ERR_SYS;
+                }
+                if (g_aio.inflight > 0 && uring_reap() == 0 && uring_enter(0, 1) < 0) {
+                    stuck = 1;
+                }
+                uring_reap();
+            } else if (g_aio.backend == AIO_BACKEND_THREADS) {
+                pthread_cond_wait(&g_aio.done_cond, &g_aio_mutex);
+            }
+        }
+        pthread_mutex_unlock(&g_aio_mutex);
+        
+        if (stuck) {
+            aio_poll();
+            return MS_ERR_SYS;
+        }
+        if (inflight == 0 && !has_done) {
+            return rc;
+        }
+        aio_poll();
+        if (aio_submit() != MS_OK) {
+            rc = MS_ERR_SYS;
+        }
+    }
+}
+
+// fd để epoll chờ completion (-1 nếu chưa khởi tạo)
+int aio_event_fd() {
+    pthread_once(&g_aio_once, register_fork_handler);
+    pthread_mutex_lock(&g_aio_mutex);
+    ensure_backend();
+    int fd = g_aio.event_fd;
+    pthread_mutex_unlock(&g_aio_mutex);
+    return fd;
+}
+
+int aio_pending() {
+    pthread_mutex_lock(&g_aio_mutex);
+    int n = g_aio.inflight + (g_aio.done_head != NULL);
+    pthread_mutex_unlock(&g_aio_mutex);
+    return n;
+}
+
+const char* aio_backend_name() {
+    pthread_once(&g_aio_once, register_fork_handler);
+    pthread_mutex_lock(&g_aio_mutex);
+    int backend = ensure_backend();
+    pthread_mutex_unlock(&g_aio_mutex);
+    switch (backend) {
+        case AIO_BACKEND_URING:
+            return "io_uring";
+        case AIO_BACKEND_THREADS:
+            return "threads";
+    }
+    return "none";
+}
@@ -0,0 +1,369 @@
+#define _GNU_SOURCE
+#include "mail_system.h"
+
+// Batch mode: đọc lệnh từng dòng (các trường cách nhau bởi '|', escape giống
+// file database: "&#124;" cho '|' và "\n" cho xuống dòng) và trả kết quả dạng
+// máy đọc được:
+//   OK|...            lệnh thành công
+//   ERR|<lý do>       lệnh lỗi
+//   ROW|...           một dòng kết quả của list/search/read
+// Không clear màn hình, không lưu file sau từng lệnh.
+
+#define BATCH_MAX_FIELDS 8
+
+static int split_fields(char* line, char** fields, int max) {
+    int n = 0;
+    char* p = line;
+    fields[n++] = p;
+    while (*p && n < max) {
+        if (*p == '|') {
+            *p = '\0';
+            fields[n++] = p + 1;
+        }
+        p++;
+    }
+    return n;
+}
+
+static void unescape_field(char* field) {
+    char* src = field;
+    char* dst = field;
+    while (*src) {
+        if (strncmp(src, "&#124;", 6) == 0) {
+            *dst++ = '|';
+            src += 6;
+        } else if (strncmp(src, "\\n", 2) == 0) {
+            *dst++ = '\n';
+            src += 2;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst = '\0';
+}
+
+static void write_field(FILE* out, const char* value) {
+    fputc('|', out);
+    for (const char* p = value; *p; p++) {
+        if (*p == '|') {
+            fputs("&#124;", out);
+        } else if (*p == '\n') {
+            fputs("\\n", out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+}
+
+static void write_email_row(FILE* out, SharedMemoryData* shm_ptr, Email* email, int with_content) {
+    User* sender = read_user(shm_ptr, email->sender_id);
+    User* receiver = read_user(shm_ptr, email->receiver_id);
+    
+    fprintf(out, "ROW|%d", email->email_id);
+    write_field(out, sender ? sender->email : "unknown");
+    write_field(out, receiver ? receiver->email : "unknown");
+    write_field(out, email->subject);
+    fprintf(out, "|%ld|%d", (long)email->sent_at, email->is_read);
+    if (with_content) {
+        write_field(out, email->content);
+    }
+    fputc('\n', out);
+}
+
+static void batch_error(BatchSession* session, FILE* out, const char* message) {
+    session->errors++;
+    fprintf(out, "ERR|%s\n", message);
+}
+
+static int require_login(BatchSession* session, FILE* out) {
+    if (session->user_id <= 0) {
+        batch_error(session, out, "not logged in");
+        return 0;
+    }
+    return 1;
+}
+
+static void batch_register(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (n < 5 || strlen(f[1]) == 0 || strchr(f[2], '@') == NULL || strlen(f[3]) < 4) {
+        batch_error(session, out, "usage: register|name|email|password|age");
+        return;
+    }
+    
+    int age = atoi(f[4]);
+    if (age <= 0 || age > 150) {
+        batch_error(session, out, "invalid age");
+        return;
+    }
+    
+    lock_store();
+    int user_id = create_user(shm_ptr, f[1], f[2], f[3], age);
+    unlock_store();
+    
+    if (user_id > 0) {
+        fprintf(out, "OK|%d\n", user_id);
+    } else {
+        batch_error(session, out, mailstore_strerror(user_id));
+    }
+}
+
+static void batch_login(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (n < 3) {
+        batch_error(session, out, "usage: login|email|password");
+        return;
+    }
+    
+    User* user = verify_user_credentials(shm_ptr, f[1], f[2]);
+    if (user == NULL) {
+        session->user_id = -1;
+        batch_error(session, out, "invalid email or password");
+        return;
+    }
+    
+    session->user_id = user->user_id;
+    fprintf(out, "OK|%d", user->user_id);
+    write_field(out, user->name);
+    fputc('\n', out);
+}
+
+static void batch_send(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    if (n < 4) {
+        batch_error(session, out, "usage: send|receiver_email|subject|content");
+        return;
+    }
+    
+    User* receiver = find_user_by_email(shm_ptr, f[1]);
+    if (receiver == NULL) {
+        batch_error(session, out, "receiver not found");
+        return;
+    }
+    
+    lock_store();
+    int email_id = create_email(shm_ptr, session->user_id, receiver->user_id, f[2], f[3]);
+    unlock_store();
+    
+    if (email_id > 0) {
+        fprintf(out, "OK|%d\n", email_id);
+    } else {
+        batch_error(session, out, mailstore_strerror(email_id));
+    }
+}
+
+static void batch_list(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    
+    int sent = (n >= 2 && strcmp(f[1], "sent") == 0);
+    int count = 0;
+    EmailIterator it;
+    email_iter_init(&it, session->user_id, sent ? MAILBOX_SENT : MAILBOX_RECEIVED);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        write_email_row(out, shm_ptr, email, 0);
+        count++;
+    }
+    fprintf(out, "OK|%d\n", count);
+}
+
+static void batch_read(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    if (n < 2) {
+        batch_error(session, out, "usage: read|email_id");
+        return;
+    }
+    
+    Email* email = read_email(shm_ptr, atoi(f[1]));
+    if (email == NULL ||
+        (email->receiver_id != session->user_id && email->sender_id != session->user_id)) {
+        batch_error(session, out, "email not found");
+        return;
+    }
+    
+    write_email_row(out, shm_ptr, email, 1);
+    if (email->receiver_id == session->user_id && !email->is_read) {
+        lock_store();
+        update_email_status(shm_ptr, email->email_id, 1);
+        unlock_store();
+    }
+    fprintf(out, "OK|1\n");
+}
+
+static void batch_mark_read(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    if (n < 2) {
+        batch_error(session, out, "usage: mark-read|email_id|all");
+        return;
+    }
+    
+    if (strcmp(f[1], "all") == 0) {
+        lock_store();
+        int count = mark_all_emails_read(shm_ptr, session->user_id);
+        unlock_store();
+        fprintf(out, "OK|%d\n", count);
+        return;
+    }
+    
+    Email* email = read_email(shm_ptr, atoi(f[1]));
+    if (email == NULL || email->receiver_id != session->user_id) {
+        batch_error(session, out, "email not found");
+        return;
+    }
+    
+    lock_store();
+    int rc = update_email_status(shm_ptr, email->email_id, 1);
+    unlock_store();
+    if (rc == MS_OK) {
+        fprintf(out, "OK|1\n");
+    } else {
+        batch_error(session, out, mailstore_strerror(rc));
+    }
+}
+
+static void batch_delete(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    if (n < 2) {
+        batch_error(session, out, "usage: delete|email_id|read");
+        return;
+    }
+    
+    if (strcmp(f[1], "read") == 0) {
+        lock_store();
+        int count = delete_read_emails(shm_ptr, session->user_id);
+        unlock_store();
+        fprintf(out, "OK|%d\n", count);
+        return;
+    }
+    
+    Email* email = read_email(shm_ptr, atoi(f[1]));
+    if (email == NULL ||
+        (email->receiver_id != session->user_id && email->sender_id != session->user_id)) {
+        batch_error(session, out, "email not found");
+        return;
+    }
+    
+    lock_store();
+    int rc = delete_email(shm_ptr, email->email_id);
+    unlock_store();
+    if (rc == MS_OK) {
+        fprintf(out, "OK|1\n");
+    } else {
+        batch_error(session, out, mailstore_strerror(rc));
+    }
+}
+
+static void batch_search(SharedMemoryData* shm_ptr, BatchSession* session, char** f, int n, FILE* out) {
+    if (!require_login(session, out)) {
+        return;
+    }
+    if (n < 2) {
+        batch_error(session, out, "usage: search|keyword");
+        return;
+    }
+    
+    int ids[MAX_EMAILS];
+    int count = find_emails_matching(shm_ptr, session->user_id, f[1], ids, MAX_EMAILS);
+    for (int i = 0; i < count && i < MAX_EMAILS; i++) {
+        Email* email = read_email(shm_ptr, ids[i]);
+        if (email != NULL) {
+            write_email_row(out, shm_ptr, email, 0);
+        }
+    }
+    fprintf(out, "OK|%d\n", count);
+}
+
+static int dispatch_batch_command(SharedMemoryData* shm_ptr, BatchSession* session, char* line, FILE* out) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+        return 1;
+    }
+    
+    char* f[BATCH_MAX_FIELDS];
+    int n = split_fields(line, f, BATCH_MAX_FIELDS);
+    for (int i = 0; i < n; i++) {
+        unescape_field(f[i]);
+    }
+    
+    const char* cmd = f[0];
+    if (strcmp(cmd, "register") == 0) {
+        batch_register(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "login") == 0) {
+        batch_login(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "logout") == 0) {
+        session->user_id = -1;
+        fprintf(out, "OK\n");
+    } else if (strcmp(cmd, "send") == 0) {
+        batch_send(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "list") == 0) {
+        batch_list(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "read") == 0) {
+        batch_read(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "mark-read") == 0) {
+        batch_mark_read(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "delete") == 0) {
+        batch_delete(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "search") == 0) {
+        batch_search(shm_ptr, session, f, n, out);
+    } else if (strcmp(cmd, "unread") == 0) {
+        if (require_login(session, out)) {
+            fprintf(out, "OK|%d\n", get_unread_email_count(shm_ptr, session->user_id));
+        }
+    } else if (strcmp(cmd, "stats") == 0) {
+        if (n >= 2 && strcmp(f[1], "reset") == 0) {
+            stats_reset(shm_ptr);
+        } else {
+            print_store_stats(shm_ptr, out, STATS_FORMAT_ROWS);
+        }
+        fprintf(out, "OK|%d\n", STAT_OP_COUNT);
+    } else if (strcmp(cmd, "save") == 0) {
+        lock_store();
+        start_background_save(shm_ptr, BGSAVE_USERS | BGSAVE_EMAILS);
+        unlock_store();
+        fprintf(out, "OK\n");
+    } else if (strcmp(cmd, "quit") == 0) {
+        fprintf(out, "OK\n");
+        return 0;
+    } else {
+        batch_error(session, out, "unknown command");
+    }
+    
+    return 1;
+}
+
+// Thực thi một dòng lệnh. Trả về 0 khi gặp "quit", 1 để tiếp tục.
+// Trace span id1 = user của phiên, id2 = 1 nếu lệnh trả về ERR.
+int execute_batch_command(SharedMemoryData* shm_ptr, BatchSession* session, char* line, FILE* out) {
+    long long start = stats_now();
+    int errors = session->errors;
+    int rc = dispatch_batch_command(shm_ptr, session, line, out);
+    TRACE_OP(shm_ptr, TRACE_BATCH_COMMAND, start, session->user_id, session->errors != errors, rc);
+    return rc;
+}
+
+// Chạy toàn bộ luồng lệnh, lưu file một lần ở cuối. Trả về số lệnh lỗi.
+int run_batch(SharedMemoryData* shm_ptr, FILE* in, FILE* out) {
+    BatchSession session = { .user_id = -1, .errors = 0 };
+    char line[MAX_CONTENT_LENGTH * 2];
+    
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (!execute_batch_command(shm_ptr, &session, line, out)) {
+            break;
+        }
+    }
+    
+    lock_store();
+    save_users_to_file(shm_ptr);
+    save_emails_to_file(shm_ptr);
+    unlock_store();
+    fflush(out);
+    
+    return session.errors;
+}
@@ -0,0 +1,308 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+// Lưu nền kiểu BGSAVE: khi đang giữ store lock chỉ copy phần segment mà các
+// hàm ghi file cần (control, users, các email đã dùng và vài con số của
+// changelog/journal/tier) sang bộ nhớ riêng rồi fork(); process con thấy bản
+// chụp đó qua copy-on-write và tự ghi file, cha nhả khóa và tiếp tục ngay.
+// Segment là shm dùng chung nên con không thể đọc thẳng nó làm bản chụp.
+// Khi đang có con lưu cùng loại, yêu cầu mới chỉ được ghi nhận (g_pending) và
+// gộp lại thành một lần lưu sau khi con đó xong, thay vì chụp lại sau mỗi thao
+// tác. Con báo kết quả qua pipe; cha thu kết quả bằng poll_background_save().
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    int what;
+} BgSaveChild;
+
+static BgSaveChild g_children[BGSAVE_MAX_CHILDREN];
+static BgSaveResult g_last_result;
+static int g_pending;                     // loại lưu đang chờ con trước xong
+static SharedMemoryData* g_pending_shm;
+
+static long elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static int save_snapshot_file(SharedMemoryData* shm_ptr, const SharedMemoryData* snapshot,
+                              const char* path, unsigned int seq, int is_emails) {
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, getpid());
+    
+    // Như save_emails_to_file: mail đã hạ xuống phải bền trong file cold trước
+    if (is_emails && tier_sync(snapshot) != MS_OK) {
+        return -1;
+    }
+    int rc = is_emails ? write_emails_file(snapshot, tmp_path) : write_users_file(snapshot, tmp_path);
+    if (rc != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    
+    // Chỉ giữ khóa trong lúc rename, không phải trong lúc ghi file
+    lock_store();
+    if (is_emails) {
+        rc = install_db_file(tmp_path, path, &shm_ptr->control.emails_saved_seq, seq);
+        if (rc > 0 && shm_ptr->changelog.persisted_modseq < snapshot->changelog.highest_modseq) {
+            shm_ptr->changelog.persisted_modseq = snapshot->changelog.highest_modseq;
+        }
+        if (rc > 0) {
+            journal_prune(snapshot->journal.epoch);
+        }
+    } else {
+        rc = install_db_file(tmp_path, path, &shm_ptr->control.users_saved_seq, seq);
+    }
+    unlock_store();
+    
+    return (rc < 0) ? -1 : 0;
+}
+
+static void run_child_save(SharedMemoryData* shm_ptr, const SharedMemoryData* snapshot,
+                           int what, unsigned int seq, int fd) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long trace_start = stats_now();
+    
+    int status = 0;
+    if ((what & BGSAVE_USERS) && save_snapshot_file(shm_ptr, snapshot, USER_DB_FILE, seq, 0) != 0) {
+        status = -1;
+    }
+    if ((what & BGSAVE_EMAILS) && save_snapshot_file(shm_ptr, snapshot, EMAIL_DB_FILE, seq, 1) != 0) {
+        status = -1;
+    }
+    if (what & BGSAVE_BACKUP) {
+        write_backup_files(snapshot);
+    }
+    
+    BgSaveResult result;
+    result.what = what;
+    result.status = status;
+    result.seq = seq;
+    result.duration_ms = elapsed_ms(&start);
+    result.finished_at = time(NULL);
+    TRACE_OP(shm_ptr, TRACE_BGSAVE_WRITE, trace_start, what, (int)seq, status);
+    if (write(fd, &result, sizeof(result)) != (ssize_t)sizeof(result)) {
+        status = -1;
+    }
+    
+    _exit(status == 0 ? 0 : 1);
+}
+
+static void collect_child(BgSaveChild* child, int status) {
+    BgSaveResult result;
+    if (read(child->fd, &result, sizeof(result)) == (ssize_t)sizeof(result)) {
+        g_last_result = result;
+    } else {
+        memset(&g_last_result, 0, sizeof(g_last_result));
+        g_last_result.what = child->what;
+        g_last_result.status = -1;
+        g_last_result.finished_at = time(NULL);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        g_last_result.status = -1;
+    }
+    
+    close(child->fd);
+    child->pid = 0;
+}
+
+static void wait_child(BgSaveChild* child) {
+    int status;
+    while (waitpid(child->pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    collect_child(child, status);
+}
+
+// Chỉ các trường write_*_file/write_backup_files/tier_sync đọc là hợp lệ
+// trong bản chụp; phần còn lại (trace, stats, changelog, index cold...) không
+// được copy và không được chạm tới.
+static void copy_snapshot(SharedMemoryData* snapshot, const SharedMemoryData* shm_ptr) {
+    int count = shm_ptr->control.email_count;
+    if (count < 0) {
+        count = 0;
+    } else if (count > MAX_EMAILS) {
+        count = MAX_EMAILS;
+    }
+    
+    snapshot->control = shm_ptr->control;
+    memcpy(snapshot->users, shm_ptr->users, sizeof(shm_ptr->users));
+    memcpy(snapshot->emails, shm_ptr->emails, count * sizeof(Email));
+    snapshot->changelog.highest_modseq = shm_ptr->changelog.highest_modseq;
+    snapshot->journal.epoch = shm_ptr->journal.epoch;
+    snapshot->tier.enabled = shm_ptr->tier.enabled;
+    snapshot->tier.file_size = shm_ptr->tier.file_size;
+}
+
+static int running_mask() {
+    int mask = 0;
+    for (int i = 0; i < BGSAVE_MAX_CHILDREN; i++) {
+        if (g_children[i].pid != 0) {
+            mask |= g_children[i].what;
+        }
+    }
+    return mask;
+}
+
+static void save_in_foreground(SharedMemoryData* shm_ptr, int what) {
+    if (what & BGSAVE_USERS) {
+        save_users_to_file(shm_ptr);
+    }
+    if (what & BGSAVE_EMAILS) {
+        save_emails_to_file(shm_ptr);
+    }
+    if (what & BGSAVE_BACKUP) {
+        backup_database(shm_ptr);
+    }
+}
+
+// Bắt đầu lưu nền (caller giữ store lock). what: BGSAVE_USERS | BGSAVE_EMAILS
+// | BGSAVE_BACKUP. Trả về pid của process con, hoặc 0 nếu đã lưu trực tiếp
+// hoặc được gộp vào lần lưu sau khi con đang chạy xong.
+pid_t start_background_save(SharedMemoryData* shm_ptr, int what) {
+    if (shm_ptr == NULL || what == 0) {
+        return 0;
+    }
+    
+    poll_background_save();
+    if (what & running_mask()) {
+        g_pending |= what;
+        g_pending_shm = shm_ptr;
+        return 0;
+    }
+    if (g_pending_shm == shm_ptr) {
+        int ready = g_pending & ~running_mask();
+        what |= ready;
+        g_pending &= ~ready;
+    }
+    lazy_load_all(shm_ptr);
+    
+    int slot = -1;
+    for (int i = 0; i < BGSAVE_MAX_CHILDREN; i++) {
+        if (g_children[i].pid == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot == -1) {
+        // Quá nhiều lần lưu đang chạy. Không chờ con ở đây vì con cần store
+        // lock mà caller đang giữ: lưu trực tiếp.
+        save_in_foreground(shm_ptr, what);
+        return 0;
+    }
+    
+    long long trace_start = stats_now();
+    SharedMemoryData* snapshot = malloc(sizeof(SharedMemoryData));
+    int fds[2];
+    if (snapshot == NULL || pipe(fds) == -1) {
+        free(snapshot);
+        save_in_foreground(shm_ptr, what);
+        return 0;
+    }
+    
+    if (what & BGSAVE_EMAILS) {
+        journal_rotate(shm_ptr);
+    }
+    copy_snapshot(snapshot, shm_ptr);
+    unsigned int seq = ++shm_ptr->control.save_seq;
+    
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        free(snapshot);
+        save_in_foreground(shm_ptr, what);
+        return 0;
+    }
+    
+    if (pid == 0) {
+        close(fds[0]);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+        run_child_save(shm_ptr, snapshot, what, seq, fds[1]);
+    }
+    
+    close(fds[1]);
+    free(snapshot);   // bản của con vẫn còn nhờ copy-on-write
+    
+    g_children[slot].pid = pid;
+    g_children[slot].fd = fds[0];
+    g_children[slot].what = what;
+    TRACE_OP(shm_ptr, TRACE_BGSAVE_FORK, trace_start, what, (int)seq, pid);
+    return pid;
+}
+
+// Lưu phần đã gộp khi không còn con cùng loại chạy. Trong lúc caller giữ
+// store lock thì để start_background_save tự gộp vào lần lưu của nó.
+static void start_pending_save() {
+    int what = g_pending & ~running_mask();
+    if (what == 0 || store_lock_held()) {
+        return;
+    }
+    g_pending &= ~what;
+    lock_store();
+    start_background_save(g_pending_shm, what);
+    unlock_store();
+}
+
+// Thu kết quả các lần lưu nền đã xong (không block), rồi bắt đầu lần lưu đã
+// gộp nếu có. Trả về số lần đã xong.
+int poll_background_save() {
+    int finished = 0;
+    for (int i = 0; i < BGSAVE_MAX_CHILDREN; i++) {
+        if (g_children[i].pid == 0) {
+            continue;
+        }
+        
+        int status;
+        pid_t rc = waitpid(g_children[i].pid, &status, WNOHANG);
+        if (rc == g_children[i].pid || (rc == -1 && errno == ECHILD)) {
+            collect_child(&g_children[i], rc == -1 ? -1 : status);
+            finished++;
+        }
+    }
+    start_pending_save();
+    return finished;
+}
+
+// Chờ tất cả lần lưu nền xong, kể cả lần đã gộp còn chờ (dùng trước khi
+// thoát, không được giữ store lock)
+void wait_background_saves() {
+    do {
+        for (int i = 0; i < BGSAVE_MAX_CHILDREN; i++) {
+            if (g_children[i].pid != 0) {
+                wait_child(&g_children[i]);
+            }
+        }
+        start_pending_save();
+    } while (running_mask() != 0);
+}
+
+int background_saves_running() {
+    int running = 0;
+    for (int i = 0; i < BGSAVE_MAX_CHILDREN; i++) {
+        if (g_children[i].pid != 0) {
+            running++;
+        }
+    }
+    return running;
+}
+
+// Kết quả lần lưu nền gần nhất của process này (0 nếu chưa có)
+int get_last_background_save(BgSaveResult* result) {
+    if (result == NULL || g_last_result.finished_at == 0) {
+        return 0;
+    }
+    *result = g_last_result;
+    return 1;
+}
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <fcntl.h>
+#include <pthread.h>
+
+// Capture workload: khi biến môi trường MAILSTORE_CAPTURE=<prefix> được đặt
+// (hoặc gọi capture_open), mỗi process ghi các thao tác store-level cùng tham
+// số vào file nhị phân <prefix>.<pid>.cap: CaptureHeader rồi chuỗi
+// CaptureRecord + các chuỗi tham số (không có '\0'). mail_replay đọc lại.
+// File chỉ chủ sở hữu đọc được (0600) và không chứa mật khẩu: s3 được thay
+// bằng token băm (capture_password_token), replay chỉ cần token bằng nhau.
+// Ghi qua buffer riêng của process; flush khi đầy, khi capture_close và lúc
+// exit. Process con sau fork mở file mới của nó.
+
+#define CAPTURE_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    int state;                   // 0 = chưa kiểm tra env, 1 = đang ghi, -1 = tắt
+    int fd;
+    long long last_ns;
+    size_t len;
+    char prefix[200];
+    char buffer[CAPTURE_BUFFER_SIZE];
+} CaptureState;
+
+static CaptureState g_capture = { .state = 0, .fd = -1 };
+static pthread_mutex_t g_capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_capture_once = PTHREAD_ONCE_INIT;
+
+static void flush_buffer() {
+    size_t off = 0;
+    while (off < g_capture.len) {
+        ssize_t n = write(g_capture.fd, g_capture.buffer + off, g_capture.len - off);
+        if (n <= 0) {
+            break;                   // đĩa đầy/lỗi: bỏ phần còn lại, không chặn store
+        }
+        off += n;
+    }
+    g_capture.len = 0;
+}
+
+static void capture_at_exit() {
+    capture_close();
+}
+
+// Con sau fork: bỏ buffer của cha (cha sẽ tự flush) và mở file riêng
+static void capture_after_fork() {
+    if (g_capture.state == 1) {
+        close(g_capture.fd);
+        g_capture.fd = -1;
+        g_capture.len = 0;
+        g_capture.state = 0;
+    }
+    pthread_mutex_init(&g_capture_mutex, NULL);
+}
+
+static void register_handlers() {
+    atexit(capture_at_exit);
+    pthread_atfork(NULL, NULL, capture_after_fork);
+}
+
+static int open_capture_file() {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%d.cap", g_capture.prefix, getpid());
+    
+    g_capture.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (g_capture.fd == -1) {
+        g_capture.state = -1;
+        return MS_ERR_IO;
+    }
+    
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.pid = getpid();
+    header.start_ns = stats_now();
+    header.start_time = time(NULL);
+    
+    g_capture.last_ns = header.start_ns;
+    memcpy(g_capture.buffer, &header, sizeof(header));
+    g_capture.len = sizeof(header);
+    g_capture.state = 1;
+    return MS_OK;
+}
+
+// Bắt đầu capture với prefix cho file. Trả về MS_OK hoặc MS_ERR_IO.
+int capture_open(const char* prefix) {
+    if (prefix == NULL || prefix[0] == '\0') {
+        return MS_ERR_INVALID;
+    }
+    
+    pthread_once(&g_capture_once, register_handlers);
+    pthread_mutex_lock(&g_capture_mutex);
+    if (g_capture.state == 1) {
+        flush_buffer();
+        close(g_capture.fd);
+    }
+    snprintf(g_capture.prefix, sizeof(g_capture.prefix), "%s", prefix);
+    int rc = open_capture_file();
+    pthread_mutex_unlock(&g_capture_mutex);
+    return rc;
+}
+
+void capture_close() {
+    pthread_mutex_lock(&g_capture_mutex);
+    if (g_capture.state == 1) {
+        flush_buffer();
+        close(g_capture.fd);
+        g_capture.fd = -1;
+    }
+    g_capture.state = -1;
+    pthread_mutex_unlock(&g_capture_mutex);
+}
+
+// Kiểm tra (một lần mỗi process) xem có cần capture không
+int capture_active() {
+    if (g_capture.state == 0) {
+        pthread_once(&g_capture_once, register_handlers);
+        pthread_mutex_lock(&g_capture_mutex);
+        if (g_capture.state == 0) {
+            // Process con sau fork giữ prefix của cha
+            const char* prefix = g_capture.prefix[0] ? g_capture.prefix : getenv("MAILSTORE_CAPTURE");
+            if (prefix == NULL || prefix[0] == '\0') {
+                g_capture.state = -1;
+            } else {
+                if (prefix != g_capture.prefix) {
+                    snprintf(g_capture.prefix, sizeof(g_capture.prefix), "%s", prefix);
+                }
+                open_capture_file();
+            }
+        }
+        pthread_mutex_unlock(&g_capture_mutex);
+    }
+    return g_capture.state == 1;
+}
+
+static void append(const void* data, size_t size) {
+    if (g_capture.len + size > CAPTURE_BUFFER_SIZE) {
+        flush_buffer();
+    }
+    memcpy(g_capture.buffer + g_capture.len, data, size);
+    g_capture.len += size;
+}
+
+static unsigned short field_length(const char* s, size_t max) {
+    if (s == NULL) {
+        return 0;
+    }
+    size_t n = strnlen(s, max);
+    return (unsigned short)n;
+}
+
+// Token thay cho mật khẩu trong file capture: "#" + FNV-1a 64 bit dạng hex.
+// Không phải cách lưu mật khẩu an toàn, chỉ để file không chứa bản rõ; cùng
+// mật khẩu cho cùng token nên login khi replay vẫn đúng/sai như lúc ghi.
+void capture_password_token(const char* password, char* out, size_t size) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (const char* p = password ? password : ""; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    snprintf(out, size, "#%016llx", h);
+}
+
+// Ghi một thao tác. Chuỗi NULL được ghi như chuỗi rỗng; s3 (mật khẩu) được
+// ghi dưới dạng token.
+void capture_record(int op, int a, int b, const char* s1, const char* s2, const char* s3) {
+    if (!capture_active()) {
+        return;
+    }
+    
+    char token[CAPTURE_TOKEN_LENGTH];
+    if (s3 != NULL) {
+        capture_password_token(s3, token, sizeof(token));
+        s3 = token;
+    }
+    
+    CaptureRecord rec;
+    rec.op = (unsigned char)op;
+    rec.flags = 0;
+    rec.len1 = field_length(s1, MAX_SUBJECT_LENGTH);
+    rec.len2 = field_length(s2, MAX_CONTENT_LENGTH);
+    rec.len3 = field_length(s3, MAX_PASSWORD_LENGTH);
+    rec.a = a;
+    rec.b = b;
+    
+    pthread_mutex_lock(&g_capture_mutex);
+    if (g_capture.state == 1) {
+        long long now = stats_now();
+        long long delta_us = (now - g_capture.last_ns) / 1000;
+        rec.delta_us = delta_us > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (unsigned int)(delta_us > 0 ? delta_us : 0);
+        g_capture.last_ns += (long long)rec.delta_us * 1000;
+        
+        append(&rec, sizeof(rec));
+        append(s1 ? s1 : "", rec.len1);
+        append(s2 ? s2 : "", rec.len2);
+        append(s3 ? s3 : "", rec.len3);
+    }
+    pthread_mutex_unlock(&g_capture_mutex);
+}
+
+const char* capture_op_name(int op) {
+    static const char* names[] = {
+        "unknown", "create_user", "login", "create_email", "read_email", "update_email",
+        "delete_email", "search", "unread", "mark_all_read", "delete_read"
+    };
+    return (op > 0 && op <= CAP_DELETE_READ) ? names[op] : names[0];
+}
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <stdint.h>
+
+// Change log: mọi thay đổi email (create / flags / delete) được đóng dấu một
+// modseq tăng dần, toàn cục và theo mailbox, giống IMAP CONDSTORE. Client giữ
+// modseq lần đồng bộ trước và chỉ lấy các bản ghi mới hơn.
+//
+// Email cold (tier.c) không có slot trong mảng emails: tier ghi thay đổi của
+// nó qua một Email tạm, bản ghi mang slot = -1 và get_changes_since dựng lại
+// email từ file cold.
+
+// Bản dựng lại của email cold cho kết quả get_changes_since (hợp lệ tới lần
+// gọi sau trong process)
+static Email g_cold_views[REPLICA_BATCH];
+
+static void bump_mailbox_modseq(SharedMemoryData* shm_ptr, int user_id, unsigned long long modseq) {
+    int slot = user_slot_of(shm_ptr, user_id);
+    if (slot < 0) {
+        return;
+    }
+    
+    unsigned long long* word = &shm_ptr->changelog.mailbox_modseq[slot];
+    unsigned long long current = __atomic_load_n(word, __ATOMIC_RELAXED);
+    while (current < modseq &&
+           !__atomic_compare_exchange_n(word, &current, modseq, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+static int email_slot(SharedMemoryData* shm_ptr, const Email* email) {
+    uintptr_t p = (uintptr_t)email;
+    uintptr_t base = (uintptr_t)shm_ptr->emails;
+    if (p < base || p >= base + sizeof(shm_ptr->emails)) {
+        return -1;
+    }
+    return (int)(email - shm_ptr->emails);
+}
+
+// Gọi sau mỗi thay đổi email (caller giữ store lock). Trả về modseq mới.
+unsigned long long record_email_change(SharedMemoryData* shm_ptr, Email* email, int op) {
+    if (shm_ptr == NULL || email == NULL) {
+        return 0;
+    }
+    
+    ChangeLog* log = &shm_ptr->changelog;
+    unsigned long long modseq = __atomic_add_fetch(&log->highest_modseq, 1, __ATOMIC_ACQ_REL);
+    email->modseq = modseq;
+    
+    // Seqlock: modseq = 0 trong lúc ghi, reader thấy đổi thì bỏ bản copy
+    ChangeRecord* record = &log->records[modseq % CHANGE_LOG_SIZE];
+    __atomic_store_n(&record->modseq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->op = op;
+    record->email_id = email->email_id;
+    record->slot = email_slot(shm_ptr, email);
+    record->sender_id = email->sender_id;
+    record->receiver_id = email->receiver_id;
+    __atomic_store_n(&record->modseq, modseq, __ATOMIC_RELEASE);
+    
+    bump_mailbox_modseq(shm_ptr, email->sender_id, modseq);
+    if (email->receiver_id != email->sender_id) {
+        bump_mailbox_modseq(shm_ptr, email->receiver_id, modseq);
+    }
+    
+    journal_append(shm_ptr, email, op);
+    return modseq;
+}
+
+unsigned long long get_global_modseq(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&shm_ptr->changelog.highest_modseq, __ATOMIC_ACQUIRE);
+}
+
+unsigned long long get_mailbox_modseq(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    
+    int slot = user_slot_of(shm_ptr, user_id);
+    return (slot < 0) ? 0 : __atomic_load_n(&shm_ptr->changelog.mailbox_modseq[slot], __ATOMIC_ACQUIRE);
+}
+
+// Lấy các email của user_id (0 = mọi mailbox) thay đổi sau modseq `since`.
+// Mỗi email chỉ xuất hiện một lần với trạng thái hiện tại. Trả về số thay
+// đổi ghi vào changes, *next_since là modseq dùng cho lần gọi sau; trả về
+// -1 nếu `since` đã ra khỏi change log => client phải quét lại toàn bộ.
+int get_changes_since(SharedMemoryData* shm_ptr, int user_id, unsigned long long since,
+                      EmailChange* changes, int max, unsigned long long* next_since) {
+    if (shm_ptr == NULL || changes == NULL || max <= 0) {
+        return -1;
+    }
+    
+    ChangeLog* log = &shm_ptr->changelog;
+    unsigned long long highest = get_global_modseq(shm_ptr);
+    
+    if (since < log->base_modseq || since > highest ||
+        highest - since > CHANGE_LOG_SIZE) {
+        return -1;
+    }
+    
+    int count = 0;
+    int cold = 0;
+    unsigned long long modseq = since + 1;
+    for (; modseq <= highest && count < max; modseq++) {
+        ChangeRecord* record = &log->records[modseq % CHANGE_LOG_SIZE];
+        unsigned long long stamped = __atomic_load_n(&record->modseq, __ATOMIC_ACQUIRE);
+        if (stamped < modseq) {
+            break;          // writer chưa ghi xong bản ghi này
+        }
+        if (stamped > modseq) {
+            return -1;      // ring đã quay vòng trong lúc đọc
+        }
+        
+        // Copy rồi đọc lại modseq: đổi nghĩa là bản ghi bị ghi đè giữa chừng
+        ChangeRecord copy;
+        copy.op = record->op;
+        copy.email_id = record->email_id;
+        copy.slot = record->slot;
+        copy.sender_id = record->sender_id;
+        copy.receiver_id = record->receiver_id;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->modseq, __ATOMIC_RELAXED) != stamped) {
+            return -1;
+        }
+        
+        if (user_id > 0 && copy.sender_id != user_id && copy.receiver_id != user_id) {
+            continue;
+        }
+        
+        Email* email = NULL;
+        int slot = copy.slot;
+        if (copy.op != CHANGE_DELETE) {
+            email = (copy.slot >= 0) ? &shm_ptr->emails[copy.slot] : NULL;
+            if (email == NULL || email->email_id != copy.email_id || email->is_deleted) {
+                // Email cold, hoặc đã hạ xuống tier sau bản ghi này
+                if (cold == REPLICA_BATCH) {
+                    break;
+                }
+                email = tier_read(shm_ptr, copy.email_id);
+                slot = -1;
+            }
+            // Bản ghi cũ hơn trạng thái hiện tại: bản ghi mới hơn sẽ được trả về sau
+            if (email == NULL || email->modseq != modseq) {
+                continue;
+            }
+            if (slot < 0) {
+                g_cold_views[cold] = *email;
+                email = &g_cold_views[cold++];
+            }
+        }
+        
+        changes[count].modseq = modseq;
+        changes[count].op = copy.op;
+        changes[count].email_id = copy.email_id;
+        changes[count].slot = slot;
+        changes[count].email = email;
+        count++;
+    }
+    
+    if (next_since != NULL) {
+        *next_since = modseq - 1;
+    }
+    return count;
+}
@@ -1,17 +1,114 @@
 #define _GNU_SOURCE
-#include "mail_system.h"
+#include "mailstore.h"
+#include <fcntl.h>
 
-// Lưu danh sách users vào file
-void save_users_to_file(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+// File checkpoint ghi qua aio: stdio gom thành trang PERSIST_PAGE_SIZE, mỗi
+// trang là một aio_write tại offset của nó (không chờ), fclose mới fdatasync
+// và chờ mọi trang xong. Lỗi của bất kỳ trang nào làm fclose trả về EOF.
+typedef struct {
+    int fd;
+    off_t offset;
+    int failed;
+} DurableFile;
+
+typedef struct {
+    DurableFile* file;
+    size_t len;
+    char data[];
+} DurablePage;
+
+static void durable_page_done(void* arg, int result) {
+    DurablePage* page = arg;
+    if (result != (int)page->len) {
+        page->file->failed = 1;
+    }
+    free(page);
+}
+
+static void durable_sync_done(void* arg, int result) {
+    if (result != 0) {
+        ((DurableFile*)arg)->failed = 1;
+    }
+}
+
+static ssize_t durable_write(void* cookie, const char* buf, size_t size) {
+    DurableFile* file = cookie;
+    DurablePage* page = malloc(sizeof(DurablePage) + size);
+    if (page == NULL) {
+        return -1;
+    }
+    page->file = file;
+    page->len = size;
+    memcpy(page->data, buf, size);
+    
+    if (aio_write(file->fd, page->data, size, file->offset, durable_page_done, page) != MS_OK) {
+        free(page);
+        return -1;
+    }
+    file->offset += size;
+    aio_submit();
+    return size;
+}
+
+static int durable_close(void* cookie) {
+    DurableFile* file = cookie;
+    if (aio_fdatasync(file->fd, durable_sync_done, file) != MS_OK) {
+        file->failed = 1;
+    }
+    aio_wait_all();
+    
+    int failed = file->failed;
+    if (close(file->fd) != 0) {
+        failed = 1;
+    }
+    free(file);
+    return failed ? EOF : 0;
+}
+
+static FILE* open_durable_file(const char* path) {
+    DurableFile* file = calloc(1, sizeof(DurableFile));
+    if (file == NULL) {
+        return NULL;
+    }
+    file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file->fd == -1) {
+        free(file);
+        return NULL;
+    }
+    
+    cookie_io_functions_t io = { NULL, durable_write, NULL, durable_close };
+    FILE* stream = fopencookie(file, "w", io);
+    if (stream == NULL) {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+    setvbuf(stream, NULL, _IOFBF, PERSIST_PAGE_SIZE);
+    return stream;
+}
+
+// fsync thư mục chứa path để rename đã làm cũng bền
+static void sync_parent_dir(const char* path) {
+    char dir[256];
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
     }
     
-    FILE* file = fopen(USER_DB_FILE, "w");
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Ghi users của một bản snapshot (hoặc segment đang khóa) ra path
+int write_users_file(const SharedMemoryData* shm_ptr, const char* path) {
+    FILE* file = open_durable_file(path);
     if (file == NULL) {
-        perror("Error opening users database file for writing");
-        return;
+        return MS_ERR_IO;
     }
     
     // Ghi header với control data
@@ -35,21 +132,66 @@ void save_users_to_file(SharedMemoryData* shm_ptr) {
         }
     }
     
-    fclose(file);
-    printf("Users data saved to %s successfully\n", USER_DB_FILE);
+    return (fclose(file) == 0) ? MS_OK : MS_ERR_IO;
+}
+
+// Thay file database bằng file tạm nếu bản ghi này mới hơn bản đã cài
+// (caller giữ store lock). Các lần lưu nền có thể xong không theo thứ tự,
+// save_seq đảm bảo bản cũ không ghi đè bản mới. Trả về 1 nếu đã cài, 0 nếu
+// bỏ qua vì đã có bản mới hơn.
+int install_db_file(const char* tmp_path, const char* path, unsigned int* installed_seq, unsigned int seq) {
+    if (seq <= *installed_seq) {
+        unlink(tmp_path);
+        return 0;
+    }
+    
+    if (rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return MS_ERR_IO;
+    }
+    sync_parent_dir(path);
+    
+    *installed_seq = seq;
+    return 1;
 }
 
-// Đọc danh sách users từ file
-void load_users_from_file(SharedMemoryData* shm_ptr) {
+// Lưu danh sách users vào file (caller giữ store lock)
+static int save_users_to_file_impl(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+        return MS_ERR_INVALID;
     }
     
-    FILE* file = fopen(USER_DB_FILE, "r");
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", USER_DB_FILE, getpid());
+    
+    unsigned int seq = ++shm_ptr->control.save_seq;
+    if (write_users_file(shm_ptr, tmp_path) != MS_OK) {
+        unlink(tmp_path);
+        return MS_ERR_IO;
+    }
+    
+    int rc = install_db_file(tmp_path, USER_DB_FILE, &shm_ptr->control.users_saved_seq, seq);
+    return (rc < 0) ? rc : MS_OK;
+}
+
+int save_users_to_file(SharedMemoryData* shm_ptr) {
+    long long start = stats_now();
+    int result = save_users_to_file_impl(shm_ptr);
+    stats_record(shm_ptr, STAT_SAVE_USERS, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_SAVE_USERS, start, 0, 0, result);
+    return result;
+}
+
+// Đọc danh sách users từ file. Trả về số user đã nạp, MS_ERR_NOT_FOUND nếu
+// chưa có file
+static int load_users_from_path_impl(SharedMemoryData* shm_ptr, const char* path) {
+    if (shm_ptr == NULL || path == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    FILE* file = fopen(path, "r");
     if (file == NULL) {
-        printf("No existing users database file found. Starting with empty database.\n");
-        return;
+        return MS_ERR_NOT_FOUND;
     }
     
     char line[512];
@@ -106,32 +248,99 @@ void load_users_from_file(SharedMemoryData* shm_ptr) {
     }
     
     fclose(file);
-    printf("Loaded %d users from %s\n", shm_ptr->control.user_count, USER_DB_FILE);
+    shm_ptr->control.users_version++;
+    return shm_ptr->control.user_count;
 }
 
-// Lưu danh sách emails vào file
-void save_emails_to_file(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+int load_users_from_path(SharedMemoryData* shm_ptr, const char* path) {
+    long long start = stats_now();
+    int result = load_users_from_path_impl(shm_ptr, path);
+    stats_record(shm_ptr, STAT_LOAD_USERS, start, result >= 0);
+    TRACE_OP(shm_ptr, STAT_LOAD_USERS, start, 0, 0, result);
+    return result;
+}
+
+int load_users_from_file(SharedMemoryData* shm_ptr) {
+    return load_users_from_path(shm_ptr, USER_DB_FILE);
+}
+
+// Manifest ở cuối emails.txt cho lazy loading (lazy.c): với mỗi user, các dòng
+// "# OFFSETS: uid|o1,o2,..." liệt kê offset dòng email gửi hoặc nhận, rồi một
+// dòng "# MAILBOX: uid|count|offset dòng OFFSETS đầu|số dòng" cho mỗi user, và
+// dòng cuối "# MANIFEST: offset dòng MAILBOX đầu". Loader đầy đủ bỏ qua các
+// dòng '#' nên file vẫn đọc được như trước.
+static void write_mailbox_manifest(FILE* file, const SharedMemoryData* shm_ptr, const long* offsets, long pos) {
+    long first_line[MAX_USERS];
+    int lines[MAX_USERS];
+    int counts[MAX_USERS];
+    
+    for (int u = 0; u < MAX_USERS; u++) {
+        const User* user = &shm_ptr->users[u];
+        first_line[u] = pos;
+        lines[u] = 0;
+        counts[u] = 0;
+        if (!user->is_active || user->user_id <= 0) {
+            continue;
+        }
+        
+        for (int i = 0; i < shm_ptr->control.email_count; i++) {
+            const Email* email = &shm_ptr->emails[i];
+            if (offsets[i] < 0 || (email->sender_id != user->user_id && email->receiver_id != user->user_id)) {
+                continue;
+            }
+            if (counts[u] % LAZY_OFFSETS_PER_LINE == 0) {
+                pos += fprintf(file, "%s# OFFSETS: %d|%ld", counts[u] ? "\n" : "", user->user_id, offsets[i]);
+                lines[u]++;
+            } else {
+                pos += fprintf(file, ",%ld", offsets[i]);
+            }
+            counts[u]++;
+        }
+        if (counts[u] > 0) {
+            fputc('\n', file);
+            pos++;
+        }
     }
     
-    FILE* file = fopen(EMAIL_DB_FILE, "w");
+    long manifest_at = pos;
+    for (int u = 0; u < MAX_USERS; u++) {
+        if (counts[u] > 0) {
+            fprintf(file, "# MAILBOX: %d|%d|%ld|%d\n", shm_ptr->users[u].user_id, counts[u],
+                    first_line[u], lines[u]);
+        }
+    }
+    fprintf(file, "# MANIFEST: %ld\n", manifest_at);
+}
+
+// Ghi emails của một bản snapshot (hoặc segment đang khóa) ra path
+int write_emails_file(const SharedMemoryData* shm_ptr, const char* path) {
+    FILE* file = open_durable_file(path);
     if (file == NULL) {
-        perror("Error opening emails database file for writing");
-        return;
+        return MS_ERR_IO;
     }
     
-    // Ghi header với control data
-    fprintf(file, "# Emails Database - Text Format\n");
-    fprintf(file, "# EMAIL_COUNT: %d\n", shm_ptr->control.email_count);
-    fprintf(file, "# NEXT_EMAIL_ID: %d\n", shm_ptr->control.next_email_id);
-    fprintf(file, "# Format: ID|SenderID|ReceiverID|Subject|Content|SentAt|IsRead|IsDeleted\n");
-    fprintf(file, "# ======================================================================\n");
+    // Ghi header với control data (pos: offset hiện tại, stream không seek được)
+    long pos = 0;
+    pos += fprintf(file, "# Emails Database - Text Format\n");
+    pos += fprintf(file, "# EMAIL_COUNT: %d\n", shm_ptr->control.email_count);
+    pos += fprintf(file, "# NEXT_EMAIL_ID: %d\n", shm_ptr->control.next_email_id);
+    pos += fprintf(file, "# MODSEQ: %llu\n", shm_ptr->changelog.highest_modseq);
+    pos += fprintf(file, "# JOURNAL_EPOCH: %u\n", shm_ptr->journal.epoch);
+    pos += fprintf(file, "# Format: ID|SenderID|ReceiverID|Subject|Content|SentAt|IsRead|IsDeleted\n");
+    pos += fprintf(file, "# ======================================================================\n");
+    
+    // Offset từng dòng cho manifest mailbox (lazy loading)
+    long* offsets = calloc(MAX_EMAILS, sizeof(long));
+    if (offsets == NULL) {
+        fclose(file);
+        return MS_ERR_SYS;
+    }
     
-    // Ghi danh sách emails
+    // Ghi danh sách emails (slot trống: email_id = 0 sau khi hạ xuống tier cold)
     for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        if (!shm_ptr->emails[i].is_deleted) {
+        offsets[i] = -1;
+        if (!shm_ptr->emails[i].is_deleted && shm_ptr->emails[i].email_id != 0) {
+            offsets[i] = pos;
             // Escape các ký tự đặc biệt trong subject và content
             char escaped_subject[MAX_SUBJECT_LENGTH * 2];
             char escaped_content[MAX_CONTENT_LENGTH * 2];
@@ -165,7 +374,7 @@ void save_emails_to_file(SharedMemoryData* shm_ptr) {
             }
             escaped_content[j] = '\0';
             
-            fprintf(file, "%d|%d|%d|%s|%s|%ld|%d|%d\n",
+            pos += fprintf(file, "%d|%d|%d|%s|%s|%ld|%d|%d\n",
                     shm_ptr->emails[i].email_id,
                     shm_ptr->emails[i].sender_id,
                     shm_ptr->emails[i].receiver_id,
@@ -177,25 +386,134 @@ void save_emails_to_file(SharedMemoryData* shm_ptr) {
         }
     }
     
-    fclose(file);
-    printf("Emails data saved to %s successfully\n", EMAIL_DB_FILE);
+    write_mailbox_manifest(file, shm_ptr, offsets, pos);
+    free(offsets);
+    return (fclose(file) == 0) ? MS_OK : MS_ERR_IO;
 }
 
-// Đọc danh sách emails từ file
-void load_emails_from_file(SharedMemoryData* shm_ptr) {
+// Lưu danh sách emails vào file (caller giữ store lock)
+static int save_emails_to_file_impl(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+        return MS_ERR_INVALID;
+    }
+    
+    // Mail chưa nạp chỉ có trong file trên đĩa: không có thay đổi nào từ lúc
+    // mở file thì file đó vẫn đúng, ngược lại phải nạp hết trước khi ghi đè
+    if (shm_ptr->lazy.pending > 0 &&
+        shm_ptr->changelog.persisted_modseq == shm_ptr->changelog.highest_modseq) {
+        return MS_OK;
+    }
+    lazy_load_all(shm_ptr);
+    
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", EMAIL_DB_FILE, getpid());
+    
+    // Mail đã hạ xuống không còn trong file mới: file cold phải bền trước
+    if (tier_sync(shm_ptr) != MS_OK) {
+        return MS_ERR_IO;
+    }
+    
+    unsigned int seq = ++shm_ptr->control.save_seq;
+    unsigned long long modseq = shm_ptr->changelog.highest_modseq;
+    // Thay đổi sau checkpoint này đi vào journal epoch mới
+    unsigned int epoch = journal_rotate(shm_ptr);
+    if (write_emails_file(shm_ptr, tmp_path) != MS_OK) {
+        unlink(tmp_path);
+        return MS_ERR_IO;
     }
     
-    FILE* file = fopen(EMAIL_DB_FILE, "r");
+    int rc = install_db_file(tmp_path, EMAIL_DB_FILE, &shm_ptr->control.emails_saved_seq, seq);
+    if (rc > 0) {
+        shm_ptr->changelog.persisted_modseq = modseq;
+        journal_prune(epoch);
+    }
+    return (rc < 0) ? rc : MS_OK;
+}
+
+int save_emails_to_file(SharedMemoryData* shm_ptr) {
+    long long start = stats_now();
+    int result = save_emails_to_file_impl(shm_ptr);
+    stats_record(shm_ptr, STAT_SAVE_EMAILS, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_SAVE_EMAILS, start, 0, 0, result);
+    return result;
+}
+
+// Parse một dòng email của emails.txt (dòng bị strtok_r sửa).
+// Format: ID|SenderID|ReceiverID|Subject|Content|SentAt|IsRead|IsDeleted
+void parse_email_line(char* line, Email* email) {
+    char* saveptr;
+    char* token = strtok_r(line, "|", &saveptr);
+    if (token) email->email_id = atoi(token);
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) email->sender_id = atoi(token);
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) email->receiver_id = atoi(token);
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) {
+        // Unescape subject
+        char* src = token;
+        char* dst = email->subject;
+        while (*src && dst - email->subject < MAX_SUBJECT_LENGTH - 1) {
+            if (strncmp(src, "&#124;", 6) == 0) {
+                *dst++ = '|';
+                src += 6;
+            } else if (strncmp(src, "\\n", 2) == 0) {
+                *dst++ = '\n';
+                src += 2;
+            } else {
+                *dst++ = *src++;
+            }
+        }
+        *dst = '\0';
+    }
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) {
+        // Unescape content
+        char* src = token;
+        char* dst = email->content;
+        while (*src && dst - email->content < MAX_CONTENT_LENGTH - 1) {
+            if (strncmp(src, "&#124;", 6) == 0) {
+                *dst++ = '|';
+                src += 6;
+            } else if (strncmp(src, "\\n", 2) == 0) {
+                *dst++ = '\n';
+                src += 2;
+            } else {
+                *dst++ = *src++;
+            }
+        }
+        *dst = '\0';
+    }
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) email->sent_at = atol(token);
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) email->is_read = atoi(token);
+    
+    token = strtok_r(NULL, "|", &saveptr);
+    if (token) email->is_deleted = atoi(token);
+}
+
+// Đọc danh sách emails từ file. Trả về số email đã nạp, MS_ERR_NOT_FOUND nếu
+// chưa có file
+static int load_emails_from_path_impl(SharedMemoryData* shm_ptr, const char* path) {
+    if (shm_ptr == NULL || path == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    FILE* file = fopen(path, "r");
     if (file == NULL) {
-        printf("No existing emails database file found. Starting with empty database.\n");
-        return;
+        return MS_ERR_NOT_FOUND;
     }
     
     char line[4096];  // Larger buffer for content
     int saved_email_count = 0, saved_next_email_id = 1;
+    unsigned long long saved_modseq = 0;
     
     // Đọc header và control data
     while (fgets(line, sizeof(line), file)) {
@@ -203,6 +521,10 @@ void load_emails_from_file(SharedMemoryData* shm_ptr) {
             sscanf(line + 14, "%d", &saved_email_count);
         } else if (strncmp(line, "# NEXT_EMAIL_ID:", 16) == 0) {
             sscanf(line + 16, "%d", &saved_next_email_id);
+        } else if (strncmp(line, "# MODSEQ:", 9) == 0) {
+            sscanf(line + 9, "%llu", &saved_modseq);
+        } else if (strncmp(line, "# JOURNAL_EPOCH:", 16) == 0) {
+            sscanf(line + 16, "%u", &shm_ptr->journal.epoch);
         } else if (line[0] != '#' && strlen(line) > 1) {
             // Đây là data line, break để đọc emails
             fseek(file, -strlen(line), SEEK_CUR);
@@ -214,69 +536,17 @@ void load_emails_from_file(SharedMemoryData* shm_ptr) {
     shm_ptr->control.email_count = 0;
     shm_ptr->control.next_email_id = saved_next_email_id;
     
+    // Change log không được lưu: client có modseq cũ hơn phải đồng bộ lại
+    shm_ptr->changelog.highest_modseq = saved_modseq;
+    shm_ptr->changelog.base_modseq = saved_modseq;
+    shm_ptr->changelog.persisted_modseq = saved_modseq;
+    
     while (fgets(line, sizeof(line), file) && 
            shm_ptr->control.email_count < MAX_EMAILS) {
         if (line[0] == '#' || strlen(line) <= 1) continue;
         
         Email* email = &shm_ptr->emails[shm_ptr->control.email_count];
-        
-        // Parse: ID|SenderID|ReceiverID|Subject|Content|SentAt|IsRead|IsDeleted
-        char* saveptr;
-        char* token = strtok_r(line, "|", &saveptr);
-        if (token) email->email_id = atoi(token);
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) email->sender_id = atoi(token);
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) email->receiver_id = atoi(token);
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) {
-            // Unescape subject
-            char* src = token;
-            char* dst = email->subject;
-            while (*src && dst - email->subject < MAX_SUBJECT_LENGTH - 1) {
-                if (strncmp(src, "&#124;", 6) == 0) {
-                    *dst++ = '|';
-                    src += 6;
-                } else if (strncmp(src, "\\n", 2) == 0) {
-                    *dst++ = '\n';
-                    src += 2;
-                } else {
-                    *dst++ = *src++;
-                }
-            }
-            *dst = '\0';
-        }
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) {
-            // Unescape content
-            char* src = token;
-            char* dst = email->content;
-            while (*src && dst - email->content < MAX_CONTENT_LENGTH - 1) {
-                if (strncmp(src, "&#124;", 6) == 0) {
-                    *dst++ = '|';
-                    src += 6;
-                } else if (strncmp(src, "\\n", 2) == 0) {
-                    *dst++ = '\n';
-                    src += 2;
-                } else {
-                    *dst++ = *src++;
-                }
-            }
-            *dst = '\0';
-        }
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) email->sent_at = atol(token);
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) email->is_read = atoi(token);
-        
-        token = strtok_r(NULL, "|", &saveptr);
-        if (token) email->is_deleted = atoi(token);
+        parse_email_line(line, email);
         
         if (!email->is_deleted) {
             shm_ptr->control.email_count++;
@@ -284,16 +554,34 @@ void load_emails_from_file(SharedMemoryData* shm_ptr) {
     }
     
     fclose(file);
-    printf("Loaded %d emails from %s\n", shm_ptr->control.email_count, EMAIL_DB_FILE);
+    return shm_ptr->control.email_count;
+}
+
+int load_emails_from_path(SharedMemoryData* shm_ptr, const char* path) {
+    long long start = stats_now();
+    int result = load_emails_from_path_impl(shm_ptr, path);
+    stats_record(shm_ptr, STAT_LOAD_EMAILS, start, result >= 0);
+    TRACE_OP(shm_ptr, STAT_LOAD_EMAILS, start, 0, 0, result);
+    return result;
+}
+
+int load_emails_from_file(SharedMemoryData* shm_ptr) {
+    return load_emails_from_path(shm_ptr, EMAIL_DB_FILE);
 }
 
 // Backup toàn bộ database
-void backup_database(SharedMemoryData* shm_ptr) {
+int backup_database(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+        return MS_ERR_INVALID;
     }
     
+    lazy_load_all(shm_ptr);
+    return write_backup_files(shm_ptr);
+}
+
+// Ghi file backup có timestamp từ một bản snapshot (hoặc segment đang khóa)
+int write_backup_files(const SharedMemoryData* shm_ptr) {
+    int status = MS_OK;
     char backup_users[100], backup_emails[100];
     time_t now = time(NULL);
     struct tm* tm_info = localtime(&now);
@@ -322,8 +610,11 @@ void backup_database(SharedMemoryData* shm_ptr) {
                         shm_ptr->users[i].created_at);
             }
         }
-        fclose(users_backup);
-        printf("Users backup created: %s\n", backup_users);
+        if (fclose(users_backup) != 0) {
+            status = MS_ERR_IO;
+        }
+    } else {
+        status = MS_ERR_IO;
     }
     
     // Backup emails
@@ -336,7 +627,7 @@ void backup_database(SharedMemoryData* shm_ptr) {
         fprintf(emails_backup, "# ======================================================================\n");
         
         for (int i = 0; i < shm_ptr->control.email_count; i++) {
-            if (!shm_ptr->emails[i].is_deleted) {
+            if (!shm_ptr->emails[i].is_deleted && shm_ptr->emails[i].email_id != 0) {
                 // Simple backup without escaping for readability
                 fprintf(emails_backup, "%d|%d|%d|%s|%s|%ld|%d|%d\n",
                         shm_ptr->emails[i].email_id,
@@ -349,66 +640,112 @@ void backup_database(SharedMemoryData* shm_ptr) {
                         shm_ptr->emails[i].is_deleted);
             }
         }
-        fclose(emails_backup);
-        printf("Emails backup created: %s\n", backup_emails);
+        if (fclose(emails_backup) != 0) {
+            status = MS_ERR_IO;
+        }
+    } else {
+        status = MS_ERR_IO;
     }
+    
+    return status;
 }
 
-// Xóa database files
-void clear_database_files() {
+// Xóa database files. Trả về số file đã xóa
+int clear_database_files() {
+    int removed = 0;
     if (remove(USER_DB_FILE) == 0) {
-        printf("Users database file deleted successfully\n");
-    } else {
-        printf("Users database file not found or cannot be deleted\n");
+        removed++;
     }
-    
     if (remove(EMAIL_DB_FILE) == 0) {
-        printf("Emails database file deleted successfully\n");
-    } else {
-        printf("Emails database file not found or cannot be deleted\n");
+        removed++;
     }
+    return removed;
 }
 
-// Kiểm tra tính toàn vẹn của database
-int validate_database(SharedMemoryData* shm_ptr) {
+// Kết quả kiểm tra emails của một worker
+typedef struct {
+    int invalid;
+    int reported;
+    int indices[VALIDATE_REPORT_LIMIT];
+} EmailValidation;
+
+static void validate_email_range(SharedMemoryData* shm_ptr, int begin, int end, void* arg, void* result) {
+    (void)arg;
+    EmailValidation* out = (EmailValidation*)result;
+    
+    // Slot trống (email_id = 0, sau khi hạ xuống tier cold) không phải email lỗi
+    for (int i = begin; i < end; i++) {
+        if (!shm_ptr->emails[i].is_deleted && shm_ptr->emails[i].email_id != 0) {
+            if (shm_ptr->emails[i].email_id < 0 ||
+                shm_ptr->emails[i].sender_id <= 0 ||
+                shm_ptr->emails[i].receiver_id <= 0) {
+                if (out->reported < VALIDATE_REPORT_LIMIT) {
+                    out->indices[out->reported++] = i;
+                }
+                out->invalid++;
+            }
+        }
+    }
+}
+
+// Kiểm tra tính toàn vẹn của database. Trả về MS_OK hoặc MS_ERR_CORRUPT;
+// report (có thể NULL) nhận số bản ghi lỗi và vị trí các email lỗi đầu tiên.
+int validate_database(SharedMemoryData* shm_ptr, ValidationReport* report) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return 0;
+        return MS_ERR_INVALID;
     }
     
-    int valid = 1;
+    ValidationReport local;
+    if (report == NULL) {
+        report = &local;
+    }
+    memset(report, 0, sizeof(*report));
     
     // Kiểm tra users
-    printf("Validating users database...\n");
     for (int i = 0; i < shm_ptr->control.user_count; i++) {
         if (shm_ptr->users[i].is_active) {
             if (shm_ptr->users[i].user_id <= 0 || 
                 strlen(shm_ptr->users[i].name) == 0 ||
                 strlen(shm_ptr->users[i].email) == 0) {
-                printf("Invalid user found at index %d\n", i);
-                valid = 0;
+                report->invalid_users++;
             }
         }
     }
     
-    // Kiểm tra emails
-    printf("Validating emails database...\n");
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        if (!shm_ptr->emails[i].is_deleted) {
-            if (shm_ptr->emails[i].email_id <= 0 ||
-                shm_ptr->emails[i].sender_id <= 0 ||
-                shm_ptr->emails[i].receiver_id <= 0) {
-                printf("Invalid email found at index %d\n", i);
-                valid = 0;
-            }
+    // Kiểm tra emails: chia đoạn cho worker pool, gộp kết quả theo thứ tự đoạn
+    EmailValidation results[WORKER_POOL_MAX_THREADS];
+    memset(results, 0, sizeof(results));
+    int parts = run_parallel_range(shm_ptr, shm_ptr->control.email_count, validate_email_range,
+                                   NULL, results, sizeof(EmailValidation));
+    
+    for (int p = 0; p < parts; p++) {
+        for (int k = 0; k < results[p].reported && report->reported < VALIDATE_REPORT_LIMIT; k++) {
+            report->email_indices[report->reported++] = results[p].indices[k];
         }
+        report->invalid_emails += results[p].invalid;
     }
     
-    if (valid) {
-        printf("Database validation passed\n");
-    } else {
-        printf("Database validation failed\n");
+    return (report->invalid_users == 0 && report->invalid_emails == 0) ? MS_OK : MS_ERR_CORRUPT;
+}
+
+// Mô tả ngắn cho status code, dùng bởi tầng hiển thị
+const char* mailstore_strerror(int status) {
+    switch (status) {
+        case MS_ERR_INVALID:
+            return "invalid parameters";
+        case MS_ERR_NOT_FOUND:
+            return "not found";
+        case MS_ERR_EXISTS:
+            return "email already exists";
+        case MS_ERR_FULL:
+            return "store is full";
+        case MS_ERR_IO:
+            return "database file I/O error";
+        case MS_ERR_SYS:
+            return "system call failed";
+        case MS_ERR_CORRUPT:
+            return "database validation failed";
+        default:
+            return status >= 0 ? "success" : "unknown error";
     }
-    
-    return valid;
-}
\ No newline at end of file
+}
@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <signal.h>
+
+static int queue_sem_op(int semid, int semnum, int op, int flags) {
+    struct sembuf sb = {semnum, op, flags};
+    while (semop(semid, &sb, 1) == -1) {
+        if (errno != EINTR) {
+            return MS_ERR_SYS;
+        }
+    }
+    return MS_OK;
+}
+
+// Kiểm tra mail_deliveryd còn sống không (pid lưu trong control data)
+int is_delivery_daemon_running(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL || shm_ptr->control.deliveryd_pid <= 0) {
+        return 0;
+    }
+    
+    if (kill(shm_ptr->control.deliveryd_pid, 0) == -1 && errno == ESRCH) {
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Client: đẩy yêu cầu gửi mail vào hàng đợi, block nếu hàng đợi đầy
+int enqueue_send_request(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
+                         const char* subject, const char* content) {
+    if (shm_ptr == NULL || subject == NULL || content == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    int semid = open_mail_semaphores();
+    if (semid < 0) {
+        return MS_ERR_SYS;
+    }
+    
+    if (queue_sem_op(semid, SEM_QUEUE_EMPTY, -1, 0) != MS_OK) {         // wait empty
+        return MS_ERR_SYS;
+    }
+    queue_sem_op(semid, SEM_QUEUE_MUTEX, -1, SEM_UNDO); // lock
+    
+    DeliveryQueue* queue = &shm_ptr->queue;
+    SendRequest* request = &queue->requests[queue->in];
+    request->sender_id = sender_id;
+    request->receiver_id = receiver_id;
+    strncpy(request->subject, subject, MAX_SUBJECT_LENGTH - 1);
+    request->subject[MAX_SUBJECT_LENGTH - 1] = '\0';
+    strncpy(request->content, content, MAX_CONTENT_LENGTH - 1);
+    request->content[MAX_CONTENT_LENGTH - 1] = '\0';
+    request->enqueued_at = time(NULL);
+    
+    queue->in = (queue->in + 1) % DELIVERY_QUEUE_SIZE;
+    queue->count++;
+    int pending = queue->count;
+    
+    queue_sem_op(semid, SEM_QUEUE_MUTEX, 1, SEM_UNDO);  // unlock
+    queue_sem_op(semid, SEM_QUEUE_FULL, 1, 0);          // signal full
+    
+    return pending;
+}
+
+// Daemon: chờ ít nhất một yêu cầu rồi lấy thêm những yêu cầu đang có sẵn
+// (tối đa max) để xử lý thành một batch. Trả về 0 nếu bị signal ngắt.
+int dequeue_send_batch(SharedMemoryData* shm_ptr, SendRequest* batch, int max) {
+    if (shm_ptr == NULL || batch == NULL || max <= 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    int semid = open_mail_semaphores();
+    if (semid < 0) {
+        return MS_ERR_SYS;
+    }
+    
+    struct sembuf wait_full = {SEM_QUEUE_FULL, -1, 0};
+    if (semop(semid, &wait_full, 1) == -1) {
+        return (errno == EINTR) ? 0 : MS_ERR_SYS;
+    }
+    
+    int taken = 1;
+    struct sembuf try_full = {SEM_QUEUE_FULL, -1, IPC_NOWAIT};
+    while (taken < max && semop(semid, &try_full, 1) == 0) {
+        taken++;
+    }
+    
+    queue_sem_op(semid, SEM_QUEUE_MUTEX, -1, SEM_UNDO);
+    
+    DeliveryQueue* queue = &shm_ptr->queue;
+    for (int i = 0; i < taken; i++) {
+        batch[i] = queue->requests[queue->out];
+        queue->out = (queue->out + 1) % DELIVERY_QUEUE_SIZE;
+        queue->count--;
+    }
+    
+    queue_sem_op(semid, SEM_QUEUE_MUTEX, 1, SEM_UNDO);
+    queue_sem_op(semid, SEM_QUEUE_EMPTY, taken, 0);
+    
+    return taken;
+}
@@ -1,49 +1,57 @@
-#include "mail_system.h"
+#include "mailstore.h"
+
+// Mỗi thao tác public gọi bản *_impl rồi ghi latency vào stats region (stats.c)
+
+// Người gửi ở shard khác không có trong segment này (shard.c giao mail sang
+// shard của người nhận): chấp nhận id thuộc shard khác
+static int sender_exists(SharedMemoryData* shm_ptr, int sender_id) {
+    if (read_user(shm_ptr, sender_id) != NULL) {
+        return 1;
+    }
+    int count = shm_ptr->control.shard_count;
+    return count > 1 && sender_id > 0 && SHARD_OF_ID(sender_id, count) != shm_ptr->control.shard_index;
+}
+
+static int find_free_slot(SharedMemoryData* shm_ptr) {
+    for (int i = 0; i < MAX_EMAILS; i++) {
+        if (shm_ptr->emails[i].email_id == 0 || shm_ptr->emails[i].is_deleted) {
+            return i;
+        }
+    }
+    return -1;
+}
 
 // Tạo email mới (CREATE)
-int create_email(SharedMemoryData* shm_ptr, int sender_id, int receiver_id, 
-                 const char* subject, const char* content) {
+static int create_email_impl(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
+                             const char* subject, const char* content) {
     if (shm_ptr == NULL || subject == NULL || content == NULL) {
-        printf("Error: Invalid parameters\n");
-        return -1;
+        return MS_ERR_INVALID;
     }
     
-    if (shm_ptr->control.email_count >= MAX_EMAILS) {
-        printf("Error: Maximum number of emails reached\n");
-        return -1;
+    // Khi bật tier, slot của mail đã hạ xuống file cold được dùng lại
+    if (shm_ptr->control.email_count >= MAX_EMAILS && !shm_ptr->tier.enabled) {
+        return MS_ERR_FULL;
     }
     
     // Kiểm tra sender và receiver có tồn tại không
-    User* sender = read_user(shm_ptr, sender_id);
-    User* receiver = read_user(shm_ptr, receiver_id);
-    
-    if (sender == NULL) {
-        printf("Error: Sender not found\n");
-        return -1;
+    if (!sender_exists(shm_ptr, sender_id) || read_user(shm_ptr, receiver_id) == NULL) {
+        return MS_ERR_NOT_FOUND;
     }
     
-    if (receiver == NULL) {
-        printf("Error: Receiver not found\n");
-        return -1;
-    }
-    
-    // Tìm vị trí trống trong array
-    int index = -1;
-    for (int i = 0; i < MAX_EMAILS; i++) {
-        if (shm_ptr->emails[i].email_id == 0 || shm_ptr->emails[i].is_deleted) {
-            index = i;
-            break;
-        }
+    // Tìm vị trí trống trong array; store đầy thì hạ mail đã đọc cũ nhất xuống tier cold
+    int index = find_free_slot(shm_ptr);
+    if (index == -1 && tier_demote(shm_ptr, 0, TIER_DEMOTE_BATCH) > 0) {
+        index = find_free_slot(shm_ptr);
     }
     
     if (index == -1) {
-        printf("Error: No available slot for new email\n");
-        return -1;
+        return MS_ERR_FULL;
     }
     
     // Tạo email mới
     Email* new_email = &shm_ptr->emails[index];
-    new_email->email_id = shm_ptr->control.next_email_id++;
+    new_email->email_id = shm_ptr->control.next_email_id;
+    shm_ptr->control.next_email_id += ID_STRIDE(shm_ptr);
     new_email->sender_id = sender_id;
     new_email->receiver_id = receiver_id;
     strncpy(new_email->subject, subject, MAX_SUBJECT_LENGTH - 1);
@@ -59,11 +67,27 @@ int create_email(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
         shm_ptr->control.email_count = index + 1;
     }
     
+    record_email_change(shm_ptr, new_email, CHANGE_CREATE);
+    touch_mailbox(shm_ptr, sender_id, receiver_id);
+    
+    // Đánh thức các client đang chờ mail của receiver
+    notify_mailbox(shm_ptr, receiver_id);
+    
     return new_email->email_id;
 }
 
-// Đọc email theo ID (READ)
-Email* read_email(SharedMemoryData* shm_ptr, int email_id) {
+int create_email(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
+                 const char* subject, const char* content) {
+    capture_record(CAP_CREATE_EMAIL, sender_id, receiver_id, subject, content, NULL);
+    long long start = stats_now();
+    int result = create_email_impl(shm_ptr, sender_id, receiver_id, subject, content);
+    stats_record(shm_ptr, STAT_EMAIL_CREATE, start, result > 0);
+    TRACE_OP(shm_ptr, STAT_EMAIL_CREATE, start, sender_id, receiver_id, result);
+    return result;
+}
+
+// Email trong segment (tier nóng)
+static Email* find_hot_email(SharedMemoryData* shm_ptr, int email_id) {
     if (shm_ptr == NULL || email_id <= 0) {
         return NULL;
     }
@@ -78,144 +102,93 @@ Email* read_email(SharedMemoryData* shm_ptr, int email_id) {
     return NULL;
 }
 
+// Đọc email theo ID (READ). Email đã hạ xuống file cold được dựng lại từ file
+// (tier.c); con trỏ đó chỉ để đọc, đổi cờ phải qua update/delete.
+static Email* read_email_impl(SharedMemoryData* shm_ptr, int email_id) {
+    Email* email = find_hot_email(shm_ptr, email_id);
+    if (email == NULL && lazy_load_all(shm_ptr) > 0) {
+        email = find_hot_email(shm_ptr, email_id);
+    }
+    if (email == NULL && shm_ptr != NULL && email_id > 0) {
+        email = tier_read(shm_ptr, email_id);
+    }
+    return email;
+}
+
+Email* read_email(SharedMemoryData* shm_ptr, int email_id) {
+    capture_record(CAP_READ_EMAIL, email_id, 0, NULL, NULL, NULL);
+    long long start = stats_now();
+    Email* result = read_email_impl(shm_ptr, email_id);
+    stats_record(shm_ptr, STAT_EMAIL_READ, start, result != NULL);
+    TRACE_OP(shm_ptr, STAT_EMAIL_READ, start, email_id, 0, result ? MS_OK : MS_ERR_NOT_FOUND);
+    return result;
+}
+
 // Cập nhật trạng thái đọc của email (UPDATE)
-int update_email_status(SharedMemoryData* shm_ptr, int email_id, int is_read) {
+static int update_email_status_impl(SharedMemoryData* shm_ptr, int email_id, int is_read) {
     if (shm_ptr == NULL || email_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return 0;
+        return MS_ERR_INVALID;
     }
     
-    Email* email = read_email(shm_ptr, email_id);
+    Email* email = find_hot_email(shm_ptr, email_id);
+    if (email == NULL && lazy_load_all(shm_ptr) > 0) {
+        email = find_hot_email(shm_ptr, email_id);
+    }
     if (email == NULL) {
-        printf("Error: Email not found\n");
-        return 0;
+        return tier_set_flags(shm_ptr, email_id, is_read, 0);
     }
     
     email->is_read = is_read;
-    return 1;
+    record_email_change(shm_ptr, email, CHANGE_FLAGS);
+    touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
+    return MS_OK;
+}
+
+int update_email_status(SharedMemoryData* shm_ptr, int email_id, int is_read) {
+    capture_record(CAP_UPDATE_EMAIL, email_id, is_read, NULL, NULL, NULL);
+    long long start = stats_now();
+    int result = update_email_status_impl(shm_ptr, email_id, is_read);
+    stats_record(shm_ptr, STAT_EMAIL_UPDATE, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_EMAIL_UPDATE, start, email_id, is_read, result);
+    return result;
 }
 
 // Xóa email (DELETE - soft delete)
-int delete_email(SharedMemoryData* shm_ptr, int email_id) {
+static int delete_email_impl(SharedMemoryData* shm_ptr, int email_id) {
     if (shm_ptr == NULL || email_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return 0;
+        return MS_ERR_INVALID;
     }
     
-    Email* email = read_email(shm_ptr, email_id);
+    Email* email = find_hot_email(shm_ptr, email_id);
+    if (email == NULL && lazy_load_all(shm_ptr) > 0) {
+        email = find_hot_email(shm_ptr, email_id);
+    }
     if (email == NULL) {
-        printf("Error: Email not found\n");
-        return 0;
+        return tier_set_flags(shm_ptr, email_id, 0, 1);
     }
     
     email->is_deleted = 1;
-    return 1;
+    record_email_change(shm_ptr, email, CHANGE_DELETE);
+    touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
+    return MS_OK;
 }
 
-// Hiển thị emails của một user cụ thể (type: 0=received, 1=sent)
-void display_user_emails(SharedMemoryData* shm_ptr, int user_id, int type) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    User* user = read_user(shm_ptr, user_id);
-    if (user == NULL) {
-        printf("Error: User not found\n");
-        return;
-    }
-    
-    const char* title = (type == 0) ? "RECEIVED EMAILS" : "SENT EMAILS";
-    printf("\n=== %s for %s ===\n", title, user->name);
-    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "From/To", "Subject", "Date", "Status");
-    printf("-------------------------------------------------------------------------------------\n");
-    
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted) {
-            int match = 0;
-            User* other_user = NULL;
-            
-            if (type == 0 && email->receiver_id == user_id) {
-                // Received emails
-                match = 1;
-                other_user = read_user(shm_ptr, email->sender_id);
-            } else if (type == 1 && email->sender_id == user_id) {
-                // Sent emails
-                match = 1;
-                other_user = read_user(shm_ptr, email->receiver_id);
-            }
-            
-            if (match) {
-                char date_time[20];
-                struct tm* tm_info = localtime(&email->sent_at);
-                strftime(date_time, sizeof(date_time), "%Y-%m-%d %H:%M", tm_info);
-                
-                printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
-                       email->email_id,
-                       other_user ? other_user->email : "Unknown",
-                       email->subject,
-                       date_time,
-                       email->is_read ? "Read" : "Unread");
-                count++;
-            }
-        }
-    }
-    
-    if (count == 0) {
-        printf("No %s emails found.\n", (type == 0) ? "received" : "sent");
-    } else {
-        printf("\nTotal: %d emails\n", count);
-    }
-}
-
-// Hiển thị tất cả emails trong hệ thống
-void display_all_emails(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    printf("\n=== ALL EMAILS IN SYSTEM ===\n");
-    printf("%-5s %-20s %-20s %-30s %-20s %-10s\n", "ID", "From", "To", "Subject", "Sent", "Status");
-    printf("------------------------------------------------------------------------------------------------\n");
-    
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted) {
-            User* sender = read_user(shm_ptr, email->sender_id);
-            User* receiver = read_user(shm_ptr, email->receiver_id);
-            
-            char sent_time[20];
-            struct tm* tm_info = localtime(&email->sent_at);
-            strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20.20s %-20.20s %-30.30s %-20s %-10s\n", 
-                   email->email_id,
-                   sender ? sender->email : "Unknown",
-                   receiver ? receiver->email : "Unknown",
-                   email->subject,
-                   sent_time,
-                   email->is_read ? "Read" : "Unread");
-            count++;
-        }
-    }
-    
-    if (count == 0) {
-        printf("No emails found in the system.\n");
-    } else {
-        printf("\nTotal: %d emails\n", count);
-    }
+int delete_email(SharedMemoryData* shm_ptr, int email_id) {
+    capture_record(CAP_DELETE_EMAIL, email_id, 0, NULL, NULL, NULL);
+    long long start = stats_now();
+    int result = delete_email_impl(shm_ptr, email_id);
+    stats_record(shm_ptr, STAT_EMAIL_DELETE, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_EMAIL_DELETE, start, email_id, 0, result);
+    return result;
 }
 
 // Lấy số lượng email chưa đọc của user
-int get_unread_email_count(SharedMemoryData* shm_ptr, int user_id) {
+static int get_unread_email_count_impl(SharedMemoryData* shm_ptr, int user_id) {
     if (shm_ptr == NULL || user_id <= 0) {
         return 0;
     }
     
+    lazy_fault_in(shm_ptr, user_id);
     int count = 0;
     for (int i = 0; i < shm_ptr->control.email_count; i++) {
         Email* email = &shm_ptr->emails[i];
@@ -226,137 +199,282 @@ int get_unread_email_count(SharedMemoryData* shm_ptr, int user_id) {
         }
     }
     
-    return count;
+    return count + tier_unread_count(shm_ptr, user_id);
 }
 
-// Đánh dấu tất cả email của user là đã đọc
-int mark_all_emails_read(SharedMemoryData* shm_ptr, int user_id) {
-    if (shm_ptr == NULL || user_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return 0;
-    }
-    
+int get_unread_email_count(SharedMemoryData* shm_ptr, int user_id) {
+    capture_record(CAP_UNREAD, user_id, 0, NULL, NULL, NULL);
+    long long start = stats_now();
+    int result = get_unread_email_count_impl(shm_ptr, user_id);
+    stats_record(shm_ptr, STAT_EMAIL_UNREAD, start, 1);
+    TRACE_OP(shm_ptr, STAT_EMAIL_UNREAD, start, user_id, 0, result);
+    return result;
+}
+
+static void mark_read_range(SharedMemoryData* shm_ptr, int begin, int end, void* arg, void* result) {
+    int user_id = *(int*)arg;
     int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
+    for (int i = begin; i < end; i++) {
         Email* email = &shm_ptr->emails[i];
         if (!email->is_deleted && 
             email->receiver_id == user_id && 
             !email->is_read) {
             email->is_read = 1;
+            record_email_change(shm_ptr, email, CHANGE_FLAGS);
+            touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
             count++;
         }
     }
-    
-    printf("Marked %d emails as read\n", count);
-    return count;
+    *(int*)result = count;
 }
 
-// Xóa tất cả email đã đọc của user
-int delete_read_emails(SharedMemoryData* shm_ptr, int user_id) {
-    if (shm_ptr == NULL || user_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return 0;
-    }
-    
+static void delete_read_range(SharedMemoryData* shm_ptr, int begin, int end, void* arg, void* result) {
+    int user_id = *(int*)arg;
     int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
+    for (int i = begin; i < end; i++) {
         Email* email = &shm_ptr->emails[i];
         if (!email->is_deleted && 
             (email->sender_id == user_id || email->receiver_id == user_id) && 
             email->is_read) {
             email->is_deleted = 1;
+            record_email_change(shm_ptr, email, CHANGE_DELETE);
+            touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
             count++;
         }
     }
+    *(int*)result = count;
+}
+
+// Chạy một thao tác hàng loạt trên mảng emails bằng worker pool và cộng kết quả
+static int run_bulk_email_task(SharedMemoryData* shm_ptr, range_task_fn fn, int user_id) {
+    int counts[WORKER_POOL_MAX_THREADS] = {0};
+    int parts = run_parallel_range(shm_ptr, shm_ptr->control.email_count, fn, &user_id,
+                                   counts, sizeof(int));
     
-    printf("Deleted %d read emails\n", count);
-    return count;
+    int total = 0;
+    for (int i = 0; i < parts; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+// Đánh dấu tất cả email của user là đã đọc (caller giữ store lock)
+static int mark_all_emails_read_impl(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL || user_id <= 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    lazy_fault_in(shm_ptr, user_id);
+    int cold = tier_mark_all_read(shm_ptr, user_id);
+    // Journal ghi một record range cho cả mailbox thay vì từng mail
+    journal_begin_range(shm_ptr, user_id);
+    int hot = run_bulk_email_task(shm_ptr, mark_read_range, user_id);
+    journal_end_range(shm_ptr, hot);
+    return cold < 0 ? cold : hot + cold;
+}
+
+int mark_all_emails_read(SharedMemoryData* shm_ptr, int user_id) {
+    capture_record(CAP_MARK_ALL_READ, user_id, 0, NULL, NULL, NULL);
+    long long start = stats_now();
+    int result = mark_all_emails_read_impl(shm_ptr, user_id);
+    stats_record(shm_ptr, STAT_EMAIL_MARK_ALL, start, result >= 0);
+    TRACE_OP(shm_ptr, STAT_EMAIL_MARK_ALL, start, user_id, 0, result);
+    return result;
 }
 
-// Tìm kiếm email theo người gửi
-void find_emails_by_sender(SharedMemoryData* shm_ptr, int sender_id) {
-    if (shm_ptr == NULL || sender_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return;
+// Xóa tất cả email đã đọc của user (caller giữ store lock)
+static int delete_read_emails_impl(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL || user_id <= 0) {
+        return MS_ERR_INVALID;
     }
     
-    User* sender = read_user(shm_ptr, sender_id);
-    if (sender == NULL) {
-        printf("Error: Sender not found\n");
-        return;
+    lazy_fault_in(shm_ptr, user_id);
+    int cold = tier_delete_read(shm_ptr, user_id);
+    int hot = run_bulk_email_task(shm_ptr, delete_read_range, user_id);
+    return cold < 0 ? cold : hot + cold;
+}
+
+int delete_read_emails(SharedMemoryData* shm_ptr, int user_id) {
+    capture_record(CAP_DELETE_READ, user_id, 0, NULL, NULL, NULL);
+    long long start = stats_now();
+    int result = delete_read_emails_impl(shm_ptr, user_id);
+    stats_record(shm_ptr, STAT_EMAIL_DELETE_READ, start, result >= 0);
+    TRACE_OP(shm_ptr, STAT_EMAIL_DELETE_READ, start, user_id, 0, result);
+    return result;
+}
+
+// Duyệt emails chưa bị xóa của một mailbox (type: MAILBOX_RECEIVED / MAILBOX_SENT
+// / MAILBOX_BOTH), hoặc của cả store khi user_id <= 0. Mail trong file cold
+// (tier.c) đến sau mail trong segment.
+void email_iter_init(EmailIterator* it, int user_id, int type) {
+    it->user_id = user_id;
+    it->type = type;
+    it->pos = 0;
+    it->cold_pos = 0;
+}
+
+Email* email_iter_next(SharedMemoryData* shm_ptr, EmailIterator* it) {
+    if (shm_ptr == NULL) {
+        return NULL;
+    }
+    if (it->pos == 0) {
+        lazy_fault_in(shm_ptr, it->user_id);    // user_id <= 0: cả store
     }
     
-    printf("\n=== EMAILS FROM %s ===\n", sender->email);
-    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "To", "Subject", "Sent", "Status");
-    printf("-------------------------------------------------------------------------------------\n");
+    while (it->pos < shm_ptr->control.email_count) {
+        Email* email = &shm_ptr->emails[it->pos++];
+        if (email->is_deleted || email->email_id == 0) {
+            continue;
+        }
+        if (it->user_id <= 0) {
+            return email;
+        }
+        
+        int received = (email->receiver_id == it->user_id);
+        int sent = (email->sender_id == it->user_id);
+        if ((it->type == MAILBOX_RECEIVED && received) ||
+            (it->type == MAILBOX_SENT && sent) ||
+            (it->type == MAILBOX_BOTH && (received || sent))) {
+            return email;
+        }
+    }
     
+    // Hết segment: tiếp tục với mail đã hạ xuống file cold
+    return tier_iter_next(shm_ptr, it);
+}
+
+// Tìm email có keyword trong subject hoặc content (user_id <= 0: cả store),
+// kể cả mail đã hạ xuống file cold. Ghi tối đa max ID vào ids (có thể NULL),
+// trả về tổng số email khớp; caller đọc từng email bằng read_email (bản dựng
+// lại của mail cold dùng chung một buffer nên không trả con trỏ).
+int find_emails_matching(SharedMemoryData* shm_ptr, int user_id, const char* keyword,
+                         int* ids, int max) {
+    if (shm_ptr == NULL || keyword == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    capture_record(CAP_SEARCH, user_id, 0, keyword, NULL, NULL);
+    long long start = stats_now();
     int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted && email->sender_id == sender_id) {
-            User* receiver = read_user(shm_ptr, email->receiver_id);
-            
-            char sent_time[20];
-            struct tm* tm_info = localtime(&email->sent_at);
-            strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
-                   email->email_id,
-                   receiver ? receiver->email : "Unknown",
-                   email->subject,
-                   sent_time,
-                   email->is_read ? "Read" : "Unread");
+    EmailIterator it;
+    email_iter_init(&it, user_id, MAILBOX_BOTH);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        if (strstr(email->subject, keyword) != NULL || strstr(email->content, keyword) != NULL) {
+            if (ids != NULL && count < max) {
+                ids[count] = email->email_id;
+            }
             count++;
         }
     }
     
-    if (count == 0) {
-        printf("No emails found from this sender.\n");
-    } else {
-        printf("\nTotal: %d emails\n", count);
-    }
+    stats_record(shm_ptr, STAT_EMAIL_SEARCH, start, 1);
+    TRACE_OP(shm_ptr, STAT_EMAIL_SEARCH, start, user_id, 0, count);
+    return count;
 }
 
-// Tìm kiếm email theo người nhận
-void find_emails_by_receiver(SharedMemoryData* shm_ptr, int receiver_id) {
-    if (shm_ptr == NULL || receiver_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return;
+// Copy text nguồn vào field cố định, bỏ '\r' (CRLF -> LF) và cắt ngắn. Với
+// unquote_from, dòng ">*From " (mboxrd) được bỏ một '>'.
+static void copy_import_text(char* dst, size_t size, const char* src, size_t len, int unquote_from) {
+    size_t j = 0;
+    int line_start = 1;
+    for (size_t i = 0; i < len && j < size - 1; i++) {
+        if (line_start && unquote_from && src[i] == '>') {
+            size_t k = i;
+            while (k < len && src[k] == '>') {
+                k++;
+            }
+            if (len - k >= 5 && memcmp(src + k, "From ", 5) == 0) {
+                i++;
+            }
+        }
+        line_start = (src[i] == '\n');
+        if (src[i] != '\r' && src[i] != '\0') {
+            dst[j++] = src[i];
+        }
     }
-    
-    User* receiver = read_user(shm_ptr, receiver_id);
-    if (receiver == NULL) {
-        printf("Error: Receiver not found\n");
-        return;
+    dst[j] = '\0';
+}
+
+// Nhập một lô email (caller giữ store lock). Kiểm tra user của cả lô trước, rồi
+// cấp slot trống bằng một lần quét tiến duy nhất thay vì tìm lại từ đầu cho
+// mỗi email; mỗi mailbox được notify một lần cho mỗi dãy email liên tiếp của
+// nó. Không lưu file: caller lưu một lần sau khi nhập xong. Trả về số email đã
+// nhập (< n khi store đầy).
+static int import_emails_impl(SharedMemoryData* shm_ptr, const EmailImport* items, int n) {
+    if (shm_ptr == NULL || items == NULL || n < 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    int checked_sender = 0, checked_receiver = 0;
+    for (int i = 0; i < n; i++) {
+        if (items[i].subject == NULL || items[i].content == NULL) {
+            return MS_ERR_INVALID;
+        }
+        if (items[i].sender_id != checked_sender) {
+            if (!sender_exists(shm_ptr, items[i].sender_id)) {
+                return MS_ERR_NOT_FOUND;
+            }
+            checked_sender = items[i].sender_id;
+        }
+        if (items[i].receiver_id != checked_receiver) {
+            if (read_user(shm_ptr, items[i].receiver_id) == NULL) {
+                return MS_ERR_NOT_FOUND;
+            }
+            checked_receiver = items[i].receiver_id;
+        }
     }
     
-    printf("\n=== EMAILS TO %s ===\n", receiver->email);
-    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "From", "Subject", "Sent", "Status");
-    printf("-------------------------------------------------------------------------------------\n");
-    
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted && email->receiver_id == receiver_id) {
-            User* sender = read_user(shm_ptr, email->sender_id);
-            
-            char sent_time[20];
-            struct tm* tm_info = localtime(&email->sent_at);
-            strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
-                   email->email_id,
-                   sender ? sender->email : "Unknown",
-                   email->subject,
-                   sent_time,
-                   email->is_read ? "Read" : "Unread");
-            count++;
+    time_t now = time(NULL);
+    int imported = 0;
+    int slot = 0;
+    int pending_notify = 0;
+    for (int i = 0; i < n; i++) {
+        while (slot < MAX_EMAILS && shm_ptr->emails[slot].email_id != 0 &&
+               !shm_ptr->emails[slot].is_deleted) {
+            slot++;
+        }
+        if (slot == MAX_EMAILS) {
+            break;
+        }
+        
+        const EmailImport* item = &items[i];
+        Email* email = &shm_ptr->emails[slot];
+        email->email_id = shm_ptr->control.next_email_id;
+        shm_ptr->control.next_email_id += ID_STRIDE(shm_ptr);
+        email->sender_id = item->sender_id;
+        email->receiver_id = item->receiver_id;
+        copy_import_text(email->subject, MAX_SUBJECT_LENGTH, item->subject, item->subject_len, 0);
+        copy_import_text(email->content, MAX_CONTENT_LENGTH, item->content, item->content_len,
+                         item->unquote_from);
+        email->sent_at = item->sent_at ? item->sent_at : now;
+        email->is_read = item->is_read ? 1 : 0;
+        email->is_deleted = 0;
+        
+        if (slot >= shm_ptr->control.email_count) {
+            shm_ptr->control.email_count = slot + 1;
         }
+        record_email_change(shm_ptr, email, CHANGE_CREATE);
+        touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
+        
+        if (pending_notify != 0 && pending_notify != item->receiver_id) {
+            notify_mailbox(shm_ptr, pending_notify);
+        }
+        pending_notify = item->receiver_id;
+        imported++;
+        slot++;
     }
     
-    if (count == 0) {
-        printf("No emails found for this receiver.\n");
-    } else {
-        printf("\nTotal: %d emails\n", count);
+    if (pending_notify != 0) {
+        notify_mailbox(shm_ptr, pending_notify);
     }
-}
\ No newline at end of file
+    return imported;
+}
+
+int import_emails(SharedMemoryData* shm_ptr, const EmailImport* items, int n) {
+    long long start = stats_now();
+    int result = import_emails_impl(shm_ptr, items, n);
+    stats_record(shm_ptr, STAT_EMAIL_IMPORT, start, result >= 0);
+    TRACE_OP(shm_ptr, STAT_EMAIL_IMPORT, start, n, 0, result);
+    return result;
+}
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+
+// Export mbox (mboxrd) theo luồng với bộ nhớ cố định: mỗi vòng giữ store lock
+// chỉ để copy tối đa EXPORT_CHUNK_EMAILS email khớp bộ lọc (kèm địa chỉ người
+// gửi/nhận) ra bộ nhớ riêng, nhả khóa rồi mới định dạng và ghi. Output đi qua
+// một buffer EXPORT_BUFFER_SIZE, ghi bằng write() lớn. Hết mảng trong segment
+// thì tới mail đã hạ xuống file cold (tier.c), cũng theo chunk. Email được tạo
+// vào slot đã quét qua trong lúc export sẽ không có trong kết quả.
+
+typedef struct {
+    Email email;
+    char from[MAX_EMAIL_LENGTH];
+    char to[MAX_EMAIL_LENGTH];
+} ExportItem;
+
+typedef struct {
+    int fd;
+    size_t len;
+    long long written;
+    int failed;
+    ExportItem chunk[EXPORT_CHUNK_EMAILS];
+    char buffer[EXPORT_BUFFER_SIZE];
+} ExportState;
+
+static void flush_output(ExportState* st) {
+    size_t off = 0;
+    while (off < st->len && !st->failed) {
+        ssize_t n = write(st->fd, st->buffer + off, st->len - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            st->failed = 1;
+            break;
+        }
+        off += n;
+    }
+    st->written += off;
+    st->len = 0;
+}
+
+static void append(ExportState* st, const char* data, size_t size) {
+    while (size > 0) {
+        if (st->len == EXPORT_BUFFER_SIZE) {
+            flush_output(st);
+        }
+        size_t n = EXPORT_BUFFER_SIZE - st->len;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(st->buffer + st->len, data, n);
+        st->len += n;
+        data += n;
+        size -= n;
+    }
+}
+
+static void append_str(ExportState* st, const char* s) {
+    append(st, s, strlen(s));
+}
+
+// Dòng body có dạng ">*From " được thêm một '>' (mboxrd)
+static void append_body(ExportState* st, const char* body) {
+    const char* p = body;
+    while (*p) {
+        const char* nl = strchr(p, '\n');
+        size_t len = nl ? (size_t)(nl - p) + 1 : strlen(p);
+        
+        const char* q = p;
+        while (*q == '>') {
+            q++;
+        }
+        if (strncmp(q, "From ", 5) == 0) {
+            append(st, ">", 1);
+        }
+        append(st, p, len);
+        p += len;
+    }
+    if (p == body || p[-1] != '\n') {
+        append(st, "\n", 1);
+    }
+}
+
+static void write_message(ExportState* st, const ExportItem* item) {
+    const Email* email = &item->email;
+    struct tm tm;
+    char envelope[64], date[64], header[512];
+    
+    gmtime_r(&email->sent_at, &tm);
+    strftime(envelope, sizeof(envelope), "%a %b %e %H:%M:%S %Y", &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S +0000", &tm);
+    
+    snprintf(header, sizeof(header),
+             "From %s %s\n"
+             "From: <%s>\n"
+             "To: <%s>\n"
+             "Date: %s\n"
+             "Message-ID: <%d@mailstore.local>\n"
+             "Status: %s\n"
+             "Subject: ",
+             item->from, envelope, item->from, item->to, date,
+             email->email_id, email->is_read ? "RO" : "O");
+    append_str(st, header);
+    append_str(st, email->subject);
+    append(st, "\n\n", 2);
+    append_body(st, email->content);
+    append(st, "\n", 1);
+}
+
+static int matches(const Email* email, const ExportFilter* filter) {
+    if (email->email_id <= 0 || email->is_deleted) {
+        return 0;
+    }
+    if (filter->user_id > 0) {
+        int received = (email->receiver_id == filter->user_id);
+        int sent = (email->sender_id == filter->user_id);
+        if ((filter->type == MAILBOX_RECEIVED && !received) ||
+            (filter->type == MAILBOX_SENT && !sent) ||
+            (filter->type == MAILBOX_BOTH && !received && !sent)) {
+            return 0;
+        }
+    }
+    if (filter->since > 0 && email->sent_at < filter->since) {
+        return 0;
+    }
+    if (filter->until > 0 && email->sent_at >= filter->until) {
+        return 0;
+    }
+    return 1;
+}
+
+static void copy_address(SharedMemoryData* shm_ptr, int user_id, char* out) {
+    User* user = read_user(shm_ptr, user_id);
+    if (user != NULL) {
+        snprintf(out, MAX_EMAIL_LENGTH, "%s", user->email);
+    } else {
+        snprintf(out, MAX_EMAIL_LENGTH, "user%d@mailstore.local", user_id);
+    }
+}
+
+// Ghi các email khớp filter (NULL = cả store) ra fd dạng mbox. Tự lấy store
+// lock theo từng chunk nên caller KHÔNG được giữ lock. Trả về số email đã
+// export, MS_ERR_IO nếu ghi lỗi; bytes (có thể NULL) nhận số byte đã ghi.
+int export_mbox(SharedMemoryData* shm_ptr, int fd, const ExportFilter* filter, long long* bytes) {
+    if (shm_ptr == NULL || fd < 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    ExportFilter all = { 0, MAILBOX_BOTH, 0, 0 };
+    if (filter == NULL) {
+        filter = &all;
+    }
+    
+    lazy_fault_in(shm_ptr, filter->user_id);
+    ExportState* st = malloc(sizeof(ExportState));
+    if (st == NULL) {
+        return MS_ERR_SYS;
+    }
+    st->fd = fd;
+    st->len = 0;
+    st->written = 0;
+    st->failed = 0;
+    
+    int exported = 0;
+    int pos = 0;
+    while (!st->failed) {
+        int n = 0;
+        lock_store();
+        int high_water = shm_ptr->control.email_count;
+        while (pos < high_water && pos < MAX_EMAILS && n < EXPORT_CHUNK_EMAILS) {
+            const Email* email = &shm_ptr->emails[pos++];
+            if (matches(email, filter)) {
+                ExportItem* item = &st->chunk[n++];
+                item->email = *email;
+                copy_address(shm_ptr, email->sender_id, item->from);
+                copy_address(shm_ptr, email->receiver_id, item->to);
+            }
+        }
+        unlock_store();
+        
+        for (int i = 0; i < n; i++) {
+            write_message(st, &st->chunk[i]);
+        }
+        exported += n;
+        
+        if (pos >= high_water || pos >= MAX_EMAILS) {
+            break;
+        }
+    }
+    
+    // Mail cold: tier_iter_next lọc theo mailbox, view dùng chung nên copy ngay
+    EmailIterator it;
+    email_iter_init(&it, filter->user_id, filter->type);
+    int cold_done = 0;
+    while (!st->failed && !cold_done) {
+        int n = 0;
+        lock_store();
+        while (n < EXPORT_CHUNK_EMAILS) {
+            const Email* email = tier_iter_next(shm_ptr, &it);
+            if (email == NULL) {
+                cold_done = 1;
+                break;
+            }
+            if (matches(email, filter)) {
+                ExportItem* item = &st->chunk[n++];
+                item->email = *email;
+                copy_address(shm_ptr, email->sender_id, item->from);
+                copy_address(shm_ptr, email->receiver_id, item->to);
+            }
+        }
+        unlock_store();
+        
+        for (int i = 0; i < n; i++) {
+            write_message(st, &st->chunk[i]);
+        }
+        exported += n;
+    }
+    flush_output(st);
+    
+    if (bytes != NULL) {
+        *bytes = st->written;
+    }
+    int result = st->failed ? MS_ERR_IO : exported;
+    free(st);
+    return result;
+}
@@ -0,0 +1,849 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Change journal: mỗi thay đổi email (record_email_change) được ghi thêm vào
+// emails.journal.<epoch> qua aio mà không chờ đĩa. Offset được cấp từ tail
+// trong segment nên nhiều process ghi cùng một file không cần O_APPEND. Ghi
+// được gửi theo lô khi nhả store lock (journal_kick); fdatasync theo kiểu group
+// commit: tối đa một sync đang chạy mỗi process, các thay đổi đến trong lúc đó
+// được sync chung ở lần sau. journal_commit đăng ký callback chạy khi mọi thay
+// đổi process này đã ghi đều đã bền trên đĩa.
+//
+// Checkpoint (lưu emails.txt) mở epoch mới; khi emails.txt mới đã được cài,
+// các file journal cũ hơn bị xóa. Lúc khởi tạo segment, journal_recover áp lại
+// các record mới hơn MODSEQ của emails.txt. Vì offset được cấp trước khi ghi,
+// lúc crash file có thể có lỗ (offset process chậm đã nhận nhưng chưa ghi)
+// trước record process khác đã commit; khôi phục bỏ qua lỗ đó.
+//
+// Đổi cờ đọc không ghi ngay: mỗi process gom chúng vào một buffer theo
+// email_id (đổi nhiều lần chỉ giữ trạng thái cuối) và ghi cả buffer thành một
+// record JOURNAL_FLAG_BATCH dạng bitmap khi buffer đầy, cũ hơn FLAG_BATCH_AGE_MS
+// (lúc nhả store lock) hoặc trước khi journal_commit / journal_sync báo bền.
+// Xóa thì ghi ngay thành record CHANGE_DELETE: slot được giải phóng có thể bị
+// CREATE của process khác dùng lại, khôi phục cần thấy xóa trước CREATE đó.
+// mark_all_emails_read ghi một record JOURNAL_FLAG_RANGE thay cho từng mail.
+
+typedef struct Waiter {
+    unsigned long long target;
+    aio_callback cb;
+    void* arg;
+    struct Waiter* next;
+} Waiter;
+
+typedef struct {
+    int fd;
+    unsigned int epoch;
+    int retired_fd;              // fd của epoch trước, đóng khi hết request
+    unsigned long long appended; // modseq lớn nhất process này đã ghi
+    unsigned long long durable;  // modseq lớn nhất đã chắc chắn trên đĩa
+    int dirty;                   // có ghi chưa được sync
+    int sync_inflight;
+    int failed;
+    Waiter* waiters;
+} JournalWriter;
+
+#define FLAG_HASH_SIZE (2 * FLAG_BATCH_MAX)
+
+typedef struct {
+    int email_id;
+    unsigned char flags;         // EMAIL_FLAG_*
+    unsigned long long modseq;
+} PendingFlag;
+
+// Buffer cờ của process (giữ g_writer_mutex khi đụng tới)
+typedef struct {
+    SharedMemoryData* shm_ptr;
+    int count;
+    long long oldest_ns;
+    int range_user;              // mark_all đang chạy cho mailbox này
+    PendingFlag entries[FLAG_BATCH_MAX];
+    int slots[FLAG_HASH_SIZE];   // hash email_id -> vị trí trong entries + 1
+} FlagBuffer;
+
+static JournalWriter g_writer = { .fd = -1, .retired_fd = -1 };
+static FlagBuffer g_flags;
+static pthread_mutex_t g_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_writer_once = PTHREAD_ONCE_INIT;
+
+static void journal_path(unsigned int epoch, char* path, size_t size) {
+    snprintf(path, size, "%s.%u", JOURNAL_FILE, epoch);
+}
+
+static unsigned int record_checksum(const JournalRecord* rec) {
+    const unsigned char* p = (const unsigned char*)rec;
+    unsigned int h = 2166136261u;
+    for (unsigned int i = 0; i < rec->length; i++) {
+        unsigned char c = p[i];
+        if (i >= offsetof(JournalRecord, checksum) && i < offsetof(JournalRecord, reserved)) {
+            c = 0;
+        }
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+static void journal_at_exit() {
+    journal_sync();
+}
+
+// Process con không kế thừa ghi dở của cha
+static void journal_after_fork() {
+    pthread_mutex_init(&g_writer_mutex, NULL);
+    if (g_writer.fd != -1) {
+        close(g_writer.fd);
+    }
+    if (g_writer.retired_fd != -1) {
+        close(g_writer.retired_fd);
+    }
+    memset(&g_writer, 0, sizeof(g_writer));
+    g_writer.fd = -1;
+    g_writer.retired_fd = -1;
+    memset(&g_flags, 0, sizeof(g_flags));
+}
+
+static void register_handlers() {
+    atexit(journal_at_exit);
+    pthread_atfork(NULL, NULL, journal_after_fork);
+}
+
+static void on_write_done(void* arg, int result) {
+    JournalRecord* rec = arg;
+    if (result != (int)rec->length) {
+        pthread_mutex_lock(&g_writer_mutex);
+        g_writer.failed = 1;
+        pthread_mutex_unlock(&g_writer_mutex);
+    }
+    free(rec);
+}
+
+static void on_sync_done(void* arg, int result) {
+    unsigned long long target = (unsigned long long)(uintptr_t)arg;
+    Waiter* ready = NULL;
+    
+    pthread_mutex_lock(&g_writer_mutex);
+    g_writer.sync_inflight = 0;
+    if (result != 0) {
+        g_writer.failed = 1;
+    } else if (target > g_writer.durable) {
+        g_writer.durable = target;
+    }
+    
+    Waiter** link = &g_writer.waiters;
+    while (*link != NULL) {
+        Waiter* w = *link;
+        if (g_writer.failed || w->target <= g_writer.durable) {
+            *link = w->next;
+            w->next = ready;
+            ready = w;
+        } else {
+            link = &w->next;
+        }
+    }
+    int status = g_writer.failed ? MS_ERR_IO : MS_OK;
+    int more = g_writer.dirty;
+    pthread_mutex_unlock(&g_writer_mutex);
+    
+    while (ready != NULL) {
+        Waiter* next = ready->next;
+        ready->cb(ready->arg, status);
+        free(ready);
+        ready = next;
+    }
+    if (more) {
+        journal_kick();
+    }
+}
+
+// Mở file của epoch hiện tại nếu cần (giữ g_writer_mutex)
+static int ensure_journal_file(SharedMemoryData* shm_ptr) {
+    unsigned int epoch = shm_ptr->journal.epoch;
+    if (g_writer.fd != -1 && g_writer.epoch == epoch) {
+        return 0;
+    }
+    
+    if (g_writer.fd != -1) {
+        // Sync nốt file cũ (barrier, nên sync của file mới cũng chờ nó)
+        if (g_writer.dirty && aio_fdatasync(g_writer.fd, NULL, NULL) == MS_OK) {
+            g_writer.dirty = 0;
+        }
+        if (g_writer.retired_fd != -1) {
+            close(g_writer.retired_fd);
+        }
+        g_writer.retired_fd = g_writer.fd;
+        g_writer.fd = -1;
+    }
+    
+    char path[256];
+    journal_path(epoch, path, sizeof(path));
+    g_writer.fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (g_writer.fd == -1) {
+        g_writer.failed = 1;
+        return -1;
+    }
+    g_writer.epoch = epoch;
+    return 0;
+}
+
+// Dựng record (đã có checksum) cho một thay đổi; với CHANGE_CREATE kèm subject
+// và content. Caller free. Dùng chung cho journal và log shipping (mail_standby).
+JournalRecord* journal_build_record(const Email* email, int op) {
+    size_t subject_len = 0, content_len = 0;
+    if (op == CHANGE_CREATE) {
+        subject_len = strnlen(email->subject, MAX_SUBJECT_LENGTH);
+        content_len = strnlen(email->content, MAX_CONTENT_LENGTH);
+    }
+    size_t length = (sizeof(JournalRecord) + subject_len + content_len + 7) & ~(size_t)7;
+    
+    JournalRecord* rec = calloc(1, length);
+    if (rec == NULL) {
+        return NULL;
+    }
+    rec->magic = JOURNAL_MAGIC;
+    rec->length = (unsigned int)length;
+    rec->modseq = email->modseq;
+    rec->op = op;
+    rec->email_id = email->email_id;
+    rec->sender_id = email->sender_id;
+    rec->receiver_id = email->receiver_id;
+    rec->sent_at = email->sent_at;
+    rec->is_read = email->is_read;
+    rec->subject_len = (unsigned short)subject_len;
+    rec->content_len = (unsigned short)content_len;
+    memcpy((char*)(rec + 1), email->subject, subject_len);
+    memcpy((char*)(rec + 1) + subject_len, email->content, content_len);
+    rec->checksum = record_checksum(rec);
+    return rec;
+}
+
+// Record bọc payload tùy ý (op không phải CHANGE_*), dùng cho log shipping
+JournalRecord* journal_build_frame(int op, unsigned long long modseq, const void* payload, size_t size) {
+    size_t length = (sizeof(JournalRecord) + size + 7) & ~(size_t)7;
+    JournalRecord* rec = calloc(1, length);
+    if (rec == NULL) {
+        return NULL;
+    }
+    rec->magic = JOURNAL_MAGIC;
+    rec->length = (unsigned int)length;
+    rec->modseq = modseq;
+    rec->op = op;
+    if (size > 0) {
+        memcpy(rec + 1, payload, size);
+    }
+    rec->checksum = record_checksum(rec);
+    return rec;
+}
+
+// Kiểm tra header (sau khi đọc sizeof(JournalRecord) byte) và, khi full = 1,
+// cả checksum của record đã đọc đủ length byte
+int journal_check_record(const JournalRecord* rec, size_t max_length, int full) {
+    if (rec->magic != JOURNAL_MAGIC || rec->length < sizeof(JournalRecord) ||
+        rec->length > max_length ||
+        rec->length < sizeof(JournalRecord) + rec->subject_len + rec->content_len) {
+        return MS_ERR_CORRUPT;
+    }
+    if (full && record_checksum(rec) != rec->checksum) {
+        return MS_ERR_CORRUPT;
+    }
+    return MS_OK;
+}
+
+// Cấp offset và gửi record (caller giữ store lock và g_writer_mutex). Record
+// được free khi ghi xong hoặc lỗi.
+static void write_record_locked(SharedMemoryData* shm_ptr, JournalRecord* rec) {
+    size_t length = rec->length;
+    if (ensure_journal_file(shm_ptr) != 0) {
+        free(rec);
+        return;
+    }
+    off_t offset = (off_t)__atomic_fetch_add(&shm_ptr->journal.tail, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm_ptr->journal.records, 1, __ATOMIC_RELAXED);
+    unsigned long long modseq = rec->modseq;
+    if (aio_write(g_writer.fd, rec, length, offset, on_write_done, rec) != MS_OK) {
+        g_writer.failed = 1;
+        free(rec);
+        return;
+    }
+    if (modseq > g_writer.appended) {
+        g_writer.appended = modseq;
+    }
+    g_writer.dirty = 1;
+}
+
+static size_t chunk_size(unsigned int count) {
+    return (sizeof(FlagChunk) + count * (sizeof(unsigned int) + 1) + 7) & ~(size_t)7;
+}
+
+static int compare_pending(const void* a, const void* b) {
+    int x = ((const PendingFlag*)a)->email_id;
+    int y = ((const PendingFlag*)b)->email_id;
+    return (x > y) - (x < y);
+}
+
+// Ghi buffer cờ thành một record JOURNAL_FLAG_BATCH (caller giữ store lock và
+// g_writer_mutex). Trả về số entry đã ghi.
+static int flush_flags_locked() {
+    FlagBuffer* buf = &g_flags;
+    int n = buf->count;
+    if (n == 0) {
+        return 0;
+    }
+    
+    // Sắp theo id để các id gần nhau chung một chunk 64 bit
+    qsort(buf->entries, n, sizeof(PendingFlag), compare_pending);
+    unsigned long long top = 0;
+    size_t size = 0;
+    for (int i = 0; i < n; ) {
+        int j = i;
+        while (j < n && buf->entries[j].email_id - buf->entries[i].email_id < 64) {
+            if (buf->entries[j].modseq > top) {
+                top = buf->entries[j].modseq;
+            }
+            j++;
+        }
+        size += chunk_size(j - i);
+        i = j;
+    }
+    
+    char* payload = calloc(1, size);
+    JournalRecord* rec = NULL;
+    if (payload != NULL) {
+        char* p = payload;
+        for (int i = 0; i < n; ) {
+            FlagChunk* chunk = (FlagChunk*)p;
+            chunk->base_id = buf->entries[i].email_id;
+            int j = i;
+            while (j < n && buf->entries[j].email_id - chunk->base_id < 64) {
+                j++;
+            }
+            chunk->count = (unsigned int)(j - i);
+            unsigned int* deltas = (unsigned int*)(chunk + 1);
+            unsigned char* flags = (unsigned char*)(deltas + chunk->count);
+            for (int k = i; k < j; k++) {
+                chunk->mask |= 1ULL << (buf->entries[k].email_id - chunk->base_id);
+                deltas[k - i] = (unsigned int)(top - buf->entries[k].modseq);
+                flags[k - i] = buf->entries[k].flags;
+            }
+            p += chunk_size(chunk->count);
+            i = j;
+        }
+        rec = journal_build_frame(JOURNAL_FLAG_BATCH, top, payload, size);
+        free(payload);
+    }
+    
+    SharedMemoryData* shm_ptr = buf->shm_ptr;
+    buf->count = 0;
+    memset(buf->slots, 0, sizeof(buf->slots));
+    if (rec == NULL) {
+        g_writer.failed = 1;
+        return MS_ERR_SYS;
+    }
+    __atomic_add_fetch(&shm_ptr->journal.flag_entries, n, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm_ptr->journal.flag_records, 1, __ATOMIC_RELAXED);
+    write_record_locked(shm_ptr, rec);
+    return n;
+}
+
+// Entry của email_id trong buffer, thêm mới nếu chưa có; NULL khi buffer đầy
+static PendingFlag* pending_entry(int email_id) {
+    unsigned int h = ((unsigned int)email_id * 2654435761u) & (FLAG_HASH_SIZE - 1);
+    while (g_flags.slots[h] != 0) {
+        PendingFlag* entry = &g_flags.entries[g_flags.slots[h] - 1];
+        if (entry->email_id == email_id) {
+            return entry;
+        }
+        h = (h + 1) & (FLAG_HASH_SIZE - 1);
+    }
+    if (g_flags.count == FLAG_BATCH_MAX) {
+        return NULL;
+    }
+    if (g_flags.count == 0) {
+        g_flags.oldest_ns = stats_now();
+    }
+    PendingFlag* entry = &g_flags.entries[g_flags.count++];
+    g_flags.slots[h] = g_flags.count;
+    entry->email_id = email_id;
+    return entry;
+}
+
+static void buffer_flag(SharedMemoryData* shm_ptr, const Email* email) {
+    unsigned char flags = email->is_read ? EMAIL_FLAG_READ : 0;
+    
+    pthread_mutex_lock(&g_writer_mutex);
+    __atomic_add_fetch(&shm_ptr->journal.flag_changes, 1, __ATOMIC_RELAXED);
+    // Mark-all đang chạy: record range ghi ở journal_end_range đã bao gồm
+    if (g_flags.range_user != 0 && email->is_read &&
+        email->receiver_id == g_flags.range_user) {
+        pthread_mutex_unlock(&g_writer_mutex);
+        return;
+    }
+    if (g_flags.count > 0 && g_flags.shm_ptr != shm_ptr) {
+        flush_flags_locked();
+    }
+    g_flags.shm_ptr = shm_ptr;
+    
+    PendingFlag* entry = pending_entry(email->email_id);
+    if (entry == NULL) {
+        flush_flags_locked();
+        entry = pending_entry(email->email_id);
+    }
+    entry->flags = flags;
+    entry->modseq = email->modseq;
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Ghi một thay đổi vào journal (caller giữ store lock, như record_email_change).
+// Chỉ xếp hàng, không chờ đĩa; đổi cờ đọc chỉ vào buffer cờ.
+void journal_append(SharedMemoryData* shm_ptr, const Email* email, int op) {
+    if (shm_ptr == NULL || email == NULL || !shm_ptr->journal.enabled) {
+        return;
+    }
+    
+    pthread_once(&g_writer_once, register_handlers);
+    if (op == CHANGE_FLAGS) {
+        buffer_flag(shm_ptr, email);
+        return;
+    }
+    
+    JournalRecord* rec = journal_build_record(email, op);
+    if (rec == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_writer_mutex);
+    write_record_locked(shm_ptr, rec);
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Ghi buffer cờ của process. force = 0: chỉ khi buffer đã cũ hơn
+// FLAG_BATCH_AGE_MS (unlock_store gọi trước khi nhả khóa). Tự lấy store lock
+// nếu thread này chưa giữ. Trả về số entry đã ghi.
+int journal_flush_flags(int force) {
+    if (__atomic_load_n(&g_flags.count, __ATOMIC_RELAXED) == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_writer_mutex);
+    int due = g_flags.count > 0 &&
+              (force || stats_now() - g_flags.oldest_ns >= FLAG_BATCH_AGE_MS * 1000000LL);
+    pthread_mutex_unlock(&g_writer_mutex);
+    if (!due) {
+        return 0;
+    }
+    
+    // Offset trong file cấp từ tail, chỉ hợp lệ khi giữ store lock (journal_rotate)
+    int locked = 0;
+    if (!store_lock_held()) {
+        if (lock_store() != MS_OK) {
+            return MS_ERR_SYS;
+        }
+        locked = 1;
+    }
+    pthread_mutex_lock(&g_writer_mutex);
+    int n = flush_flags_locked();
+    pthread_mutex_unlock(&g_writer_mutex);
+    if (locked) {
+        unlock_store();
+    }
+    return n;
+}
+
+// Bao quanh phần hot của mark_all_emails_read (caller giữ store lock): các mail
+// được đánh dấu đọc không vào buffer, journal_end_range ghi một record range
+// với modseq cao nhất sau thao tác (changed = số mail đã đổi).
+void journal_begin_range(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL || !shm_ptr->journal.enabled) {
+        return;
+    }
+    pthread_once(&g_writer_once, register_handlers);
+    pthread_mutex_lock(&g_writer_mutex);
+    // Thay đổi đang buffer cũ hơn range: ghi trước để nằm trước nó trong file
+    flush_flags_locked();
+    g_flags.range_user = user_id;
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+void journal_end_range(SharedMemoryData* shm_ptr, int changed) {
+    if (shm_ptr == NULL || !shm_ptr->journal.enabled) {
+        return;
+    }
+    
+    pthread_once(&g_writer_once, register_handlers);
+    pthread_mutex_lock(&g_writer_mutex);
+    FlagRange range = { g_flags.range_user, EMAIL_FLAG_READ };
+    g_flags.range_user = 0;
+    if (changed > 0 && range.user_id != 0) {
+        unsigned long long modseq = __atomic_load_n(&shm_ptr->changelog.highest_modseq, __ATOMIC_ACQUIRE);
+        JournalRecord* rec = journal_build_frame(JOURNAL_FLAG_RANGE, modseq, &range, sizeof(range));
+        if (rec == NULL) {
+            g_writer.failed = 1;
+        } else {
+            __atomic_add_fetch(&shm_ptr->journal.flag_records, 1, __ATOMIC_RELAXED);
+            write_record_locked(shm_ptr, rec);
+        }
+    }
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Gửi các ghi đang xếp hàng và một fdatasync nếu chưa có sync nào đang chạy.
+// Không chặn; được gọi khi nhả store lock.
+void journal_kick() {
+    pthread_mutex_lock(&g_writer_mutex);
+    if (g_writer.fd == -1 && g_writer.retired_fd == -1) {
+        pthread_mutex_unlock(&g_writer_mutex);
+        return;
+    }
+    if (g_writer.dirty && !g_writer.sync_inflight && g_writer.fd != -1) {
+        unsigned long long target = g_writer.appended;
+        if (aio_fdatasync(g_writer.fd, on_sync_done, (void*)(uintptr_t)target) == MS_OK) {
+            g_writer.sync_inflight = 1;
+            g_writer.dirty = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_writer_mutex);
+    
+    aio_submit();
+    aio_poll();
+    
+    pthread_mutex_lock(&g_writer_mutex);
+    if (g_writer.retired_fd != -1 && aio_pending() == 0) {
+        close(g_writer.retired_fd);
+        g_writer.retired_fd = -1;
+    }
+    pthread_mutex_unlock(&g_writer_mutex);
+}
+
+// Cho vòng lặp sự kiện gọi khi aio_event_fd() readable
+int journal_poll() {
+    int n = aio_poll();
+    journal_kick();
+    return n;
+}
+
+// Gọi cb(arg, MS_OK | MS_ERR_IO) khi mọi thay đổi process này đã ghi đều đã
+// bền. Có thể gọi cb ngay (trước khi trả về) nếu không còn gì phải chờ.
+int journal_commit(aio_callback cb, void* arg) {
+    if (cb == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    // Cờ còn trong buffer cũng phải bền trước khi báo
+    journal_flush_flags(1);
+    pthread_mutex_lock(&g_writer_mutex);
+    if (g_writer.failed || g_writer.appended <= g_writer.durable) {
+        int status = g_writer.failed ? MS_ERR_IO : MS_OK;
+        pthread_mutex_unlock(&g_writer_mutex);
+        cb(arg, status);
+        return MS_OK;
+    }
+    
+    Waiter* w = malloc(sizeof(Waiter));
+    if (w == NULL) {
+        pthread_mutex_unlock(&g_writer_mutex);
+        return MS_ERR_SYS;
+    }
+    w->target = g_writer.appended;
+    w->cb = cb;
+    w->arg = arg;
+    w->next = g_writer.waiters;
+    g_writer.waiters = w;
+    pthread_mutex_unlock(&g_writer_mutex);
+    
+    journal_kick();
+    return MS_OK;
+}
+
+// 1 nếu process này còn thay đổi chưa bền
+int journal_pending() {
+    pthread_mutex_lock(&g_writer_mutex);
+    int pending = !g_writer.failed && (g_writer.appended > g_writer.durable || g_flags.count > 0);
+    pthread_mutex_unlock(&g_writer_mutex);
+    return pending;
+}
+
+// Chờ đến khi mọi thay đổi của process này đã bền (dùng lúc thoát)
+int journal_sync() {
+    journal_flush_flags(1);
+    while (1) {
+        journal_kick();
+        pthread_mutex_lock(&g_writer_mutex);
+        int done = g_writer.failed || g_writer.fd == -1 ||
+                   (g_writer.appended <= g_writer.durable && !g_writer.dirty);
+        int failed = g_writer.failed;
+        pthread_mutex_unlock(&g_writer_mutex);
+        if (done) {
+            aio_wait_all();
+            return failed ? MS_ERR_IO : MS_OK;
+        }
+        aio_wait_all();
+    }
+}
+
+// Mở epoch mới cho checkpoint (caller giữ store lock). Trả về epoch mới;
+// checkpoint ghi số này vào emails.txt.
+unsigned int journal_rotate(SharedMemoryData* shm_ptr) {
+    shm_ptr->journal.epoch++;
+    shm_ptr->journal.tail = 0;
+    return shm_ptr->journal.epoch;
+}
+
+// Liệt kê epoch của các file journal trong thư mục hiện tại (tăng dần).
+// Trả về số epoch, -1 nếu lỗi; caller free(*out).
+static int list_epochs(unsigned int** out) {
+    *out = NULL;
+    DIR* dir = opendir(".");
+    if (dir == NULL) {
+        return -1;
+    }
+    
+    size_t prefix = strlen(JOURNAL_FILE) + 1;
+    int count = 0, cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, JOURNAL_FILE ".", prefix) != 0) {
+            continue;
+        }
+        char* end;
+        unsigned long epoch = strtoul(entry->d_name + prefix, &end, 10);
+        if (end == entry->d_name + prefix || *end != '\0') {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 8;
+            unsigned int* grown = realloc(*out, cap * sizeof(unsigned int));
+            if (grown == NULL) {
+                break;
+            }
+            *out = grown;
+        }
+        (*out)[count++] = (unsigned int)epoch;
+    }
+    closedir(dir);
+    
+    // Thường chỉ vài file
+    for (int i = 1; i < count; i++) {
+        unsigned int v = (*out)[i];
+        int j = i - 1;
+        while (j >= 0 && (*out)[j] > v) {
+            (*out)[j + 1] = (*out)[j];
+            j--;
+        }
+        (*out)[j + 1] = v;
+    }
+    return count;
+}
+
+// Xóa journal của các epoch đã nằm trong checkpoint (nhỏ hơn epoch)
+void journal_prune(unsigned int epoch) {
+    unsigned int* epochs;
+    int count = list_epochs(&epochs);
+    char path[256];
+    for (int i = 0; i < count && epochs[i] < epoch; i++) {
+        journal_path(epochs[i], path, sizeof(path));
+        unlink(path);
+    }
+    free(epochs);
+}
+
+static Email* find_email_slot(SharedMemoryData* shm_ptr, int email_id) {
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        if (shm_ptr->emails[i].email_id == email_id && !shm_ptr->emails[i].is_deleted) {
+            return &shm_ptr->emails[i];
+        }
+    }
+    return NULL;
+}
+
+// Mỗi entry của JOURNAL_FLAG_BATCH được áp như một record đổi cờ riêng. Entry
+// không mới hơn checkpoint (base_modseq lúc khôi phục) bị bỏ qua.
+static void apply_flag_batch(SharedMemoryData* shm_ptr, const JournalRecord* rec) {
+    const char* p = (const char*)(rec + 1);
+    const char* end = (const char*)rec + rec->length;
+    unsigned long long base = shm_ptr->changelog.base_modseq;
+    
+    while ((size_t)(end - p) >= sizeof(FlagChunk)) {
+        const FlagChunk* chunk = (const FlagChunk*)p;
+        size_t size = chunk_size(chunk->count);
+        if (chunk->count == 0 || chunk->count > 64 || size > (size_t)(end - p)) {
+            break;
+        }
+        const unsigned int* deltas = (const unsigned int*)(chunk + 1);
+        const unsigned char* flags = (const unsigned char*)(deltas + chunk->count);
+        unsigned int k = 0;
+        for (int bit = 0; bit < 64 && k < chunk->count; bit++) {
+            if (!((chunk->mask >> bit) & 1)) {
+                continue;
+            }
+            unsigned long long modseq = rec->modseq - deltas[k];
+            unsigned char f = flags[k++];
+            Email* email = (modseq > base) ? find_email_slot(shm_ptr, chunk->base_id + bit) : NULL;
+            if (email == NULL || email->modseq >= modseq) {
+                continue;
+            }
+            email->is_read = (f & EMAIL_FLAG_READ) ? 1 : 0;
+            if (f & EMAIL_FLAG_DELETED) {
+                email->is_deleted = 1;
+            }
+            email->modseq = modseq;
+            touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
+        }
+        p += size;
+    }
+}
+
+// JOURNAL_FLAG_RANGE: mọi mail còn sống của mailbox nhận có modseq <= record.
+// Mail đã đọc cũng được đóng dấu modseq của record: một record cũ hơn (bỏ
+// đọc) nằm sau trong file không được ghi đè trạng thái này.
+static void apply_flag_range(SharedMemoryData* shm_ptr, const JournalRecord* rec) {
+    if (rec->length < sizeof(JournalRecord) + sizeof(FlagRange)) {
+        return;
+    }
+    const FlagRange* range = (const FlagRange*)(rec + 1);
+    int changed = 0;
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        Email* email = &shm_ptr->emails[i];
+        if (email->email_id != 0 && !email->is_deleted && email->receiver_id == range->user_id &&
+            email->modseq <= rec->modseq) {
+            changed += !email->is_read;
+            email->is_read = 1;
+            email->modseq = rec->modseq;
+        }
+    }
+    if (changed > 0) {
+        touch_mailbox(shm_ptr, range->user_id, range->user_id);
+    }
+}
+
+// Áp một record vào store (caller giữ lock hoặc là process duy nhất). Record
+// cũ hơn trạng thái hiện tại của email bị bỏ qua; CHANGE_CREATE cho email đã
+// có chỉ cập nhật cờ (log shipping gửi trạng thái đầy đủ dưới dạng CREATE).
+void journal_apply_record(SharedMemoryData* shm_ptr, const JournalRecord* rec) {
+    if (rec->op == JOURNAL_FLAG_BATCH) {
+        apply_flag_batch(shm_ptr, rec);
+        return;
+    }
+    if (rec->op == JOURNAL_FLAG_RANGE) {
+        apply_flag_range(shm_ptr, rec);
+        return;
+    }
+    
+    Email* email = find_email_slot(shm_ptr, rec->email_id);
+    if (email != NULL && email->modseq >= rec->modseq) {
+        return;
+    }
+    if (rec->op == CHANGE_CREATE && email == NULL) {
+        for (int i = 0; i < MAX_EMAILS; i++) {
+            if (shm_ptr->emails[i].email_id == 0 || shm_ptr->emails[i].is_deleted) {
+                email = &shm_ptr->emails[i];
+                break;
+            }
+        }
+        if (email == NULL) {
+            return;
+        }
+        const char* text = (const char*)(rec + 1);
+        size_t subject_len = rec->subject_len < MAX_SUBJECT_LENGTH ? rec->subject_len : MAX_SUBJECT_LENGTH - 1;
+        size_t content_len = rec->content_len < MAX_CONTENT_LENGTH ? rec->content_len : MAX_CONTENT_LENGTH - 1;
+        memset(email, 0, sizeof(Email));
+        email->email_id = rec->email_id;
+        email->sender_id = rec->sender_id;
+        email->receiver_id = rec->receiver_id;
+        memcpy(email->subject, text, subject_len);
+        memcpy(email->content, text + rec->subject_len, content_len);
+        email->sent_at = (time_t)rec->sent_at;
+        email->is_read = rec->is_read;
+        
+        int slot = (int)(email - shm_ptr->emails);
+        if (slot >= shm_ptr->control.email_count) {
+            shm_ptr->control.email_count = slot + 1;
+        }
+        if (rec->email_id >= shm_ptr->control.next_email_id) {
+            shm_ptr->control.next_email_id = rec->email_id + 1;
+        }
+    } else if (email != NULL && (rec->op == CHANGE_FLAGS || rec->op == CHANGE_CREATE)) {
+        email->is_read = rec->is_read;
+    } else if (email != NULL && rec->op == CHANGE_DELETE) {
+        email->is_deleted = 1;
+    } else {
+        return;
+    }
+    email->modseq = rec->modseq;
+    touch_mailbox(shm_ptr, email->sender_id, email->receiver_id);
+}
+
+// Áp các record mới hơn MODSEQ đã nạp từ các file journal có epoch >= epoch
+// ghi trong emails.txt (caller đã load_emails_from_file). Vùng không phải
+// record hợp lệ (lỗ toàn 0 hay record ghi dở lúc crash) được bỏ qua: quét tiếp
+// từng bước 8 byte (record luôn bắt đầu ở bội số 8) tới record có magic và
+// checksum đúng. Record nằm sau lỗ có thể đã được báo bền cho process khác;
+// record trong lỗ thì chưa (journal_commit chỉ báo sau fdatasync). Sau đó ghi
+// tiếp vào epoch mới. Trả về số record đã áp.
+int journal_recover(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    unsigned long long base = shm_ptr->changelog.highest_modseq;
+    unsigned long long highest = base;
+    size_t max_length = sizeof(JournalRecord) + MAX_SUBJECT_LENGTH + MAX_CONTENT_LENGTH + 8;
+    if (max_length < sizeof(JournalRecord) + FLAG_BATCH_MAX * chunk_size(1)) {
+        max_length = sizeof(JournalRecord) + FLAG_BATCH_MAX * chunk_size(1);
+    }
+    
+    unsigned int* epochs;
+    int count = list_epochs(&epochs);
+    int applied = 0;
+    unsigned int next_epoch = shm_ptr->journal.epoch;
+    char path[256];
+    for (int i = 0; i < count; i++) {
+        if (epochs[i] < shm_ptr->journal.epoch) {
+            continue;
+        }
+        next_epoch = epochs[i] + 1;
+        journal_path(epochs[i], path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        struct stat st;
+        size_t size = (fstat(fd, &st) == 0) ? (size_t)st.st_size : 0;
+        const char* map = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED) {
+            continue;
+        }
+        
+        size_t offset = 0;
+        while (offset + sizeof(JournalRecord) <= size) {
+            const JournalRecord* rec = (const JournalRecord*)(map + offset);
+            size_t limit = (size - offset < max_length) ? size - offset : max_length;
+            if (journal_check_record(rec, limit, 1) != MS_OK) {
+                offset += 8;
+                continue;
+            }
+            // Thứ tự trong file có thể lệch modseq (ghi song song), nên so với base
+            if (rec->modseq > base) {
+                journal_apply_record(shm_ptr, rec);
+                if (rec->modseq > highest) {
+                    highest = rec->modseq;
+                }
+                applied++;
+            }
+            offset += rec->length;
+        }
+        munmap((void*)map, size);
+    }
+    free(epochs);
+    
+    shm_ptr->journal.epoch = next_epoch;
+    shm_ptr->journal.tail = 0;
+    if (applied > 0) {
+        shm_ptr->changelog.highest_modseq = highest;
+        shm_ptr->changelog.base_modseq = highest;
+    }
+    return applied;
+}
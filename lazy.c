@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <sys/wait.h>
+
+// Lazy loading (MAILSTORE_LAZY): lúc khởi tạo segment chỉ nạp users.txt, header
+// và manifest mailbox ở cuối emails.txt (xem write_mailbox_manifest), nên thời
+// gian tới lần đăng nhập đầu không phụ thuộc số email. Mail của một user được
+// nạp lần đầu mailbox đó được dùng (email_iter_next, get_unread_email_count,
+// mark-all / delete-read) bằng cách đọc đúng các dòng trong manifest. Với
+// MAILSTORE_LAZY=prefetch, một process nền (fork từ process khởi tạo) nạp dần
+// các mailbox còn lại, mỗi lần một mailbox dưới store lock.
+//
+// Email nằm trong hai mailbox (người gửi và người nhận): khi nạp mailbox thứ
+// hai, email có bên kia đã LAZY_LOADED được bỏ qua. Thao tác cần cả store
+// (lưu emails.txt, backup, lưu nền, tìm theo ID không thấy, export, snapshot
+// của replica / standby) gọi lazy_load_all trước. Việc nạp không đi qua change
+// log: mỗi lần nạp tăng lazy.generation, replica và standby so với mức lúc
+// copy và copy lại toàn bộ khi đổi. Journal cần store đầy đủ để áp record,
+// tier cần nó để bỏ bản trùng trong file cold, nên khi bật journal hoặc tier
+// init_shared_memory nạp như cũ.
+
+static int mailbox_state(SharedMemoryData* shm_ptr, int user_id) {
+    int slot = user_slot_of(shm_ptr, user_id);
+    if (slot < 0 || shm_ptr->lazy.mailboxes[slot].user_id != user_id) {
+        return LAZY_NONE;
+    }
+    return shm_ptr->lazy.mailboxes[slot].state;
+}
+
+// Email đã nằm trong segment nếu mailbox của bên kia đã được nạp
+static int already_loaded(SharedMemoryData* shm_ptr, const Email* email, int user_id) {
+    if (email->sender_id != user_id && mailbox_state(shm_ptr, email->sender_id) == LAZY_LOADED) {
+        return 1;
+    }
+    return email->receiver_id != user_id && mailbox_state(shm_ptr, email->receiver_id) == LAZY_LOADED;
+}
+
+// Copy email vào slot trống tiếp theo từ *cursor
+static int insert_email(SharedMemoryData* shm_ptr, const Email* email, int* cursor) {
+    while (*cursor < MAX_EMAILS && shm_ptr->emails[*cursor].email_id != 0 &&
+           !shm_ptr->emails[*cursor].is_deleted) {
+        (*cursor)++;
+    }
+    if (*cursor == MAX_EMAILS) {
+        return MS_ERR_FULL;
+    }
+    
+    shm_ptr->emails[*cursor] = *email;
+    if (*cursor >= shm_ptr->control.email_count) {
+        shm_ptr->control.email_count = *cursor + 1;
+    }
+    (*cursor)++;
+    shm_ptr->lazy.loaded++;
+    return MS_OK;
+}
+
+static int fault_in_locked(SharedMemoryData* shm_ptr, int slot);
+
+static void finish_load(SharedMemoryData* shm_ptr, long long start) {
+    __atomic_add_fetch(&shm_ptr->lazy.generation, 1, __ATOMIC_RELEASE);
+    shm_ptr->lazy.load_ns += stats_now() - start;
+}
+
+// Prefetch trong process cháu (fork hai lần để không để lại zombie): mapping
+// segment của nó độc lập với process khởi tạo, process đó có thể thoát trước.
+// Nhả khóa giữa hai mailbox để traffic và các lần nạp theo yêu cầu không phải
+// chờ cả store.
+static void start_prefetch(SharedMemoryData* shm_ptr) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+        return;
+    }
+    if (fork() != 0) {
+        _exit(0);
+    }
+    
+    for (int slot = 0; slot < MAX_USERS && __atomic_load_n(&shm_ptr->lazy.pending, __ATOMIC_ACQUIRE) > 0; slot++) {
+        if (shm_ptr->lazy.mailboxes[slot].state != LAZY_PENDING) {
+            continue;
+        }
+        lock_store();
+        fault_in_locked(shm_ptr, slot);
+        unlock_store();
+    }
+    _exit(0);
+}
+
+// Đọc header và manifest của emails.txt. Trả về số mailbox chờ nạp, hoặc
+// MS_ERR_NOT_FOUND / MS_ERR_CORRUPT khi file không có manifest (caller nạp
+// đầy đủ như cũ).
+int lazy_open(SharedMemoryData* shm_ptr, int prefetch) {
+    if (shm_ptr == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    FILE* file = fopen(EMAIL_DB_FILE, "r");
+    if (file == NULL) {
+        return MS_ERR_NOT_FOUND;
+    }
+    
+    char line[4096];
+    int next_email_id = 1;
+    unsigned long long modseq = 0;
+    unsigned int epoch = 0;
+    long data_offset = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "# NEXT_EMAIL_ID:", 16) == 0) {
+            sscanf(line + 16, "%d", &next_email_id);
+        } else if (strncmp(line, "# MODSEQ:", 9) == 0) {
+            sscanf(line + 9, "%llu", &modseq);
+        } else if (strncmp(line, "# JOURNAL_EPOCH:", 16) == 0) {
+            sscanf(line + 16, "%u", &epoch);
+        } else if (line[0] != '#') {
+            break;
+        }
+        data_offset = ftell(file);
+    }
+    
+    // Dòng cuối: "# MANIFEST: offset"
+    long manifest_at = -1;
+    if (fseek(file, -64, SEEK_END) != 0) {
+        fseek(file, 0, SEEK_SET);
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "# MANIFEST:", 11) == 0) {
+            manifest_at = atol(line + 11);
+        }
+    }
+    if (manifest_at < 0 || fseek(file, manifest_at, SEEK_SET) != 0) {
+        fclose(file);
+        return MS_ERR_CORRUPT;
+    }
+    
+    LazyState* lazy = &shm_ptr->lazy;
+    memset(lazy, 0, sizeof(LazyState));
+    while (fgets(line, sizeof(line), file)) {
+        int user_id, count, lines;
+        long long offsets_at;
+        if (sscanf(line, "# MAILBOX: %d|%d|%lld|%d", &user_id, &count, &offsets_at, &lines) != 4) {
+            continue;
+        }
+        int slot = user_slot_of(shm_ptr, user_id);
+        if (slot < 0) {
+            continue;
+        }
+        LazyMailbox* mailbox = &lazy->mailboxes[slot];
+        mailbox->state = LAZY_PENDING;
+        mailbox->user_id = user_id;
+        mailbox->count = count;
+        mailbox->lines = lines;
+        mailbox->offsets_at = offsets_at;
+        lazy->pending++;
+    }
+    fclose(file);
+    
+    shm_ptr->control.email_count = 0;
+    shm_ptr->control.next_email_id = next_email_id;
+    shm_ptr->changelog.highest_modseq = modseq;
+    shm_ptr->changelog.base_modseq = modseq;
+    shm_ptr->changelog.persisted_modseq = modseq;
+    shm_ptr->journal.epoch = epoch;
+    lazy->data_offset = data_offset;
+    lazy->enabled = 1;
+    
+    if (prefetch && lazy->pending > 0) {
+        start_prefetch(shm_ptr);
+    }
+    return lazy->pending;
+}
+
+// Nạp mail của một mailbox theo manifest (caller giữ store lock)
+static int fault_in_locked(SharedMemoryData* shm_ptr, int slot) {
+    LazyMailbox* mailbox = &shm_ptr->lazy.mailboxes[slot];
+    if (mailbox->state != LAZY_PENDING) {
+        return 0;
+    }
+    
+    FILE* file = fopen(EMAIL_DB_FILE, "r");
+    if (file == NULL) {
+        return MS_ERR_IO;
+    }
+    
+    long long start = stats_now();
+    char line[4096];
+    char row[4096];
+    int cursor = 0;
+    int loaded = 0;
+    int status = MS_OK;
+    long long* offsets = malloc((size_t)mailbox->lines * LAZY_OFFSETS_PER_LINE * sizeof(long long));
+    int n = 0;
+    
+    if (offsets == NULL || fseek(file, mailbox->offsets_at, SEEK_SET) != 0) {
+        status = MS_ERR_IO;
+    }
+    for (int l = 0; status == MS_OK && l < mailbox->lines && fgets(line, sizeof(line), file); l++) {
+        int user_id;
+        int pos;
+        if (sscanf(line, "# OFFSETS: %d|%n", &user_id, &pos) != 1 || user_id != mailbox->user_id) {
+            status = MS_ERR_CORRUPT;
+            break;
+        }
+        char* saveptr;
+        for (char* token = strtok_r(line + pos, ",\n", &saveptr); token != NULL && n < mailbox->count;
+             token = strtok_r(NULL, ",\n", &saveptr)) {
+            offsets[n++] = atoll(token);
+        }
+    }
+    
+    for (int i = 0; status == MS_OK && i < n; i++) {
+        if (fseek(file, offsets[i], SEEK_SET) != 0 || fgets(row, sizeof(row), file) == NULL) {
+            status = MS_ERR_IO;
+            break;
+        }
+        Email email;
+        memset(&email, 0, sizeof(email));
+        parse_email_line(row, &email);
+        if (email.email_id <= 0 || email.is_deleted || already_loaded(shm_ptr, &email, mailbox->user_id)) {
+            continue;
+        }
+        status = insert_email(shm_ptr, &email, &cursor);
+        if (status == MS_OK) {
+            loaded++;
+        }
+    }
+    free(offsets);
+    fclose(file);
+    
+    // Lỗi đọc thì để lazy_load_all quét lại cả file lúc lưu
+    if (status == MS_OK) {
+        mailbox->state = LAZY_LOADED;
+        shm_ptr->lazy.pending--;
+        shm_ptr->lazy.faults++;
+    }
+    finish_load(shm_ptr, start);
+    return (status == MS_OK) ? loaded : status;
+}
+
+// Bảo đảm mail của user_id đã nằm trong segment (user_id <= 0: cả store).
+// Gọi được dù thread này có giữ store lock hay không. Trả về số email vừa nạp.
+int lazy_fault_in(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL || __atomic_load_n(&shm_ptr->lazy.pending, __ATOMIC_ACQUIRE) == 0) {
+        return 0;
+    }
+    if (user_id <= 0) {
+        return lazy_load_all(shm_ptr);
+    }
+    
+    int slot = user_slot_of(shm_ptr, user_id);
+    if (slot < 0 || shm_ptr->lazy.mailboxes[slot].state != LAZY_PENDING ||
+        shm_ptr->lazy.mailboxes[slot].user_id != user_id) {
+        return 0;
+    }
+    
+    int locked = store_lock_held();
+    if (!locked) {
+        lock_store();
+    }
+    int result = fault_in_locked(shm_ptr, slot);
+    if (!locked) {
+        unlock_store();
+    }
+    return result;
+}
+
+// Nạp mọi email còn lại bằng một lần quét emails.txt. Trả về số email vừa nạp.
+int lazy_load_all(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL || __atomic_load_n(&shm_ptr->lazy.pending, __ATOMIC_ACQUIRE) == 0) {
+        return 0;
+    }
+    
+    int locked = store_lock_held();
+    if (!locked) {
+        lock_store();
+    }
+    
+    LazyState* lazy = &shm_ptr->lazy;
+    int loaded = 0;
+    FILE* file = (lazy->pending > 0) ? fopen(EMAIL_DB_FILE, "r") : NULL;
+    if (file != NULL && fseek(file, lazy->data_offset, SEEK_SET) == 0) {
+        long long start = stats_now();
+        char line[4096];
+        int cursor = 0;
+        while (fgets(line, sizeof(line), file)) {
+            if (line[0] == '#' || strlen(line) <= 1) {
+                continue;
+            }
+            Email email;
+            memset(&email, 0, sizeof(email));
+            parse_email_line(line, &email);
+            if (email.email_id <= 0 || email.is_deleted || already_loaded(shm_ptr, &email, 0)) {
+                continue;
+            }
+            if (insert_email(shm_ptr, &email, &cursor) != MS_OK) {
+                break;
+            }
+            loaded++;
+        }
+        
+        for (int i = 0; i < MAX_USERS; i++) {
+            if (lazy->mailboxes[i].state == LAZY_PENDING) {
+                lazy->mailboxes[i].state = LAZY_LOADED;
+            }
+        }
+        lazy->pending = 0;
+        finish_load(shm_ptr, start);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    if (!locked) {
+        unlock_store();
+    }
+    return loaded;
+}
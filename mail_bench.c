@@ -0,0 +1,605 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// mail_bench: microbenchmark cho libmailstore. Chạy trên một store riêng
+// (calloc, không đụng shared memory của hệ thống) trong thư mục tạm, nên
+// save/load không ghi đè users.txt/emails.txt thật.
+//
+//   ./mail_bench [-u users] [-e emails] [-b body_bytes] [-n iterations]
+//                [-s seed] [-t] [-o results.json]
+//
+// -t: chạy thêm các thao tác quét toàn mảng trên bản copy của store đặt trên
+// trang 4KB và trên huge page, đếm dTLB miss bằng perf_event_open.
+
+#define BENCH_MAX_RESULTS 20
+#define BENCH_DEFAULT_ITERATIONS 100000
+#define BENCH_IO_DIVISOR 1000        // save/load chậm hơn nhiều: ít vòng hơn
+#define BENCH_MIN_IO_ITERATIONS 20
+
+typedef struct {
+    int users;
+    int emails;
+    int body_bytes;
+    int iterations;
+    unsigned int seed;
+    int tlb;
+    const char* json_path;
+} BenchConfig;
+
+typedef struct {
+    const char* name;
+    long ops;
+    double total_ns;
+    double ops_per_sec;
+    long long p50_ns;
+    long long p90_ns;
+    long long p99_ns;
+    long long max_ns;
+} BenchResult;
+
+static const char* g_words[] = {
+    "meeting", "report", "invoice", "holiday", "project", "review", "deadline",
+    "lunch", "update", "schedule", "budget", "release", "question", "urgent"
+};
+#define BENCH_WORD_COUNT ((int)(sizeof(g_words) / sizeof(g_words[0])))
+
+static BenchResult g_results[BENCH_MAX_RESULTS];
+static int g_result_count = 0;
+static long long* g_latencies = NULL;
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Gộp n latency đã đo thành một dòng kết quả
+static void record_result(const char* name, long n) {
+    if (n <= 0 || g_result_count >= BENCH_MAX_RESULTS) {
+        return;
+    }
+    
+    double total = 0;
+    for (long i = 0; i < n; i++) {
+        total += g_latencies[i];
+    }
+    qsort(g_latencies, n, sizeof(long long), compare_ll);
+    
+    BenchResult* r = &g_results[g_result_count++];
+    r->name = name;
+    r->ops = n;
+    r->total_ns = total;
+    r->ops_per_sec = (total > 0) ? n * 1e9 / total : 0;
+    r->p50_ns = g_latencies[(n - 1) * 50 / 100];
+    r->p90_ns = g_latencies[(n - 1) * 90 / 100];
+    r->p99_ns = g_latencies[(n - 1) * 99 / 100];
+    r->max_ns = g_latencies[n - 1];
+    
+    printf("%-24s %10ld %14.0f %10lld %10lld %10lld %12lld\n",
+           r->name, r->ops, r->ops_per_sec, r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns);
+}
+
+// ===== Data generator =====
+
+static void reset_store(SharedMemoryData* shm_ptr) {
+    memset(shm_ptr, 0, sizeof(SharedMemoryData));
+    shm_ptr->control.next_user_id = 1;
+    shm_ptr->control.next_email_id = 1;
+}
+
+static void reset_emails(SharedMemoryData* shm_ptr) {
+    memset(shm_ptr->emails, 0, sizeof(shm_ptr->emails));
+    memset(&shm_ptr->changelog, 0, sizeof(shm_ptr->changelog));
+    shm_ptr->control.email_count = 0;
+    shm_ptr->control.next_email_id = 1;
+}
+
+static void make_user_fields(int n, char* name, char* email, char* password) {
+    snprintf(name, MAX_NAME_LENGTH, "Bench User %d", n);
+    snprintf(email, MAX_EMAIL_LENGTH, "user%d@bench.local", n);
+    snprintf(password, MAX_PASSWORD_LENGTH, "pw%d", n);
+}
+
+static void make_subject(char* subject, unsigned int* seed) {
+    snprintf(subject, MAX_SUBJECT_LENGTH, "%s %s %d",
+             g_words[rand_r(seed) % BENCH_WORD_COUNT],
+             g_words[rand_r(seed) % BENCH_WORD_COUNT],
+             rand_r(seed) % 1000);
+}
+
+static void make_body(char* body, int size, unsigned int* seed) {
+    if (size >= MAX_CONTENT_LENGTH) {
+        size = MAX_CONTENT_LENGTH - 1;
+    }
+    
+    int len = 0;
+    while (len < size) {
+        const char* word = g_words[rand_r(seed) % BENCH_WORD_COUNT];
+        int wlen = strlen(word);
+        if (len + wlen + 1 > size) {
+            break;
+        }
+        memcpy(body + len, word, wlen);
+        len += wlen;
+        body[len++] = ' ';
+    }
+    while (len < size) {
+        body[len++] = 'x';
+    }
+    body[len] = '\0';
+}
+
+static void create_users(SharedMemoryData* shm_ptr, int count) {
+    char name[MAX_NAME_LENGTH], email[MAX_EMAIL_LENGTH], password[MAX_PASSWORD_LENGTH];
+    for (int i = 1; i <= count; i++) {
+        make_user_fields(i, name, email, password);
+        create_user(shm_ptr, name, email, password, 20 + i % 50);
+    }
+}
+
+static void create_emails(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    char subject[MAX_SUBJECT_LENGTH];
+    char* body = malloc(MAX_CONTENT_LENGTH);
+    
+    for (int i = 0; i < cfg->emails; i++) {
+        make_subject(subject, seed);
+        make_body(body, cfg->body_bytes, seed);
+        int sender = 1 + rand_r(seed) % cfg->users;
+        int receiver = 1 + rand_r(seed) % cfg->users;
+        int email_id = create_email(shm_ptr, sender, receiver, subject, body);
+        if (email_id > 0 && rand_r(seed) % 2) {
+            update_email_status(shm_ptr, email_id, 1);
+        }
+    }
+    free(body);
+}
+
+// Store đầy đủ theo cấu hình: cfg->users users, cfg->emails emails
+static void generate_store(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    reset_store(shm_ptr);
+    create_users(shm_ptr, cfg->users);
+    create_emails(shm_ptr, cfg, seed);
+}
+
+// ===== Benchmarks =====
+
+static void bench_create_user(SharedMemoryData* shm_ptr, const BenchConfig* cfg) {
+    char name[MAX_NAME_LENGTH], email[MAX_EMAIL_LENGTH], password[MAX_PASSWORD_LENGTH];
+    long n = 0;
+    
+    while (n < cfg->iterations) {
+        reset_store(shm_ptr);
+        for (int i = 1; i <= cfg->users && n < cfg->iterations; i++) {
+            make_user_fields(i, name, email, password);
+            long long start = now_ns();
+            create_user(shm_ptr, name, email, password, 30);
+            g_latencies[n++] = now_ns() - start;
+        }
+    }
+    record_result("create_user", n);
+}
+
+static void bench_find_user(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    char name[MAX_NAME_LENGTH], email[MAX_EMAIL_LENGTH], password[MAX_PASSWORD_LENGTH];
+    
+    for (long n = 0; n < cfg->iterations; n++) {
+        make_user_fields(1 + rand_r(seed) % cfg->users, name, email, password);
+        long long start = now_ns();
+        find_user_by_email(shm_ptr, email);
+        g_latencies[n] = now_ns() - start;
+    }
+    record_result("find_user_by_email", cfg->iterations);
+}
+
+static void bench_verify_user(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    char name[MAX_NAME_LENGTH], email[MAX_EMAIL_LENGTH], password[MAX_PASSWORD_LENGTH];
+    
+    for (long n = 0; n < cfg->iterations; n++) {
+        make_user_fields(1 + rand_r(seed) % cfg->users, name, email, password);
+        long long start = now_ns();
+        verify_user_credentials(shm_ptr, email, password);
+        g_latencies[n] = now_ns() - start;
+    }
+    record_result("verify_user_credentials", cfg->iterations);
+}
+
+static void bench_create_email(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    char subject[MAX_SUBJECT_LENGTH];
+    char* body = malloc(MAX_CONTENT_LENGTH);
+    make_subject(subject, seed);
+    make_body(body, cfg->body_bytes, seed);
+    long n = 0;
+    
+    while (n < cfg->iterations) {
+        reset_emails(shm_ptr);
+        for (int i = 0; i < cfg->emails && n < cfg->iterations; i++) {
+            int sender = 1 + rand_r(seed) % cfg->users;
+            int receiver = 1 + rand_r(seed) % cfg->users;
+            long long start = now_ns();
+            create_email(shm_ptr, sender, receiver, subject, body);
+            g_latencies[n++] = now_ns() - start;
+        }
+    }
+    free(body);
+    record_result("create_email", n);
+}
+
+static void bench_read_email(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    int max_id = shm_ptr->control.next_email_id - 1;
+    
+    for (long n = 0; n < cfg->iterations; n++) {
+        int email_id = 1 + rand_r(seed) % max_id;
+        long long start = now_ns();
+        read_email(shm_ptr, email_id);
+        g_latencies[n] = now_ns() - start;
+    }
+    record_result("read_email", cfg->iterations);
+}
+
+static void bench_unread_count(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    for (long n = 0; n < cfg->iterations; n++) {
+        int user_id = 1 + rand_r(seed) % cfg->users;
+        long long start = now_ns();
+        get_unread_email_count(shm_ptr, user_id);
+        g_latencies[n] = now_ns() - start;
+    }
+    record_result("get_unread_email_count", cfg->iterations);
+}
+
+// Cùng cách tìm như search_emails() của menu, không in kết quả
+static void bench_search(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed) {
+    volatile int sink = 0;
+    
+    for (long n = 0; n < cfg->iterations; n++) {
+        const char* keyword = g_words[rand_r(seed) % BENCH_WORD_COUNT];
+        long long start = now_ns();
+        sink += find_emails_matching(shm_ptr, 0, keyword, NULL, 0);
+        g_latencies[n] = now_ns() - start;
+    }
+    (void)sink;
+    record_result("search_emails", cfg->iterations);
+}
+
+static void bench_file_io(SharedMemoryData* shm_ptr, const BenchConfig* cfg) {
+    long iterations = cfg->iterations / BENCH_IO_DIVISOR;
+    if (iterations < BENCH_MIN_IO_ITERATIONS) {
+        iterations = BENCH_MIN_IO_ITERATIONS;
+    }
+    
+    struct {
+        const char* name;
+        int (*fn)(SharedMemoryData*);
+    } ops[] = {
+        { "save_users_to_file", save_users_to_file },
+        { "load_users_from_file", load_users_from_file },
+        { "save_emails_to_file", save_emails_to_file },
+        { "load_emails_from_file", load_emails_from_file },
+    };
+    
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+        for (long n = 0; n < iterations; n++) {
+            long long start = now_ns();
+            ops[k].fn(shm_ptr);
+            g_latencies[n] = now_ns() - start;
+        }
+        record_result(ops[k].name, iterations);
+    }
+}
+
+// ===== TLB: trang 4KB vs huge page =====
+
+typedef struct {
+    void* base;
+    size_t len;
+    SharedMemoryData* store;
+} StoreMapping;
+
+// Mapping riêng cho store. huge = 0: ép trang 4KB; huge = 1: thử MAP_HUGETLB,
+// không được thì THP trên vùng căn theo huge page.
+static int map_store(StoreMapping* map, int huge) {
+    size_t page = get_huge_page_size();
+    size_t size = (sizeof(SharedMemoryData) + page - 1) / page * page;
+    
+    if (huge) {
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            map->base = p;
+            map->len = size;
+            map->store = p;
+            return 0;
+        }
+    }
+    
+    map->len = size + page;
+    map->base = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map->base == MAP_FAILED) {
+        return -1;
+    }
+    uintptr_t aligned = ((uintptr_t)map->base + page - 1) & ~(uintptr_t)(page - 1);
+    map->store = (SharedMemoryData*)aligned;
+    madvise(map->store, size, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    return 0;
+}
+
+// Bộ đếm dTLB load miss của process này (user space), -1 nếu kernel không cho
+static int open_dtlb_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long read_counter(int fd) {
+    long long value = 0;
+    if (fd == -1 || read(fd, &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+        return -1;
+    }
+    return value;
+}
+
+// Chạy get_unread_email_count và search (quét toàn mảng) trên store; trả về
+// dTLB miss/op của từng thao tác vào misses[2] (-1 nếu không đo được)
+static void run_scans(SharedMemoryData* shm_ptr, const BenchConfig* cfg, unsigned int* seed,
+                      const char* suffix, double misses[2]) {
+    static char names[4][48];
+    static int next_name = 0;
+    int counter = open_dtlb_counter();
+    
+    for (int k = 0; k < 2; k++) {
+        long long before = read_counter(counter);
+        if (counter != -1) {
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        
+        volatile int sink = 0;
+        for (long n = 0; n < cfg->iterations; n++) {
+            long long start = now_ns();
+            if (k == 0) {
+                sink += get_unread_email_count(shm_ptr, 1 + rand_r(seed) % cfg->users);
+            } else {
+                sink += find_emails_matching(shm_ptr, 0, g_words[rand_r(seed) % BENCH_WORD_COUNT], NULL, 0);
+            }
+            g_latencies[n] = now_ns() - start;
+        }
+        (void)sink;
+        
+        if (counter != -1) {
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        long long after = read_counter(counter);
+        misses[k] = (before >= 0 && after >= 0) ? (double)(after - before) / cfg->iterations : -1;
+        
+        char* name = names[next_name++ % 4];
+        snprintf(name, sizeof(names[0]), "%s/%s", k == 0 ? "scan_unread" : "scan_search", suffix);
+        record_result(name, cfg->iterations);
+    }
+    if (counter != -1) {
+        close(counter);
+    }
+}
+
+static void bench_tlb(const SharedMemoryData* source, const BenchConfig* cfg, unsigned int* seed) {
+    const char* labels[2] = { "4k", "huge" };
+    double misses[2][2];
+    size_t page_kb[2] = { 0, 0 };
+    
+    for (int huge = 0; huge < 2; huge++) {
+        StoreMapping map;
+        if (map_store(&map, huge) != 0) {
+            perror("mail_bench: mmap");
+            misses[huge][0] = misses[huge][1] = -1;
+            continue;
+        }
+        memcpy(map.store, source, sizeof(SharedMemoryData));
+        
+        PageInfo pages;
+        if (get_page_info(map.store, &pages) == MS_OK) {
+            page_kb[huge] = (pages.huge_bytes >= sizeof(SharedMemoryData) / 2)
+                            ? get_huge_page_size() / 1024 : pages.page_size / 1024;
+        }
+        
+        unsigned int scan_seed = *seed;   // cùng chuỗi thao tác cho cả hai
+        run_scans(map.store, cfg, &scan_seed, labels[huge], misses[huge]);
+        munmap(map.base, map.len);
+    }
+    
+    printf("\ndTLB load misses per op (user space):\n");
+    printf("%-10s %10s %14s %14s\n", "backing", "page KB", "scan_unread", "scan_search");
+    for (int huge = 0; huge < 2; huge++) {
+        printf("%-10s %10zu", labels[huge], page_kb[huge]);
+        for (int k = 0; k < 2; k++) {
+            if (misses[huge][k] < 0) {
+                printf(" %14s", "n/a");
+            } else {
+                printf(" %14.1f", misses[huge][k]);
+            }
+        }
+        printf("\n");
+    }
+    if (misses[0][0] < 0) {
+        printf("(perf_event_open not permitted: check kernel.perf_event_paranoid)\n");
+    }
+}
+
+// ===== Output =====
+
+static int write_json(const BenchConfig* cfg, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    
+    fprintf(file, "{\n");
+    fprintf(file, "  \"benchmark\": \"mailstore\",\n");
+    fprintf(file, "  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(file, "  \"config\": {\"users\": %d, \"emails\": %d, \"body_bytes\": %d, "
+                  "\"iterations\": %d, \"seed\": %u},\n",
+            cfg->users, cfg->emails, cfg->body_bytes, cfg->iterations, cfg->seed);
+    fprintf(file, "  \"results\": [\n");
+    for (int i = 0; i < g_result_count; i++) {
+        BenchResult* r = &g_results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ops\": %ld, \"ops_per_sec\": %.1f, "
+                      "\"p50_ns\": %lld, \"p90_ns\": %lld, \"p99_ns\": %lld, \"max_ns\": %lld}%s\n",
+                r->name, r->ops, r->ops_per_sec, r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns,
+                (i + 1 < g_result_count) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+// Làm việc trong thư mục tạm để save/load không đụng database thật
+static int enter_temp_dir(char* dir, size_t size) {
+    snprintf(dir, size, "/tmp/mail_bench.XXXXXX");
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        perror("mail_bench: temp dir");
+        return -1;
+    }
+    return 0;
+}
+
+static void leave_temp_dir(const char* dir, const char* cwd) {
+    unlink(USER_DB_FILE);
+    unlink(EMAIL_DB_FILE);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-u users] [-e emails] [-b body_bytes] [-n iterations] "
+                    "[-s seed] [-t] [-o results.json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg = {
+        .users = MAX_USERS,
+        .emails = MAX_EMAILS,
+        .body_bytes = 500,
+        .iterations = BENCH_DEFAULT_ITERATIONS,
+        .seed = 42,
+        .tlb = 0,
+        .json_path = NULL,
+    };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "u:e:b:n:s:to:")) != -1) {
+        switch (opt) {
+            case 'u':
+                cfg.users = atoi(optarg);
+                break;
+            case 'e':
+                cfg.emails = atoi(optarg);
+                break;
+            case 'b':
+                cfg.body_bytes = atoi(optarg);
+                break;
+            case 'n':
+                cfg.iterations = atoi(optarg);
+                break;
+            case 's':
+                cfg.seed = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                cfg.tlb = 1;
+                break;
+            case 'o':
+                cfg.json_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    if (cfg.users < 1 || cfg.users > MAX_USERS || cfg.emails < 1 || cfg.emails > MAX_EMAILS ||
+        cfg.body_bytes < 0 || cfg.body_bytes >= MAX_CONTENT_LENGTH || cfg.iterations < 1) {
+        fprintf(stderr, "mail_bench: users 1..%d, emails 1..%d, body_bytes 0..%d, iterations >= 1\n",
+                MAX_USERS, MAX_EMAILS, MAX_CONTENT_LENGTH - 1);
+        return 1;
+    }
+    
+    SharedMemoryData* shm_ptr = calloc(1, sizeof(SharedMemoryData));
+    g_latencies = malloc(sizeof(long long) * cfg.iterations);
+    if (shm_ptr == NULL || g_latencies == NULL) {
+        fprintf(stderr, "mail_bench: out of memory\n");
+        return 1;
+    }
+    
+    // Đường dẫn JSON tương đối tính theo thư mục gốc, không phải thư mục tạm
+    char cwd[4096], temp_dir[64], json_path[4096 + 256];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    if (cfg.json_path != NULL) {
+        if (cfg.json_path[0] == '/') {
+            snprintf(json_path, sizeof(json_path), "%s", cfg.json_path);
+        } else {
+            snprintf(json_path, sizeof(json_path), "%s/%s", cwd, cfg.json_path);
+        }
+    }
+    if (enter_temp_dir(temp_dir, sizeof(temp_dir)) != 0) {
+        return 1;
+    }
+    
+    printf("mail_bench: %d users, %d emails, %d-byte bodies, %d iterations (seed %u)\n\n",
+           cfg.users, cfg.emails, cfg.body_bytes, cfg.iterations, cfg.seed);
+    printf("%-24s %10s %14s %10s %10s %10s %12s\n",
+           "operation", "ops", "ops/sec", "p50 ns", "p90 ns", "p99 ns", "max ns");
+    printf("--------------------------------------------------------------------------------------------------\n");
+    
+    unsigned int seed = cfg.seed;
+    bench_create_user(shm_ptr, &cfg);
+    
+    generate_store(shm_ptr, &cfg, &seed);
+    bench_find_user(shm_ptr, &cfg, &seed);
+    bench_verify_user(shm_ptr, &cfg, &seed);
+    bench_create_email(shm_ptr, &cfg, &seed);
+    
+    generate_store(shm_ptr, &cfg, &seed);
+    bench_read_email(shm_ptr, &cfg, &seed);
+    bench_unread_count(shm_ptr, &cfg, &seed);
+    bench_search(shm_ptr, &cfg, &seed);
+    bench_file_io(shm_ptr, &cfg);
+    if (cfg.tlb) {
+        generate_store(shm_ptr, &cfg, &seed);
+        bench_tlb(shm_ptr, &cfg, &seed);
+    }
+    
+    leave_temp_dir(temp_dir, cwd);
+    
+    int rc = 0;
+    if (cfg.json_path != NULL) {
+        if (write_json(&cfg, json_path) == 0) {
+            printf("\nResults written to %s\n", cfg.json_path);
+        } else {
+            fprintf(stderr, "mail_bench: cannot write %s: %s\n", cfg.json_path, strerror(errno));
+            rc = 1;
+        }
+    }
+    
+    free(g_latencies);
+    free(shm_ptr);
+    return rc;
+}
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include "mail_system.h"
+#include <signal.h>
+
+// mail_deliveryd: process duy nhất ghi mail mới vào shared memory.
+// Client (mail_system) chỉ đẩy SendRequest vào hàng đợi, daemon lấy theo
+// batch, tạo email dưới store lock và lưu file một lần cho cả batch.
+
+static volatile sig_atomic_t g_running = 1;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+static int apply_batch(SharedMemoryData* shm_ptr, SendRequest* batch, int n) {
+    int delivered = 0;
+    
+    lock_store();
+    for (int i = 0; i < n; i++) {
+        int email_id = create_email(shm_ptr, batch[i].sender_id, batch[i].receiver_id,
+                                    batch[i].subject, batch[i].content);
+        if (email_id > 0) {
+            delivered++;
+        } else {
+            fprintf(stderr, "mail_deliveryd: rejected request from user %d to user %d\n",
+                    batch[i].sender_id, batch[i].receiver_id);
+        }
+    }
+    shm_ptr->queue.delivered += delivered;
+    shm_ptr->queue.rejected += n - delivered;
+    
+    if (delivered > 0) {
+        start_background_save(shm_ptr, BGSAVE_EMAILS);
+    }
+    unlock_store();
+    
+    return delivered;
+}
+
+int main() {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);   // không đặt SA_RESTART để semop bị ngắt
+    sigaction(SIGTERM, &sa, NULL);
+    
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        printf("Failed to attach to shared memory!\n");
+        return 1;
+    }
+    
+    init_shared_memory(shm_ptr);
+    
+    if (open_mail_semaphores() < 0) {
+        detach_shared_memory(shm_ptr);
+        return 1;
+    }
+    
+    // Kiểm tra và ghi pid trong cùng một lần giữ khóa: hai daemon khởi động
+    // cùng lúc không thể cùng thấy "chưa chạy"
+    lock_store();
+    if (is_delivery_daemon_running(shm_ptr) && shm_ptr->control.deliveryd_pid != getpid()) {
+        int running = shm_ptr->control.deliveryd_pid;
+        unlock_store();
+        printf("mail_deliveryd already running (PID %d)\n", running);
+        detach_shared_memory(shm_ptr);
+        return 1;
+    }
+    shm_ptr->control.deliveryd_pid = getpid();
+    unlock_store();
+    
+    printf("mail_deliveryd started (PID %d). Press Ctrl+C to exit.\n", getpid());
+    
+    SendRequest batch[DELIVERY_BATCH_SIZE];
+    while (g_running) {
+        int n = dequeue_send_batch(shm_ptr, batch, DELIVERY_BATCH_SIZE);
+        poll_background_save();
+        if (n <= 0) {
+            continue;
+        }
+        
+        int delivered = apply_batch(shm_ptr, batch, n);
+        printf("Delivered %d/%d queued emails (pending: %d)\n",
+               delivered, n, shm_ptr->queue.count);
+    }
+    
+    printf("\nmail_deliveryd stopping...\n");
+    shm_ptr->control.deliveryd_pid = 0;
+    
+    // Client thấy pid = 0 sẽ tự gửi trực tiếp; xử lý nốt các request còn
+    // lại trong hàng đợi trước khi thoát.
+    while (shm_ptr->queue.count > 0) {
+        int n = dequeue_send_batch(shm_ptr, batch, DELIVERY_BATCH_SIZE);
+        if (n <= 0) {
+            break;
+        }
+        apply_batch(shm_ptr, batch, n);
+    }
+    wait_background_saves();
+    
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <fcntl.h>
+
+// mail_export: xuất mail ra mbox (mboxrd) cho một user, một khoảng ngày hoặc
+// cả store. Ghi theo luồng qua export_mbox nên bộ nhớ cố định và store lock
+// chỉ bị giữ trong lúc copy từng chunk nhỏ.
+//
+//   ./mail_export [-u user@email] [-t received|sent|both] [-s YYYY-MM-DD]
+//                 [-e YYYY-MM-DD] [-o out.mbox]
+
+// "YYYY-MM-DD" (UTC) -> time_t, -1 nếu sai định dạng
+static time_t parse_day(const char* s) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* rest = strptime(s, "%Y-%m-%d", &tm);
+    if (rest == NULL || *rest != '\0') {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-u user@email] [-t received|sent|both] [-s YYYY-MM-DD] "
+                    "[-e YYYY-MM-DD] [-o out.mbox]\n", prog);
+    fprintf(stderr, "  -s/-e: sent_at in [start day, end day] (UTC, end day inclusive)\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* user_email = NULL;
+    const char* out_path = NULL;
+    ExportFilter filter = { 0, MAILBOX_BOTH, 0, 0 };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "u:t:s:e:o:")) != -1) {
+        switch (opt) {
+            case 'u':
+                user_email = optarg;
+                break;
+            case 't':
+                if (strcmp(optarg, "received") == 0) {
+                    filter.type = MAILBOX_RECEIVED;
+                } else if (strcmp(optarg, "sent") == 0) {
+                    filter.type = MAILBOX_SENT;
+                } else if (strcmp(optarg, "both") == 0) {
+                    filter.type = MAILBOX_BOTH;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                filter.since = parse_day(optarg);
+                if (filter.since < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'e':
+                filter.until = parse_day(optarg);
+                if (filter.until < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                filter.until += 24 * 3600;
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "mail_export: failed to attach to shared memory\n");
+        return 1;
+    }
+    init_shared_memory(shm_ptr);
+    
+    if (user_email != NULL) {
+        User* user = find_user_by_email(shm_ptr, user_email);
+        if (user == NULL) {
+            fprintf(stderr, "mail_export: no user with email %s\n", user_email);
+            detach_shared_memory(shm_ptr);
+            return 1;
+        }
+        filter.user_id = user->user_id;
+    }
+    
+    int fd = STDOUT_FILENO;
+    if (out_path != NULL) {
+        fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1) {
+            perror(out_path);
+            detach_shared_memory(shm_ptr);
+            return 1;
+        }
+    }
+    
+    long long start = stats_now();
+    long long bytes = 0;
+    int exported = export_mbox(shm_ptr, fd, &filter, &bytes);
+    double elapsed = (stats_now() - start) / 1e9;
+    
+    if (out_path != NULL && close(fd) != 0 && exported >= 0) {
+        exported = MS_ERR_IO;
+    }
+    detach_shared_memory(shm_ptr);
+    
+    if (exported < 0) {
+        fprintf(stderr, "mail_export: %s\n", mailstore_strerror(exported));
+        return 1;
+    }
+    fprintf(stderr, "Exported %d emails (%.1f KB) in %.3f s%s%s\n",
+            exported, bytes / 1024.0, elapsed, out_path ? " to " : "", out_path ? out_path : "");
+    return 0;
+}
@@ -1,5 +1,82 @@
 #include "mail_system.h"
 
+// Global variable to track logged-in user
+static int g_current_user_id = -1;
+
+// Authentication helper functions
+int is_user_logged_in() {
+    return g_current_user_id > 0;
+}
+
+int get_current_user_id() {
+    return g_current_user_id;
+}
+
+void logout_user() {
+    g_current_user_id = -1;
+    printf("Logged out successfully!\n");
+}
+
+void show_login_menu() {
+    printf("\n" "===============================================\n");
+    printf("      MAIL SYSTEM - LOGIN/REGISTER\n");
+    printf("===============================================\n");
+    printf("1. Login\n");
+    printf("2. Register New Account\n");
+    printf("3. Exit\n");
+    printf("===============================================\n");
+}
+
+int handle_authentication(SharedMemoryData* shm_ptr) {
+    int choice;
+    
+    while (1) {
+        clear_screen();
+        show_login_menu();
+        choice = get_user_choice();
+        
+        switch (choice) {
+            case 1: {
+                // Login
+                char email[MAX_EMAIL_LENGTH];
+                char password[MAX_PASSWORD_LENGTH];
+                
+                printf("\n=== LOGIN ===\n");
+                printf("Email: ");
+                fgets(email, sizeof(email), stdin);
+                email[strcspn(email, "\n")] = 0;
+                
+                printf("Password: ");
+                fgets(password, sizeof(password), stdin);
+                password[strcspn(password, "\n")] = 0;
+                
+                User* user = verify_user_credentials(shm_ptr, email, password);
+                if (user != NULL) {
+                    g_current_user_id = user->user_id;
+                    printf("\nLogin successful! Welcome, %s!\n", user->name);
+                    pause_system();
+                    return 1;
+                } else {
+                    printf("\nInvalid email or password!\n");
+                    pause_system();
+                }
+                break;
+            }
+            case 2: {
+                // Register
+                register_user(shm_ptr);
+                pause_system();
+                break;
+            }
+            case 3:
+                return 0;
+            default:
+                printf("Invalid choice! Please try again.\n");
+                pause_system();
+        }
+    }
+}
+
 void compose_mail(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
         printf("Error: Shared memory not available\n");
@@ -55,13 +132,31 @@ void compose_mail(SharedMemoryData* shm_ptr) {
         }
     }
     
+    // Span trace tính từ lúc nhập xong (gồm cả thời gian chờ store lock)
+    long long start = stats_now();
+    
+    // Có mail_deliveryd thì chỉ đẩy vào hàng đợi, daemon lo ghi và lưu file
+    if (is_delivery_daemon_running(shm_ptr)) {
+        int pending = enqueue_send_request(shm_ptr, sender->user_id, receiver->user_id, subject, content);
+        if (pending > 0) {
+            printf("Email queued for delivery (%d pending)\n", pending);
+        } else {
+            printf("Failed to send email!\n");
+        }
+        TRACE_OP(shm_ptr, TRACE_COMPOSE_MAIL, start, sender->user_id, receiver->user_id, pending);
+        return;
+    }
+    
+    lock_store();
     int email_id = create_email(shm_ptr, sender->user_id, receiver->user_id, subject, content);
     if (email_id > 0) {
         printf("Email sent successfully! Email ID: %d\n", email_id);
-        save_emails_to_file(shm_ptr);
+        start_background_save(shm_ptr, BGSAVE_EMAILS);
     } else {
-        printf("Failed to send email!\n");
+        printf("Failed to send email: %s\n", mailstore_strerror(email_id));
     }
+    unlock_store();
+    TRACE_OP(shm_ptr, TRACE_COMPOSE_MAIL, start, sender->user_id, receiver->user_id, email_id);
 }
 
 void view_sent_mails(SharedMemoryData* shm_ptr) {
@@ -87,24 +182,23 @@ void view_sent_mails(SharedMemoryData* shm_ptr) {
     printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "To", "Subject", "Sent", "Status");
     printf("-------------------------------------------------------------------------------------\n");
     
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted && email->sender_id == user->user_id) {
-            User* receiver = read_user(shm_ptr, email->receiver_id);
-            
-            char sent_time[20];
-            struct tm* tm_info = localtime(&email->sent_at);
-            strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20s %-30.30s %-20s %-10s\n", 
-                   email->email_id,
-                   receiver ? receiver->email : "Unknown",
-                   email->subject,
-                   sent_time,
-                   email->is_read ? "Read" : "Unread");
-            count++;
-        }
+    // Danh sách lấy từ cache view (mailbox_cache.c), chỉ dựng lại khi mailbox đổi
+    const MailboxRow* rows = NULL;
+    int count = mailbox_view(shm_ptr, user->user_id, MAILBOX_SENT, &rows);
+    if (count < 0) {
+        count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        char sent_time[20];
+        struct tm* tm_info = localtime(&rows[i].sent_at);
+        strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20s %-30.30s %-20s %-10s\n", 
+               rows[i].email_id,
+               rows[i].peer,
+               rows[i].subject,
+               sent_time,
+               rows[i].is_read ? "Read" : "Unread");
     }
     
     if (count == 0) {
@@ -178,24 +272,23 @@ void view_received_mails(SharedMemoryData* shm_ptr) {
     printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "From", "Subject", "Received", "Status");
     printf("-------------------------------------------------------------------------------------\n");
     
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted && email->receiver_id == user->user_id) {
-            User* sender = read_user(shm_ptr, email->sender_id);
-            
-            char received_time[20];
-            struct tm* tm_info = localtime(&email->sent_at);
-            strftime(received_time, sizeof(received_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20s %-30.30s %-20s %-10s\n", 
-                   email->email_id,
-                   sender ? sender->email : "Unknown",
-                   email->subject,
-                   received_time,
-                   email->is_read ? "Read" : "Unread");
-            count++;
-        }
+    // Danh sách lấy từ cache view (mailbox_cache.c), chỉ dựng lại khi mailbox đổi
+    const MailboxRow* rows = NULL;
+    int count = mailbox_view(shm_ptr, user->user_id, MAILBOX_RECEIVED, &rows);
+    if (count < 0) {
+        count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        char received_time[20];
+        struct tm* tm_info = localtime(&rows[i].sent_at);
+        strftime(received_time, sizeof(received_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20s %-30.30s %-20s %-10s\n", 
+               rows[i].email_id,
+               rows[i].peer,
+               rows[i].subject,
+               received_time,
+               rows[i].is_read ? "Read" : "Unread");
     }
     
     if (count == 0) {
@@ -244,9 +337,11 @@ void view_received_mails(SharedMemoryData* shm_ptr) {
             printf("────────────────────────────────────────────────────────\n\n");
             
             if (!email->is_read) {
+                lock_store();
                 update_email_status(shm_ptr, email_id, 1);
                 printf("✓ Email marked as read.\n");
-                save_emails_to_file(shm_ptr);
+                start_background_save(shm_ptr, BGSAVE_EMAILS);
+                unlock_store();
             }
         }
     }
@@ -264,29 +359,31 @@ void search_emails(SharedMemoryData* shm_ptr) {
     fgets(keyword, sizeof(keyword), stdin);
     keyword[strcspn(keyword, "\n")] = 0;
     
+    print_search_results(shm_ptr, keyword);
+}
+
+// In kết quả tìm kiếm trên toàn bộ email (cũng dùng cho ./mail_system --report)
+void print_search_results(SharedMemoryData* shm_ptr, const char* keyword) {
     printf("\nSearch results for '%s':\n", keyword);
     printf("%-5s %-20s %-20s %-30s %-10s\n", "ID", "From", "To", "Subject", "Status");
     printf("-------------------------------------------------------------------------------------\n");
     
-    int count = 0;
-    for (int i = 0; i < shm_ptr->control.email_count; i++) {
-        Email* email = &shm_ptr->emails[i];
-        if (!email->is_deleted) {
-            if (strstr(email->subject, keyword) != NULL || 
-                strstr(email->content, keyword) != NULL) {
-                
-                User* sender = read_user(shm_ptr, email->sender_id);
-                User* receiver = read_user(shm_ptr, email->receiver_id);
-                
-                printf("%-5d %-20s %-20s %-30.30s %-10s\n", 
-                       email->email_id,
-                       sender ? sender->email : "Unknown",
-                       receiver ? receiver->email : "Unknown",
-                       email->subject,
-                       email->is_read ? "Read" : "Unread");
-                count++;
-            }
+    int ids[MAX_EMAILS];
+    int count = find_emails_matching(shm_ptr, 0, keyword, ids, MAX_EMAILS);
+    for (int i = 0; i < count && i < MAX_EMAILS; i++) {
+        Email* email = read_email(shm_ptr, ids[i]);
+        if (email == NULL) {
+            continue;            // vừa bị xóa
         }
+        User* sender = read_user(shm_ptr, email->sender_id);
+        User* receiver = read_user(shm_ptr, email->receiver_id);
+        
+        printf("%-5d %-20s %-20s %-30.30s %-10s\n", 
+               email->email_id,
+               sender ? sender->email : "Unknown",
+               receiver ? receiver->email : "Unknown",
+               email->subject,
+               email->is_read ? "Read" : "Unread");
     }
     
     if (count == 0) {
@@ -296,6 +393,35 @@ void search_emails(SharedMemoryData* shm_ptr) {
     }
 }
 
+void wait_for_new_mail(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    if (!is_user_logged_in()) {
+        printf("Error: User not logged in\n");
+        return;
+    }
+    
+    int user_id = get_current_user_id();
+    unsigned int seen = get_mailbox_event_seq(shm_ptr, user_id);
+    
+    printf("\n=== WAITING FOR NEW MAIL ===\n");
+    printf("Unread: %d. Waiting up to %d seconds...\n",
+           get_unread_email_count(shm_ptr, user_id), NEW_MAIL_WAIT_SECONDS);
+    fflush(stdout);
+    
+    int rc = wait_for_mailbox_event(shm_ptr, user_id, seen, NEW_MAIL_WAIT_SECONDS * 1000);
+    if (rc > 0) {
+        printf("📬 New mail arrived! Unread: %d\n", get_unread_email_count(shm_ptr, user_id));
+    } else if (rc == 0) {
+        printf("No new mail.\n");
+    } else {
+        printf("Stopped waiting.\n");
+    }
+}
+
 void delete_mail(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
         printf("Error: Shared memory not available\n");
@@ -328,12 +454,14 @@ void delete_mail(SharedMemoryData* shm_ptr) {
     getchar(); // Clear buffer
     
     if (confirm == 'y' || confirm == 'Y') {
-        if (delete_email(shm_ptr, email_id)) {
+        lock_store();
+        if (delete_email(shm_ptr, email_id) == MS_OK) {
             printf("Email deleted successfully!\n");
-            save_emails_to_file(shm_ptr);
+            start_background_save(shm_ptr, BGSAVE_EMAILS);
         } else {
             printf("Failed to delete email!\n");
         }
+        unlock_store();
     } else {
         printf("Email deletion cancelled.\n");
     }
@@ -360,9 +488,14 @@ void reply_mail(SharedMemoryData* shm_ptr) {
     User* original_sender = read_user(shm_ptr, original_email->sender_id);
     User* receiver = read_user(shm_ptr, original_email->receiver_id);
     
+    // Tài khoản người gửi (hoặc người nhận) gốc có thể đã bị xóa
+    if (original_sender == NULL || receiver == NULL) {
+        printf("Cannot reply: %s\n", mailstore_strerror(MS_ERR_NOT_FOUND));
+        return;
+    }
+    
     printf("\nReplying to:\n");
-    printf("From: %s <%s>\n", original_sender ? original_sender->name : "Unknown", 
-           original_sender ? original_sender->email : "unknown");
+    printf("From: %s <%s>\n", original_sender->name, original_sender->email);
     printf("Subject: %s\n", original_email->subject);
     
     char content[MAX_CONTENT_LENGTH];
@@ -389,12 +522,454 @@ void reply_mail(SharedMemoryData* shm_ptr) {
         snprintf(reply_subject, sizeof(reply_subject), "Re: %s", original_email->subject);
     }
     
+    if (is_delivery_daemon_running(shm_ptr)) {
+        int pending = enqueue_send_request(shm_ptr, receiver->user_id, original_email->sender_id,
+                                           reply_subject, content);
+        if (pending > 0) {
+            printf("Reply queued for delivery (%d pending)\n", pending);
+        } else {
+            printf("Failed to send reply!\n");
+        }
+        return;
+    }
+    
+    lock_store();
     int reply_id = create_email(shm_ptr, receiver->user_id, original_email->sender_id, 
                                reply_subject, content);
     if (reply_id > 0) {
         printf("Reply sent successfully! Email ID: %d\n", reply_id);
-        save_emails_to_file(shm_ptr);
+        start_background_save(shm_ptr, BGSAVE_EMAILS);
+    } else {
+        printf("Failed to send reply: %s\n", mailstore_strerror(reply_id));
+    }
+    unlock_store();
+}
+
+void display_all_users(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    printf("\n=== ALL USERS ===\n");
+    printf("%-5s %-20s %-30s %-5s %-20s\n", "ID", "Name", "Email", "Age", "Created");
+    printf("--------------------------------------------------------------------------------\n");
+    
+    int count = 0;
+    UserIterator it;
+    user_iter_init(&it);
+    User* user;
+    while ((user = user_iter_next(shm_ptr, &it)) != NULL) {
+        char created_time[20];
+        struct tm* tm_info = localtime(&user->created_at);
+        strftime(created_time, sizeof(created_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20.20s %-30.30s %-5d %-20s\n", 
+               user->user_id, user->name, user->email, user->age, created_time);
+        count++;
+    }
+    
+    if (count == 0) {
+        printf("No users found.\n");
+    } else {
+        printf("\nTotal: %d users\n", count);
+    }
+}
+
+void search_users(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    char keyword[100];
+    printf("\n=== SEARCH USERS ===\n");
+    printf("Enter search keyword (name or email): ");
+    fgets(keyword, sizeof(keyword), stdin);
+    keyword[strcspn(keyword, "\n")] = 0;
+    
+    printf("\nSearch results for '%s':\n", keyword);
+    printf("%-5s %-20s %-30s %-5s\n", "ID", "Name", "Email", "Age");
+    printf("----------------------------------------------------------------\n");
+    
+    int count = 0;
+    UserIterator it;
+    user_iter_init(&it);
+    User* user;
+    while ((user = user_iter_next(shm_ptr, &it)) != NULL) {
+        if (strstr(user->name, keyword) != NULL || 
+            strstr(user->email, keyword) != NULL) {
+            printf("%-5d %-20.20s %-30.30s %-5d\n", 
+                   user->user_id, user->name, user->email, user->age);
+            count++;
+        }
+    }
+    
+    if (count == 0) {
+        printf("No users found matching '%s'.\n", keyword);
+    } else {
+        printf("\nFound %d users\n", count);
+    }
+}
+
+void register_user(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_EMAIL_LENGTH];
+    char password[MAX_PASSWORD_LENGTH];
+    int age;
+    
+    printf("\n=== USER REGISTRATION ===\n");
+    
+    printf("Enter name: ");
+    fgets(name, sizeof(name), stdin);
+    name[strcspn(name, "\n")] = 0;
+    
+    printf("Enter email: ");
+    fgets(email, sizeof(email), stdin);
+    email[strcspn(email, "\n")] = 0;
+    
+    printf("Enter password: ");
+    fgets(password, sizeof(password), stdin);
+    password[strcspn(password, "\n")] = 0;
+    
+    printf("Enter age: ");
+    scanf("%d", &age);
+    getchar(); 
+    
+    if (strlen(name) == 0) {
+        printf("Error: Name cannot be empty\n");
+        return;
+    }
+    
+    if (strlen(email) == 0 || strchr(email, '@') == NULL) {
+        printf("Error: Invalid email format\n");
+        return;
+    }
+    
+    if (strlen(password) < 4) {
+        printf("Error: Password must be at least 4 characters\n");
+        return;
+    }
+    
+    if (age <= 0 || age > 150) {
+        printf("Error: Invalid age\n");
+        return;
+    }
+    
+    lock_store();
+    int user_id = create_user(shm_ptr, name, email, password, age);
+    if (user_id > 0) {
+        start_background_save(shm_ptr, BGSAVE_USERS);
+    }
+    unlock_store();
+    
+    if (user_id > 0) {
+        printf("Registration successful! Your User ID is: %d\n", user_id);
+        printf("Please login with your credentials.\n");
     } else {
-        printf("Failed to send reply!\n");
+        printf("Error: %s\n", mailstore_strerror(user_id));
     }
-}
\ No newline at end of file
+}
+
+void edit_user(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    int user_id;
+    
+    if (is_user_logged_in()) {
+        user_id = get_current_user_id();
+        printf("\n=== UPDATE YOUR PROFILE ===\n");
+    } else {
+        printf("\n=== EDIT USER ===\n");
+        printf("Enter User ID to edit: ");
+        scanf("%d", &user_id);
+        getchar(); 
+    }
+    
+    User* user = read_user(shm_ptr, user_id);
+    if (user == NULL) {
+        printf("User not found!\n");
+        return;
+    }
+    
+    printf("\nCurrent information:\n");
+    printf("Name: %s\n", user->name);
+    printf("Email: %s\n", user->email);
+    printf("Age: %d\n", user->age);
+    
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_EMAIL_LENGTH];
+    char password[MAX_PASSWORD_LENGTH];
+    int age;
+    
+    printf("\nEnter new information (press Enter to keep current value):\n");
+    
+    printf("New name [%s]: ", user->name);
+    fgets(name, sizeof(name), stdin);
+    if (name[0] == '\n') {
+        strcpy(name, user->name);
+    } else {
+        name[strcspn(name, "\n")] = 0;
+    }
+    
+    printf("New email [%s]: ", user->email);
+    fgets(email, sizeof(email), stdin);
+    if (email[0] == '\n') {
+        strcpy(email, user->email);
+    } else {
+        email[strcspn(email, "\n")] = 0;
+    }
+    
+    printf("New password (press Enter to keep current): ");
+    fgets(password, sizeof(password), stdin);
+    password[strcspn(password, "\n")] = 0;
+    
+    printf("New age [%d]: ", user->age);
+    char age_str[10];
+    fgets(age_str, sizeof(age_str), stdin);
+    if (age_str[0] == '\n') {
+        age = user->age;
+    } else {
+        age = atoi(age_str);
+    }
+    
+    lock_store();
+    int rc = update_user(shm_ptr, user_id, name, email, strlen(password) > 0 ? password : NULL, age);
+    if (rc == MS_OK) {
+        start_background_save(shm_ptr, BGSAVE_USERS);
+    }
+    unlock_store();
+    
+    if (rc == MS_OK) {
+        printf("User information updated successfully!\n");
+    } else {
+        printf("Error: %s\n", mailstore_strerror(rc));
+    }
+}
+
+void remove_user(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    int user_id;
+    printf("\n=== DELETE USER ===\n");
+    printf("Enter User ID to delete: ");
+    scanf("%d", &user_id);
+    getchar(); 
+    
+    User* user = read_user(shm_ptr, user_id);
+    if (user == NULL) {
+        printf("User not found!\n");
+        return;
+    }
+    
+    printf("\nUser to delete:\n");
+    printf("Name: %s\n", user->name);
+    printf("Email: %s\n", user->email);
+    printf("Age: %d\n", user->age);
+    
+    char confirm;
+    printf("\nAre you sure you want to delete this user? (y/n): ");
+    scanf("%c", &confirm);
+    getchar(); 
+    
+    if (confirm == 'y' || confirm == 'Y') {
+        lock_store();
+        int rc = delete_user(shm_ptr, user_id);
+        if (rc == MS_OK) {
+            start_background_save(shm_ptr, BGSAVE_USERS);
+        }
+        unlock_store();
+        
+        if (rc == MS_OK) {
+            printf("User deleted successfully!\n");
+        } else {
+            printf("Error: %s\n", mailstore_strerror(rc));
+        }
+    } else {
+        printf("User deletion cancelled.\n");
+    }
+}
+
+// Hiển thị emails của một user cụ thể (type: 0=received, 1=sent)
+void display_user_emails(SharedMemoryData* shm_ptr, int user_id, int type) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    User* user = read_user(shm_ptr, user_id);
+    if (user == NULL) {
+        printf("Error: User not found\n");
+        return;
+    }
+    
+    const char* title = (type == 0) ? "RECEIVED EMAILS" : "SENT EMAILS";
+    printf("\n=== %s for %s ===\n", title, user->name);
+    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "From/To", "Subject", "Date", "Status");
+    printf("-------------------------------------------------------------------------------------\n");
+    
+    int count = 0;
+    EmailIterator it;
+    email_iter_init(&it, user_id, type == 0 ? MAILBOX_RECEIVED : MAILBOX_SENT);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        User* other_user = read_user(shm_ptr, (type == 0) ? email->sender_id : email->receiver_id);
+        
+        char date_time[20];
+        struct tm* tm_info = localtime(&email->sent_at);
+        strftime(date_time, sizeof(date_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
+               email->email_id,
+               other_user ? other_user->email : "Unknown",
+               email->subject,
+               date_time,
+               email->is_read ? "Read" : "Unread");
+        count++;
+    }
+    
+    if (count == 0) {
+        printf("No %s emails found.\n", (type == 0) ? "received" : "sent");
+    } else {
+        printf("\nTotal: %d emails\n", count);
+    }
+}
+
+// Hiển thị tất cả emails trong hệ thống
+void display_all_emails(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Error: Shared memory not available\n");
+        return;
+    }
+    
+    printf("\n=== ALL EMAILS IN SYSTEM ===\n");
+    printf("%-5s %-20s %-20s %-30s %-20s %-10s\n", "ID", "From", "To", "Subject", "Sent", "Status");
+    printf("------------------------------------------------------------------------------------------------\n");
+    
+    int count = 0;
+    EmailIterator it;
+    email_iter_init(&it, 0, MAILBOX_BOTH);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        User* sender = read_user(shm_ptr, email->sender_id);
+        User* receiver = read_user(shm_ptr, email->receiver_id);
+        
+        char sent_time[20];
+        struct tm* tm_info = localtime(&email->sent_at);
+        strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20.20s %-20.20s %-30.30s %-20s %-10s\n", 
+               email->email_id,
+               sender ? sender->email : "Unknown",
+               receiver ? receiver->email : "Unknown",
+               email->subject,
+               sent_time,
+               email->is_read ? "Read" : "Unread");
+        count++;
+    }
+    
+    if (count == 0) {
+        printf("No emails found in the system.\n");
+    } else {
+        printf("\nTotal: %d emails\n", count);
+    }
+}
+
+// Tìm kiếm email theo người gửi
+void find_emails_by_sender(SharedMemoryData* shm_ptr, int sender_id) {
+    if (shm_ptr == NULL || sender_id <= 0) {
+        printf("Error: Invalid parameters\n");
+        return;
+    }
+    
+    User* sender = read_user(shm_ptr, sender_id);
+    if (sender == NULL) {
+        printf("Error: Sender not found\n");
+        return;
+    }
+    
+    printf("\n=== EMAILS FROM %s ===\n", sender->email);
+    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "To", "Subject", "Sent", "Status");
+    printf("-------------------------------------------------------------------------------------\n");
+    
+    int count = 0;
+    EmailIterator it;
+    email_iter_init(&it, sender_id, MAILBOX_SENT);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        User* receiver = read_user(shm_ptr, email->receiver_id);
+        
+        char sent_time[20];
+        struct tm* tm_info = localtime(&email->sent_at);
+        strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
+               email->email_id,
+               receiver ? receiver->email : "Unknown",
+               email->subject,
+               sent_time,
+               email->is_read ? "Read" : "Unread");
+        count++;
+    }
+    
+    if (count == 0) {
+        printf("No emails found from this sender.\n");
+    } else {
+        printf("\nTotal: %d emails\n", count);
+    }
+}
+
+// Tìm kiếm email theo người nhận
+void find_emails_by_receiver(SharedMemoryData* shm_ptr, int receiver_id) {
+    if (shm_ptr == NULL || receiver_id <= 0) {
+        printf("Error: Invalid parameters\n");
+        return;
+    }
+    
+    User* receiver = read_user(shm_ptr, receiver_id);
+    if (receiver == NULL) {
+        printf("Error: Receiver not found\n");
+        return;
+    }
+    
+    printf("\n=== EMAILS TO %s ===\n", receiver->email);
+    printf("%-5s %-20s %-30s %-20s %-10s\n", "ID", "From", "Subject", "Sent", "Status");
+    printf("-------------------------------------------------------------------------------------\n");
+    
+    int count = 0;
+    EmailIterator it;
+    email_iter_init(&it, receiver_id, MAILBOX_RECEIVED);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        User* sender = read_user(shm_ptr, email->sender_id);
+        
+        char sent_time[20];
+        struct tm* tm_info = localtime(&email->sent_at);
+        strftime(sent_time, sizeof(sent_time), "%Y-%m-%d %H:%M", tm_info);
+        
+        printf("%-5d %-20.20s %-30.30s %-20s %-10s\n", 
+               email->email_id,
+               sender ? sender->email : "Unknown",
+               email->subject,
+               sent_time,
+               email->is_read ? "Read" : "Unread");
+        count++;
+    }
+    
+    if (count == 0) {
+        printf("No emails found for this receiver.\n");
+    } else {
+        printf("\nTotal: %d emails\n", count);
+    }
+}
@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// mail_import: nhập hàng loạt mbox / Maildir vào mailbox của một user. File
+// được mmap và parse tại chỗ (header/body là các lát cắt trỏ vào mapping, không
+// copy trung gian); email được gom thành lô IMPORT_BATCH_SIZE và ghi thẳng vào
+// slot qua import_emails dưới một lần khóa store mỗi lô. emails.txt chỉ được
+// lưu một lần ở cuối thay vì sau mỗi email.
+//
+//   ./mail_import -u user@email [-s sender@email] [-b batch] [-n] mbox_or_maildir...
+//
+// Người gửi được khớp theo địa chỉ From với user đã có; địa chỉ lạ được gán cho
+// -s (mặc định chính người nhận). Tạo user trước bằng batch `register`.
+
+typedef struct {
+    const char* receiver_email;
+    const char* fallback_email;
+    int batch;
+    int dry_run;                 // chỉ parse, không ghi store
+} ImportConfig;
+
+typedef struct {
+    long long messages;
+    long long imported;
+    long long unknown_senders;
+    long long skipped;           // không nhập được vì store đầy
+    long long bytes;
+    int files;
+} ImportTotals;
+
+typedef struct {
+    const char* p;
+    size_t len;
+} Slice;
+
+typedef struct {
+    const char* data;
+    size_t size;
+} Mapping;
+
+typedef struct {
+    Slice from;
+    Slice subject;
+    Slice body;
+    time_t date;
+    int seen;                    // "Status: RO" (mbox do mail_export ghi)
+} ParsedMessage;
+
+static SharedMemoryData* g_shm = NULL;
+static ImportConfig g_cfg;
+static ImportTotals g_totals;
+static EmailImport* g_batch = NULL;
+static int g_batch_count = 0;
+static Mapping* g_mappings = NULL;    // file Maildir mà lô hiện tại còn trỏ vào
+static int g_mapping_count = 0;
+static int g_receiver_id = 0;
+static int g_fallback_id = 0;
+static int g_full = 0;
+
+static Slice trim(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        end--;
+    }
+    Slice s = { p, (size_t)(end - p) };
+    return s;
+}
+
+static const char* line_end(const char* p, const char* end) {
+    const char* nl = memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+// "Display Name <addr>" -> addr
+static Slice header_address(Slice value) {
+    const char* lt = memchr(value.p, '<', value.len);
+    if (lt != NULL) {
+        const char* gt = memchr(lt, '>', value.p + value.len - lt);
+        if (gt != NULL) {
+            Slice s = { lt + 1, (size_t)(gt - lt - 1) };
+            return s;
+        }
+    }
+    return value;
+}
+
+// RFC 2822 ("Tue, 1 Jul 2003 10:52:37 +0200") hoặc dòng From_ của mbox
+// ("Tue Jul  1 10:52:37 2003"). Trả về 0 nếu không đọc được.
+static time_t parse_date(const char* p, size_t len) {
+    char buf[96];
+    if (len >= sizeof(buf)) {
+        len = sizeof(buf) - 1;
+    }
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* rest = strptime(buf, "%a, %d %b %Y %H:%M:%S", &tm);
+    if (rest == NULL) {
+        memset(&tm, 0, sizeof(tm));
+        rest = strptime(buf, "%d %b %Y %H:%M:%S", &tm);
+    }
+    if (rest == NULL) {
+        memset(&tm, 0, sizeof(tm));
+        rest = strptime(buf, "%a %b %d %H:%M:%S %Y", &tm);
+        return rest ? timegm(&tm) : 0;
+    }
+    
+    time_t t = timegm(&tm);
+    char sign;
+    int zone;
+    if (sscanf(rest, " %c%4d", &sign, &zone) == 2 && (sign == '+' || sign == '-')) {
+        int offset = (zone / 100) * 3600 + (zone % 100) * 60;
+        t += (sign == '+') ? -offset : offset;
+    }
+    return t;
+}
+
+static int header_is(const char* line, const char* end, const char* name) {
+    size_t n = strlen(name);
+    return (size_t)(end - line) > n && strncasecmp(line, name, n) == 0;
+}
+
+// Parse header From/Subject/Date và body của một message [p, end)
+static void parse_message(const char* p, const char* end, ParsedMessage* msg) {
+    memset(msg, 0, sizeof(ParsedMessage));
+    
+    while (p < end) {
+        const char* eol = line_end(p, end);
+        Slice line = trim(p, eol);
+        const char* next = (eol < end) ? eol + 1 : end;
+        if (line.len == 0 && (p == eol || *p == '\r')) {
+            p = next;            // dòng trống: hết header
+            break;
+        }
+        
+        if (header_is(p, eol, "From:")) {
+            msg->from = header_address(trim(p + 5, eol));
+        } else if (header_is(p, eol, "Subject:")) {
+            msg->subject = trim(p + 8, eol);
+        } else if (header_is(p, eol, "Date:")) {
+            Slice value = trim(p + 5, eol);
+            msg->date = parse_date(value.p, value.len);
+        } else if (header_is(p, eol, "Status:")) {
+            Slice value = trim(p + 7, eol);
+            msg->seen = (memchr(value.p, 'R', value.len) != NULL);
+        }
+        p = next;
+    }
+    
+    // Bỏ các dòng trống cuối (mbox ngăn message bằng một dòng trống)
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r')) {
+        end--;
+    }
+    msg->body.p = p;
+    msg->body.len = (size_t)(end - p);
+}
+
+static int lookup_user(Slice address) {
+    static int cached_id = 0;
+    static char cached[MAX_EMAIL_LENGTH];
+    
+    if (address.len == 0 || address.len >= MAX_EMAIL_LENGTH) {
+        return 0;
+    }
+    if (cached_id != 0 && strlen(cached) == address.len &&
+        strncasecmp(cached, address.p, address.len) == 0) {
+        return cached_id;
+    }
+    
+    for (int i = 0; i < MAX_USERS; i++) {
+        const User* user = &g_shm->users[i];
+        if (user->is_active && strlen(user->email) == address.len &&
+            strncasecmp(user->email, address.p, address.len) == 0) {
+            memcpy(cached, address.p, address.len);
+            cached[address.len] = '\0';
+            cached_id = user->user_id;
+            return cached_id;
+        }
+    }
+    return 0;
+}
+
+static void release_mappings() {
+    for (int i = 0; i < g_mapping_count; i++) {
+        munmap((void*)g_mappings[i].data, g_mappings[i].size);
+    }
+    g_mapping_count = 0;
+}
+
+// Ghi lô hiện tại vào store rồi unmap các file Maildir mà lô trỏ vào. mbox
+// phải gọi trước khi munmap file của nó.
+static void flush_batch() {
+    if (g_batch_count == 0) {
+        release_mappings();
+        return;
+    }
+    
+    lock_store();
+    int imported = import_emails(g_shm, g_batch, g_batch_count);
+    unlock_store();
+    
+    if (imported < 0) {
+        fprintf(stderr, "mail_import: %s\n", mailstore_strerror(imported));
+        g_totals.skipped += g_batch_count;
+        g_full = 1;
+    } else {
+        g_totals.imported += imported;
+        if (imported < g_batch_count) {
+            g_totals.skipped += g_batch_count - imported;
+            g_full = 1;
+        }
+    }
+    g_batch_count = 0;
+    release_mappings();
+}
+
+static void add_message(const char* p, const char* end, time_t envelope_date, int is_read, int is_mbox) {
+    ParsedMessage msg;
+    parse_message(p, end, &msg);
+    g_totals.messages++;
+    
+    if (g_cfg.dry_run) {
+        return;
+    }
+    if (g_full) {
+        g_totals.skipped++;
+        return;
+    }
+    
+    int sender_id = lookup_user(msg.from);
+    if (sender_id == 0) {
+        sender_id = g_fallback_id;
+        g_totals.unknown_senders++;
+    }
+    
+    EmailImport* item = &g_batch[g_batch_count++];
+    item->sender_id = sender_id;
+    item->receiver_id = g_receiver_id;
+    item->subject = msg.subject.p ? msg.subject.p : "";
+    item->subject_len = msg.subject.len;
+    item->content = msg.body.p;
+    item->content_len = msg.body.len;
+    item->sent_at = msg.date ? msg.date : envelope_date;
+    item->is_read = is_read || msg.seen;
+    item->unquote_from = is_mbox;
+    
+    if (g_batch_count == g_cfg.batch) {
+        flush_batch();
+    }
+}
+
+// mmap cả file chỉ đọc. Trả về NULL nếu lỗi hoặc file rỗng.
+static const char* map_file(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    
+    *size = st.st_size;
+    g_totals.bytes += st.st_size;
+    g_totals.files++;
+    return data;
+}
+
+// mbox: mỗi message bắt đầu bằng dòng "From " ở đầu dòng
+static void import_mbox(const char* path) {
+    size_t size;
+    const char* data = map_file(path, &size);
+    if (data == NULL) {
+        return;
+    }
+    
+    const char* end = data + size;
+    const char* p = data;
+    if (size < 5 || strncmp(p, "From ", 5) != 0) {
+        fprintf(stderr, "%s: not an mbox file\n", path);
+        munmap((void*)data, size);
+        return;
+    }
+    
+    while (p < end && !g_full) {
+        const char* from_line_end = line_end(p, end);
+        
+        // Dòng From_ : "From addr Tue Jul  1 10:52:37 2003"
+        time_t envelope_date = 0;
+        const char* sp = memchr(p + 5, ' ', from_line_end - (p + 5));
+        if (sp != NULL) {
+            Slice date = trim(sp + 1, from_line_end);
+            envelope_date = parse_date(date.p, date.len);
+        }
+        
+        const char* body = (from_line_end < end) ? from_line_end + 1 : end;
+        const char* next = memmem(body, end - body, "\nFrom ", 6);
+        const char* msg_end = next ? next + 1 : end;
+        
+        add_message(body, msg_end, envelope_date, 0, 1);
+        p = msg_end;
+    }
+    
+    flush_batch();
+    munmap((void*)data, size);
+}
+
+// Maildir: flag "S" sau ":2," trong tên file nghĩa là đã đọc
+static void import_maildir_folder(const char* dir, const char* sub) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, sub);
+    DIR* d = opendir(path);
+    if (d == NULL) {
+        return;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL && !g_full) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        
+        char file[1280];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        size_t size;
+        const char* data = map_file(file, &size);
+        if (data == NULL) {
+            continue;
+        }
+        
+        const char* info = strstr(entry->d_name, ":2,");
+        int is_read = (info != NULL && strchr(info + 3, 'S') != NULL);
+        
+        // Giữ mapping đến khi lô chứa message này được ghi
+        g_mappings[g_mapping_count].data = data;
+        g_mappings[g_mapping_count].size = size;
+        g_mapping_count++;
+        add_message(data, data + size, 0, is_read, 0);
+        if (g_cfg.dry_run) {
+            release_mappings();
+        }
+    }
+    closedir(d);
+}
+
+// Duyệt cây Maildir: new/ và cur/ của thư mục này, rồi mọi thư mục con
+// (Maildir++ ".Folder" hoặc cây nhiều Maildir)
+static void import_maildir(const char* dir) {
+    import_maildir_folder(dir, "new");
+    import_maildir_folder(dir, "cur");
+    
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        perror(dir);
+        return;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL && !g_full) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+            strcmp(name, "new") == 0 || strcmp(name, "cur") == 0 || strcmp(name, "tmp") == 0) {
+            continue;
+        }
+        
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            import_maildir(path);
+        }
+    }
+    closedir(d);
+}
+
+static void import_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return;
+    }
+    
+    if (S_ISDIR(st.st_mode)) {
+        import_maildir(path);
+    } else {
+        import_mbox(path);
+    }
+}
+
+static int resolve_user(const char* email) {
+    User* user = find_user_by_email(g_shm, email);
+    if (user == NULL) {
+        fprintf(stderr, "mail_import: no user with email %s\n", email);
+        return 0;
+    }
+    return user->user_id;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s -u user@email [-s sender@email] [-b batch] [-n] mbox_or_maildir...\n",
+            prog);
+}
+
+int main(int argc, char* argv[]) {
+    g_cfg.receiver_email = NULL;
+    g_cfg.fallback_email = NULL;
+    g_cfg.batch = IMPORT_BATCH_SIZE;
+    g_cfg.dry_run = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "u:s:b:n")) != -1) {
+        switch (opt) {
+            case 'u':
+                g_cfg.receiver_email = optarg;
+                break;
+            case 's':
+                g_cfg.fallback_email = optarg;
+                break;
+            case 'b':
+                g_cfg.batch = atoi(optarg);
+                break;
+            case 'n':
+                g_cfg.dry_run = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || g_cfg.batch < 1 || (!g_cfg.dry_run && g_cfg.receiver_email == NULL)) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (!g_cfg.dry_run) {
+        g_shm = attach_shared_memory();
+        if (g_shm == NULL) {
+            fprintf(stderr, "mail_import: failed to attach to shared memory\n");
+            return 1;
+        }
+        init_shared_memory(g_shm);
+        
+        g_receiver_id = resolve_user(g_cfg.receiver_email);
+        g_fallback_id = g_cfg.fallback_email ? resolve_user(g_cfg.fallback_email) : g_receiver_id;
+        if (g_receiver_id == 0 || g_fallback_id == 0) {
+            detach_shared_memory(g_shm);
+            return 1;
+        }
+    
+    }
+    
+    g_batch = malloc(sizeof(EmailImport) * g_cfg.batch);
+    g_mappings = malloc(sizeof(Mapping) * g_cfg.batch);
+    if (g_batch == NULL || g_mappings == NULL) {
+        perror("mail_import: malloc");
+        return 1;
+    }
+    
+    long long start = stats_now();
+    for (int i = optind; i < argc; i++) {
+        import_path(argv[i]);
+    }
+    flush_batch();
+    double elapsed = (stats_now() - start) / 1e9;
+    
+    double save_elapsed = 0;
+    int rc = 0;
+    if (!g_cfg.dry_run && g_totals.imported > 0) {
+        long long save_start = stats_now();
+        lock_store();
+        int saved = save_emails_to_file(g_shm);
+        unlock_store();
+        save_elapsed = (stats_now() - save_start) / 1e9;
+        if (saved != MS_OK) {
+            fprintf(stderr, "mail_import: save failed: %s\n", mailstore_strerror(saved));
+            rc = 1;
+        }
+    }
+    
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+    printf("Parsed %lld messages (%.1f MB) from %d files in %.3f s (%.0f messages/min)\n",
+           g_totals.messages, g_totals.bytes / (1024.0 * 1024.0), g_totals.files, elapsed,
+           g_totals.messages / elapsed * 60);
+    if (!g_cfg.dry_run) {
+        printf("Imported %lld into %s, %lld from unknown senders, %lld skipped (store full)\n",
+               g_totals.imported, g_cfg.receiver_email, g_totals.unknown_senders, g_totals.skipped);
+        printf("Saved %s once in %.3f s\n", EMAIL_DB_FILE, save_elapsed);
+        detach_shared_memory(g_shm);
+    }
+    free(g_batch);
+    free(g_mappings);
+    return (rc == 0 && g_totals.skipped > 0) ? 2 : rc;
+}
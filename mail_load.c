@@ -0,0 +1,638 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include "producer_consumer/buffer.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// mail_load: tạo tải nhiều process lên cùng một segment. Fork N worker, mỗi
+// worker attach segment (attach_shared_memory) như một phiên riêng và chạy
+// trộn send / list / mark-read / search / delete trong một khoảng thời gian.
+// Với -r, các worker chạy producer/consumer trên ring của producer_consumer/
+// để so sánh cùng một tải với IPC dạng hàng đợi.
+//
+//   ./mail_load [-p procs] [-d seconds] [-m send:list:read:search:delete]
+//               [-u users] [-k] [-r] [-o results.json]
+
+#define LOAD_MAX_PROCS 64
+#define LOAD_BUCKETS 512             // log2 với 8 bucket con mỗi bậc (sai số <= 12.5%)
+#define LOAD_USER_DOMAIN "@load.local"
+
+#define LOAD_OP_SEND 0
+#define LOAD_OP_LIST 1
+#define LOAD_OP_MARK_READ 2
+#define LOAD_OP_SEARCH 3
+#define LOAD_OP_DELETE 4
+#define LOAD_OP_PUT 5
+#define LOAD_OP_GET 6
+#define LOAD_OP_COUNT 7
+
+static const char* g_op_names[LOAD_OP_COUNT] = {
+    "send", "list", "mark-read", "search", "delete", "ring-put", "ring-get"
+};
+
+typedef struct {
+    long long ops;
+    long long errors;
+    unsigned long long hist[LOAD_BUCKETS];
+} LoadOpStats;
+
+// Kết quả của một worker, nằm trong vùng MAP_SHARED để cha gộp lại
+typedef struct {
+    LoadOpStats ops[LOAD_OP_COUNT];
+    long long full;                  // send bị từ chối vì store đầy
+    long long inconsistent;          // bản ghi đọc được không khớp mailbox
+    long long sent_ok;
+    long long ring_sum_put;
+    long long ring_sum_get;
+} WorkerStats;
+
+typedef struct {
+    int procs;
+    int seconds;
+    int mix[5];                      // trọng số send, list, mark-read, search, delete
+    int users;
+    int keep;
+    int ring;
+    const char* json_path;
+} LoadConfig;
+
+static int g_user_ids[MAX_USERS];
+static int g_user_count = 0;
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int latency_bucket(long long ns) {
+    if (ns < 8) {
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int msb = 63 - __builtin_clzll((unsigned long long)ns);
+    int bucket = (msb - 2) * 8 + (int)((ns >> (msb - 3)) & 7);
+    return bucket < LOAD_BUCKETS ? bucket : LOAD_BUCKETS - 1;
+}
+
+static long long bucket_value(int bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+    int msb = bucket / 8 + 2;
+    return (8LL + bucket % 8) << (msb - 3);
+}
+
+static void record_op(WorkerStats* stats, int op, long long start, int ok) {
+    LoadOpStats* s = &stats->ops[op];
+    s->ops++;
+    if (!ok) {
+        s->errors++;
+    }
+    s->hist[latency_bucket(now_ns() - start)]++;
+}
+
+// ===== Mail store workload =====
+
+static int pick_op(const LoadConfig* cfg, unsigned int* seed) {
+    int total = 0;
+    for (int i = 0; i < 5; i++) {
+        total += cfg->mix[i];
+    }
+    int r = rand_r(seed) % total;
+    for (int i = 0; i < 5; i++) {
+        if (r < cfg->mix[i]) {
+            return i;
+        }
+        r -= cfg->mix[i];
+    }
+    return LOAD_OP_LIST;
+}
+
+static int op_send(SharedMemoryData* shm_ptr, WorkerStats* stats, int user_id, unsigned int* seed) {
+    char subject[MAX_SUBJECT_LENGTH];
+    snprintf(subject, sizeof(subject), "load %d from %d", rand_r(seed) % 1000, getpid());
+    int receiver = g_user_ids[rand_r(seed) % g_user_count];
+    
+    lock_store();
+    int email_id = create_email(shm_ptr, user_id, receiver, subject, "generated by mail_load");
+    unlock_store();
+    
+    if (email_id > 0) {
+        stats->sent_ok++;
+        return 1;
+    }
+    if (email_id == MS_ERR_FULL) {
+        stats->full++;
+        return 1;                    // store đầy là trạng thái hợp lệ, không phải lỗi
+    }
+    return 0;
+}
+
+// Đọc không khóa như menu/batch: kiểm tra từng bản ghi có đúng mailbox không
+static int op_list(SharedMemoryData* shm_ptr, WorkerStats* stats, int user_id) {
+    EmailIterator it;
+    email_iter_init(&it, user_id, MAILBOX_RECEIVED);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        if (email->email_id <= 0 || email->receiver_id != user_id) {
+            stats->inconsistent++;
+        }
+    }
+    return 1;
+}
+
+static int op_mark_read(SharedMemoryData* shm_ptr, int user_id) {
+    EmailIterator it;
+    email_iter_init(&it, user_id, MAILBOX_RECEIVED);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        if (!email->is_read) {
+            break;
+        }
+    }
+    if (email == NULL) {
+        return 1;                    // không còn mail chưa đọc
+    }
+    
+    lock_store();
+    int rc = update_email_status(shm_ptr, email->email_id, 1);
+    unlock_store();
+    return rc == MS_OK || rc == MS_ERR_NOT_FOUND;   // có thể vừa bị worker khác xóa
+}
+
+static int op_search(SharedMemoryData* shm_ptr, WorkerStats* stats, int user_id, unsigned int* seed) {
+    char keyword[16];
+    snprintf(keyword, sizeof(keyword), "load %d", rand_r(seed) % 100);
+    
+    int ids[MAX_EMAILS];
+    int count = find_emails_matching(shm_ptr, user_id, keyword, ids, MAX_EMAILS);
+    for (int i = 0; i < count && i < MAX_EMAILS; i++) {
+        Email* email = read_email(shm_ptr, ids[i]);
+        if (email != NULL && email->sender_id != user_id && email->receiver_id != user_id) {
+            stats->inconsistent++;
+        }
+    }
+    return count >= 0;
+}
+
+static int op_delete(SharedMemoryData* shm_ptr, int user_id) {
+    lock_store();
+    int count = delete_read_emails(shm_ptr, user_id);
+    unlock_store();
+    return count >= 0;
+}
+
+static void run_mail_worker(const LoadConfig* cfg, WorkerStats* stats, int worker, long long deadline) {
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        stats->ops[LOAD_OP_LIST].errors++;
+        return;
+    }
+    
+    unsigned int seed = (unsigned int)(getpid() ^ now_ns());
+    int user_id = g_user_ids[worker % g_user_count];
+    
+    while (now_ns() < deadline) {
+        int op = pick_op(cfg, &seed);
+        long long start = now_ns();
+        int ok = 1;
+        switch (op) {
+            case LOAD_OP_SEND:
+                ok = op_send(shm_ptr, stats, user_id, &seed);
+                break;
+            case LOAD_OP_LIST:
+                ok = op_list(shm_ptr, stats, user_id);
+                break;
+            case LOAD_OP_MARK_READ:
+                ok = op_mark_read(shm_ptr, user_id);
+                break;
+            case LOAD_OP_SEARCH:
+                ok = op_search(shm_ptr, stats, user_id, &seed);
+                break;
+            case LOAD_OP_DELETE:
+                ok = op_delete(shm_ptr, user_id);
+                break;
+        }
+        record_op(stats, op, start, ok);
+    }
+    
+    detach_shared_memory(shm_ptr);
+}
+
+// Tạo (hoặc dùng lại) các user dành riêng cho tải
+static int prepare_load_users(SharedMemoryData* shm_ptr, int count) {
+    char name[MAX_NAME_LENGTH], email[MAX_EMAIL_LENGTH];
+    
+    lock_store();
+    for (int i = 1; i <= count; i++) {
+        snprintf(name, sizeof(name), "Load User %d", i);
+        snprintf(email, sizeof(email), "load%d%s", i, LOAD_USER_DOMAIN);
+        
+        User* user = find_user_by_email(shm_ptr, email);
+        int user_id = user ? user->user_id : create_user(shm_ptr, name, email, "load", 30);
+        if (user_id > 0) {
+            g_user_ids[g_user_count++] = user_id;
+        }
+    }
+    unlock_store();
+    
+    return g_user_count;
+}
+
+// Xóa email và user của tải (trừ khi chạy với -k)
+static void remove_load_data(SharedMemoryData* shm_ptr) {
+    lock_store();
+    for (int i = 0; i < shm_ptr->control.email_count; i++) {
+        Email* email = &shm_ptr->emails[i];
+        if (email->is_deleted) {
+            continue;
+        }
+        for (int k = 0; k < g_user_count; k++) {
+            if (email->sender_id == g_user_ids[k] || email->receiver_id == g_user_ids[k]) {
+                delete_email(shm_ptr, email->email_id);
+                break;
+            }
+        }
+    }
+    for (int k = 0; k < g_user_count; k++) {
+        delete_user(shm_ptr, g_user_ids[k]);
+    }
+    unlock_store();
+}
+
+// Sau khi tất cả worker dừng: email_id không trùng và số email mới khớp số send
+static long long check_store_consistency(SharedMemoryData* shm_ptr, int valid_before,
+                                         int next_email_id_before, long long sent_ok) {
+    long long problems = 0;
+    
+    if (valid_before && validate_database(shm_ptr, NULL) != MS_OK) {
+        problems++;
+    }
+    
+    for (int i = 0; i < shm_ptr->control.email_count; i++) {
+        Email* a = &shm_ptr->emails[i];
+        if (a->is_deleted || a->email_id <= 0) {
+            continue;
+        }
+        for (int j = i + 1; j < shm_ptr->control.email_count; j++) {
+            if (!shm_ptr->emails[j].is_deleted && shm_ptr->emails[j].email_id == a->email_id) {
+                problems++;
+            }
+        }
+    }
+    
+    long long created = shm_ptr->control.next_email_id - next_email_id_before;
+    if (created != sent_ok) {
+        fprintf(stderr, "mail_load: %lld emails created but %lld sends succeeded "
+                        "(other clients running?)\n", created, sent_ok);
+        problems++;
+    }
+    return problems;
+}
+
+// ===== producer_consumer ring workload =====
+
+static int ring_sem_op(int semid, int semnum, int op, int flags, int timeout_ms) {
+    struct sembuf sb = {semnum, op, flags};
+    struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    while (semtimedop(semid, &sb, 1, timeout_ms >= 0 ? &ts : NULL) == -1) {
+        if (errno != EINTR) {
+            return -1;               // EAGAIN: hết thời gian chờ
+        }
+    }
+    return 0;
+}
+
+static int open_ring(SharedBuffer** buf_out, int* semid_out) {
+    int shmid = shmget(SHM_KEY, sizeof(SharedBuffer), IPC_CREAT | 0666);
+    int semid = semget(SEM_KEY, 3, IPC_CREAT | 0666);
+    if (shmid == -1 || semid == -1) {
+        perror("mail_load: ring");
+        return -1;
+    }
+    
+    SharedBuffer* buf = (SharedBuffer*)shmat(shmid, NULL, 0);
+    if (buf == (void*)-1) {
+        perror("mail_load: shmat ring");
+        return -1;
+    }
+    
+    *buf_out = buf;
+    *semid_out = semid;
+    return 0;
+}
+
+static void reset_ring(SharedBuffer* buf, int semid) {
+    memset(buf, 0, sizeof(SharedBuffer));
+    semctl(semid, SEM_MUTEX, SETVAL, 1);
+    semctl(semid, SEM_EMPTY, SETVAL, BUFFER_SIZE);
+    semctl(semid, SEM_FULL, SETVAL, 0);
+}
+
+// Worker chẵn là producer, lẻ là consumer; cùng giao thức với producer.c/consumer.c
+static void run_ring_worker(WorkerStats* stats, int worker, long long deadline) {
+    SharedBuffer* buf;
+    int semid;
+    if (open_ring(&buf, &semid) != 0) {
+        return;
+    }
+    
+    int producer = (worker % 2 == 0);
+    unsigned int seed = (unsigned int)(getpid() ^ now_ns());
+    
+    while (now_ns() < deadline) {
+        long long start = now_ns();
+        if (ring_sem_op(semid, producer ? SEM_EMPTY : SEM_FULL, -1, 0, 100) != 0) {
+            continue;                // chờ quá lâu: kiểm tra lại deadline
+        }
+        ring_sem_op(semid, SEM_MUTEX, -1, SEM_UNDO, -1);
+        
+        if (producer) {
+            int item = 1 + rand_r(&seed) % 1000;
+            buf->buffer[buf->in] = item;
+            buf->in = (buf->in + 1) % BUFFER_SIZE;
+            buf->count++;
+            stats->ring_sum_put += item;
+        } else {
+            stats->ring_sum_get += buf->buffer[buf->out];
+            buf->out = (buf->out + 1) % BUFFER_SIZE;
+            buf->count--;
+        }
+        if (buf->count < 0 || buf->count > BUFFER_SIZE) {
+            stats->inconsistent++;
+        }
+        
+        ring_sem_op(semid, SEM_MUTEX, 1, SEM_UNDO, -1);
+        ring_sem_op(semid, producer ? SEM_FULL : SEM_EMPTY, 1, 0, -1);
+        record_op(stats, producer ? LOAD_OP_PUT : LOAD_OP_GET, start, 1);
+    }
+    
+    shmdt(buf);
+}
+
+// ===== Report =====
+
+static long long percentile(const unsigned long long* hist, long long total, double q) {
+    if (total == 0) {
+        return 0;
+    }
+    long long rank = (long long)(q * (total - 1)) + 1;
+    long long seen = 0;
+    for (int b = 0; b < LOAD_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= rank) {
+            return bucket_value(b);
+        }
+    }
+    return bucket_value(LOAD_BUCKETS - 1);
+}
+
+static void report(const LoadConfig* cfg, const WorkerStats* total, double elapsed, long long problems) {
+    FILE* json = NULL;
+    if (cfg->json_path != NULL) {
+        json = fopen(cfg->json_path, "w");
+        if (json == NULL) {
+            perror("mail_load: json");
+        }
+    }
+    
+    printf("\n%-10s %10s %12s %8s %10s %10s %10s %12s\n",
+           "op", "ops", "ops/sec", "errors", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    printf("------------------------------------------------------------------------------------------\n");
+    
+    if (json != NULL) {
+        fprintf(json, "{\n  \"mode\": \"%s\",\n", cfg->ring ? "ring" : "mail");
+        fprintf(json, "  \"procs\": %d,\n  \"seconds\": %.3f,\n", cfg->procs, elapsed);
+        fprintf(json, "  \"mix\": [%d, %d, %d, %d, %d],\n",
+                cfg->mix[0], cfg->mix[1], cfg->mix[2], cfg->mix[3], cfg->mix[4]);
+        fprintf(json, "  \"ops\": [\n");
+    }
+    
+    long long all_ops = 0;
+    int first = 1;
+    for (int op = 0; op < LOAD_OP_COUNT; op++) {
+        const LoadOpStats* s = &total->ops[op];
+        if (s->ops == 0) {
+            continue;
+        }
+        all_ops += s->ops;
+        
+        long long p50 = percentile(s->hist, s->ops, 0.50);
+        long long p99 = percentile(s->hist, s->ops, 0.99);
+        long long p999 = percentile(s->hist, s->ops, 0.999);
+        long long max = percentile(s->hist, s->ops, 1.0);
+        printf("%-10s %10lld %12.0f %8lld %10lld %10lld %10lld %12lld\n",
+               g_op_names[op], s->ops, s->ops / elapsed, s->errors, p50, p99, p999, max);
+        
+        if (json != NULL) {
+            fprintf(json, "%s    {\"name\": \"%s\", \"ops\": %lld, \"ops_per_sec\": %.1f, \"errors\": %lld, "
+                          "\"p50_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld, \"max_ns\": %lld}",
+                    first ? "" : ",\n", g_op_names[op], s->ops, s->ops / elapsed, s->errors,
+                    p50, p99, p999, max);
+        }
+        first = 0;
+    }
+    
+    printf("\nTotal: %lld ops in %.2f s (%.0f ops/sec) across %d processes\n",
+           all_ops, elapsed, all_ops / elapsed, cfg->procs);
+    if (!cfg->ring) {
+        printf("Sends rejected (store full): %lld\n", total->full);
+    }
+    printf("Inconsistent reads: %lld, consistency problems: %lld\n", total->inconsistent, problems);
+    
+    if (json != NULL) {
+        fprintf(json, "\n  ],\n  \"total_ops\": %lld,\n  \"ops_per_sec\": %.1f,\n", all_ops, all_ops / elapsed);
+        fprintf(json, "  \"store_full\": %lld,\n  \"inconsistent_reads\": %lld,\n"
+                      "  \"consistency_problems\": %lld\n}\n",
+                total->full, total->inconsistent, problems);
+        fclose(json);
+        printf("Results written to %s\n", cfg->json_path);
+    }
+}
+
+static int parse_mix(const char* text, int* mix) {
+    if (sscanf(text, "%d:%d:%d:%d:%d", &mix[0], &mix[1], &mix[2], &mix[3], &mix[4]) != 5) {
+        return -1;
+    }
+    int total = 0;
+    for (int i = 0; i < 5; i++) {
+        if (mix[i] < 0) {
+            return -1;
+        }
+        total += mix[i];
+    }
+    return total > 0 ? 0 : -1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p procs] [-d seconds] [-m send:list:read:search:delete] "
+                    "[-u users] [-k] [-r] [-o results.json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig cfg = {
+        .procs = 4,
+        .seconds = 5,
+        .mix = {20, 40, 20, 10, 10},
+        .users = 10,
+        .keep = 0,
+        .ring = 0,
+        .json_path = NULL,
+    };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:m:u:kro:")) != -1) {
+        switch (opt) {
+            case 'p':
+                cfg.procs = atoi(optarg);
+                break;
+            case 'd':
+                cfg.seconds = atoi(optarg);
+                break;
+            case 'm':
+                if (parse_mix(optarg, cfg.mix) != 0) {
+                    fprintf(stderr, "mail_load: bad mix '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                cfg.users = atoi(optarg);
+                break;
+            case 'k':
+                cfg.keep = 1;
+                break;
+            case 'r':
+                cfg.ring = 1;
+                break;
+            case 'o':
+                cfg.json_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    if (cfg.procs < 1 || cfg.procs > LOAD_MAX_PROCS || cfg.seconds < 1 ||
+        cfg.users < 1 || cfg.users > MAX_USERS) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    WorkerStats* stats = mmap(NULL, sizeof(WorkerStats) * cfg.procs, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mail_load: mmap");
+        return 1;
+    }
+    memset(stats, 0, sizeof(WorkerStats) * cfg.procs);
+    
+    SharedMemoryData* shm_ptr = NULL;
+    int next_email_id_before = 0;
+    int valid_before = 0;
+    if (cfg.ring) {
+        SharedBuffer* buf;
+        int semid;
+        if (open_ring(&buf, &semid) != 0) {
+            return 1;
+        }
+        reset_ring(buf, semid);
+        shmdt(buf);
+        printf("mail_load: %d processes on the producer_consumer ring for %d s\n",
+               cfg.procs, cfg.seconds);
+    } else {
+        shm_ptr = attach_shared_memory();
+        if (shm_ptr == NULL) {
+            fprintf(stderr, "mail_load: failed to attach to shared memory\n");
+            return 1;
+        }
+        init_shared_memory(shm_ptr);
+        if (prepare_load_users(shm_ptr, cfg.users) == 0) {
+            fprintf(stderr, "mail_load: cannot create load users\n");
+            return 1;
+        }
+        lock_store();
+        valid_before = (validate_database(shm_ptr, NULL) == MS_OK);
+        next_email_id_before = shm_ptr->control.next_email_id;
+        unlock_store();
+        printf("mail_load: %d processes, %d users, mix %d:%d:%d:%d:%d for %d s\n",
+               cfg.procs, g_user_count, cfg.mix[0], cfg.mix[1], cfg.mix[2], cfg.mix[3],
+               cfg.mix[4], cfg.seconds);
+    }
+    fflush(stdout);
+    
+    long long start = now_ns();
+    long long deadline = start + (long long)cfg.seconds * 1000000000LL;
+    pid_t pids[LOAD_MAX_PROCS];
+    int started = 0;
+    for (int i = 0; i < cfg.procs; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            if (cfg.ring) {
+                run_ring_worker(&stats[i], i, deadline);
+            } else {
+                run_mail_worker(&cfg, &stats[i], i, deadline);
+            }
+            capture_close();     // _exit bỏ qua atexit: flush capture nếu có
+            journal_sync();
+            _exit(0);
+        }
+        if (pids[i] == -1) {
+            perror("mail_load: fork");
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    
+    WorkerStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < started; i++) {
+        for (int op = 0; op < LOAD_OP_COUNT; op++) {
+            total.ops[op].ops += stats[i].ops[op].ops;
+            total.ops[op].errors += stats[i].ops[op].errors;
+            for (int b = 0; b < LOAD_BUCKETS; b++) {
+                total.ops[op].hist[b] += stats[i].ops[op].hist[b];
+            }
+        }
+        total.full += stats[i].full;
+        total.inconsistent += stats[i].inconsistent;
+        total.sent_ok += stats[i].sent_ok;
+        total.ring_sum_put += stats[i].ring_sum_put;
+        total.ring_sum_get += stats[i].ring_sum_get;
+    }
+    
+    long long problems = 0;
+    if (cfg.ring) {
+        // Những gì đã put = đã get + còn lại trong ring
+        SharedBuffer* buf;
+        int semid;
+        if (open_ring(&buf, &semid) == 0) {
+            long long left = 0;
+            for (int i = 0, idx = buf->out; i < buf->count; i++, idx = (idx + 1) % BUFFER_SIZE) {
+                left += buf->buffer[idx];
+            }
+            if (total.ops[LOAD_OP_PUT].ops != total.ops[LOAD_OP_GET].ops + buf->count ||
+                total.ring_sum_put != total.ring_sum_get + left) {
+                problems++;
+            }
+            shmdt(buf);
+        }
+    } else {
+        lock_store();
+        problems = check_store_consistency(shm_ptr, valid_before, next_email_id_before, total.sent_ok);
+        unlock_store();
+        if (!cfg.keep) {
+            remove_load_data(shm_ptr);
+        }
+        detach_shared_memory(shm_ptr);
+    }
+    
+    report(&cfg, &total, elapsed, problems);
+    munmap(stats, sizeof(WorkerStats) * cfg.procs);
+    return problems > 0 ? 2 : 0;
+}
@@ -0,0 +1,443 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// mail_replay: chạy lại các file capture (MAILSTORE_CAPTURE=<prefix>) trên một
+// store mới (MAP_SHARED ẩn danh, không đụng segment thật), nhanh hết mức hoặc
+// theo nhịp gốc, với N process. In throughput/latency theo thao tác và một
+// checksum của store cuối cùng để so sánh A/B. Với -p 1 kết quả là tất định.
+//
+//   ./mail_replay [-p procs] [-r] [-x speed] [-d db_dir] [-o results.json] file.cap...
+
+#define REPLAY_MAX_PROCS 64
+#define REPLAY_OPS (CAP_DELETE_READ + 1)
+
+typedef struct {
+    long long t_ns;              // thời điểm gốc (CLOCK_MONOTONIC của process ghi)
+    int file;
+    int seq;
+    int op;
+    int a;
+    int b;
+    char* s1;
+    char* s2;
+    char* s3;
+} ReplayOp;
+
+typedef struct {
+    OpStats ops[REPLAY_OPS];
+} WorkerResult;
+
+// Dùng chung giữa các process replay
+typedef struct {
+    pthread_mutex_t lock;
+    WorkerResult results[REPLAY_MAX_PROCS];
+} ReplayShared;
+
+typedef struct {
+    int procs;
+    int paced;
+    double speed;
+    const char* db_dir;
+    const char* json_path;
+} ReplayConfig;
+
+static ReplayOp* g_ops = NULL;
+static int g_op_count = 0;
+static int g_op_capacity = 0;
+
+static char* copy_field(const char* src, int len) {
+    char* s = malloc(len + 1);
+    if (s != NULL) {
+        memcpy(s, src, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+static int add_op(const ReplayOp* op) {
+    if (g_op_count == g_op_capacity) {
+        int capacity = g_op_capacity ? g_op_capacity * 2 : 4096;
+        ReplayOp* ops = realloc(g_ops, sizeof(ReplayOp) * capacity);
+        if (ops == NULL) {
+            return -1;
+        }
+        g_ops = ops;
+        g_op_capacity = capacity;
+    }
+    g_ops[g_op_count++] = *op;
+    return 0;
+}
+
+// Đọc một file capture vào g_ops. Trả về số thao tác, -1 nếu file lỗi.
+static int load_capture(const char* path, int file_index) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    
+    CaptureHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CAPTURE_VERSION) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        fclose(file);
+        return -1;
+    }
+    
+    long long t = header.start_ns;
+    int count = 0;
+    CaptureRecord rec;
+    char strings[MAX_SUBJECT_LENGTH + MAX_CONTENT_LENGTH + MAX_PASSWORD_LENGTH];
+    while (fread(&rec, sizeof(rec), 1, file) == 1) {
+        size_t total = (size_t)rec.len1 + rec.len2 + rec.len3;
+        if (total > sizeof(strings) || fread(strings, 1, total, file) != total) {
+            fprintf(stderr, "%s: truncated after %d records\n", path, count);
+            break;
+        }
+        
+        t += (long long)rec.delta_us * 1000;
+        ReplayOp op;
+        op.t_ns = t;
+        op.file = file_index;
+        op.seq = count;
+        op.op = rec.op;
+        op.a = rec.a;
+        op.b = rec.b;
+        op.s1 = copy_field(strings, rec.len1);
+        op.s2 = copy_field(strings + rec.len1, rec.len2);
+        op.s3 = copy_field(strings + rec.len1 + rec.len2, rec.len3);
+        if (op.s1 == NULL || op.s2 == NULL || op.s3 == NULL || add_op(&op) != 0) {
+            fprintf(stderr, "%s: out of memory\n", path);
+            break;
+        }
+        count++;
+    }
+    
+    fclose(file);
+    return count;
+}
+
+static int compare_ops(const void* a, const void* b) {
+    const ReplayOp* x = (const ReplayOp*)a;
+    const ReplayOp* y = (const ReplayOp*)b;
+    if (x->t_ns != y->t_ns) {
+        return x->t_ns < y->t_ns ? -1 : 1;
+    }
+    if (x->file != y->file) {
+        return x->file - y->file;
+    }
+    return x->seq - y->seq;
+}
+
+static void record_latency(OpStats* s, long long ns, int ok) {
+    int bucket = (ns <= 0) ? 0 : 64 - __builtin_clzll((unsigned long long)ns);
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+    s->count++;
+    s->total_ns += ns > 0 ? ns : 0;
+    s->hist[bucket]++;
+    if (!ok) {
+        s->failed++;
+    }
+}
+
+// Thực thi một thao tác; ghi phải giữ lock của replay (không dùng store lock
+// của hệ thống thật)
+static int execute_op(SharedMemoryData* store, ReplayShared* shared, const ReplayOp* op) {
+    int rc = MS_OK;
+    switch (op->op) {
+        case CAP_CREATE_USER:
+            pthread_mutex_lock(&shared->lock);
+            rc = create_user(store, op->s1, op->s2, op->s3, op->a);
+            pthread_mutex_unlock(&shared->lock);
+            return rc > 0;
+        case CAP_LOGIN:
+            return verify_user_credentials(store, op->s1, op->s3) != NULL;
+        case CAP_CREATE_EMAIL:
+            pthread_mutex_lock(&shared->lock);
+            rc = create_email(store, op->a, op->b, op->s1, op->s2);
+            pthread_mutex_unlock(&shared->lock);
+            return rc > 0;
+        case CAP_READ_EMAIL:
+            return read_email(store, op->a) != NULL;
+        case CAP_UPDATE_EMAIL:
+            pthread_mutex_lock(&shared->lock);
+            rc = update_email_status(store, op->a, op->b);
+            pthread_mutex_unlock(&shared->lock);
+            return rc == MS_OK;
+        case CAP_DELETE_EMAIL:
+            pthread_mutex_lock(&shared->lock);
+            rc = delete_email(store, op->a);
+            pthread_mutex_unlock(&shared->lock);
+            return rc == MS_OK;
+        case CAP_SEARCH:
+            return find_emails_matching(store, op->a, op->s1, NULL, 0) >= 0;
+        case CAP_UNREAD:
+            return get_unread_email_count(store, op->a) >= 0;
+        case CAP_MARK_ALL_READ:
+            pthread_mutex_lock(&shared->lock);
+            rc = mark_all_emails_read(store, op->a);
+            pthread_mutex_unlock(&shared->lock);
+            return rc >= 0;
+        case CAP_DELETE_READ:
+            pthread_mutex_lock(&shared->lock);
+            rc = delete_read_emails(store, op->a);
+            pthread_mutex_unlock(&shared->lock);
+            return rc >= 0;
+    }
+    return 0;
+}
+
+static int op_worker(const ReplayConfig* cfg, int files, int index) {
+    return (files >= cfg->procs) ? g_ops[index].file % cfg->procs : index % cfg->procs;
+}
+
+static void run_worker(const ReplayConfig* cfg, SharedMemoryData* store, ReplayShared* shared,
+                       int worker, int files, long long replay_start) {
+    WorkerResult* result = &shared->results[worker];
+    long long t0 = g_ops[0].t_ns;
+    
+    for (int i = 0; i < g_op_count; i++) {
+        if (op_worker(cfg, files, i) != worker) {
+            continue;
+        }
+        const ReplayOp* op = &g_ops[i];
+        
+        if (cfg->paced) {
+            long long due = replay_start + (long long)((op->t_ns - t0) / cfg->speed);
+            long long wait = due - stats_now();
+            if (wait > 0) {
+                struct timespec ts = { wait / 1000000000LL, wait % 1000000000LL };
+                nanosleep(&ts, NULL);
+            }
+        }
+        
+        long long start = stats_now();
+        int ok = execute_op(store, shared, op);
+        if (op->op > 0 && op->op < REPLAY_OPS) {
+            record_latency(&result->ops[op->op], stats_now() - start, ok);
+        }
+    }
+}
+
+// FNV-1a trên các email còn sống: hai lần replay giống nhau cho cùng checksum
+static unsigned long long store_checksum(const SharedMemoryData* store) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (int i = 0; i < store->control.email_count; i++) {
+        const Email* email = &store->emails[i];
+        if (email->email_id <= 0 || email->is_deleted) {
+            continue;
+        }
+        int fields[4] = { email->email_id, email->sender_id, email->receiver_id, email->is_read };
+        const unsigned char* p = (const unsigned char*)fields;
+        for (size_t k = 0; k < sizeof(fields); k++) {
+            h = (h ^ p[k]) * 1099511628211ULL;
+        }
+        for (const char* s = email->subject; *s; s++) {
+            h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+static int load_initial_state(SharedMemoryData* store, const char* dir) {
+    memset(store, 0, sizeof(SharedMemoryData));
+    store->control.next_user_id = 1;
+    store->control.next_email_id = 1;
+    store->stats.started_at = time(NULL);
+    
+    char cwd[512];
+    if (getcwd(cwd, sizeof(cwd)) == NULL || chdir(dir) != 0) {
+        perror(dir);
+        return -1;
+    }
+    int users = load_users_from_file(store);
+    int emails = load_emails_from_file(store);
+    
+    // File capture chỉ có token mật khẩu: đổi mật khẩu của snapshot theo cùng cách
+    for (int i = 0; i < MAX_USERS; i++) {
+        if (store->users[i].is_active) {
+            char token[CAPTURE_TOKEN_LENGTH];
+            capture_password_token(store->users[i].password, token, sizeof(token));
+            snprintf(store->users[i].password, MAX_PASSWORD_LENGTH, "%s", token);
+        }
+    }
+    if (chdir(cwd) != 0) {
+        perror(cwd);
+        return -1;
+    }
+    
+    printf("Initial state from %s: %d users, %d emails\n", dir,
+           users > 0 ? users : 0, emails > 0 ? emails : 0);
+    return 0;
+}
+
+static void report(const ReplayConfig* cfg, const WorkerResult* total, const SharedMemoryData* store,
+                   double elapsed) {
+    printf("\n%-14s %10s %12s %8s %10s %10s %12s\n",
+           "op", "ops", "ops/sec", "failed", "p50 ns", "p99 ns", "max ns");
+    printf("-------------------------------------------------------------------------------\n");
+    
+    FILE* json = NULL;
+    if (cfg->json_path != NULL && (json = fopen(cfg->json_path, "w")) == NULL) {
+        perror(cfg->json_path);
+    }
+    if (json != NULL) {
+        fprintf(json, "{\n  \"procs\": %d,\n  \"paced\": %d,\n  \"speed\": %.2f,\n  \"seconds\": %.3f,\n"
+                      "  \"ops\": [\n", cfg->procs, cfg->paced, cfg->speed, elapsed);
+    }
+    
+    long long all = 0;
+    int first = 1;
+    for (int op = 1; op < REPLAY_OPS; op++) {
+        const OpStats* s = &total->ops[op];
+        if (s->count == 0) {
+            continue;
+        }
+        all += s->count;
+        printf("%-14s %10llu %12.0f %8llu %10llu %10llu %12llu\n",
+               capture_op_name(op), s->count, s->count / elapsed, s->failed,
+               stats_percentile(s, 0.50), stats_percentile(s, 0.99), stats_percentile(s, 1.0));
+        if (json != NULL) {
+            fprintf(json, "%s    {\"name\": \"%s\", \"ops\": %llu, \"failed\": %llu, \"ops_per_sec\": %.1f, "
+                          "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}",
+                    first ? "" : ",\n", capture_op_name(op), s->count, s->failed, s->count / elapsed,
+                    stats_percentile(s, 0.50), stats_percentile(s, 0.99), stats_percentile(s, 1.0));
+        }
+        first = 0;
+    }
+    
+    unsigned long long checksum = store_checksum(store);
+    printf("\nReplayed %lld ops in %.3f s (%.0f ops/sec) with %d processes\n",
+           all, elapsed, all / elapsed, cfg->procs);
+    printf("Final store: %d users, %d email slots, next email id %d, checksum %016llx\n",
+           store->control.user_count, store->control.email_count,
+           store->control.next_email_id, checksum);
+    
+    if (json != NULL) {
+        fprintf(json, "\n  ],\n  \"total_ops\": %lld,\n  \"ops_per_sec\": %.1f,\n"
+                      "  \"checksum\": \"%016llx\"\n}\n", all, all / elapsed, checksum);
+        fclose(json);
+        printf("Results written to %s\n", cfg->json_path);
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p procs] [-r] [-x speed] [-d db_dir] [-o results.json] file.cap...\n",
+            prog);
+}
+
+int main(int argc, char* argv[]) {
+    ReplayConfig cfg = {
+        .procs = 1,
+        .paced = 0,
+        .speed = 1.0,
+        .db_dir = ".",
+        .json_path = NULL,
+    };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "p:rx:d:o:")) != -1) {
+        switch (opt) {
+            case 'p':
+                cfg.procs = atoi(optarg);
+                break;
+            case 'r':
+                cfg.paced = 1;
+                break;
+            case 'x':
+                cfg.speed = atof(optarg);
+                break;
+            case 'd':
+                cfg.db_dir = optarg;
+                break;
+            case 'o':
+                cfg.json_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || cfg.procs < 1 || cfg.procs > REPLAY_MAX_PROCS || cfg.speed <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    capture_close();             // không capture chính lần replay
+    
+    int files = argc - optind;
+    for (int i = 0; i < files; i++) {
+        if (load_capture(argv[optind + i], i) < 0) {
+            return 1;
+        }
+    }
+    if (g_op_count == 0) {
+        fprintf(stderr, "mail_replay: no operations to replay\n");
+        return 1;
+    }
+    qsort(g_ops, g_op_count, sizeof(ReplayOp), compare_ops);
+    printf("Loaded %d operations from %d capture files (%.3f s of traffic)\n",
+           g_op_count, files, (g_ops[g_op_count - 1].t_ns - g_ops[0].t_ns) / 1e9);
+    
+    SharedMemoryData* store = mmap(NULL, sizeof(SharedMemoryData), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ReplayShared* shared = mmap(NULL, sizeof(ReplayShared), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (store == MAP_FAILED || shared == MAP_FAILED) {
+        perror("mail_replay: mmap");
+        return 1;
+    }
+    if (load_initial_state(store, cfg.db_dir) != 0) {
+        return 1;
+    }
+    
+    memset(shared, 0, sizeof(ReplayShared));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    
+    fflush(stdout);
+    long long start = stats_now();
+    pid_t pids[REPLAY_MAX_PROCS];
+    int started = 0;
+    for (int w = 0; w < cfg.procs; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            run_worker(&cfg, store, shared, w, files, start);
+            _exit(0);
+        }
+        if (pids[w] == -1) {
+            perror("mail_replay: fork");
+            break;
+        }
+        started++;
+    }
+    for (int w = 0; w < started; w++) {
+        waitpid(pids[w], NULL, 0);
+    }
+    double elapsed = (stats_now() - start) / 1e9;
+    
+    WorkerResult total;
+    memset(&total, 0, sizeof(total));
+    for (int w = 0; w < started; w++) {
+        for (int op = 0; op < REPLAY_OPS; op++) {
+            total.ops[op].count += shared->results[w].ops[op].count;
+            total.ops[op].failed += shared->results[w].ops[op].failed;
+            total.ops[op].total_ns += shared->results[w].ops[op].total_ns;
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                total.ops[op].hist[b] += shared->results[w].ops[op].hist[b];
+            }
+        }
+    }
+    
+    report(&cfg, &total, store, elapsed);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <signal.h>
+
+// mail_replica: feeder giữ segment replica theo kịp segment chính bằng change
+// log. Màn hình admin và ./mail_system --report đọc replica thay cho store.
+//
+//   ./mail_replica            chạy feeder (Ctrl+C để dừng)
+//   ./mail_replica status     mức đã áp dụng và độ trễ
+//   ./mail_replica destroy    xóa segment + semaphore replica
+
+static volatile sig_atomic_t g_running = 1;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+// Segment chính bị xóa và tạo lại (ipcrm, khởi động lại): key trỏ tới id khác
+static int primary_replaced() {
+    key_t key = ftok(".", SHM_KEY_USERS);
+    int id = (key == -1) ? -1 : shmget(key, sizeof(SharedMemoryData), 0666);
+    return id != -1 && id != get_shared_memory_id();
+}
+
+static SharedMemoryData* open_primary() {
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return NULL;
+    }
+    init_shared_memory(shm_ptr);
+    return shm_ptr;
+}
+
+static int run_feeder() {
+    SharedMemoryData* primary = open_primary();
+    if (primary == NULL) {
+        return 1;
+    }
+    SharedMemoryData* replica = attach_replica(1);
+    if (replica == NULL) {
+        fprintf(stderr, "mail_replica: cannot create replica segment\n");
+        detach_shared_memory(primary);
+        return 1;
+    }
+    
+    if (is_replica_running(replica) && replica->replica.feeder_pid != getpid()) {
+        printf("mail_replica already running (PID %d)\n", replica->replica.feeder_pid);
+        detach_shared_memory(replica);
+        detach_shared_memory(primary);
+        return 1;
+    }
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    // Segment replica có thể còn từ feeder trước: luôn bắt đầu bằng copy toàn bộ
+    replica->replica.is_replica = 0;
+    printf("mail_replica started (PID %d). Press Ctrl+C to exit.\n", getpid());
+    
+    while (g_running) {
+        int n = replica_sync(primary, replica);
+        if (n < 0) {
+            fprintf(stderr, "mail_replica: sync failed: %s\n", mailstore_strerror(n));
+        }
+        if (n > 0) {
+            continue;
+        }
+        
+        if (primary_replaced()) {
+            detach_shared_memory(primary);
+            primary = open_primary();
+            if (primary == NULL) {
+                break;
+            }
+            replica->replica.is_replica = 0;
+            printf("Primary segment recreated, copying it again\n");
+        }
+        usleep(REPLICA_POLL_MS * 1000);
+    }
+    
+    replica->replica.feeder_pid = 0;
+    printf("mail_replica stopped at modseq %llu (%llu changes applied, %u full copies)\n",
+           replica->replica.applied_modseq, replica->replica.applied, replica->replica.resyncs);
+    detach_shared_memory(replica);
+    if (primary == NULL) {
+        return 1;
+    }
+    primary->replica.feeder_pid = 0;
+    detach_shared_memory(primary);
+    return 0;
+}
+
+static int show_status(SharedMemoryData* primary) {
+    SharedMemoryData* replica = attach_replica(0);
+    if (replica == NULL) {
+        printf("No replica segment\n");
+        return 1;
+    }
+    
+    const ReplicaState* state = &replica->replica;
+    double age_ms = state->updated_ns > 0 ? (stats_now() - state->updated_ns) / 1e6 : 0;
+    printf("Feeder:   %s", is_replica_running(replica) ? "running" : "not running");
+    if (state->feeder_pid > 0) {
+        printf(" (PID %d)", state->feeder_pid);
+    }
+    printf("\nApplied:  modseq %llu of %llu (%llu changes behind)\n", state->applied_modseq,
+           get_global_modseq(primary), replica_lag(primary, replica));
+    printf("Updated:  %.1f ms ago\n", age_ms);
+    printf("Contents: %d users, %d email slots\n",
+           replica->control.user_count, replica->control.email_count);
+    printf("Totals:   %llu changes applied, %u full copies\n", state->applied, state->resyncs);
+    
+    detach_shared_memory(replica);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* cmd = (argc >= 2) ? argv[1] : "run";
+    
+    if (strcmp(cmd, "destroy") == 0) {
+        SharedMemoryData* replica = attach_replica(0);
+        if (replica == NULL) {
+            printf("No replica segment\n");
+            return 0;
+        }
+        if (is_replica_running(replica)) {
+            fprintf(stderr, "mail_replica: feeder still running (PID %d)\n", replica->replica.feeder_pid);
+            detach_shared_memory(replica);
+            return 1;
+        }
+        detach_shared_memory(replica);
+        return destroy_replica() == MS_OK ? 0 : 1;
+    }
+    
+    if (strcmp(cmd, "run") == 0) {
+        return run_feeder();
+    }
+    if (strcmp(cmd, "status") != 0) {
+        fprintf(stderr, "Usage: %s [run|status|destroy]\n", argv[0]);
+        return 1;
+    }
+    
+    SharedMemoryData* primary = open_primary();
+    if (primary == NULL) {
+        return 1;
+    }
+    int status = show_status(primary);
+    detach_shared_memory(primary);
+    return status;
+}
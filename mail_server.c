@@ -0,0 +1,515 @@
+#define _GNU_SOURCE
+#include "mail_system.h"
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// mail_server: server hướng sự kiện (epoll) trên Unix domain socket. Giao thức
+// là các dòng lệnh của batch mode (batch.c): client có thể gửi nhiều lệnh liên
+// tiếp không cần chờ trả lời (pipelining), kết quả trả về đúng thứ tự.
+//
+//   ./mail_server [-s socket_path] [-w workers]
+//
+// -w N: pre-fork N worker, mỗi worker có epoll riêng trên cùng listening socket.
+//
+// Khi bật change journal (MAILSTORE_JOURNAL=1), trả lời cho lệnh đã thay đổi
+// dữ liệu chỉ được gửi sau khi journal đã bền trên đĩa. Event loop không chờ
+// đĩa: output bị giữ lại, journal_commit báo khi xong (group commit), và
+// completion của aio đến qua aio_event_fd() trong cùng epoll.
+
+#define SERVER_MAX_EVENTS 256
+#define SERVER_READ_CHUNK 16384
+#define SERVER_MAX_INPUT (MAX_CONTENT_LENGTH * 4)
+#define SERVER_SAVE_INTERVAL 5
+
+typedef struct Connection {
+    int fd;
+    BatchSession session;
+    char* in;
+    size_t in_len;
+    size_t in_cap;
+    char* out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_ready;            // output đến đây đã được phép gửi
+    size_t commit_mark;          // out_ready khi journal_commit đang chờ báo về
+    int closing;                 // đóng sau khi gửi hết output
+    int awaiting;                // đang chờ journal_commit gọi durable_done
+    int recommit;                // có thêm output trong lúc chờ
+    int dead;                    // đã đóng khi đang chờ, durable_done sẽ free
+    int ready;                   // đang nằm trong g_ready
+    struct Connection* ready_next;
+} Connection;
+
+static volatile sig_atomic_t g_running = 1;
+static SharedMemoryData* g_shm_ptr = NULL;
+static Connection* g_ready = NULL;   // kết nối vừa được phép gửi thêm output
+static char g_aio_marker;            // data.ptr của aio_event_fd trong epoll
+
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+static int open_listen_socket(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Cho phép mở nhiều file descriptor nhất có thể (mỗi client một fd)
+static void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void free_connection(Connection* conn) {
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+// Kết nối còn được journal_commit hoặc g_ready tham chiếu thì chỉ đánh dấu
+// dead, nơi tham chiếu cuối cùng sẽ free
+static void close_connection(int epfd, Connection* conn) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->awaiting || conn->ready) {
+        conn->dead = 1;
+        return;
+    }
+    free_connection(conn);
+}
+
+static void update_interest(int epfd, Connection* conn) {
+    struct epoll_event ev;
+    if (conn->closing) {
+        // chỉ chờ gửi nốt output rồi đóng
+        ev.events = (conn->out_sent < conn->out_ready) ? EPOLLOUT : 0;
+    } else {
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        if (conn->out_sent < conn->out_ready) {
+            ev.events |= EPOLLOUT;
+        }
+    }
+    ev.data.ptr = conn;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Gửi phần output đã được phép gửi. Trả về -1 nếu kết nối hỏng.
+static int flush_output(Connection* conn) {
+    while (conn->out_sent < conn->out_ready) {
+        ssize_t n = write(conn->fd, conn->out + conn->out_sent, conn->out_ready - conn->out_sent);
+        if (n > 0) {
+            conn->out_sent += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+    
+    if (conn->out_sent == conn->out_len) {
+        free(conn->out);
+        conn->out = NULL;
+        conn->out_len = conn->out_sent = conn->out_ready = conn->commit_mark = 0;
+    }
+    return 0;
+}
+
+// Callback của journal_commit: output đến commit_mark đã bền. Có thể chạy
+// giữa lúc đang xử lý kết nối khác (trong unlock_store), nên chỉ đưa kết nối
+// vào g_ready; event loop gửi sau.
+static void durable_done(void* arg, int result) {
+    Connection* conn = arg;
+    conn->awaiting = 0;
+    if (conn->dead) {
+        if (!conn->ready) {
+            free_connection(conn);
+        }
+        return;
+    }
+    if (result != MS_OK) {
+        fprintf(stderr, "mail_server: journal write failed, replies are not durable\n");
+    }
+    
+    if (conn->commit_mark > conn->out_ready) {
+        conn->out_ready = conn->commit_mark;
+    }
+    if (conn->recommit) {
+        conn->recommit = 0;
+        conn->awaiting = 1;
+        conn->commit_mark = conn->out_len;
+        journal_commit(durable_done, conn);
+    }
+    if (!conn->ready) {
+        conn->ready = 1;
+        conn->ready_next = g_ready;
+        g_ready = conn;
+    }
+}
+
+// Output mới chỉ được gửi khi các thay đổi của process này đã bền
+static void release_output(Connection* conn) {
+    if (conn->awaiting) {
+        conn->recommit = 1;
+    } else if (journal_pending()) {
+        conn->awaiting = 1;
+        conn->commit_mark = conn->out_len;
+        journal_commit(durable_done, conn);
+    } else {
+        conn->out_ready = conn->out_len;
+    }
+}
+
+static void append_output(Connection* conn, const char* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    char* grown = realloc(conn->out, conn->out_len + len);
+    if (grown == NULL) {
+        conn->closing = 1;
+        return;
+    }
+    memcpy(grown + conn->out_len, data, len);
+    conn->out = grown;
+    conn->out_len += len;
+}
+
+// Chạy mọi dòng lệnh hoàn chỉnh trong input buffer (pipelining)
+static void process_input(Connection* conn) {
+    char* buf = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&buf, &size);
+    if (out == NULL) {
+        conn->closing = 1;
+        return;
+    }
+    
+    size_t start = 0;
+    while (!conn->closing) {
+        char* nl = memchr(conn->in + start, '\n', conn->in_len - start);
+        if (nl == NULL) {
+            break;
+        }
+        *nl = '\0';
+        if (!execute_batch_command(g_shm_ptr, &conn->session, conn->in + start, out)) {
+            conn->closing = 1;
+        }
+        start = (nl - conn->in) + 1;
+    }
+    
+    memmove(conn->in, conn->in + start, conn->in_len - start);
+    conn->in_len -= start;
+    
+    if (conn->in_len >= SERVER_MAX_INPUT) {
+        fprintf(out, "ERR|line too long\n");
+        conn->closing = 1;
+    }
+    
+    fclose(out);
+    append_output(conn, buf, size);
+    free(buf);
+    release_output(conn);
+}
+
+static void handle_readable(int epfd, Connection* conn) {
+    while (1) {
+        if (conn->in_cap - conn->in_len < SERVER_READ_CHUNK) {
+            size_t cap = conn->in_cap ? conn->in_cap * 2 : SERVER_READ_CHUNK * 2;
+            char* grown = realloc(conn->in, cap);
+            if (grown == NULL) {
+                close_connection(epfd, conn);
+                return;
+            }
+            conn->in = grown;
+            conn->in_cap = cap;
+        }
+        
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        conn->closing = 1;   // EOF hoặc lỗi: trả lời nốt rồi đóng
+        break;
+    }
+    
+    process_input(conn);
+    
+    if (flush_output(conn) == -1 || (conn->closing && conn->out_len == 0)) {
+        close_connection(epfd, conn);
+        return;
+    }
+    update_interest(epfd, conn);
+}
+
+static void accept_clients(int epfd, int listen_fd) {
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        
+        Connection* conn = calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->session.user_id = -1;
+        
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+// Lưu nền định kỳ khi dữ liệu đã thay đổi
+static void periodic_save(time_t* last_save, unsigned long long* saved_modseq, int* saved_next_user_id) {
+    time_t now = time(NULL);
+    poll_background_save();
+    if (now - *last_save < SERVER_SAVE_INTERVAL) {
+        return;
+    }
+    *last_save = now;
+    
+    unsigned long long modseq = get_global_modseq(g_shm_ptr);
+    int next_user_id = g_shm_ptr->control.next_user_id;
+    if (modseq == *saved_modseq && next_user_id == *saved_next_user_id) {
+        return;
+    }
+    
+    lock_store();
+    start_background_save(g_shm_ptr, BGSAVE_USERS | BGSAVE_EMAILS);
+    unlock_store();
+    *saved_modseq = modseq;
+    *saved_next_user_id = next_user_id;
+}
+
+static void run_event_loop(int listen_fd, int exclusive_accept) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) {
+        perror("epoll_create1");
+        return;
+    }
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (exclusive_accept ? EPOLLEXCLUSIVE : 0);
+    ev.data.ptr = NULL;   // NULL = listening socket
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        perror("epoll_ctl listen");
+        close(epfd);
+        return;
+    }
+    
+    if (g_shm_ptr->journal.enabled) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &g_aio_marker;
+        int aio_fd = aio_event_fd();
+        if (aio_fd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, aio_fd, &ev) == -1) {
+            fprintf(stderr, "mail_server: async journal I/O unavailable\n");
+        }
+    }
+    
+    time_t last_save = time(NULL);
+    unsigned long long saved_modseq = get_global_modseq(g_shm_ptr);
+    int saved_next_user_id = g_shm_ptr->control.next_user_id;
+    
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (g_running) {
+        int n = epoll_wait(epfd, events, SERVER_MAX_EVENTS, g_ready ? 0 : 1000);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        
+        for (int i = 0; i < n; i++) {
+            Connection* conn = events[i].data.ptr;
+            if (conn == NULL) {
+                accept_clients(epfd, listen_fd);
+                continue;
+            }
+            if ((void*)conn == &g_aio_marker) {
+                journal_poll();
+                continue;
+            }
+            
+            if (conn->closing && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                close_connection(epfd, conn);
+            } else if (!conn->closing && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                handle_readable(epfd, conn);
+            } else if (events[i].events & EPOLLOUT) {
+                if (flush_output(conn) == -1 || (conn->closing && conn->out_len == 0)) {
+                    close_connection(epfd, conn);
+                } else {
+                    update_interest(epfd, conn);
+                }
+            }
+        }
+        
+        
+        while (g_ready != NULL) {
+            Connection* conn = g_ready;
+            g_ready = conn->ready_next;
+            conn->ready = 0;
+            if (conn->dead) {
+                if (!conn->awaiting) {
+                    free_connection(conn);
+                }
+                continue;
+            }
+            if (flush_output(conn) == -1 || (conn->closing && conn->out_len == 0)) {
+                close_connection(epfd, conn);
+            } else {
+                update_interest(epfd, conn);
+            }
+        }
+        
+        periodic_save(&last_save, &saved_modseq, &saved_next_user_id);
+    }
+    
+    close(epfd);
+    wait_background_saves();
+}
+
+static void run_workers(int listen_fd, int workers) {
+    pid_t pids[64];
+    if (workers > 64) {
+        workers = 64;
+    }
+    
+    for (int i = 0; i < workers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            run_event_loop(listen_fd, 1);
+            journal_sync();
+            _exit(0);
+        }
+        if (pids[i] == -1) {
+            perror("fork worker");
+            workers = i;
+            break;
+        }
+    }
+    
+    printf("mail_server: %d workers started\n", workers);
+    while (g_running) {
+        pause();
+    }
+    
+    for (int i = 0; i < workers; i++) {
+        kill(pids[i], SIGTERM);
+    }
+    for (int i = 0; i < workers; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* socket_path = MAIL_SERVER_SOCKET;
+    int workers = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:")) != -1) {
+        switch (opt) {
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s socket_path] [-w workers]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    g_shm_ptr = attach_shared_memory();
+    if (g_shm_ptr == NULL) {
+        printf("Failed to attach to shared memory!\n");
+        return 1;
+    }
+    init_shared_memory(g_shm_ptr);
+    
+    raise_fd_limit();
+    int listen_fd = open_listen_socket(socket_path);
+    if (listen_fd == -1) {
+        detach_shared_memory(g_shm_ptr);
+        return 1;
+    }
+    
+    printf("mail_server listening on %s (PID %d)\n", socket_path, getpid());
+    fflush(stdout);
+    
+    if (workers > 0) {
+        run_workers(listen_fd, workers);
+    } else {
+        run_event_loop(listen_fd, 0);
+    }
+    
+    close(listen_fd);
+    unlink(socket_path);
+    
+    printf("\nmail_server stopping...\n");
+    lock_store();
+    if (save_users_to_file(g_shm_ptr) != MS_OK || save_emails_to_file(g_shm_ptr) != MS_OK) {
+        fprintf(stderr, "mail_server: final save failed\n");
+    }
+    unlock_store();
+    
+    detach_shared_memory(g_shm_ptr);
+    return 0;
+}
@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// mail_shard: quản lý và đo store chia shard (shard.c).
+//
+//   ./mail_shard [-d dir] [-n shards] [-r hash|domain] command [args]
+//
+//   register name email password age   tạo user ở shard theo địa chỉ
+//   send from_email to_email subject content
+//   list email [received|sent|both]
+//   deliver                            giao các bản ghi giao còn chờ
+//   save                               lưu mọi shard (mỗi shard một lock)
+//   stats                              users/emails/queue của từng shard
+//   bench [-p procs] [-s seconds] [-u users]
+//   destroy                            xóa segment + semaphore của các shard
+//
+// -n/-r chỉ dùng khi dir chưa có shards.conf. bench chạy trên thư mục tạm
+// riêng và in số lần gửi+xóa mỗi giây để so sánh giữa các số shard.
+
+#define SHARD_DEFAULT_DIR "shards"
+#define BENCH_MAX_PROCS 64
+
+typedef struct {
+    long ops;
+    long queued;
+    long failed;
+} BenchCounters;
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-d dir] [-n shards] [-r hash|domain] command [args]\n", prog);
+    fprintf(stderr, "  register name email password age | send from to subject content\n");
+    fprintf(stderr, "  list email [received|sent|both] | deliver | save | stats | destroy\n");
+    fprintf(stderr, "  bench [-p procs] [-s seconds] [-u users]\n");
+}
+
+static int cmd_register(ShardSet* set, int argc, char** argv) {
+    if (argc != 5) {
+        fprintf(stderr, "usage: register name email password age\n");
+        return 1;
+    }
+    int id = shard_create_user(set, argv[1], argv[2], argv[3], atoi(argv[4]));
+    if (id < 0) {
+        fprintf(stderr, "register: %s\n", mailstore_strerror(id));
+        return 1;
+    }
+    printf("user %d on shard %d\n", id, shard_for_id(set, id));
+    return shard_save(set, shard_for_id(set, id)) == MS_OK ? 0 : 1;
+}
+
+static int cmd_send(ShardSet* set, int argc, char** argv) {
+    if (argc != 5) {
+        fprintf(stderr, "usage: send from_email to_email subject content\n");
+        return 1;
+    }
+    User from, to;
+    if (shard_find_user(set, argv[1], &from) != MS_OK || shard_find_user(set, argv[2], &to) != MS_OK) {
+        fprintf(stderr, "send: unknown user\n");
+        return 1;
+    }
+    int id = shard_send_email(set, from.user_id, to.user_id, argv[3], argv[4]);
+    if (id < 0) {
+        fprintf(stderr, "send: %s\n", mailstore_strerror(id));
+        return 1;
+    }
+    if (id == 0) {
+        printf("queued on shard %d for shard %d\n", shard_for_id(set, from.user_id),
+               shard_for_id(set, to.user_id));
+    } else {
+        printf("email %d on shard %d\n", id, shard_for_id(set, id));
+    }
+    shard_save(set, shard_for_id(set, from.user_id));
+    return shard_save(set, shard_for_id(set, to.user_id)) == MS_OK ? 0 : 1;
+}
+
+static int cmd_list(ShardSet* set, int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: list email [received|sent|both]\n");
+        return 1;
+    }
+    int type = MAILBOX_RECEIVED;
+    if (argc > 2 && strcmp(argv[2], "sent") == 0) {
+        type = MAILBOX_SENT;
+    } else if (argc > 2 && strcmp(argv[2], "both") == 0) {
+        type = MAILBOX_BOTH;
+    }
+    
+    User user;
+    if (shard_find_user(set, argv[1], &user) != MS_OK) {
+        fprintf(stderr, "list: unknown user %s\n", argv[1]);
+        return 1;
+    }
+    int max = MAX_EMAILS * set->count;
+    Email* emails = malloc(sizeof(Email) * max);
+    if (emails == NULL) {
+        return 1;
+    }
+    int n = shard_list_mailbox(set, user.user_id, type, emails, max);
+    for (int i = 0; i < n; i++) {
+        User other;
+        int other_id = (emails[i].receiver_id == user.user_id) ? emails[i].sender_id : emails[i].receiver_id;
+        const char* address = (shard_read_user(set, other_id, &other) == MS_OK) ? other.email : "?";
+        printf("%6d  %-4s %-28s %s%s\n", emails[i].email_id,
+               emails[i].receiver_id == user.user_id ? "from" : "to", address,
+               emails[i].subject, emails[i].is_read ? "" : "  (unread)");
+    }
+    printf("%d emails\n", n);
+    free(emails);
+    return 0;
+}
+
+static int cmd_stats(ShardSet* set) {
+    printf("%d shards in %s, route by %s\n\n", set->count, set->dir,
+           set->route == SHARD_ROUTE_DOMAIN ? "domain" : "address hash");
+    printf("%-6s %8s %8s %10s %10s %10s %12s\n",
+           "shard", "users", "emails", "queued", "delivered", "rejected", "modseq");
+    for (int i = 0; i < set->count; i++) {
+        SharedMemoryData* shm_ptr = set->shards[i];
+        shard_lock(set, i);
+        int live = 0;
+        EmailIterator it;
+        email_iter_init(&it, 0, MAILBOX_BOTH);
+        while (email_iter_next(shm_ptr, &it) != NULL) {
+            live++;
+        }
+        printf("%-6d %8d %8d %10d %10d %10d %12llu\n", i, shm_ptr->control.user_count, live,
+               shm_ptr->queue.count, shm_ptr->queue.delivered, shm_ptr->queue.rejected,
+               shm_ptr->changelog.highest_modseq);
+        shard_unlock(set, i);
+    }
+    return 0;
+}
+
+// ===== bench =====
+
+// Worker i chỉ gửi tới các user có chỉ số % procs == i, nên sau mỗi lượt nó
+// có thể giao các bản ghi còn chờ rồi dọn mailbox của chính những user đó
+// (bản ghi giao không trả về email_id để xóa ngay như đường gửi trực tiếp).
+static void trim_bench_mailboxes(ShardSet* set, const int* user_ids, int users, int procs,
+                                 int index, Email* scratch) {
+    for (int s = 0; s < set->count; s++) {
+        shard_deliver(set, s);
+    }
+    for (int u = index; u < users; u += procs) {
+        int n = shard_list_mailbox(set, user_ids[u], MAILBOX_RECEIVED, scratch, MAX_EMAILS);
+        for (int i = 0; i < n; i++) {
+            shard_delete_email(set, scratch[i].email_id);
+        }
+    }
+}
+
+static void run_bench_worker(ShardSet* set, const int* user_ids, int users, int procs,
+                             int seconds, int index, BenchCounters* counters) {
+    unsigned int seed = 1234u + index * 7919u;
+    long long deadline = stats_now() + (long long)seconds * 1000000000LL;
+    int owned = (users - index + procs - 1) / procs;
+    Email* scratch = malloc(sizeof(Email) * MAX_EMAILS);
+    char subject[64];
+    
+    while (stats_now() < deadline) {
+        int queued = 0;
+        for (int k = 0; k < 64; k++) {
+            int sender = user_ids[rand_r(&seed) % users];
+            int receiver = user_ids[index + procs * (rand_r(&seed) % owned)];
+            snprintf(subject, sizeof(subject), "bench %d", k);
+            int id = shard_send_email(set, sender, receiver, subject, "shard bench body");
+            if (id > 0) {
+                shard_delete_email(set, id);
+                counters->ops++;
+            } else if (id == 0) {
+                counters->queued++;
+                queued++;
+            } else {
+                counters->failed++;
+            }
+        }
+        if (queued > 0) {
+            trim_bench_mailboxes(set, user_ids, users, procs, index, scratch);
+        }
+    }
+    trim_bench_mailboxes(set, user_ids, users, procs, index, scratch);
+    free(scratch);
+}
+
+static int cmd_bench(int count, int route, int argc, char** argv) {
+    int procs = 4, seconds = 3, users = 64;
+    optind = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:u:")) != -1) {
+        switch (opt) {
+            case 'p':
+                procs = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'u':
+                users = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: bench [-p procs] [-s seconds] [-u users]\n");
+                return 1;
+        }
+    }
+    if (procs < 1 || procs > BENCH_MAX_PROCS || seconds < 1 || users < procs || users > MAX_USERS) {
+        fprintf(stderr, "bench: procs 1..%d, seconds >= 1, users procs..%d\n", BENCH_MAX_PROCS, MAX_USERS);
+        return 1;
+    }
+    
+    char dir[] = "/tmp/mail_shard.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    ShardSet set;
+    int rc = shard_open(&set, dir, count, route);
+    if (rc != MS_OK) {
+        fprintf(stderr, "bench: %s\n", mailstore_strerror(rc));
+        return 1;
+    }
+    
+    int* user_ids = malloc(sizeof(int) * users);
+    for (int i = 0; i < users; i++) {
+        char name[32], email[64];
+        snprintf(name, sizeof(name), "Shard Bench %d", i);
+        snprintf(email, sizeof(email), "bench%d@shard%d.local", i, i % 8);
+        user_ids[i] = shard_create_user(&set, name, email, "bench", 30);
+    }
+    
+    BenchCounters* counters = mmap(NULL, sizeof(BenchCounters) * procs, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    memset(counters, 0, sizeof(BenchCounters) * procs);
+    
+    long long start = stats_now();
+    for (int i = 0; i < procs; i++) {
+        if (fork() == 0) {
+            run_bench_worker(&set, user_ids, users, procs, seconds, i, &counters[i]);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    double elapsed = (stats_now() - start) / 1e9;
+    
+    BenchCounters total = { 0, 0, 0 };
+    for (int i = 0; i < procs; i++) {
+        total.ops += counters[i].ops;
+        total.queued += counters[i].queued;
+        total.failed += counters[i].failed;
+    }
+    printf("%d shards, %d procs, %d users: %.0f sends/s (%ld direct, %ld via delivery queue, %ld failed)\n",
+           count, procs, users, (total.ops + total.queued) / elapsed, total.ops, total.queued, total.failed);
+    
+    munmap(counters, sizeof(BenchCounters) * procs);
+    free(user_ids);
+    shard_destroy(&set);
+    for (int i = 0; i < count; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/shard%d", dir, i);
+        rmdir(path);
+    }
+    char manifest[512];
+    snprintf(manifest, sizeof(manifest), "%s/%s", dir, SHARD_MANIFEST);
+    unlink(manifest);
+    rmdir(dir);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = SHARD_DEFAULT_DIR;
+    int count = 0;
+    int route = SHARD_ROUTE_HASH;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "+d:n:r:")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'r':
+                route = (strcmp(optarg, "domain") == 0) ? SHARD_ROUTE_DOMAIN : SHARD_ROUTE_HASH;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* cmd = argv[optind];
+    int cmd_argc = argc - optind;
+    char** cmd_argv = argv + optind;
+    
+    if (strcmp(cmd, "bench") == 0) {
+        return cmd_bench(count > 0 ? count : 4, route, cmd_argc, cmd_argv);
+    }
+    
+    // Thư mục đã có manifest thì số shard lấy từ manifest, không thì mặc định 4
+    char manifest[512];
+    snprintf(manifest, sizeof(manifest), "%s/%s", dir, SHARD_MANIFEST);
+    if (count == 0 && access(manifest, F_OK) != 0) {
+        count = 4;
+    }
+    
+    ShardSet set;
+    int rc = shard_open(&set, dir, count, route);
+    if (rc != MS_OK) {
+        fprintf(stderr, "mail_shard: cannot open %s: %s\n", dir, mailstore_strerror(rc));
+        return 1;
+    }
+    
+    int status = 0;
+    if (strcmp(cmd, "register") == 0) {
+        status = cmd_register(&set, cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "send") == 0) {
+        status = cmd_send(&set, cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "list") == 0) {
+        status = cmd_list(&set, cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "deliver") == 0) {
+        int delivered = 0;
+        for (int i = 0; i < set.count; i++) {
+            delivered += shard_deliver(&set, i);
+        }
+        printf("delivered %d\n", delivered);
+        status = (shard_save_all(&set) == MS_OK) ? 0 : 1;
+    } else if (strcmp(cmd, "save") == 0) {
+        status = (shard_save_all(&set) == MS_OK) ? 0 : 1;
+    } else if (strcmp(cmd, "stats") == 0) {
+        status = cmd_stats(&set);
+    } else if (strcmp(cmd, "destroy") == 0) {
+        shard_save_all(&set);
+        status = (shard_destroy(&set) == MS_OK) ? 0 : 1;
+        return status;
+    } else {
+        usage(argv[0]);
+        status = 1;
+    }
+    
+    shard_close(&set);
+    return status;
+}
@@ -0,0 +1,603 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// mail_standby: log shipping sang một store dự phòng ở thư mục khác.
+//
+//   ./mail_standby receive -d /backup/mail [-s socket]   chạy ở bất kỳ đâu
+//   ./mail_standby ship -s /backup/mail/standby.sock     chạy trong thư mục primary
+//
+// Shipper đọc change log của segment chính (như mail_replica), đóng gói thay
+// đổi thành JournalRecord và gửi qua Unix socket; đường gửi mail của primary
+// không thêm I/O đĩa nào. Standby áp record vào segment của thư mục nó (khóa
+// theo ftok thư mục đó), lưu users.txt/emails.txt mỗi STANDBY_SAVE_MS và ack
+// modseq đã lưu bền. Chuyển sang standby: dừng receive rồi chạy mail_system
+// trong thư mục standby. Socket mặc định: <thư mục standby>/standby.sock.
+
+typedef struct {
+    ControlData control;
+    User users[MAX_USERS];
+} ShipUsers;
+
+#define FRAME_MAX (sizeof(JournalRecord) + sizeof(ShipUsers) + MAX_SUBJECT_LENGTH + MAX_CONTENT_LENGTH + 8)
+
+static volatile sig_atomic_t g_running = 1;
+
+static void stop_handler(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s receive -d dir [-s socket]\n", prog);
+    fprintf(stderr, "       %s ship -s socket\n", prog);
+}
+
+// ===== frame I/O =====
+
+static int write_full(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return MS_ERR_IO;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return MS_OK;
+}
+
+static int read_full(int fd, void* buf, size_t len) {
+    char* p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return MS_ERR_IO;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return MS_OK;
+}
+
+// Gửi rồi free record
+static int send_frame(int fd, JournalRecord* rec, unsigned long long* bytes) {
+    if (rec == NULL) {
+        return MS_ERR_SYS;
+    }
+    int rc = write_full(fd, rec, rec->length);
+    if (rc == MS_OK && bytes != NULL) {
+        *bytes += rec->length;
+    }
+    free(rec);
+    return rc;
+}
+
+static int read_frame(int fd, JournalRecord* rec) {
+    if (read_full(fd, rec, sizeof(JournalRecord)) != MS_OK) {
+        return MS_ERR_IO;
+    }
+    if (journal_check_record(rec, FRAME_MAX, 0) != MS_OK) {
+        return MS_ERR_CORRUPT;
+    }
+    if (read_full(fd, rec + 1, rec->length - sizeof(JournalRecord)) != MS_OK) {
+        return MS_ERR_IO;
+    }
+    return journal_check_record(rec, FRAME_MAX, 1);
+}
+
+static int readable(int fd, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+static void socket_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+}
+
+// ===== shipper (phía primary) =====
+
+typedef struct {
+    int fd;
+    unsigned long long shipped;
+    unsigned int users_version;
+    unsigned int lazy_generation;    // lazy.generation của primary lúc snapshot
+    // modseq cuối của từng lô đã gửi và thời điểm gửi, để tính độ trễ ack
+    unsigned long long mark_modseq[STANDBY_LAG_MARKS];
+    long long mark_ns[STANDBY_LAG_MARKS];
+    int mark_head;
+    int mark_count;
+} ShipLink;
+
+static Email g_staged[REPLICA_BATCH];
+static ShipUsers g_users;
+
+static void add_mark(ShipLink* link, unsigned long long modseq) {
+    if (link->mark_count == STANDBY_LAG_MARKS) {
+        // Đầy: gộp vào mark mới nhất (độ trễ vẫn tính từ mark cũ nhất)
+        int last = (link->mark_head + link->mark_count - 1) % STANDBY_LAG_MARKS;
+        link->mark_modseq[last] = modseq;
+        return;
+    }
+    int slot = (link->mark_head + link->mark_count) % STANDBY_LAG_MARKS;
+    link->mark_modseq[slot] = modseq;
+    link->mark_ns[slot] = stats_now();
+    link->mark_count++;
+}
+
+static void publish_lag(SharedMemoryData* primary, ShipLink* link) {
+    StandbyState* state = &primary->standby;
+    long long lag = (link->mark_count > 0) ? stats_now() - link->mark_ns[link->mark_head] : 0;
+    __atomic_store_n(&state->shipped_modseq, link->shipped, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->lag_ns, lag, __ATOMIC_RELAXED);
+}
+
+static int handle_ack(SharedMemoryData* primary, ShipLink* link, const JournalRecord* rec) {
+    if (rec->op != SHIP_ACK) {
+        return MS_ERR_CORRUPT;
+    }
+    while (link->mark_count > 0 && link->mark_modseq[link->mark_head] <= rec->modseq) {
+        link->mark_head = (link->mark_head + 1) % STANDBY_LAG_MARKS;
+        link->mark_count--;
+    }
+    __atomic_store_n(&primary->standby.acked_modseq, rec->modseq, __ATOMIC_RELAXED);
+    return MS_OK;
+}
+
+// Copy toàn bộ dưới một lần giữ store lock, gửi ngoài lock. Mailbox lazy chưa
+// nạp được nạp hết trước. Mail đã hạ xuống file cold (việc hạ xuống không có
+// trong change log) được gửi như mail thường: chỉ copy index dưới lock, dựng
+// lại từ file khi gửi.
+static int send_snapshot(SharedMemoryData* primary, ShipLink* link) {
+    Email* emails = malloc(sizeof(Email) * MAX_EMAILS);
+    ColdEntry* cold = malloc(sizeof(ColdEntry) * TIER_INDEX_SIZE);
+    if (emails == NULL || cold == NULL) {
+        free(emails);
+        free(cold);
+        return MS_ERR_SYS;
+    }
+    
+    lazy_load_all(primary);
+    lock_store();
+    g_users.control = primary->control;
+    memcpy(g_users.users, primary->users, sizeof(g_users.users));
+    unsigned int generation = primary->lazy.generation;
+    int count = primary->control.email_count;
+    memcpy(emails, primary->emails, sizeof(Email) * count);
+    int cold_count = primary->tier.enabled ? primary->tier.count : 0;
+    memcpy(cold, primary->tier.index, sizeof(ColdEntry) * cold_count);
+    unsigned long long modseq = get_global_modseq(primary);
+    unlock_store();
+    
+    unsigned long long* bytes = &primary->standby.bytes;
+    int rc = send_frame(link->fd, journal_build_frame(SHIP_SNAPSHOT, modseq, &g_users, sizeof(g_users)), bytes);
+    int sent = 0;
+    for (int i = 0; i < count && rc == MS_OK; i++) {
+        if (emails[i].email_id > 0 && !emails[i].is_deleted) {
+            rc = send_frame(link->fd, journal_build_record(&emails[i], CHANGE_CREATE), bytes);
+            sent++;
+        }
+    }
+    for (int i = 0; i < cold_count && rc == MS_OK; i++) {
+        if (cold[i].email_id == 0 || cold[i].is_deleted) {
+            continue;
+        }
+        // Tái dùng buffer của mail trong segment: đã gửi xong
+        if (tier_materialize(&cold[i], &emails[0]) != MS_OK) {
+            fprintf(stderr, "mail_standby: cannot read cold email %d\n", cold[i].email_id);
+            continue;
+        }
+        rc = send_frame(link->fd, journal_build_record(&emails[0], CHANGE_CREATE), bytes);
+        sent++;
+    }
+    if (rc == MS_OK) {
+        rc = send_frame(link->fd, journal_build_frame(SHIP_SNAPSHOT_END, modseq, NULL, 0), bytes);
+    }
+    free(emails);
+    free(cold);
+    if (rc != MS_OK) {
+        return rc;
+    }
+    
+    link->shipped = modseq;
+    link->users_version = g_users.control.users_version;
+    link->lazy_generation = generation;
+    primary->standby.snapshots++;
+    add_mark(link, modseq);
+    return sent;
+}
+
+// Gửi một lô thay đổi. Trả về số thay đổi đã gửi (0 = standby đã theo kịp).
+static int ship_changes(SharedMemoryData* primary, ShipLink* link) {
+    // Nạp lazy không đi qua change log: mail vừa nạp chỉ đến được bằng snapshot
+    if (__atomic_load_n(&primary->lazy.generation, __ATOMIC_ACQUIRE) != link->lazy_generation) {
+        return send_snapshot(primary, link);
+    }
+    if (get_global_modseq(primary) == link->shipped &&
+        __atomic_load_n(&primary->control.users_version, __ATOMIC_RELAXED) == link->users_version) {
+        return 0;
+    }
+    
+    EmailChange changes[REPLICA_BATCH];
+    unsigned long long next = link->shipped;
+    
+    lock_store();
+    int users_changed = (primary->control.users_version != link->users_version);
+    if (users_changed) {
+        g_users.control = primary->control;
+        memcpy(g_users.users, primary->users, sizeof(g_users.users));
+    }
+    int n = get_changes_since(primary, 0, link->shipped, changes, REPLICA_BATCH, &next);
+    if (n < 0) {
+        unlock_store();
+        return send_snapshot(primary, link);
+    }
+    // Gửi trạng thái hiện tại của email chứ không phải op gốc: bản ghi create
+    // có thể đã bị thay đổi mới hơn thay thế trong change log
+    for (int i = 0; i < n; i++) {
+        if (changes[i].op == CHANGE_DELETE) {
+            memset(&g_staged[i], 0, sizeof(Email));
+            g_staged[i].email_id = changes[i].email_id;
+            g_staged[i].modseq = changes[i].modseq;
+        } else {
+            g_staged[i] = *changes[i].email;
+        }
+    }
+    unlock_store();
+    
+    unsigned long long* bytes = &primary->standby.bytes;
+    int rc = MS_OK;
+    if (users_changed) {
+        rc = send_frame(link->fd, journal_build_frame(SHIP_USERS, next, &g_users, sizeof(g_users)), bytes);
+    }
+    for (int i = 0; i < n && rc == MS_OK; i++) {
+        int op = (changes[i].op == CHANGE_DELETE) ? CHANGE_DELETE : CHANGE_CREATE;
+        rc = send_frame(link->fd, journal_build_record(&g_staged[i], op), bytes);
+    }
+    if (rc != MS_OK) {
+        return rc;
+    }
+    
+    if (users_changed) {
+        link->users_version = g_users.control.users_version;
+    }
+    link->shipped = next;
+    add_mark(link, next);
+    return n + users_changed;
+}
+
+static int connect_standby(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_un addr;
+    socket_address(path, &addr);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Một phiên kết nối: nhận HELLO, bắt kịp từ modseq standby đã có, rồi gửi
+// liên tục cho tới khi mất kết nối
+static void ship_session(SharedMemoryData* primary, int fd, JournalRecord* frame) {
+    ShipLink link;
+    memset(&link, 0, sizeof(link));
+    link.fd = fd;
+    
+    if (read_frame(fd, frame) != MS_OK || frame->op != SHIP_HELLO) {
+        fprintf(stderr, "mail_standby: bad hello from standby\n");
+        return;
+    }
+    primary->standby.acked_modseq = frame->modseq;
+    primary->standby.connected = 1;
+    
+    int rc;
+    int full = (frame->modseq == 0 || frame->modseq > get_global_modseq(primary));
+    printf("Standby connected at modseq %llu (%s)\n", frame->modseq, full ? "full copy" : "resuming");
+    if (full) {
+        rc = send_snapshot(primary, &link);
+    } else {
+        link.shipped = frame->modseq;
+        link.users_version = primary->control.users_version - 1;    // gửi lại users một lần
+        link.lazy_generation = primary->lazy.generation;            // bản của standby đã đầy đủ
+        rc = ship_changes(primary, &link);
+    }
+    
+    while (g_running && rc >= 0) {
+        publish_lag(primary, &link);
+        if (readable(fd, rc > 0 ? 0 : REPLICA_POLL_MS)) {
+            if (read_frame(fd, frame) != MS_OK || handle_ack(primary, &link, frame) != MS_OK) {
+                break;
+            }
+        }
+        rc = ship_changes(primary, &link);
+    }
+    publish_lag(primary, &link);
+    primary->standby.connected = 0;
+}
+
+static int run_shipper(const char* path) {
+    SharedMemoryData* primary = attach_shared_memory();
+    if (primary == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return 1;
+    }
+    init_shared_memory(primary);
+    
+    StandbyState* state = &primary->standby;
+    if (state->shipper_pid > 0 && state->shipper_pid != getpid() &&
+        !(kill(state->shipper_pid, 0) == -1 && errno == ESRCH)) {
+        printf("mail_standby ship already running (PID %d)\n", state->shipper_pid);
+        detach_shared_memory(primary);
+        return 1;
+    }
+    memset(state, 0, sizeof(StandbyState));
+    state->shipper_pid = getpid();
+    
+    JournalRecord* frame = malloc(FRAME_MAX);
+    printf("mail_standby shipping to %s (PID %d). Press Ctrl+C to exit.\n", path, getpid());
+    int waiting = 0;
+    while (g_running) {
+        int fd = connect_standby(path);
+        if (fd < 0) {
+            if (!waiting) {
+                printf("Standby not reachable, retrying every %d ms\n", STANDBY_RETRY_MS);
+                waiting = 1;
+            }
+            usleep(STANDBY_RETRY_MS * 1000);
+            continue;
+        }
+        waiting = 0;
+        ship_session(primary, fd, frame);
+        close(fd);
+        if (g_running) {
+            printf("Standby disconnected at acked modseq %llu\n", state->acked_modseq);
+        }
+    }
+    
+    free(frame);
+    state->shipper_pid = 0;
+    state->connected = 0;
+    detach_shared_memory(primary);
+    return 0;
+}
+
+// ===== standby =====
+
+typedef struct {
+    int in_snapshot;             // giữa SHIP_SNAPSHOT và SHIP_SNAPSHOT_END: không lưu
+    int dirty;
+    unsigned long long durable;  // modseq của users.txt/emails.txt trong thư mục standby
+    long long last_save_ns;
+    unsigned long long applied;
+} StandbyStore;
+
+static void apply_users(SharedMemoryData* shm_ptr, const ShipUsers* payload) {
+    memcpy(shm_ptr->users, payload->users, sizeof(shm_ptr->users));
+    shm_ptr->control.user_count = payload->control.user_count;
+    shm_ptr->control.next_user_id = payload->control.next_user_id;
+    shm_ptr->control.users_version++;
+}
+
+// Caller giữ store lock của standby
+static int apply_frame(SharedMemoryData* shm_ptr, StandbyStore* store, const JournalRecord* rec) {
+    switch (rec->op) {
+        case SHIP_SNAPSHOT:
+            if (rec->length < sizeof(JournalRecord) + sizeof(ShipUsers)) {
+                return MS_ERR_CORRUPT;
+            }
+            memset(shm_ptr->emails, 0, sizeof(shm_ptr->emails));
+            shm_ptr->control.email_count = 0;
+            shm_ptr->control.next_email_id = ((const ShipUsers*)(rec + 1))->control.next_email_id;
+            apply_users(shm_ptr, (const ShipUsers*)(rec + 1));
+            // Bộ nhớ không còn khớp file trên đĩa: đứt giữa chừng thì lần kết
+            // nối sau phải copy lại từ đầu
+            shm_ptr->changelog.highest_modseq = 0;
+            store->durable = 0;
+            store->in_snapshot = 1;
+            break;
+        case SHIP_USERS:
+            if (rec->length < sizeof(JournalRecord) + sizeof(ShipUsers)) {
+                return MS_ERR_CORRUPT;
+            }
+            apply_users(shm_ptr, (const ShipUsers*)(rec + 1));
+            break;
+        case SHIP_SNAPSHOT_END:
+            shm_ptr->changelog.highest_modseq = rec->modseq;
+            shm_ptr->changelog.base_modseq = rec->modseq;
+            store->in_snapshot = 0;
+            break;
+        case CHANGE_CREATE:
+        case CHANGE_FLAGS:
+        case CHANGE_DELETE:
+            journal_apply_record(shm_ptr, rec);
+            if (!store->in_snapshot && rec->modseq > shm_ptr->changelog.highest_modseq) {
+                shm_ptr->changelog.highest_modseq = rec->modseq;
+            }
+            break;
+        default:
+            return MS_ERR_CORRUPT;
+    }
+    store->applied++;
+    store->dirty = 1;
+    return MS_OK;
+}
+
+// Lưu thư mục standby rồi ack modseq đã bền
+static int checkpoint(SharedMemoryData* shm_ptr, StandbyStore* store, int fd) {
+    if (!store->dirty || store->in_snapshot) {
+        return MS_OK;
+    }
+    
+    lock_store();
+    int rc = save_users_to_file(shm_ptr);
+    if (rc == MS_OK) {
+        rc = save_emails_to_file(shm_ptr);
+    }
+    unsigned long long modseq = shm_ptr->changelog.highest_modseq;
+    unlock_store();
+    store->last_save_ns = stats_now();
+    if (rc != MS_OK) {
+        fprintf(stderr, "mail_standby: save failed: %s\n", mailstore_strerror(rc));
+        return rc;
+    }
+    
+    store->dirty = 0;
+    store->durable = modseq;
+    return (fd >= 0) ? send_frame(fd, journal_build_frame(SHIP_ACK, modseq, NULL, 0), NULL) : MS_OK;
+}
+
+static void receive_session(SharedMemoryData* shm_ptr, StandbyStore* store, int fd, JournalRecord* frame) {
+    if (send_frame(fd, journal_build_frame(SHIP_HELLO, store->durable, NULL, 0), NULL) != MS_OK) {
+        return;
+    }
+    
+    long long save_interval = (long long)STANDBY_SAVE_MS * 1000000LL;
+    while (g_running) {
+        if (readable(fd, 50)) {
+            int rc = MS_OK;
+            int n = 0;
+            lock_store();
+            do {
+                rc = read_frame(fd, frame);
+                if (rc == MS_OK) {
+                    rc = apply_frame(shm_ptr, store, frame);
+                }
+                n++;
+            } while (rc == MS_OK && n < REPLICA_BATCH && readable(fd, 0));
+            unlock_store();
+            if (rc != MS_OK) {
+                if (rc == MS_ERR_CORRUPT) {
+                    fprintf(stderr, "mail_standby: corrupt frame, dropping connection\n");
+                }
+                break;
+            }
+        }
+        if (stats_now() - store->last_save_ns >= save_interval && checkpoint(shm_ptr, store, fd) != MS_OK) {
+            break;
+        }
+    }
+}
+
+static int run_receiver(const char* dir, const char* socket_path) {
+    char path[PATH_MAX];
+    if (socket_path != NULL) {
+        snprintf(path, sizeof(path), "%s", socket_path);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s", dir, STANDBY_SOCKET);
+    }
+    // Socket được bind trước khi chdir nên đường dẫn tương đối vẫn đúng
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    socket_address(path, &addr);
+    unlink(path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0) {
+        perror("mail_standby: socket");
+        return 1;
+    }
+    if (chdir(dir) < 0) {
+        perror("mail_standby: chdir");
+        return 1;
+    }
+    
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory in %s!\n", dir);
+        return 1;
+    }
+    init_shared_memory(shm_ptr);
+    if (shm_ptr->standby.shipper_pid > 0 && !(kill(shm_ptr->standby.shipper_pid, 0) == -1 && errno == ESRCH)) {
+        fprintf(stderr, "mail_standby: %s hosts the primary store\n", dir);
+        detach_shared_memory(shm_ptr);
+        return 1;
+    }
+    
+    StandbyStore store;
+    memset(&store, 0, sizeof(store));
+    store.durable = shm_ptr->changelog.highest_modseq;
+    JournalRecord* frame = malloc(FRAME_MAX);
+    
+    printf("mail_standby receiving on %s into %s at modseq %llu. Press Ctrl+C to exit.\n",
+           path, dir, store.durable);
+    while (g_running) {
+        if (!readable(listen_fd, 200)) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        printf("Primary connected\n");
+        receive_session(shm_ptr, &store, fd, frame);
+        close(fd);
+        // Giữa bản copy toàn bộ thì giữ nguyên file cũ trên đĩa
+        checkpoint(shm_ptr, &store, -1);
+        printf("Primary disconnected, %llu records applied, modseq %llu on disk\n",
+               store.applied, store.durable);
+    }
+    
+    checkpoint(shm_ptr, &store, -1);
+    free(frame);
+    close(listen_fd);
+    unlink(path);
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* cmd = argv[1];
+    const char* dir = NULL;
+    const char* socket_path = NULL;
+    
+    optind = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    if (strcmp(cmd, "receive") == 0 && dir != NULL) {
+        return run_receiver(dir, socket_path);
+    }
+    if (strcmp(cmd, "ship") == 0 && socket_path != NULL) {
+        return run_shipper(socket_path);
+    }
+    usage(argv[0]);
+    return 1;
+}
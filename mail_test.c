@@ -0,0 +1,676 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+// mail_test: kiểm tra các đường khôi phục của libmailstore trên segment và file
+// thật, mỗi case trong một thư mục tạm riêng (key IPC theo ftok(".") nên không
+// đụng store của hệ thống). Mỗi pha chạy trong một process con, thoát bằng
+// _exit mà không lưu hay gỡ segment (như bị kill); "khởi động lại" xóa segment
+// để pha sau khởi tạo lại từ users.txt / emails.txt / journal / file cold.
+//
+//   ./mail_test [case...]        không có tham số: chạy mọi case
+//
+// Trả về 0 nếu mọi kiểm tra đều qua.
+
+#define TEST_JOURNAL 0x01            // MAILSTORE_JOURNAL=1 cho pha
+#define TEST_TIER 0x02               // MAILSTORE_TIER=1
+#define TEST_LAZY 0x04               // MAILSTORE_LAZY=1
+
+typedef int (*phase_fn)(SharedMemoryData* shm_ptr);
+
+// Pha chạy song song với pha khác: con dừng ở phase_pause cho tới khi cha gọi
+// resume_phase
+typedef struct {
+    pid_t pid;
+    int to_child;
+    int from_child;
+} Phase;
+
+typedef struct {
+    const char* name;
+    int (*run)();
+} TestCase;
+
+static int g_failures;               // số kiểm tra hỏng trong process hiện tại
+static int g_to_parent = -1;         // trong process con của start_phase
+static int g_from_parent = -1;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+static void apply_flags(int flags) {
+    unsetenv("MAILSTORE_JOURNAL");
+    unsetenv("MAILSTORE_TIER");
+    unsetenv("MAILSTORE_LAZY");
+    if (flags & TEST_JOURNAL) {
+        setenv("MAILSTORE_JOURNAL", "1", 1);
+    }
+    if (flags & TEST_TIER) {
+        setenv("MAILSTORE_TIER", "1", 1);
+    }
+    if (flags & TEST_LAZY) {
+        setenv("MAILSTORE_LAZY", "1", 1);
+    }
+}
+
+static void run_child(int flags, phase_fn fn) {
+    apply_flags(flags);
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        perror("mail_test: attach");
+        _exit(2);
+    }
+    init_shared_memory(shm_ptr);
+    int failures = fn(shm_ptr) + g_failures;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(failures > 0 ? 1 : 0);
+}
+
+static int wait_child(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : 1;
+}
+
+// Chạy một pha tới hết. Trả về 0 nếu mọi kiểm tra trong pha đều qua.
+static int run_phase(int flags, phase_fn fn) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        return 1;
+    }
+    if (pid == 0) {
+        run_child(flags, fn);
+    }
+    return wait_child(pid);
+}
+
+// Chạy pha tới lần gọi phase_pause đầu tiên
+static int start_phase(Phase* phase, int flags, phase_fn fn) {
+    int down[2], up[2];
+    if (pipe(down) == -1 || pipe(up) == -1) {
+        return 1;
+    }
+    phase->pid = fork();
+    if (phase->pid == -1) {
+        return 1;
+    }
+    if (phase->pid == 0) {
+        close(down[1]);
+        close(up[0]);
+        g_from_parent = down[0];
+        g_to_parent = up[1];
+        run_child(flags, fn);
+    }
+    close(down[0]);
+    close(up[1]);
+    phase->to_child = down[1];
+    phase->from_child = up[0];
+    
+    char c;
+    return (read(phase->from_child, &c, 1) == 1) ? 0 : 1;
+}
+
+// Trong pha: báo cha đã tới điểm dừng và chờ được cho chạy tiếp
+static void phase_pause() {
+    char c = 'p';
+    if (write(g_to_parent, &c, 1) != 1 || read(g_from_parent, &c, 1) != 1) {
+        _exit(2);
+    }
+}
+
+// Cho pha chạy tiếp tới hết. Trả về 0 nếu mọi kiểm tra trong pha đều qua.
+static int resume_phase(Phase* phase) {
+    char c = 'r';
+    int rc = (write(phase->to_child, &c, 1) == 1) ? 0 : 1;
+    close(phase->to_child);
+    close(phase->from_child);
+    return wait_child(phase->pid) | rc;
+}
+
+// Xóa segment (và replica) như sau reboot: pha sau khởi tạo lại từ file
+static void restart_store() {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (attach_shared_memory() != NULL) {
+            destroy_shared_memory();
+        }
+        if (attach_replica(0) != NULL) {
+            destroy_replica();
+        }
+        _exit(0);
+    }
+    if (pid > 0) {
+        wait_child(pid);
+    }
+}
+
+static int enter_case_dir(char* dir, size_t size) {
+    snprintf(dir, size, "/tmp/mail_test.XXXXXX");
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        perror("mail_test: temp dir");
+        return -1;
+    }
+    return 0;
+}
+
+static void leave_case_dir(const char* dir, const char* cwd) {
+    restart_store();
+    key_t key = ftok(".", SEM_KEY_MAIL);
+    int sem = (key == -1) ? -1 : semget(key, 0, 0);
+    if (sem != -1) {
+        semctl(sem, 0, IPC_RMID);
+    }
+    
+    // Thư mục do mkdtemp tạo: chỉ chứa file của case
+    DIR* d = opendir(".");
+    struct dirent* entry;
+    while (d != NULL && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            unlink(entry->d_name);
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+}
+
+// ---- dữ liệu dùng chung ----
+
+static int user_id_of(SharedMemoryData* shm_ptr, const char* email) {
+    User* user = find_user_by_email(shm_ptr, email);
+    return user ? user->user_id : 0;
+}
+
+// Email đầu tiên trong mailbox nhận của user có subject này (NULL nếu không có)
+static Email* find_received(SharedMemoryData* shm_ptr, int user_id, const char* subject) {
+    EmailIterator it;
+    email_iter_init(&it, user_id, MAILBOX_RECEIVED);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        if (strcmp(email->subject, subject) == 0) {
+            return email;
+        }
+    }
+    return NULL;
+}
+
+static int count_received(SharedMemoryData* shm_ptr, int user_id) {
+    EmailIterator it;
+    email_iter_init(&it, user_id, MAILBOX_RECEIVED);
+    int count = 0;
+    while (email_iter_next(shm_ptr, &it) != NULL) {
+        count++;
+    }
+    return count;
+}
+
+// Alice và Bob, Bob gửi Alice 5 mail chưa đọc "mail-0".."mail-4", lưu ra file
+static int write_mailboxes(SharedMemoryData* shm_ptr) {
+    int alice = create_user(shm_ptr, "Alice", "alice@test", "secret", 30);
+    int bob = create_user(shm_ptr, "Bob", "bob@test", "secret", 31);
+    CHECK(alice > 0 && bob > 0);
+    
+    lock_store();
+    for (int i = 0; i < 5; i++) {
+        char subject[16];
+        snprintf(subject, sizeof(subject), "mail-%d", i);
+        CHECK(create_email(shm_ptr, bob, alice, subject, "body") > 0);
+    }
+    CHECK(save_users_to_file(shm_ptr) == MS_OK);
+    CHECK(save_emails_to_file(shm_ptr) == MS_OK);
+    unlock_store();
+    return 0;
+}
+
+// Dữ liệu ban đầu trên đĩa, segment đã xóa: pha sau khởi tạo với cờ của nó
+static int setup_mailboxes() {
+    int failed = run_phase(0, write_mailboxes);
+    restart_store();
+    return failed;
+}
+
+// ---- journal: khôi phục ----
+
+// Process chậm đã được cấp offset nhưng chưa ghi khi máy dừng: để lại lỗ toàn
+// 0 trước record process này đã commit
+static int write_after_gap(SharedMemoryData* shm_ptr) {
+    lock_store();
+    __atomic_fetch_add(&shm_ptr->journal.tail, 64, __ATOMIC_RELAXED);
+    CHECK(create_email(shm_ptr, user_id_of(shm_ptr, "bob@test"), user_id_of(shm_ptr, "alice@test"),
+                       "after-gap", "body") > 0);
+    unlock_store();
+    CHECK(journal_sync() == MS_OK);
+    return 0;
+}
+
+static int check_after_gap(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(find_received(shm_ptr, alice, "after-gap") != NULL);
+    CHECK(count_received(shm_ptr, alice) == 6);
+    return 0;
+}
+
+static int test_journal_gap() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_JOURNAL, write_after_gap);
+    restart_store();
+    failed |= run_phase(TEST_JOURNAL, check_after_gap);
+    return failed;
+}
+
+// Hai process đổi cờ cùng một mail: bản mới hơn (modseq lớn hơn) nằm trước
+// trong file vì process kia ghi buffer cờ sau
+static int mark_read_then_pause(SharedMemoryData* shm_ptr) {
+    Email* email = find_received(shm_ptr, user_id_of(shm_ptr, "alice@test"), "mail-0");
+    CHECK(email != NULL);
+    lock_store();
+    CHECK(email != NULL && update_email_status(shm_ptr, email->email_id, 1) == MS_OK);
+    unlock_store();
+    phase_pause();
+    CHECK(journal_sync() == MS_OK);
+    return 0;
+}
+
+static int mark_unread(SharedMemoryData* shm_ptr) {
+    Email* email = find_received(shm_ptr, user_id_of(shm_ptr, "alice@test"), "mail-0");
+    CHECK(email != NULL && email->is_read);
+    lock_store();
+    CHECK(email != NULL && update_email_status(shm_ptr, email->email_id, 0) == MS_OK);
+    unlock_store();
+    CHECK(journal_sync() == MS_OK);
+    return 0;
+}
+
+static int check_unread(SharedMemoryData* shm_ptr) {
+    Email* email = find_received(shm_ptr, user_id_of(shm_ptr, "alice@test"), "mail-0");
+    CHECK(email != NULL && !email->is_read);
+    return 0;
+}
+
+static int test_journal_order() {
+    Phase slow;
+    int failed = setup_mailboxes();
+    failed |= start_phase(&slow, TEST_JOURNAL, mark_read_then_pause);
+    failed |= run_phase(TEST_JOURNAL, mark_unread);
+    failed |= resume_phase(&slow);
+    restart_store();
+    failed |= run_phase(TEST_JOURNAL, check_unread);
+    return failed;
+}
+
+// Gom cờ: mail-0 đã đọc trong emails.txt. Process chậm bỏ đọc mail-0 (còn
+// trong buffer cờ) và xóa mail-1 (ghi ngay); process khác mark-all-read rồi
+// process chậm mới ghi buffer, sau record range trong file.
+static int read_first_mail(SharedMemoryData* shm_ptr) {
+    Email* email = find_received(shm_ptr, user_id_of(shm_ptr, "alice@test"), "mail-0");
+    lock_store();
+    CHECK(email != NULL && update_email_status(shm_ptr, email->email_id, 1) == MS_OK);
+    CHECK(save_emails_to_file(shm_ptr) == MS_OK);
+    unlock_store();
+    return 0;
+}
+
+static int unread_and_delete_then_pause(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    Email* first = find_received(shm_ptr, alice, "mail-0");
+    Email* second = find_received(shm_ptr, alice, "mail-1");
+    lock_store();
+    unsigned long long records = shm_ptr->journal.records;
+    CHECK(first != NULL && update_email_status(shm_ptr, first->email_id, 0) == MS_OK);
+    CHECK(shm_ptr->journal.records == records);
+    CHECK(second != NULL && delete_email(shm_ptr, second->email_id) == MS_OK);
+    CHECK(shm_ptr->journal.records == records + 1);
+    unlock_store();
+    phase_pause();
+    CHECK(journal_sync() == MS_OK);
+    CHECK(shm_ptr->journal.flag_records == 2);      // range của process kia + lô này
+    return 0;
+}
+
+static int mark_all_read(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    lock_store();
+    CHECK(mark_all_emails_read(shm_ptr, alice) == 4);
+    unlock_store();
+    CHECK(journal_sync() == MS_OK);
+    return 0;
+}
+
+static int check_all_read(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(get_unread_email_count(shm_ptr, alice) == 0);
+    CHECK(count_received(shm_ptr, alice) == 4);
+    CHECK(find_received(shm_ptr, alice, "mail-1") == NULL);
+    return 0;
+}
+
+static int test_journal_flags() {
+    Phase slow;
+    int failed = setup_mailboxes();
+    failed |= run_phase(0, read_first_mail);
+    restart_store();
+    failed |= start_phase(&slow, TEST_JOURNAL, unread_and_delete_then_pause);
+    failed |= run_phase(TEST_JOURNAL, mark_all_read);
+    failed |= resume_phase(&slow);
+    restart_store();
+    failed |= run_phase(TEST_JOURNAL, check_all_read);
+    return failed;
+}
+
+// ---- tier: mail cold ----
+
+// Đánh dấu đọc cả mailbox của Alice rồi hạ hết xuống file cold
+static int demote_all(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(mark_all_emails_read(shm_ptr, alice) == 5);
+    CHECK(tier_demote(shm_ptr, 0, MAX_EMAILS) == 5);
+    CHECK(tier_live_count(shm_ptr) == 5);
+    return alice;
+}
+
+static int validate_after_demote(SharedMemoryData* shm_ptr) {
+    lock_store();
+    int alice = demote_all(shm_ptr);
+    ValidationReport report;
+    CHECK(validate_database(shm_ptr, &report) == MS_OK);
+    CHECK(report.invalid_emails == 0);
+    CHECK(count_received(shm_ptr, alice) == 5);
+    
+    int ids[8];
+    CHECK(find_emails_matching(shm_ptr, alice, "mail-3", ids, 8) == 1);
+    Email* found = read_email(shm_ptr, ids[0]);
+    CHECK(found != NULL && strcmp(found->subject, "mail-3") == 0);
+    CHECK(find_emails_matching(shm_ptr, 0, "body", NULL, 0) == 5);
+    CHECK(save_emails_to_file(shm_ptr) == MS_OK);
+    unlock_store();
+    return 0;
+}
+
+// emails.txt sau khi hạ xuống: không còn dòng cho slot trống
+static int check_saved_after_demote(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(shm_ptr->control.email_count == 0);
+    CHECK(tier_live_count(shm_ptr) == 5);
+    CHECK(count_received(shm_ptr, alice) == 5);
+    CHECK(validate_database(shm_ptr, NULL) == MS_OK);
+    return 0;
+}
+
+static int test_tier_validate() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_TIER, validate_after_demote);
+    restart_store();
+    failed |= run_phase(TEST_TIER, check_saved_after_demote);
+    return failed;
+}
+
+// Đổi cờ / xóa mail cold: có trong change log (slot -1) và journal. emails.txt
+// vẫn giữ bản trước khi hạ xuống, khôi phục áp thay đổi lên bản đó.
+static int change_cold_mail(SharedMemoryData* shm_ptr) {
+    lock_store();
+    int alice = demote_all(shm_ptr);
+    Email* unread = find_received(shm_ptr, alice, "mail-0");
+    int unread_id = unread ? unread->email_id : 0;
+    Email* deleted = find_received(shm_ptr, alice, "mail-1");
+    int deleted_id = deleted ? deleted->email_id : 0;
+    
+    unsigned long long since = get_global_modseq(shm_ptr);
+    CHECK(update_email_status(shm_ptr, unread_id, 0) == MS_OK);
+    CHECK(delete_email(shm_ptr, deleted_id) == MS_OK);
+    CHECK(get_unread_email_count(shm_ptr, alice) == 1);
+    
+    EmailChange changes[8];
+    unsigned long long next;
+    int n = get_changes_since(shm_ptr, alice, since, changes, 8, &next);
+    CHECK(n == 2 && next == since + 2);
+    CHECK(n >= 1 && changes[0].email_id == unread_id && changes[0].slot == -1 &&
+          changes[0].email != NULL && !changes[0].email->is_read);
+    CHECK(n >= 2 && changes[1].email_id == deleted_id && changes[1].op == CHANGE_DELETE &&
+          changes[1].email == NULL);
+    unlock_store();
+    CHECK(journal_sync() == MS_OK);
+    return 0;
+}
+
+static int check_cold_changes(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    Email* email = find_received(shm_ptr, alice, "mail-0");
+    CHECK(email != NULL && !email->is_read);
+    CHECK(find_received(shm_ptr, alice, "mail-1") == NULL);
+    CHECK(count_received(shm_ptr, alice) == 4);
+    CHECK(get_unread_email_count(shm_ptr, alice) == 1);
+    return 0;
+}
+
+static int test_tier_changes() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_TIER | TEST_JOURNAL, change_cold_mail);
+    restart_store();
+    failed |= run_phase(TEST_TIER | TEST_JOURNAL, check_cold_changes);
+    return failed;
+}
+
+// Export sau khi hạ xuống: mail cold có trong mọi kiểu export
+static int export_count(SharedMemoryData* shm_ptr, const ExportFilter* filter, const char* subject) {
+    char path[] = "export.mbox";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    CHECK(fd != -1);
+    int n = export_mbox(shm_ptr, fd, filter, NULL);
+    
+    char buf[8192];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    buf[len > 0 ? len : 0] = '\0';
+    if (subject != NULL) {
+        CHECK(strstr(buf, subject) != NULL);
+    }
+    close(fd);
+    unlink(path);
+    return n;
+}
+
+static int export_after_demote(SharedMemoryData* shm_ptr) {
+    lock_store();
+    int alice = demote_all(shm_ptr);
+    int bob = user_id_of(shm_ptr, "bob@test");
+    CHECK(create_email(shm_ptr, bob, alice, "hot-mail", "body") > 0);
+    unlock_store();
+    
+    CHECK(export_count(shm_ptr, NULL, "Subject: mail-4\n") == 6);
+    ExportFilter received = { alice, MAILBOX_RECEIVED, 0, 0 };
+    CHECK(export_count(shm_ptr, &received, "Subject: mail-0\n") == 6);
+    ExportFilter sent = { bob, MAILBOX_SENT, 0, 0 };
+    CHECK(export_count(shm_ptr, &sent, "Status: RO\n") == 6);
+    ExportFilter none = { bob, MAILBOX_RECEIVED, 0, 0 };
+    CHECK(export_count(shm_ptr, &none, NULL) == 0);
+    ExportFilter dated = { 0, MAILBOX_BOTH, time(NULL) - 3600, time(NULL) + 3600 };
+    CHECK(export_count(shm_ptr, &dated, "Subject: mail-2\n") == 6);
+    ExportFilter future = { 0, MAILBOX_BOTH, time(NULL) + 3600, 0 };
+    CHECK(export_count(shm_ptr, &future, NULL) == 0);
+    return 0;
+}
+
+static int test_tier_export() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_TIER, export_after_demote);
+    return failed;
+}
+
+// Replica copy lần đầu sau khi hạ xuống, rồi theo đổi cờ mail cold và lần hạ
+// xuống tiếp theo
+static int replica_after_demote(SharedMemoryData* shm_ptr) {
+    lock_store();
+    int alice = demote_all(shm_ptr);
+    unlock_store();
+    
+    SharedMemoryData* replica = attach_replica(1);
+    CHECK(replica != NULL);
+    if (replica == NULL) {
+        return 0;
+    }
+    CHECK(replica_sync(shm_ptr, replica) == MAX_EMAILS);
+    CHECK(count_received(replica, alice) == 5);
+    CHECK(get_unread_email_count(replica, alice) == 0);
+    
+    lock_store();
+    Email* email = find_received(shm_ptr, alice, "mail-0");
+    CHECK(email != NULL && update_email_status(shm_ptr, email->email_id, 0) == MS_OK);
+    int bob = user_id_of(shm_ptr, "bob@test");
+    int hot = create_email(shm_ptr, bob, alice, "mail-5", "body");
+    CHECK(hot > 0);
+    unlock_store();
+    CHECK(replica_sync(shm_ptr, replica) == 2);
+    CHECK(get_unread_email_count(replica, alice) == 2);
+    CHECK(count_received(replica, alice) == 6);
+    
+    lock_store();
+    CHECK(update_email_status(shm_ptr, hot, 1) == MS_OK);
+    CHECK(tier_demote(shm_ptr, 0, MAX_EMAILS) == 1);
+    unlock_store();
+    CHECK(replica_sync(shm_ptr, replica) == MAX_EMAILS);
+    CHECK(replica->control.email_count == 0 || replica->emails[0].email_id == 0);
+    CHECK(count_received(replica, alice) == 6);
+    CHECK(get_unread_email_count(replica, alice) == 1);
+    return 0;
+}
+
+static int test_tier_replica() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_TIER, replica_after_demote);
+    return failed;
+}
+
+// ---- lazy loading cùng tier ----
+
+// Hạ xuống nhưng không lưu: emails.txt vẫn có bản hot của cả 5 mail
+static int demote_without_save(SharedMemoryData* shm_ptr) {
+    lock_store();
+    demote_all(shm_ptr);
+    unlock_store();
+    return 0;
+}
+
+static int check_no_duplicates(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(!shm_ptr->lazy.enabled);
+    CHECK(count_received(shm_ptr, alice) == 5);
+    CHECK(tier_live_count(shm_ptr) == 0);
+    CHECK(get_unread_email_count(shm_ptr, alice) == 5);
+    return 0;
+}
+
+static int check_lazy_alone(SharedMemoryData* shm_ptr) {
+    int alice = user_id_of(shm_ptr, "alice@test");
+    CHECK(shm_ptr->lazy.enabled);
+    CHECK(count_received(shm_ptr, alice) == 5);
+    return 0;
+}
+
+static int test_lazy_tier() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_TIER, demote_without_save);
+    restart_store();
+    failed |= run_phase(TEST_TIER | TEST_LAZY, check_no_duplicates);
+    restart_store();
+    failed |= run_phase(TEST_LAZY, check_lazy_alone);
+    return failed;
+}
+
+// Replica copy lần đầu khi chưa mailbox nào được nạp
+static int replica_while_lazy(SharedMemoryData* shm_ptr) {
+    CHECK(shm_ptr->lazy.enabled && shm_ptr->lazy.pending == 2);
+    SharedMemoryData* replica = attach_replica(1);
+    CHECK(replica != NULL);
+    if (replica == NULL) {
+        return 0;
+    }
+    CHECK(replica_sync(shm_ptr, replica) == MAX_EMAILS);
+    CHECK(shm_ptr->lazy.pending == 0);
+    CHECK(count_received(replica, user_id_of(shm_ptr, "alice@test")) == 5);
+    CHECK(replica_sync(shm_ptr, replica) == 0);
+    return 0;
+}
+
+static int test_lazy_replica() {
+    int failed = setup_mailboxes();
+    failed |= run_phase(TEST_LAZY, replica_while_lazy);
+    return failed;
+}
+
+static const TestCase g_cases[] = {
+    { "journal-gap", test_journal_gap },
+    { "journal-order", test_journal_order },
+    { "journal-flags", test_journal_flags },
+    { "tier-validate", test_tier_validate },
+    { "tier-changes", test_tier_changes },
+    { "tier-export", test_tier_export },
+    { "tier-replica", test_tier_replica },
+    { "lazy-tier", test_lazy_tier },
+    { "lazy-replica", test_lazy_replica },
+};
+#define TEST_CASE_COUNT ((int)(sizeof(g_cases) / sizeof(g_cases[0])))
+
+static int selected(const TestCase* test, int argc, char* argv[]) {
+    if (argc < 2) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], test->name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    
+    int ran = 0, failed = 0;
+    for (int i = 0; i < TEST_CASE_COUNT; i++) {
+        const TestCase* test = &g_cases[i];
+        if (!selected(test, argc, argv)) {
+            continue;
+        }
+        
+        char dir[64];
+        if (enter_case_dir(dir, sizeof(dir)) != 0) {
+            return 1;
+        }
+        int rc = test->run();
+        leave_case_dir(dir, cwd);
+        
+        printf("%-20s %s\n", test->name, rc == 0 ? "ok" : "FAILED");
+        fflush(stdout);
+        ran++;
+        failed += (rc != 0);
+    }
+    
+    if (ran == 0) {
+        fprintf(stderr, "Usage: %s [case...]\nCases:", argv[0]);
+        for (int i = 0; i < TEST_CASE_COUNT; i++) {
+            fprintf(stderr, " %s", g_cases[i].name);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    printf("%d/%d passed\n", ran - failed, ran);
+    return failed > 0 ? 1 : 0;
+}
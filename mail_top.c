@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <signal.h>
+
+// mail_top: màn hình giám sát segment, refresh mỗi giây. Attach SHM_RDONLY và
+// chỉ đọc trực tiếp các mảng + stats region, không bao giờ lấy store lock nên
+// có thể để chạy cạnh hệ thống thật. Số liệu có thể lệch nhẹ vì đọc không khóa.
+//
+//   ./mail_top [-i seconds] [-n top_mailboxes] [-c count] [-1]
+
+#define TOP_DEFAULT_MAILBOXES 5
+
+typedef struct {
+    int interval;
+    int top;
+    int count;                   // 0 = chạy đến khi Ctrl+C
+    int once;                    // in một lần, không clear màn hình
+} TopConfig;
+
+typedef struct {
+    int slot;
+    int received;
+    int unread;
+    int sent;
+} MailboxUsage;
+
+typedef struct {
+    OpStats ops[STAT_OP_COUNT];
+    int delivered;
+    int rejected;
+    unsigned long long modseq;
+    long long taken_ns;
+} Sample;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void take_sample(const SharedMemoryData* shm_ptr, Sample* sample) {
+    stats_merge(shm_ptr, sample->ops);
+    sample->delivered = shm_ptr->queue.delivered;
+    sample->rejected = shm_ptr->queue.rejected;
+    sample->modseq = shm_ptr->changelog.highest_modseq;
+    sample->taken_ns = now_ns();
+}
+
+static int user_slot(const SharedMemoryData* shm_ptr, int user_id) {
+    for (int i = 0; i < MAX_USERS; i++) {
+        if (shm_ptr->users[i].is_active && shm_ptr->users[i].user_id == user_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int compare_usage(const void* a, const void* b) {
+    const MailboxUsage* x = (const MailboxUsage*)a;
+    const MailboxUsage* y = (const MailboxUsage*)b;
+    if (x->received != y->received) {
+        return y->received - x->received;
+    }
+    return y->unread - x->unread;
+}
+
+static void show_store(const SharedMemoryData* shm_ptr) {
+    int high_water = shm_ptr->control.email_count;
+    if (high_water > MAX_EMAILS) {
+        high_water = MAX_EMAILS;
+    }
+    
+    int live = 0, holes = 0;
+    for (int i = 0; i < high_water; i++) {
+        const Email* email = &shm_ptr->emails[i];
+        if (email->email_id > 0 && !email->is_deleted) {
+            live++;
+        } else {
+            holes++;
+        }
+    }
+    
+    printf("STORE    users %d/%d   emails %d live in %d/%d slots   holes %d (%.1f%% fragmented)\n",
+           shm_ptr->control.user_count, MAX_USERS, live, high_water, MAX_EMAILS, holes,
+           high_water ? holes * 100.0 / high_water : 0.0);
+}
+
+static void show_queue(SharedMemoryData* shm_ptr, const Sample* prev, const Sample* cur, double dt) {
+    printf("QUEUE    delivery %d/%d pending   delivered %.1f/s   rejected %.1f/s   daemon ",
+           shm_ptr->queue.count, DELIVERY_QUEUE_SIZE,
+           (cur->delivered - prev->delivered) / dt, (cur->rejected - prev->rejected) / dt);
+    if (is_delivery_daemon_running(shm_ptr)) {
+        printf("PID %d\n", shm_ptr->control.deliveryd_pid);
+    } else {
+        printf("not running\n");
+    }
+    printf("CHANGES  modseq %llu (%.1f changes/s)   change log from %llu\n",
+           cur->modseq, (cur->modseq - prev->modseq) / dt, shm_ptr->changelog.base_modseq);
+}
+
+// Persistence lag: thay đổi (modseq) và email chưa có trong emails.txt trên đĩa
+static void show_persistence(const SharedMemoryData* shm_ptr) {
+    unsigned long long persisted = shm_ptr->changelog.persisted_modseq;
+    int dirty = 0;
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        if (shm_ptr->emails[i].email_id > 0 && shm_ptr->emails[i].modseq > persisted) {
+            dirty++;
+        }
+    }
+    
+    printf("PERSIST  %llu changes / %d emails not on disk (modseq %llu on disk)   "
+           "save_seq %u, users.txt @%u, emails.txt @%u\n",
+           shm_ptr->changelog.highest_modseq - persisted, dirty, persisted,
+           shm_ptr->control.save_seq, shm_ptr->control.users_saved_seq,
+           shm_ptr->control.emails_saved_seq);
+    if (shm_ptr->journal.enabled) {
+        printf("JOURNAL  epoch %u, %.1f KB, %llu records written\n",
+               shm_ptr->journal.epoch, shm_ptr->journal.tail / 1024.0,
+               shm_ptr->journal.records);
+        printf("FLAGS    %llu changes -> %llu entries in %llu batch/range records\n",
+               shm_ptr->journal.flag_changes, shm_ptr->journal.flag_entries,
+               shm_ptr->journal.flag_records);
+    }
+}
+
+static void show_ops(const Sample* prev, const Sample* cur, double dt) {
+    printf("\n%-18s %10s %10s %12s %12s %12s\n",
+           "operation", "ops/s", "failed/s", "p50 ns", "p99 ns", "total");
+    int shown = 0;
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        OpStats delta;
+        delta.count = cur->ops[op].count - prev->ops[op].count;
+        delta.failed = cur->ops[op].failed - prev->ops[op].failed;
+        delta.total_ns = cur->ops[op].total_ns - prev->ops[op].total_ns;
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            delta.hist[b] = cur->ops[op].hist[b] - prev->ops[op].hist[b];
+        }
+        if (cur->ops[op].count == 0) {
+            continue;
+        }
+        printf("%-18s %10.1f %10.1f %12llu %12llu %12llu\n",
+               stats_op_name(op), delta.count / dt, delta.failed / dt,
+               stats_percentile(&delta, 0.50), stats_percentile(&delta, 0.99),
+               cur->ops[op].count);
+        shown++;
+    }
+    if (shown == 0) {
+        printf("   (No operations recorded)\n");
+    }
+}
+
+static void show_mailboxes(const SharedMemoryData* shm_ptr, int top) {
+    MailboxUsage boxes[MAX_USERS];
+    for (int i = 0; i < MAX_USERS; i++) {
+        boxes[i].slot = i;
+        boxes[i].received = boxes[i].unread = boxes[i].sent = 0;
+    }
+    
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        const Email* email = &shm_ptr->emails[i];
+        if (email->email_id <= 0 || email->is_deleted) {
+            continue;
+        }
+        int receiver = user_slot(shm_ptr, email->receiver_id);
+        if (receiver >= 0) {
+            boxes[receiver].received++;
+            if (!email->is_read) {
+                boxes[receiver].unread++;
+            }
+        }
+        int sender = user_slot(shm_ptr, email->sender_id);
+        if (sender >= 0) {
+            boxes[sender].sent++;
+        }
+    }
+    
+    qsort(boxes, MAX_USERS, sizeof(MailboxUsage), compare_usage);
+    
+    printf("\n%-5s %-30s %10s %8s %8s\n", "ID", "Largest mailboxes", "received", "unread", "sent");
+    for (int i = 0; i < top && i < MAX_USERS; i++) {
+        const User* user = &shm_ptr->users[boxes[i].slot];
+        if (!user->is_active || (boxes[i].received == 0 && boxes[i].sent == 0)) {
+            break;
+        }
+        printf("%-5d %-30.30s %10d %8d %8d\n", user->user_id, user->email,
+               boxes[i].received, boxes[i].unread, boxes[i].sent);
+    }
+}
+
+static void draw(SharedMemoryData* shm_ptr, const TopConfig* cfg, const Sample* prev, const Sample* cur) {
+    double dt = (cur->taken_ns - prev->taken_ns) / 1e9;
+    if (dt <= 0) {
+        dt = 1;
+    }
+    
+    char now[32];
+    time_t t = time(NULL);
+    strftime(now, sizeof(now), "%H:%M:%S", localtime(&t));
+    
+    if (!cfg->once) {
+        printf("\033[H\033[2J");
+    }
+    printf("mail_top - %s   segment %d (%.2f MB, read-only)   interval %.1fs\n\n",
+           now, get_shared_memory_id(), sizeof(SharedMemoryData) / (1024.0 * 1024.0), dt);
+    show_store(shm_ptr);
+    show_queue(shm_ptr, prev, cur, dt);
+    show_persistence(shm_ptr);
+    show_ops(prev, cur, dt);
+    show_mailboxes(shm_ptr, cfg->top);
+    fflush(stdout);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-i seconds] [-n top_mailboxes] [-c count] [-1]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    TopConfig cfg = {
+        .interval = 1,
+        .top = TOP_DEFAULT_MAILBOXES,
+        .count = 0,
+        .once = 0,
+    };
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:c:1")) != -1) {
+        switch (opt) {
+            case 'i':
+                cfg.interval = atoi(optarg);
+                break;
+            case 'n':
+                cfg.top = atoi(optarg);
+                break;
+            case 'c':
+                cfg.count = atoi(optarg);
+                break;
+            case '1':
+                cfg.once = 1;
+                cfg.count = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (cfg.interval < 1 || cfg.top < 0 || cfg.count < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    SharedMemoryData* shm_ptr = attach_shared_memory_readonly();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "mail_top: no mail system shared memory (run ./mail_system first)\n");
+        return 1;
+    }
+    
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    
+    Sample prev, cur;
+    take_sample(shm_ptr, &prev);
+    for (int n = 0; !g_stop && (cfg.count == 0 || n < cfg.count); n++) {
+        sleep(cfg.interval);
+        if (g_stop) {
+            break;
+        }
+        take_sample(shm_ptr, &cur);
+        draw(shm_ptr, &cfg, &prev, &cur);
+        prev = cur;
+    }
+    
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
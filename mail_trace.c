@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+
+// mail_trace: bật/tắt trace ring và xuất các ring ra Chrome trace format
+// (mở bằng chrome://tracing hoặc Perfetto). Dump attach chỉ đọc.
+//
+//   ./mail_trace on | off | clear | status
+//   ./mail_trace dump [-o trace.json]
+
+static int trace_control(const char* cmd) {
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "mail_trace: failed to attach to shared memory\n");
+        return 1;
+    }
+    
+    // Khởi tạo segment trước, nếu không lần init sau sẽ xóa cờ enabled
+    init_shared_memory(shm_ptr);
+    
+    if (strcmp(cmd, "on") == 0) {
+        trace_set_enabled(shm_ptr, 1);
+    } else if (strcmp(cmd, "off") == 0) {
+        trace_set_enabled(shm_ptr, 0);
+    } else {
+        trace_clear(shm_ptr);
+    }
+    
+    printf("Tracing %s\n", strcmp(cmd, "clear") == 0 ? "buffers cleared" :
+                           shm_ptr->trace.enabled ? "enabled" : "disabled");
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
+
+static int trace_status() {
+    SharedMemoryData* shm_ptr = attach_shared_memory_readonly();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "mail_trace: no mail system shared memory\n");
+        return 1;
+    }
+    
+    printf("Tracing: %s\n", shm_ptr->trace.enabled ? "enabled" : "disabled");
+    printf("%-6s %-8s %12s\n", "Ring", "PID", "Events");
+    for (int r = 0; r < STATS_SHARDS; r++) {
+        unsigned long long head = shm_ptr->trace.rings[r].head;
+        if (head > 0) {
+            printf("%-6d %-8d %12llu%s\n", r, shm_ptr->stats.shards[r].owner_pid, head,
+                   head > TRACE_RING_SIZE ? " (wrapped)" : "");
+        }
+    }
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
+
+// Mỗi event là một "complete event" (ph = X); ts/dur tính bằng micro giây
+static void write_chrome_trace(FILE* out, const TraceEvent* events, int count) {
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (int i = 0; i < count; i++) {
+        const TraceEvent* ev = &events[i];
+        fprintf(out, "  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                     "\"pid\": %d, \"tid\": %d, \"args\": {\"id1\": %d, \"id2\": %d, \"result\": %d}}%s\n",
+                trace_op_name(ev->op), ev->op < STAT_OP_COUNT ? "store" : "request",
+                ev->start_ns / 1000.0, (ev->end_ns - ev->start_ns) / 1000.0,
+                ev->pid, ev->tid, ev->id1, ev->id2, ev->result,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+static int trace_dump(const char* path) {
+    SharedMemoryData* shm_ptr = attach_shared_memory_readonly();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "mail_trace: no mail system shared memory\n");
+        return 1;
+    }
+    
+    int max = STATS_SHARDS * TRACE_RING_SIZE;
+    TraceEvent* events = malloc(sizeof(TraceEvent) * max);
+    if (events == NULL) {
+        perror("mail_trace: malloc");
+        detach_shared_memory(shm_ptr);
+        return 1;
+    }
+    int count = trace_collect(shm_ptr, events, max);
+    detach_shared_memory(shm_ptr);
+    
+    FILE* out = stdout;
+    if (path != NULL) {
+        out = fopen(path, "w");
+        if (out == NULL) {
+            perror("mail_trace: open output");
+            free(events);
+            return 1;
+        }
+    }
+    
+    write_chrome_trace(out, events, count);
+    if (out != stdout) {
+        fclose(out);
+        fprintf(stderr, "%d events written to %s\n", count, path);
+    }
+    free(events);
+    return 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s on | off | clear | status | dump [-o trace.json]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    const char* cmd = argv[1];
+    if (strcmp(cmd, "on") == 0 || strcmp(cmd, "off") == 0 || strcmp(cmd, "clear") == 0) {
+        return trace_control(cmd);
+    }
+    if (strcmp(cmd, "status") == 0) {
+        return trace_status();
+    }
+    if (strcmp(cmd, "dump") == 0) {
+        const char* path = NULL;
+        if (argc >= 4 && strcmp(argv[2], "-o") == 0) {
+            path = argv[3];
+        }
+        return trace_dump(path);
+    }
+    
+    usage(argv[0]);
+    return 1;
+}
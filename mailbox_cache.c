@@ -0,0 +1,167 @@
+#include "mailstore.h"
+
+// Cache mailbox view: mỗi process giữ tối đa MAILBOX_CACHE_ENTRIES view đã dựng
+// (id, email người gửi/nhận, subject, ngày, cờ đọc), bỏ view dùng lâu nhất khi
+// đầy. Mở lại cùng mailbox không quét mảng emails và không gọi read_user cho
+// từng dòng nữa.
+//
+// View hợp lệ khi bộ đếm notify.mailbox_gen của user (tăng trong create /
+// update / delete và các thao tác hàng loạt, xem touch_mailbox) và
+// control.users_version (đổi tên/xóa user) còn giống lúc dựng. Cache là
+// static của process, chỉ dùng từ một thread (tầng menu).
+
+typedef struct {
+    SharedMemoryData* shm_ptr;
+    int user_id;                 // 0 = entry trống
+    int type;
+    unsigned int gen;
+    unsigned int users_version;
+    unsigned long last_used;
+    int count;
+    int capacity;
+    MailboxRow* rows;
+} CacheEntry;
+
+static CacheEntry g_entries[MAILBOX_CACHE_ENTRIES];
+static unsigned long g_tick;
+static long g_hits, g_misses;
+
+static unsigned int* gen_word(SharedMemoryData* shm_ptr, int user_id) {
+    int slot = user_slot_of(shm_ptr, user_id);
+    return (slot < 0) ? NULL : &shm_ptr->notify.mailbox_gen[slot];
+}
+
+static void bump_gen(SharedMemoryData* shm_ptr, int user_id) {
+    unsigned int* word = gen_word(shm_ptr, user_id);
+    if (word != NULL) {
+        __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Gọi sau mỗi thay đổi email (caller giữ store lock; worker pool gọi song song)
+void touch_mailbox(SharedMemoryData* shm_ptr, int sender_id, int receiver_id) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    bump_gen(shm_ptr, sender_id);
+    if (receiver_id != sender_id) {
+        bump_gen(shm_ptr, receiver_id);
+    }
+}
+
+static CacheEntry* find_entry(SharedMemoryData* shm_ptr, int user_id, int type) {
+    for (int i = 0; i < MAILBOX_CACHE_ENTRIES; i++) {
+        CacheEntry* entry = &g_entries[i];
+        if (entry->user_id == user_id && entry->type == type && entry->shm_ptr == shm_ptr) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Entry trống hoặc entry dùng lâu nhất
+static CacheEntry* victim_entry() {
+    CacheEntry* victim = &g_entries[0];
+    for (int i = 0; i < MAILBOX_CACHE_ENTRIES; i++) {
+        if (g_entries[i].user_id == 0) {
+            return &g_entries[i];
+        }
+        if (g_entries[i].last_used < victim->last_used) {
+            victim = &g_entries[i];
+        }
+    }
+    return victim;
+}
+
+static int append_row(CacheEntry* entry, SharedMemoryData* shm_ptr, const Email* email, int type) {
+    if (entry->count == entry->capacity) {
+        int capacity = entry->capacity ? entry->capacity * 2 : 64;
+        MailboxRow* rows = realloc(entry->rows, (size_t)capacity * sizeof(MailboxRow));
+        if (rows == NULL) {
+            return MS_ERR_SYS;
+        }
+        entry->rows = rows;
+        entry->capacity = capacity;
+    }
+    
+    MailboxRow* row = &entry->rows[entry->count++];
+    row->email_id = email->email_id;
+    row->peer_id = (type == MAILBOX_SENT) ? email->receiver_id : email->sender_id;
+    User* peer = read_user(shm_ptr, row->peer_id);
+    strncpy(row->peer, peer ? peer->email : "Unknown", MAX_EMAIL_LENGTH - 1);
+    row->peer[MAX_EMAIL_LENGTH - 1] = '\0';
+    strncpy(row->subject, email->subject, MAX_SUBJECT_LENGTH - 1);
+    row->subject[MAX_SUBJECT_LENGTH - 1] = '\0';
+    row->sent_at = email->sent_at;
+    row->is_read = email->is_read;
+    return MS_OK;
+}
+
+// Dựng lại view. Bộ đếm được đọc trước khi duyệt: thay đổi xen vào giữa chỉ
+// làm lần xem sau dựng lại, không bao giờ giữ view cũ.
+static int build_entry(CacheEntry* entry, SharedMemoryData* shm_ptr, int user_id, int type,
+                       unsigned int gen) {
+    entry->shm_ptr = shm_ptr;
+    entry->user_id = user_id;
+    entry->type = type;
+    entry->gen = gen;
+    entry->users_version = __atomic_load_n(&shm_ptr->control.users_version, __ATOMIC_ACQUIRE);
+    entry->count = 0;
+    
+    EmailIterator it;
+    email_iter_init(&it, user_id, type);
+    Email* email;
+    while ((email = email_iter_next(shm_ptr, &it)) != NULL) {
+        if (append_row(entry, shm_ptr, email, type) != MS_OK) {
+            entry->user_id = 0;
+            return MS_ERR_SYS;
+        }
+    }
+    return MS_OK;
+}
+
+// View của mailbox (MAILBOX_RECEIVED / MAILBOX_SENT) theo thứ tự email_iter_next.
+// *rows thuộc cache, dùng được tới lần gọi mailbox_view tiếp theo. Trả về số
+// dòng hoặc MS_ERR_*.
+int mailbox_view(SharedMemoryData* shm_ptr, int user_id, int type, const MailboxRow** rows) {
+    if (shm_ptr == NULL || user_id <= 0 || rows == NULL ||
+        (type != MAILBOX_RECEIVED && type != MAILBOX_SENT)) {
+        return MS_ERR_INVALID;
+    }
+    
+    // Nạp mailbox (lazy loading) trước khi đọc bộ đếm để lần nạp không làm hỏng view
+    lazy_fault_in(shm_ptr, user_id);
+    unsigned int* word = gen_word(shm_ptr, user_id);
+    if (word == NULL) {
+        return MS_ERR_NOT_FOUND;
+    }
+    unsigned int gen = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    
+    CacheEntry* entry = find_entry(shm_ptr, user_id, type);
+    if (entry != NULL && entry->gen == gen &&
+        entry->users_version == __atomic_load_n(&shm_ptr->control.users_version, __ATOMIC_ACQUIRE)) {
+        g_hits++;
+    } else {
+        g_misses++;
+        if (entry == NULL) {
+            entry = victim_entry();
+        }
+        int status = build_entry(entry, shm_ptr, user_id, type, gen);
+        if (status != MS_OK) {
+            return status;
+        }
+    }
+    
+    entry->last_used = ++g_tick;
+    *rows = entry->rows;
+    return entry->count;
+}
+
+void mailbox_cache_counts(long* hits, long* misses) {
+    if (hits != NULL) {
+        *hits = g_hits;
+    }
+    if (misses != NULL) {
+        *misses = g_misses;
+    }
+}
@@ -0,0 +1,784 @@
+#ifndef MAILSTORE_H
+#define MAILSTORE_H
+
+// libmailstore: phần lưu trữ của mail system (shared memory, CRUD, database,
+// delivery queue, notify, change log, lưu nền). Không in ra màn hình và không
+// đọc stdin: hàm trả về status code (MS_*) hoặc struct/iterator, việc hiển thị
+// do tầng menu (mail_functions.c, main.c) hoặc batch/server đảm nhận.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Constants
+#define MAX_USERS 100
+#define MAX_EMAILS 1000
+#define MAX_NAME_LENGTH 50
+#define MAX_EMAIL_LENGTH 100
+#define MAX_PASSWORD_LENGTH 50
+#define MAX_SUBJECT_LENGTH 200
+#define MAX_CONTENT_LENGTH 2000
+#define USER_DB_FILE "users.txt"
+#define EMAIL_DB_FILE "emails.txt"
+
+// Shared Memory Keys
+#define SHM_KEY_USERS 1234
+#define SHM_KEY_EMAILS 5678
+#define SHM_KEY_CONTROL 9999
+
+// Semaphore set (store lock + delivery queue)
+#define SEM_KEY_MAIL 4321
+#define SEM_STORE_LOCK 0
+#define SEM_QUEUE_MUTEX 1
+#define SEM_QUEUE_EMPTY 2
+#define SEM_QUEUE_FULL 3
+#define MAIL_SEM_COUNT 4
+
+// Delivery queue
+#define DELIVERY_QUEUE_SIZE 64
+#define DELIVERY_BATCH_SIZE 16
+
+// Change log (modseq) for delta sync
+#define CHANGE_LOG_SIZE 4096
+#define CHANGE_CREATE 1
+#define CHANGE_FLAGS 2
+#define CHANGE_DELETE 3
+
+// Worker pool for bulk operations
+#define WORKER_POOL_MAX_THREADS 8
+#ifndef PARALLEL_MIN_ITEMS
+#define PARALLEL_MIN_ITEMS (MAX_EMAILS / 4)     // ít hơn thì chạy tuần tự
+#endif
+#define VALIDATE_REPORT_LIMIT 32
+
+// Background save (BGSAVE)
+#define BGSAVE_USERS 1
+#define BGSAVE_EMAILS 2
+#define BGSAVE_BACKUP 4
+#define BGSAVE_MAX_CHILDREN 4
+
+// Hot-path statistics (stats region trong segment)
+#define STATS_SHARDS 16              // mỗi process ghi vào shard riêng
+#define STATS_BUCKETS 32             // bucket b: latency < 2^b ns
+#define STAT_USER_CREATE 0
+#define STAT_USER_READ 1
+#define STAT_USER_FIND 2
+#define STAT_USER_VERIFY 3
+#define STAT_USER_UPDATE 4
+#define STAT_USER_DELETE 5
+#define STAT_EMAIL_CREATE 6
+#define STAT_EMAIL_READ 7
+#define STAT_EMAIL_UPDATE 8
+#define STAT_EMAIL_DELETE 9
+#define STAT_EMAIL_UNREAD 10
+#define STAT_EMAIL_MARK_ALL 11
+#define STAT_EMAIL_DELETE_READ 12
+#define STAT_EMAIL_SEARCH 13
+#define STAT_SAVE_USERS 14
+#define STAT_SAVE_EMAILS 15
+#define STAT_LOAD_USERS 16
+#define STAT_LOAD_EMAILS 17
+#define STAT_EMAIL_IMPORT 18
+#define STAT_OP_COUNT 19
+
+// Trace ring: op < STAT_OP_COUNT dùng chung mã với stats, còn lại là span
+// của tầng trên
+#define TRACE_RING_SIZE 1024         // event mỗi process, ghi đè vòng tròn
+#define TRACE_COMPOSE_MAIL 32
+#define TRACE_BATCH_COMMAND 33
+#define TRACE_BGSAVE_FORK 34
+#define TRACE_BGSAVE_WRITE 35
+
+// Workload capture (file nhị phân cho mail_replay)
+#define CAPTURE_MAGIC "MSCAP001"
+#define CAPTURE_VERSION 2            // 2: s3 là token mật khẩu, không phải mật khẩu
+#define CAPTURE_TOKEN_LENGTH 18      // "#" + 16 hex + '\0'
+#define CAP_CREATE_USER 1            // a = age, s1 = name, s2 = email, s3 = token mật khẩu
+#define CAP_LOGIN 2                  // s1 = email, s3 = token mật khẩu
+#define CAP_CREATE_EMAIL 3           // a = sender, b = receiver, s1 = subject, s2 = content
+#define CAP_READ_EMAIL 4             // a = email_id
+#define CAP_UPDATE_EMAIL 5           // a = email_id, b = is_read
+#define CAP_DELETE_EMAIL 6           // a = email_id
+#define CAP_SEARCH 7                 // a = user_id, s1 = keyword
+#define CAP_UNREAD 8                 // a = user_id
+#define CAP_MARK_ALL_READ 9          // a = user_id
+#define CAP_DELETE_READ 10           // a = user_id
+
+// Status codes: >= 0 là thành công (một số hàm trả về id/số lượng), âm là lỗi
+#define MS_OK 0
+#define MS_ERR_INVALID (-1)     // tham số không hợp lệ
+#define MS_ERR_NOT_FOUND (-2)   // user/email/file không tồn tại
+#define MS_ERR_EXISTS (-3)      // email đăng ký đã được dùng
+#define MS_ERR_FULL (-4)        // hết chỗ trong mảng users/emails
+#define MS_ERR_IO (-5)          // lỗi đọc/ghi file database
+#define MS_ERR_SYS (-6)         // lỗi system call (shm, semaphore, fork...)
+#define MS_ERR_CORRUPT (-7)     // database không hợp lệ
+
+// Async I/O (aio.c) và change journal (journal.c)
+#define AIO_BACKEND_NONE 0
+#define AIO_BACKEND_URING 1
+#define AIO_BACKEND_THREADS 2
+#define AIO_QUEUE_DEPTH 256
+#define AIO_THREADS 2
+#define PERSIST_PAGE_SIZE (64 * 1024)    // checkpoint ghi theo trang này
+#define JOURNAL_FILE "emails.journal"    // file thật: emails.journal.<epoch>
+#define JOURNAL_MAGIC 0x314A534DU        // "MSJ1"
+#define JOURNAL_FLAG_BATCH 8             // record: cờ của nhiều email (payload FlagChunk...)
+#define JOURNAL_FLAG_RANGE 9             // record: mark-all-read cả mailbox (payload FlagRange)
+#define FLAG_BATCH_MAX 1024              // số email giữ trong buffer cờ trước khi ghi
+#define FLAG_BATCH_AGE_MS 1000           // buffer cũ hơn thì ghi ở lần nhả lock tiếp theo
+#define EMAIL_FLAG_READ 0x01             // bit cờ trong journal (còn chỗ cho starred/flagged)
+#define EMAIL_FLAG_DELETED 0x02          // chỉ trong journal cũ: xóa giờ là record CHANGE_DELETE
+
+// Sharding (shard.c): mỗi shard là một segment + semaphore + thư mục riêng.
+// Id user/email do shard i cấp là i+1, i+1+N, ... nên id cho biết shard.
+#define MAX_SHARDS 16
+#define SHARD_ROUTE_HASH 0               // hash cả địa chỉ email
+#define SHARD_ROUTE_DOMAIN 1             // hash phần domain: cùng domain cùng shard
+#define SHARD_MANIFEST "shards.conf"
+#define SHARD_DELIVER_BATCH 32
+#define ID_STRIDE(shm) ((shm)->control.shard_count > 1 ? (shm)->control.shard_count : 1)
+#define SHARD_OF_ID(id, count) (((id) - 1) % (count))
+
+// Replica (replica.c): segment thứ hai chỉ cho báo cáo/admin, được một
+// process feeder cập nhật từ change log của segment chính
+#define SHM_KEY_REPLICA 2468
+#define SEM_KEY_REPLICA 8642
+#define REPLICA_BATCH 256                // số thay đổi copy mỗi lần giữ store lock
+#define REPLICA_POLL_MS 20               // feeder ngủ bao lâu khi không có thay đổi
+
+// Log shipping tới standby (mail_standby): frame là JournalRecord, op SHIP_*
+// mang payload riêng thay cho subject/content
+#define STANDBY_SOCKET "standby.sock"
+#define SHIP_HELLO 16                    // standby -> primary: modseq đã có trên đĩa
+#define SHIP_ACK 17                      // standby -> primary: modseq đã lưu bền
+#define SHIP_SNAPSHOT 18                 // bắt đầu copy toàn bộ, payload ShipUsers
+#define SHIP_USERS 19                    // bảng users mới, payload ShipUsers
+#define SHIP_SNAPSHOT_END 20             // modseq của bản copy toàn bộ
+#define STANDBY_SAVE_MS 200              // standby gom thay đổi rồi lưu file
+#define STANDBY_RETRY_MS 1000            // shipper thử kết nối lại
+#define STANDBY_LAG_MARKS 64
+
+// Tiered storage (tier.c): mail cũ đã đọc nằm trong file cold, không chiếm slot
+#define TIER_COLD_FILE "emails.cold"     // append-only, cùng định dạng JournalRecord
+#define TIER_INDEX_SIZE 16384            // số email cold tối đa (chỉ index nằm trong segment)
+#define TIER_DEMOTE_BATCH 64             // số email hạ xuống mỗi lần store đầy
+#define TIER_COLD_DAYS 30                // --tier mặc định: mail đã đọc cũ hơn mức này
+
+// Lazy loading (lazy.c): chỉ nạp users + manifest lúc khởi tạo
+#define LAZY_OFFSETS_PER_LINE 32         // offset mỗi dòng "# OFFSETS:" trong emails.txt
+#define LAZY_NONE 0                      // mailbox không có trong manifest
+#define LAZY_PENDING 1                   // mail của mailbox chưa nạp
+#define LAZY_LOADED 2                    // đã nạp theo manifest
+
+// Bulk import (mail_import)
+#define IMPORT_BATCH_SIZE 256
+
+// mbox export: số email copy mỗi lần giữ lock và kích thước buffer ghi
+#define EXPORT_CHUNK_EMAILS 32
+#define EXPORT_BUFFER_SIZE (256 * 1024)
+
+// Cache mailbox view đã dựng (mailbox_cache.c), mỗi process một bản
+#define MAILBOX_CACHE_ENTRIES 8          // số (user, mailbox) giữ lại, bỏ cái dùng lâu nhất
+
+// Mailbox filter cho EmailIterator
+#define MAILBOX_RECEIVED 0
+#define MAILBOX_SENT 1
+#define MAILBOX_BOTH 2
+
+// User Structure
+typedef struct {
+    int user_id;
+    char name[MAX_NAME_LENGTH];
+    char email[MAX_EMAIL_LENGTH];
+    char password[MAX_PASSWORD_LENGTH];
+    int age;
+    int is_active;
+    time_t created_at;
+} User;
+
+// Email Structure
+typedef struct {
+    int email_id;
+    int sender_id;
+    int receiver_id;
+    char subject[MAX_SUBJECT_LENGTH];
+    char content[MAX_CONTENT_LENGTH];
+    time_t sent_at;
+    int is_read;
+    int is_deleted;
+    unsigned long long modseq;   // modseq của lần thay đổi gần nhất
+} Email;
+
+// Control Structure for Shared Memory
+typedef struct {
+    int user_count;
+    int email_count;
+    int next_user_id;
+    int next_email_id;
+    pid_t deliveryd_pid;      // 0 khi không có mail_deliveryd chạy
+    unsigned int save_seq;           // tăng mỗi lần chụp dữ liệu để lưu
+    unsigned int users_saved_seq;    // save_seq của users.txt đang trên đĩa
+    unsigned int emails_saved_seq;   // save_seq của emails.txt đang trên đĩa
+    int shard_index;                 // segment này là shard nào (shard.c)
+    int shard_count;                 // 0 = store thường, không shard
+    unsigned int users_version;      // tăng mỗi lần bảng users thay đổi
+} ControlData;
+
+// Send request waiting in the delivery queue
+typedef struct {
+    int sender_id;
+    int receiver_id;
+    char subject[MAX_SUBJECT_LENGTH];
+    char content[MAX_CONTENT_LENGTH];
+    time_t enqueued_at;
+} SendRequest;
+
+// Ring buffer FIFO (cùng cơ chế với producer_consumer/buffer.h)
+typedef struct {
+    int in;
+    int out;
+    int count;
+    int delivered;
+    int rejected;
+    SendRequest requests[DELIVERY_QUEUE_SIZE];
+} DeliveryQueue;
+
+// Futex words báo mail mới: mỗi slot user một bộ đếm + một bộ đếm chung
+typedef struct {
+    unsigned int global_seq;
+    unsigned int user_seq[MAX_USERS];
+    unsigned int mailbox_gen[MAX_USERS];     // tăng mỗi khi nội dung mailbox đổi (create/flags/delete)
+} NotifyData;
+
+// Một bản ghi thay đổi trong change log
+typedef struct {
+    unsigned long long modseq;
+    int op;                      // CHANGE_CREATE / CHANGE_FLAGS / CHANGE_DELETE
+    int email_id;
+    int slot;                    // vị trí trong mảng emails, -1 = email cold (tier.c)
+    int sender_id;
+    int receiver_id;
+} ChangeRecord;
+
+// Change log dạng ring: records[modseq % CHANGE_LOG_SIZE]
+typedef struct {
+    unsigned long long highest_modseq;               // modseq toàn cục
+    unsigned long long base_modseq;                  // cũ hơn mức này phải resync toàn bộ
+    unsigned long long persisted_modseq;             // modseq của emails.txt trên đĩa
+    unsigned long long mailbox_modseq[MAX_USERS];    // theo slot user
+    ChangeRecord records[CHANGE_LOG_SIZE];
+} ChangeLog;
+
+// Kết quả delta sync: email == NULL nghĩa là email đã bị xóa (vanished).
+// Email cold có slot = -1 và email trỏ tới bản dựng lại từ file cold.
+typedef struct {
+    unsigned long long modseq;
+    int op;
+    int email_id;
+    int slot;                    // vị trí trong mảng emails, -1 = email cold
+    Email* email;
+} EmailChange;
+
+// Kết quả một lần lưu nền, process con gửi về qua pipe
+typedef struct {
+    int what;
+    int status;                  // 0 = thành công
+    unsigned int seq;
+    long duration_ms;
+    time_t finished_at;
+} BgSaveResult;
+
+// Một email cần nhập hàng loạt. subject/content trỏ thẳng vào dữ liệu nguồn
+// (không cần '\0'), chỉ được copy một lần khi ghi vào slot.
+typedef struct {
+    int sender_id;
+    int receiver_id;
+    const char* subject;
+    size_t subject_len;
+    const char* content;
+    size_t content_len;
+    time_t sent_at;              // 0 = thời điểm nhập
+    int is_read;
+    int unquote_from;            // mboxrd: dòng ">*From " bỏ một '>'
+} EmailImport;
+
+// Bộ lọc cho export_mbox. user_id <= 0: cả store; since/until = 0: không giới
+// hạn (khoảng [since, until) theo sent_at)
+typedef struct {
+    int user_id;
+    int type;                    // MAILBOX_RECEIVED / MAILBOX_SENT / MAILBOX_BOTH
+    time_t since;
+    time_t until;
+} ExportFilter;
+
+// Duyệt emails không cấp phát bộ nhớ. user_id <= 0: mọi email trong store
+typedef struct {
+    int user_id;
+    int type;                    // MAILBOX_RECEIVED / MAILBOX_SENT / MAILBOX_BOTH
+    int pos;
+    int cold_pos;                // vị trí trong index cold; -1 = chỉ duyệt segment
+} EmailIterator;
+
+typedef struct {
+    int pos;
+} UserIterator;
+
+// Một dòng của mailbox view (mailbox_view): peer là email người gửi (mailbox
+// nhận) hoặc người nhận (mailbox gửi), "Unknown" nếu user không còn
+typedef struct {
+    int email_id;
+    int peer_id;
+    char peer[MAX_EMAIL_LENGTH];
+    char subject[MAX_SUBJECT_LENGTH];
+    time_t sent_at;
+    int is_read;
+} MailboxRow;
+
+// Kết quả validate_database
+typedef struct {
+    int invalid_users;
+    int invalid_emails;
+    int reported;                // số phần tử hợp lệ trong email_indices
+    int email_indices[VALIDATE_REPORT_LIMIT];
+} ValidationReport;
+
+// Bộ đếm của một thao tác: số lần gọi, số lần thất bại, histogram log2
+typedef struct {
+    unsigned long long count;
+    unsigned long long failed;
+    unsigned long long total_ns;
+    unsigned long long hist[STATS_BUCKETS];
+} OpStats;
+
+// Mỗi shard nằm trên cache line riêng để các process không tranh nhau
+typedef struct {
+    pid_t owner_pid;             // 0 = chưa ai dùng
+    OpStats ops[STAT_OP_COUNT];
+} __attribute__((aligned(64))) StatsShard;
+
+typedef struct {
+    time_t started_at;
+    StatsShard shards[STATS_SHARDS];
+} StatsRegion;
+
+// Một trace event cố định 48 byte. seq = số thứ tự + 1 của event, ghi sau
+// cùng (release); 0 nghĩa là slot trống hoặc đang được ghi.
+typedef struct {
+    unsigned long long seq;
+    long long start_ns;          // CLOCK_MONOTONIC
+    long long end_ns;
+    int pid;
+    int tid;
+    int op;
+    int id1;                     // user_id / sender_id / email_id tùy op
+    int id2;
+    int result;                  // giá trị trả về (id, số lượng hoặc MS_*)
+} TraceEvent;
+
+// Ring của một process (cùng chỉ số với shard trong stats region)
+typedef struct {
+    unsigned long long head;     // tổng số event đã ghi
+    TraceEvent events[TRACE_RING_SIZE];
+} __attribute__((aligned(64))) TraceRing;
+
+typedef struct {
+    int enabled;                 // bật/tắt lúc chạy (mail_trace on/off)
+    TraceRing rings[STATS_SHARDS];
+} TraceRegion;
+
+// Đầu file capture
+typedef struct {
+    char magic[8];               // CAPTURE_MAGIC
+    unsigned int version;
+    int pid;                     // process đã ghi file
+    long long start_ns;          // CLOCK_MONOTONIC lúc mở file
+    long long start_time;        // time() lúc mở file
+} CaptureHeader;
+
+// Một thao tác (20 byte), theo sau là len1 + len2 + len3 byte chuỗi
+typedef struct {
+    unsigned int delta_us;       // micro giây kể từ record trước (hoặc start_ns)
+    unsigned char op;            // CAP_*
+    unsigned char flags;
+    unsigned short len1;
+    unsigned short len2;
+    unsigned short len3;
+    int a;
+    int b;
+} CaptureRecord;
+
+// Một record trong change journal (56 byte), theo sau là subject_len +
+// content_len byte (chỉ với CHANGE_CREATE), đệm tới bội số 8
+typedef struct {
+    unsigned int magic;          // JOURNAL_MAGIC
+    unsigned int length;         // cả record kể cả phần đệm
+    unsigned long long modseq;
+    int op;                      // CHANGE_CREATE / CHANGE_FLAGS / CHANGE_DELETE
+    int email_id;
+    int sender_id;
+    int receiver_id;
+    long long sent_at;
+    int is_read;
+    unsigned short subject_len;
+    unsigned short content_len;
+    unsigned int checksum;       // FNV-1a của cả record với checksum = 0
+    unsigned int reserved;
+} JournalRecord;
+
+// Payload JOURNAL_FLAG_BATCH: các chunk nối nhau, chunk có count = 0 (phần đệm)
+// là hết. Chunk phủ 64 email id từ base_id; mỗi bit bật trong mask (theo thứ
+// tự id) có một delta modseq (rec->modseq - modseq của thay đổi) trong mảng
+// uint32 ngay sau header, rồi một byte EMAIL_FLAG_*; chunk đệm tới bội số 8.
+typedef struct {
+    int base_id;
+    unsigned int count;          // số bit bật trong mask
+    unsigned long long mask;
+} FlagChunk;
+
+// Payload JOURNAL_FLAG_RANGE: mọi mail còn sống user_id nhận với modseq <=
+// rec->modseq đều đã đọc
+typedef struct {
+    int user_id;
+    int flags;                   // EMAIL_FLAG_READ
+} FlagRange;
+
+// Trạng thái journal dùng chung. Mỗi checkpoint emails.txt mở epoch mới; file
+// emails.txt ghi epoch bắt đầu sau nó để khôi phục biết đọc journal nào.
+typedef struct {
+    int enabled;                 // MAILSTORE_JOURNAL=1 lúc khởi tạo segment
+    unsigned int epoch;
+    unsigned long long tail;     // offset ghi tiếp theo trong file epoch hiện tại
+    unsigned long long records;  // số record đã ghi từ khi khởi tạo
+    unsigned long long flag_changes;     // thay đổi cờ đưa vào buffer
+    unsigned long long flag_entries;     // entry cờ thực sự ghi (sau khi gộp)
+    unsigned long long flag_records;     // record JOURNAL_FLAG_BATCH / _RANGE đã ghi
+} JournalState;
+
+// Trạng thái replica. Trong segment replica: mức đã áp dụng; trong segment
+// chính: feeder công bố cùng thông tin để đo độ trễ từ phía primary.
+typedef struct {
+    int is_replica;              // 1 trong segment replica
+    pid_t feeder_pid;
+    unsigned long long applied_modseq;
+    unsigned int users_version;  // users_version của primary đã copy
+    unsigned int resyncs;        // số lần phải copy lại toàn bộ
+    unsigned long long tier_demoted;  // tier.demoted của primary lúc copy (hạ xuống => copy lại)
+    unsigned int lazy_generation;     // lazy.generation của primary lúc copy
+    unsigned long long applied;  // số thay đổi đã áp dụng
+    long long updated_ns;        // stats_now() lần cập nhật gần nhất
+} ReplicaState;
+
+// Trạng thái log shipping do shipper công bố trong segment chính (hiện trong stats)
+typedef struct {
+    pid_t shipper_pid;
+    int connected;
+    unsigned long long shipped_modseq;   // đã gửi sang standby
+    unsigned long long acked_modseq;     // standby đã lưu bền trong thư mục của nó
+    long long lag_ns;                    // tuổi của thay đổi cũ nhất chưa được ack
+    unsigned long long bytes;
+    unsigned int snapshots;
+} StandbyState;
+
+// Một email đã hạ xuống file cold: cờ nằm ở đây, subject/content ở offset
+typedef struct {
+    int email_id;                // 0 = entry trống
+    int sender_id;
+    int receiver_id;
+    int is_read;
+    int is_deleted;
+    unsigned int length;         // độ dài record CHANGE_CREATE trong file
+    long long sent_at;
+    unsigned long long offset;
+    unsigned long long modseq;   // thay đổi cuối (change log)
+} ColdEntry;
+
+// Trạng thái tier dùng chung. file_size là offset ghi tiếp theo (cấp dưới
+// store lock, như journal.tail).
+typedef struct {
+    int enabled;                 // MAILSTORE_TIER=1 lúc khởi tạo segment
+    int count;                   // số entry đã dùng trong index (kể cả đã xóa)
+    unsigned long long file_size;
+    unsigned long long demoted;
+    unsigned long long paged_in;  // số lần read_email đọc từ file cold
+    ColdEntry index[TIER_INDEX_SIZE];
+} TierState;
+
+// Manifest của một mailbox (theo slot user) trong emails.txt
+typedef struct {
+    int state;                   // LAZY_NONE / LAZY_PENDING / LAZY_LOADED
+    int user_id;
+    int count;                   // số email theo manifest
+    int lines;                   // số dòng "# OFFSETS:"
+    long long offsets_at;        // offset dòng OFFSETS đầu tiên
+} LazyMailbox;
+
+typedef struct {
+    int enabled;                 // MAILSTORE_LAZY lúc khởi tạo segment
+    int pending;                 // số mailbox còn LAZY_PENDING
+    long long data_offset;       // dòng email đầu tiên (lazy_load_all quét từ đây)
+    unsigned long long faults;   // số mailbox đã nạp theo yêu cầu
+    unsigned long long loaded;   // số email đã nạp
+    long long load_ns;           // tổng thời gian nạp
+    unsigned int generation;     // +1 mỗi lần nạp; replica / standby copy lại khi đổi
+    LazyMailbox mailboxes[MAX_USERS];
+} LazyState;
+
+// Shared Memory Structure
+typedef struct {
+    ControlData control;
+    User users[MAX_USERS];
+    Email emails[MAX_EMAILS];
+    DeliveryQueue queue;
+    NotifyData notify;
+    ChangeLog changelog;
+    StatsRegion stats;
+    TraceRegion trace;
+    JournalState journal;
+    ReplicaState replica;
+    StandbyState standby;
+    TierState tier;
+    LazyState lazy;
+} SharedMemoryData;
+
+// Một tập shard đã mở trong process này (shard.c). Email nằm ở shard của
+// người nhận; gửi sang shard khác đi qua hàng đợi giao (queue) của shard
+// người gửi rồi được giao dưới lock của shard nhận.
+typedef struct {
+    int count;
+    int route;                   // SHARD_ROUTE_*
+    char dir[256];
+    SharedMemoryData* shards[MAX_SHARDS];
+    int shm_ids[MAX_SHARDS];
+    int sem_ids[MAX_SHARDS];
+} ShardSet;
+
+// Trang bộ nhớ đang dùng cho một mapping (đọc từ /proc/self/smaps)
+typedef struct {
+    size_t page_size;            // KernelPageSize của mapping
+    size_t mapped_bytes;         // kích thước mapping
+    size_t huge_bytes;           // phần đang nằm trên huge page (hugetlb hoặc THP)
+    int hugetlb;                 // 1 nếu là segment SHM_HUGETLB / hugetlbfs
+} PageInfo;
+
+// Status Functions
+const char* mailstore_strerror(int status);
+
+// Shared Memory Functions
+int create_shared_memory();
+SharedMemoryData* attach_shared_memory();
+SharedMemoryData* attach_shared_memory_readonly();
+int detach_shared_memory(SharedMemoryData* shm_ptr);
+int destroy_shared_memory();
+int init_shared_memory(SharedMemoryData* shm_ptr);
+int get_shared_memory_id();
+int check_shared_memory_status();
+size_t get_huge_page_size();
+int get_page_info(const void* addr, PageInfo* info);
+int open_mail_semaphores();
+int reset_mail_semaphores();
+int lock_store();
+int unlock_store();
+int store_lock_held();
+
+// Database Functions
+int save_users_to_file(SharedMemoryData* shm_ptr);
+int load_users_from_file(SharedMemoryData* shm_ptr);
+int save_emails_to_file(SharedMemoryData* shm_ptr);
+int load_emails_from_file(SharedMemoryData* shm_ptr);
+int load_users_from_path(SharedMemoryData* shm_ptr, const char* path);
+int load_emails_from_path(SharedMemoryData* shm_ptr, const char* path);
+void parse_email_line(char* line, Email* email);
+int write_users_file(const SharedMemoryData* shm_ptr, const char* path);
+int write_emails_file(const SharedMemoryData* shm_ptr, const char* path);
+int install_db_file(const char* tmp_path, const char* path, unsigned int* installed_seq, unsigned int seq);
+int backup_database(SharedMemoryData* shm_ptr);
+int write_backup_files(const SharedMemoryData* shm_ptr);
+int clear_database_files();
+int validate_database(SharedMemoryData* shm_ptr, ValidationReport* report);
+
+// Background Save Functions
+pid_t start_background_save(SharedMemoryData* shm_ptr, int what);
+int poll_background_save();
+void wait_background_saves();
+int background_saves_running();
+int get_last_background_save(BgSaveResult* result);
+
+// User CRUD Functions
+int create_user(SharedMemoryData* shm_ptr, const char* name, const char* email, const char* password, int age);
+User* read_user(SharedMemoryData* shm_ptr, int user_id);
+User* find_user_by_email(SharedMemoryData* shm_ptr, const char* email);
+User* verify_user_credentials(SharedMemoryData* shm_ptr, const char* email, const char* password);
+int update_user(SharedMemoryData* shm_ptr, int user_id, const char* name, const char* email, const char* password, int age);
+int delete_user(SharedMemoryData* shm_ptr, int user_id);
+void user_iter_init(UserIterator* it);
+User* user_iter_next(SharedMemoryData* shm_ptr, UserIterator* it);
+int user_slot_of(SharedMemoryData* shm_ptr, int user_id);
+
+// Email CRUD Functions
+int create_email(SharedMemoryData* shm_ptr, int sender_id, int receiver_id, 
+                 const char* subject, const char* content);
+Email* read_email(SharedMemoryData* shm_ptr, int email_id);
+int update_email_status(SharedMemoryData* shm_ptr, int email_id, int is_read);
+int delete_email(SharedMemoryData* shm_ptr, int email_id);
+int get_unread_email_count(SharedMemoryData* shm_ptr, int user_id);
+int mark_all_emails_read(SharedMemoryData* shm_ptr, int user_id);
+int delete_read_emails(SharedMemoryData* shm_ptr, int user_id);
+void email_iter_init(EmailIterator* it, int user_id, int type);
+Email* email_iter_next(SharedMemoryData* shm_ptr, EmailIterator* it);
+int find_emails_matching(SharedMemoryData* shm_ptr, int user_id, const char* keyword,
+                         int* ids, int max);
+int import_emails(SharedMemoryData* shm_ptr, const EmailImport* items, int n);
+
+// Export Functions (tự lấy store lock theo từng chunk)
+int export_mbox(SharedMemoryData* shm_ptr, int fd, const ExportFilter* filter, long long* bytes);
+
+// Delivery Queue Functions
+int is_delivery_daemon_running(SharedMemoryData* shm_ptr);
+int enqueue_send_request(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
+                         const char* subject, const char* content);
+int dequeue_send_batch(SharedMemoryData* shm_ptr, SendRequest* batch, int max);
+
+// Notification Functions
+void notify_mailbox(SharedMemoryData* shm_ptr, int user_id);
+unsigned int get_mailbox_event_seq(SharedMemoryData* shm_ptr, int user_id);
+unsigned int get_global_event_seq(SharedMemoryData* shm_ptr);
+int wait_for_mailbox_event(SharedMemoryData* shm_ptr, int user_id, unsigned int seen_seq, int timeout_ms);
+int wait_for_mailbox_events(SharedMemoryData* shm_ptr, const int* user_ids, unsigned int* seen_seqs,
+                            int n, int timeout_ms);
+
+// Change Log / Delta Sync Functions
+unsigned long long record_email_change(SharedMemoryData* shm_ptr, Email* email, int op);
+unsigned long long get_global_modseq(SharedMemoryData* shm_ptr);
+unsigned long long get_mailbox_modseq(SharedMemoryData* shm_ptr, int user_id);
+int get_changes_since(SharedMemoryData* shm_ptr, int user_id, unsigned long long since,
+                      EmailChange* changes, int max, unsigned long long* next_since);
+
+// Statistics Functions (caller không cần giữ store lock)
+long long stats_now();
+void stats_record(SharedMemoryData* shm_ptr, int op, long long start_ns, int ok);
+int stats_shard_index(SharedMemoryData* shm_ptr);
+void stats_merge(const SharedMemoryData* shm_ptr, OpStats* out);
+void stats_reset(SharedMemoryData* shm_ptr);
+const char* stats_op_name(int op);
+unsigned long long stats_percentile(const OpStats* op, double q);
+
+// Trace Functions
+void trace_record(SharedMemoryData* shm_ptr, int op, long long start_ns, int id1, int id2, int result);
+void trace_set_enabled(SharedMemoryData* shm_ptr, int enabled);
+void trace_clear(SharedMemoryData* shm_ptr);
+int trace_collect(const SharedMemoryData* shm_ptr, TraceEvent* out, int max);
+const char* trace_op_name(int op);
+
+// Ghi trace event nếu tracing đang bật; khi tắt chỉ tốn một lần đọc + nhánh
+#define TRACE_OP(shm_ptr, op, start_ns, id1, id2, result) \
+    do { \
+        if ((shm_ptr) != NULL && (shm_ptr)->trace.enabled) { \
+            trace_record((shm_ptr), (op), (start_ns), (id1), (id2), (result)); \
+        } \
+    } while (0)
+
+// Capture Functions (MAILSTORE_CAPTURE=<prefix> bật tự động)
+int capture_open(const char* prefix);
+void capture_close();
+int capture_active();
+void capture_record(int op, int a, int b, const char* s1, const char* s2, const char* s3);
+const char* capture_op_name(int op);
+void capture_password_token(const char* password, char* out, size_t size);
+
+// Async I/O Functions (callback chạy trong aio_poll / aio_wait_all của caller)
+typedef void (*aio_callback)(void* arg, int result);
+int aio_write(int fd, const void* buf, size_t len, off_t offset, aio_callback cb, void* arg);
+int aio_fdatasync(int fd, aio_callback cb, void* arg);
+int aio_submit();
+int aio_poll();
+int aio_wait_all();
+int aio_event_fd();
+int aio_pending();
+const char* aio_backend_name();
+
+// Journal Functions
+void journal_append(SharedMemoryData* shm_ptr, const Email* email, int op);
+void journal_kick();
+int journal_poll();
+int journal_commit(aio_callback cb, void* arg);
+int journal_pending();
+int journal_sync();
+int journal_flush_flags(int force);
+void journal_begin_range(SharedMemoryData* shm_ptr, int user_id);
+void journal_end_range(SharedMemoryData* shm_ptr, int changed);
+unsigned int journal_rotate(SharedMemoryData* shm_ptr);
+void journal_prune(unsigned int epoch);
+int journal_recover(SharedMemoryData* shm_ptr);
+JournalRecord* journal_build_record(const Email* email, int op);
+JournalRecord* journal_build_frame(int op, unsigned long long modseq, const void* payload, size_t size);
+int journal_check_record(const JournalRecord* rec, size_t max_length, int full);
+void journal_apply_record(SharedMemoryData* shm_ptr, const JournalRecord* rec);
+
+// Tiered Storage Functions (caller giữ store lock)
+int tier_load(SharedMemoryData* shm_ptr);
+int tier_demote(SharedMemoryData* shm_ptr, time_t older_than, int max);
+int tier_sync(const SharedMemoryData* shm_ptr);
+Email* tier_read(SharedMemoryData* shm_ptr, int email_id);
+int tier_set_flags(SharedMemoryData* shm_ptr, int email_id, int is_read, int is_deleted);
+int tier_unread_count(SharedMemoryData* shm_ptr, int user_id);
+int tier_mark_all_read(SharedMemoryData* shm_ptr, int user_id);
+int tier_delete_read(SharedMemoryData* shm_ptr, int user_id);
+Email* tier_iter_next(SharedMemoryData* shm_ptr, EmailIterator* it);
+int tier_materialize(const ColdEntry* entry, Email* out);
+int tier_live_count(SharedMemoryData* shm_ptr);
+
+// Lazy Loading Functions (tự lấy store lock nếu thread này chưa giữ)
+int lazy_open(SharedMemoryData* shm_ptr, int prefetch);
+int lazy_fault_in(SharedMemoryData* shm_ptr, int user_id);
+int lazy_load_all(SharedMemoryData* shm_ptr);
+
+// Mailbox Cache Functions
+void touch_mailbox(SharedMemoryData* shm_ptr, int sender_id, int receiver_id);
+int mailbox_view(SharedMemoryData* shm_ptr, int user_id, int type, const MailboxRow** rows);
+void mailbox_cache_counts(long* hits, long* misses);
+
+// Shard Functions (caller không giữ lock shard nào: mỗi hàm tự khóa đúng shard)
+int shard_open(ShardSet* set, const char* dir, int count, int route);
+void shard_close(ShardSet* set);
+int shard_destroy(ShardSet* set);
+int shard_for_address(const ShardSet* set, const char* email);
+int shard_for_id(const ShardSet* set, int id);
+int shard_lock(ShardSet* set, int shard);
+int shard_unlock(ShardSet* set, int shard);
+int shard_create_user(ShardSet* set, const char* name, const char* email, const char* password, int age);
+int shard_find_user(ShardSet* set, const char* email, User* out);
+int shard_read_user(ShardSet* set, int user_id, User* out);
+int shard_verify_user(ShardSet* set, const char* email, const char* password, User* out);
+int shard_send_email(ShardSet* set, int sender_id, int receiver_id, const char* subject, const char* content);
+int shard_deliver(ShardSet* set, int shard);
+int shard_read_email(ShardSet* set, int email_id, Email* out);
+int shard_update_email_status(ShardSet* set, int email_id, int is_read);
+int shard_delete_email(ShardSet* set, int email_id);
+int shard_unread_count(ShardSet* set, int user_id);
+int shard_list_mailbox(ShardSet* set, int user_id, int type, Email* out, int max);
+int shard_save(ShardSet* set, int shard);
+int shard_save_all(ShardSet* set);
+
+// Replica Functions (replica.c)
+SharedMemoryData* attach_replica(int create);
+int destroy_replica();
+int lock_replica();
+int unlock_replica();
+int replica_sync(SharedMemoryData* primary, SharedMemoryData* replica);
+int is_replica_running(SharedMemoryData* shm_ptr);
+unsigned long long replica_lag(SharedMemoryData* primary, SharedMemoryData* replica);
+
+// Worker Pool Functions
+typedef void (*range_task_fn)(SharedMemoryData* shm_ptr, int begin, int end, void* arg, void* result);
+int get_worker_count();
+int run_parallel_range(SharedMemoryData* shm_ptr, int total, range_task_fn fn, void* arg,
+                       void* results, size_t result_size);
+
+#endif // MAILSTORE_H
@@ -2,64 +2,220 @@
 #include <signal.h>
 
 static SharedMemoryData* g_shm_ptr = NULL;
+static SharedMemoryData* g_replica_ptr = NULL;
+
+// Lưu users + emails và báo kết quả
+static void save_all(SharedMemoryData* shm_ptr) {
+    int rc = save_users_to_file(shm_ptr);
+    if (rc == MS_OK) {
+        printf("Users data saved to %s successfully\n", USER_DB_FILE);
+    } else {
+        printf("Error saving %s: %s\n", USER_DB_FILE, mailstore_strerror(rc));
+    }
+    
+    rc = save_emails_to_file(shm_ptr);
+    if (rc == MS_OK) {
+        printf("Emails data saved to %s successfully\n", EMAIL_DB_FILE);
+    } else {
+        printf("Error saving %s: %s\n", EMAIL_DB_FILE, mailstore_strerror(rc));
+    }
+}
 
 void signal_handler(int sig) {
     printf("\nReceived signal %d, cleaning up...\n", sig);
     if (g_shm_ptr != NULL) {
-        save_users_to_file(g_shm_ptr);
-        save_emails_to_file(g_shm_ptr);
+        save_all(g_shm_ptr);
         detach_shared_memory(g_shm_ptr);
     }
     cleanup_shared_memory();
     exit(0);
 }
 
-void clear_screen() {
-    system("clear");
+void display_shared_memory_info(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        printf("Shared memory not available\n");
+        return;
+    }
+    
+    printf("\n╔════════════════════════════════════════════════════════╗\n");
+    printf("║         SHARED MEMORY - REAL-TIME DATA VIEW           ║\n");
+    printf("╚════════════════════════════════════════════════════════╝\n");
+    
+    // Control Information
+    printf("\n📊 CONTROL INFORMATION:\n");
+    printf("├─ Shared Memory ID: %d\n", get_shared_memory_id());
+    printf("├─ Memory Size: %.2f MB (%lu bytes)\n", 
+           sizeof(SharedMemoryData) / (1024.0 * 1024.0),
+           sizeof(SharedMemoryData));
+    PageInfo pages;
+    if (get_page_info(shm_ptr, &pages) == MS_OK) {
+        if (pages.hugetlb) {
+            printf("├─ Page Size: %zu KB (SHM_HUGETLB)\n", pages.page_size / 1024);
+        } else if (pages.huge_bytes > 0) {
+            printf("├─ Page Size: %zu KB, %zu KB on transparent huge pages\n",
+                   pages.page_size / 1024, pages.huge_bytes / 1024);
+        } else {
+            printf("├─ Page Size: %zu KB\n", pages.page_size / 1024);
+        }
+    }
+    printf("├─ Total Users: %d / %d\n", shm_ptr->control.user_count, MAX_USERS);
+    printf("├─ Total Emails: %d / %d\n", shm_ptr->control.email_count, MAX_EMAILS);
+    if (shm_ptr->lazy.enabled) {
+        printf("├─ Lazy Loading: %d mailboxes pending, %llu faulted in (%llu emails, %.1f ms)\n",
+               shm_ptr->lazy.pending, shm_ptr->lazy.faults, shm_ptr->lazy.loaded,
+               shm_ptr->lazy.load_ns / 1e6);
+    }
+    if (shm_ptr->tier.enabled) {
+        printf("├─ Cold Emails: %d / %d in %s (%.1f KB, %llu demoted, %llu paged in)\n",
+               tier_live_count(shm_ptr), TIER_INDEX_SIZE, TIER_COLD_FILE,
+               shm_ptr->tier.file_size / 1024.0, shm_ptr->tier.demoted, shm_ptr->tier.paged_in);
+    }
+    printf("├─ Next User ID: %d\n", shm_ptr->control.next_user_id);
+    printf("├─ Next Email ID: %d\n", shm_ptr->control.next_email_id);
+    printf("├─ Highest Modseq: %llu (change log from %llu)\n",
+           shm_ptr->changelog.highest_modseq, shm_ptr->changelog.base_modseq);
+    printf("├─ Persisted Modseq: %llu (%llu changes not on disk)\n",
+           shm_ptr->changelog.persisted_modseq,
+           shm_ptr->changelog.highest_modseq - shm_ptr->changelog.persisted_modseq);
+    if (shm_ptr->replica.is_replica) {
+        printf("├─ View: read-only replica, %llu changes behind, updated %.0f ms ago\n",
+               replica_lag(g_shm_ptr, shm_ptr), (stats_now() - shm_ptr->replica.updated_ns) / 1e6);
+    } else if (is_replica_running(shm_ptr)) {
+        printf("├─ Replica: feeder PID %d, %llu changes behind\n",
+               shm_ptr->replica.feeder_pid, replica_lag(shm_ptr, NULL));
+    }
+    
+    BgSaveResult last_save;
+    if (get_last_background_save(&last_save)) {
+        printf("├─ Last Background Save: %s in %ld ms (%d running)\n",
+               last_save.status == 0 ? "OK" : "FAILED", last_save.duration_ms,
+               background_saves_running());
+    }
+    long view_hits, view_misses;
+    mailbox_cache_counts(&view_hits, &view_misses);
+    printf("├─ Mailbox View Cache: %ld hits, %ld rebuilds (this process)\n", view_hits, view_misses);
+    printf("├─ Delivery Queue: %d / %d pending (delivered %d, rejected %d)\n",
+           shm_ptr->queue.count, DELIVERY_QUEUE_SIZE,
+           shm_ptr->queue.delivered, shm_ptr->queue.rejected);
+    if (is_delivery_daemon_running(shm_ptr)) {
+        printf("└─ Delivery Daemon: running (PID %d)\n", shm_ptr->control.deliveryd_pid);
+    } else {
+        printf("└─ Delivery Daemon: not running\n");
+    }
+    
+    // Users in Memory
+    printf("\n👥 USERS IN SHARED MEMORY:\n");
+    if (shm_ptr->control.user_count == 0) {
+        printf("   (No users in memory)\n");
+    } else {
+        printf("┌─────┬──────────────────────┬────────────────────────────┬─────┬────────┐\n");
+        printf("│ ID  │ Name                 │ Email                      │ Age │ Status │\n");
+        printf("├─────┼──────────────────────┼────────────────────────────┼─────┼────────┤\n");
+        for (int i = 0; i < MAX_USERS && shm_ptr->control.user_count > 0; i++) {
+            if (shm_ptr->users[i].is_active) {
+                printf("│ %-3d │ %-20.20s │ %-26.26s │ %-3d │ %-6s │\n",
+                       shm_ptr->users[i].user_id,
+                       shm_ptr->users[i].name,
+                       shm_ptr->users[i].email,
+                       shm_ptr->users[i].age,
+                       shm_ptr->users[i].is_active ? "Active" : "Inact");
+            }
+        }
+        printf("└─────┴──────────────────────┴────────────────────────────┴─────┴────────┘\n");
+    }
+    
+    // Emails in Memory
+    printf("\n📧 EMAILS IN SHARED MEMORY:\n");
+    if (shm_ptr->control.email_count == 0) {
+        printf("   (No emails in memory)\n");
+    } else {
+        printf("┌─────┬──────┬──────┬─────────────────────────────┬────────┬─────────┐\n");
+        printf("│ ID  │ From │ To   │ Subject                     │ Status │ Deleted │\n");
+        printf("├─────┼──────┼──────┼─────────────────────────────┼────────┼─────────┤\n");
+        int count = 0;
+        for (int i = 0; i < MAX_EMAILS && count < shm_ptr->control.email_count; i++) {
+            if (shm_ptr->emails[i].email_id > 0) {
+                printf("│ %-3d │ %-4d │ %-4d │ %-27.27s │ %-6s │ %-7s │\n",
+                       shm_ptr->emails[i].email_id,
+                       shm_ptr->emails[i].sender_id,
+                       shm_ptr->emails[i].receiver_id,
+                       shm_ptr->emails[i].subject,
+                       shm_ptr->emails[i].is_read ? "Read" : "Unread",
+                       shm_ptr->emails[i].is_deleted ? "Yes" : "No");
+                count++;
+            }
+        }
+        printf("└─────┴──────┴──────┴─────────────────────────────┴────────┴─────────┘\n");
+    }
+    
+    // Operation Statistics
+    printf("\n⏱  OPERATION STATS:\n");
+    print_store_stats(shm_ptr, stdout, STATS_FORMAT_TEXT);
+    
+    // Memory Usage
+    printf("\n💾 MEMORY USAGE:\n");
+    size_t used_user_memory = shm_ptr->control.user_count * sizeof(User);
+    size_t used_email_memory = shm_ptr->control.email_count * sizeof(Email);
+    size_t total_used = sizeof(ControlData) + used_user_memory + used_email_memory;
+    size_t total_allocated = sizeof(SharedMemoryData);
+    
+    printf("├─ Control Data: %lu bytes\n", sizeof(ControlData));
+    printf("├─ Users: %lu bytes (%d active)\n", used_user_memory, shm_ptr->control.user_count);
+    printf("├─ Emails: %lu bytes (%d active)\n", used_email_memory, shm_ptr->control.email_count);
+    printf("├─ Total Used: %.2f KB / %.2f MB\n", 
+           total_used / 1024.0, 
+           total_allocated / (1024.0 * 1024.0));
+    printf("└─ Usage: %.1f%%\n", (total_used * 100.0) / total_allocated);
+    
+    printf("\n════════════════════════════════════════════════════════\n");
 }
 
-void pause_system() {
-    printf("\nPress Enter to continue...");
-    getchar();
+void cleanup_shared_memory() {
+    if (get_shared_memory_id() != -1) {
+        printf("Cleaning up shared memory...\n");
+        
+        SharedMemoryData* shm_ptr = attach_shared_memory();
+        if (shm_ptr != NULL) {
+            save_all(shm_ptr);
+            detach_shared_memory(shm_ptr);
+        }
+        
+        // Không destroy shared memory ở đây để các process khác có thể sử dụng
+        // destroy_shared_memory();
+    }
 }
 
-int get_user_choice() {
-    int choice;
-    char buffer[100];
+// Attach + init segment, báo số bản ghi đã nạp nếu segment vừa được tạo
+static SharedMemoryData* open_store() {
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        return NULL;
+    }
     
-    while (1) {
-        printf("Enter your choice: ");
-        fflush(stdout);
-        
-        if (fgets(buffer, sizeof(buffer), stdin) != NULL) {
-            buffer[strcspn(buffer, "\n")] = 0;
-            
-            if (strlen(buffer) == 0) {
-                if (feof(stdin)) {
-                    return 10;
-                }
-                printf("Please enter a number.\n");
-                continue;
-            }
-            
-            char* endptr;
-            choice = strtol(buffer, &endptr, 10);
-            
-            if (*endptr == '\0') {
-                return choice;
-            } else {
-                printf("Invalid input! Please enter a valid number.\n");
-                continue;
-            }
-        } else {
-            if (feof(stdin)) {
-                printf("\nEnd of input reached. Exiting...\n");
-                return 10;
-            } else {
-                printf("Error reading input!\n");
-                return 10;
-            }
-        }
+    if (init_shared_memory(shm_ptr) > 0) {
+        printf("Shared memory initialized successfully (ID: %d)\n", get_shared_memory_id());
+        printf("Loaded %d users from %s\n", shm_ptr->control.user_count, USER_DB_FILE);
+        printf("Loaded %d emails from %s\n", shm_ptr->control.email_count, EMAIL_DB_FILE);
+    }
+    return shm_ptr;
+}
+
+// Màn hình chỉ đọc quét toàn store: dùng replica khi feeder đang chạy để
+// không tranh store lock với traffic mail. Phải gọi close_report_view sau đó.
+static SharedMemoryData* open_report_view() {
+    if (g_replica_ptr == NULL) {
+        g_replica_ptr = attach_replica(0);
+    }
+    if (g_replica_ptr != NULL && g_replica_ptr->replica.is_replica && is_replica_running(g_replica_ptr)) {
+        lock_replica();
+        return g_replica_ptr;
+    }
+    return g_shm_ptr;
+}
+
+static void close_report_view(SharedMemoryData* view) {
+    if (view != NULL && view == g_replica_ptr) {
+        unlock_replica();
     }
 }
 
@@ -73,27 +229,163 @@ void display_menu() {
     printf("4.  Search My Emails\n");
     printf("5.  Update Profile\n");
     printf("6.  View Shared Memory (DEBUG)\n");
-    printf("7.  Logout\n");
+    printf("7.  Wait for New Mail\n");
+    printf("8.  Logout\n");
     printf("===============================================\n");
 }
 
-int main() {
+// ./mail_system --batch [file]: chạy lệnh không tương tác (xem batch.c)
+static int run_batch_mode(const char* path) {
+    FILE* in = stdin;
+    if (path != NULL) {
+        in = fopen(path, "r");
+        if (in == NULL) {
+            perror("Error opening batch file");
+            return 1;
+        }
+    }
+    
+    // Kết quả máy đọc ở stdout gốc; mọi thông báo khác chuyển sang stderr
+    fflush(stdout);
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    if (out == NULL) {
+        perror("fdopen");
+        return 1;
+    }
+    
+    g_shm_ptr = open_store();
+    if (g_shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return 1;
+    }
+    
+    int errors = run_batch(g_shm_ptr, in, out);
+    
+    wait_background_saves();
+    detach_shared_memory(g_shm_ptr);
+    fclose(out);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return errors > 0 ? 2 : 0;
+}
+
+// ./mail_system --stats [--json|--reset]: in hoặc xóa số liệu hot path
+static int run_stats_mode(const char* option) {
+    SharedMemoryData* shm_ptr = attach_shared_memory();
+    if (shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return 1;
+    }
+    
+    if (option != NULL && strcmp(option, "--reset") == 0) {
+        stats_reset(shm_ptr);
+        printf("Operation stats reset\n");
+    } else {
+        int json = (option != NULL && strcmp(option, "--json") == 0);
+        print_store_stats(shm_ptr, stdout, json ? STATS_FORMAT_JSON : STATS_FORMAT_TEXT);
+    }
+    
+    detach_shared_memory(shm_ptr);
+    return 0;
+}
+
+// ./mail_system --tier [days]: hạ mail đã đọc cũ hơn days ngày xuống file cold
+static int run_tier_mode(const char* days_arg) {
+    int days = (days_arg != NULL) ? atoi(days_arg) : TIER_COLD_DAYS;
+    g_shm_ptr = attach_shared_memory();
+    if (g_shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return 1;
+    }
+    init_shared_memory(g_shm_ptr);
+    if (!g_shm_ptr->tier.enabled) {
+        fprintf(stderr, "Tiered storage is off (start the store with MAILSTORE_TIER=1)\n");
+        detach_shared_memory(g_shm_ptr);
+        return 1;
+    }
+    
+    lock_store();
+    int demoted = tier_demote(g_shm_ptr, time(NULL) - (time_t)days * 24 * 3600, MAX_EMAILS);
+    if (demoted > 0) {
+        save_emails_to_file(g_shm_ptr);
+    }
+    unlock_store();
+    
+    printf("Demoted %d read emails older than %d days to %s (%d cold, %.1f KB)\n",
+           demoted < 0 ? 0 : demoted, days, TIER_COLD_FILE, tier_live_count(g_shm_ptr),
+           g_shm_ptr->tier.file_size / 1024.0);
+    detach_shared_memory(g_shm_ptr);
+    return demoted < 0 ? 1 : 0;
+}
+
+// ./mail_system --report users|emails|info|search <keyword>: báo cáo admin,
+// đọc từ replica nếu có (xem mail_replica)
+static int run_report_mode(int argc, char* argv[]) {
+    const char* what = (argc >= 3) ? argv[2] : "info";
+    g_shm_ptr = attach_shared_memory();
+    if (g_shm_ptr == NULL) {
+        fprintf(stderr, "Failed to attach to shared memory!\n");
+        return 1;
+    }
+    init_shared_memory(g_shm_ptr);
+    
+    SharedMemoryData* view = open_report_view();
+    if (view == g_shm_ptr) {
+        fprintf(stderr, "No replica feeder running, reading the live store\n");
+    }
+    
+    int status = 0;
+    if (strcmp(what, "users") == 0) {
+        display_all_users(view);
+    } else if (strcmp(what, "emails") == 0) {
+        display_all_emails(view);
+    } else if (strcmp(what, "info") == 0) {
+        display_shared_memory_info(view);
+    } else if (strcmp(what, "search") == 0 && argc >= 4) {
+        print_search_results(view, argv[3]);
+    } else {
+        fprintf(stderr, "Usage: %s --report users|emails|info|search <keyword>\n", argv[0]);
+        status = 1;
+    }
+    close_report_view(view);
+    
+    if (g_replica_ptr != NULL) {
+        detach_shared_memory(g_replica_ptr);
+    }
+    detach_shared_memory(g_shm_ptr);
+    return status;
+}
+
+int main(int argc, char* argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        return run_batch_mode(argc >= 3 ? argv[2] : NULL);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--stats") == 0) {
+        return run_stats_mode(argc >= 3 ? argv[2] : NULL);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--report") == 0) {
+        return run_report_mode(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--tier") == 0) {
+        return run_tier_mode(argc >= 3 ? argv[2] : NULL);
+    }
+    
     printf("==============================================\n");
     printf("     MAIL SYSTEM WITH SHARED MEMORY IPC\n");
     printf("==============================================\n");
     printf("Initializing system...\n");
     
-    g_shm_ptr = attach_shared_memory();
+    g_shm_ptr = open_store();
     if (g_shm_ptr == NULL) {
         printf("Failed to attach to shared memory!\n");
         return 1;
     }
     
-    init_shared_memory(g_shm_ptr);
-    
     printf("System initialized successfully!\n");
     
     if (!handle_authentication(g_shm_ptr)) {
@@ -106,12 +398,14 @@ int main() {
     int choice;
     
     do {
+        poll_background_save();
         clear_screen();
         display_menu();
         
         User* current_user = read_user(g_shm_ptr, get_current_user_id());
         if (current_user) {
-            printf("Logged in as: %s <%s>\n", current_user->name, current_user->email);
+            printf("Logged in as: %s <%s> (%d unread)\n", current_user->name, current_user->email,
+                   get_unread_email_count(g_shm_ptr, current_user->user_id));
         }
         
         choice = get_user_choice();
@@ -137,22 +431,31 @@ int main() {
                 edit_user(g_shm_ptr);
                 pause_system();
                 break;
-            case 6:
-                display_shared_memory_info(g_shm_ptr);
+            case 6: {
+                SharedMemoryData* view = open_report_view();
+                display_shared_memory_info(view);
+                close_report_view(view);
                 pause_system();
                 break;
+            }
             case 7:
+                wait_for_new_mail(g_shm_ptr);
+                pause_system();
+                break;
+            case 8:
                 printf("Logging out...\n");
                 logout_user();
-                save_users_to_file(g_shm_ptr);
-                save_emails_to_file(g_shm_ptr);
+                lock_store();
+                save_all(g_shm_ptr);
+                unlock_store();
                 break;
             default:
                 printf("Invalid choice! Please try again.\n");
                 pause_system();
         }
-    } while (choice != 7);
+    } while (choice != 8);
     
+    wait_background_saves();
     detach_shared_memory(g_shm_ptr);
     cleanup_shared_memory();
     
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// Thông báo mail mới qua futex word trong shared memory: create_email tăng
+// bộ đếm của người nhận và đánh thức các process đang chờ. Client chỉ thức
+// dậy khi mailbox thay đổi, không cần quét lại mảng emails.
+
+static int futex_wait(unsigned int* addr, unsigned int expected, const struct timespec* timeout) {
+    return syscall(SYS_futex, addr, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static void futex_wake_all(unsigned int* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static unsigned int* user_seq_word(SharedMemoryData* shm_ptr, int user_id) {
+    int slot = user_slot_of(shm_ptr, user_id);
+    return (slot < 0) ? NULL : &shm_ptr->notify.user_seq[slot];
+}
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Chờ *addr khác seen. Trả về 1 nếu đã đổi, 0 nếu hết thời gian, -1 nếu lỗi/bị ngắt.
+static int wait_word_change(unsigned int* addr, unsigned int seen, int timeout_ms) {
+    long long deadline = (timeout_ms >= 0) ? now_ms() + timeout_ms : -1;
+    
+    while (__atomic_load_n(addr, __ATOMIC_ACQUIRE) == seen) {
+        struct timespec ts;
+        struct timespec* tsp = NULL;
+        if (deadline >= 0) {
+            long long left = deadline - now_ms();
+            if (left <= 0) {
+                return 0;
+            }
+            ts.tv_sec = left / 1000;
+            ts.tv_nsec = (left % 1000) * 1000000;
+            tsp = &ts;
+        }
+        
+        if (futex_wait(addr, seen, tsp) == -1) {
+            if (errno == ETIMEDOUT) {
+                return 0;
+            }
+            if (errno == EINTR) {
+                return -1;
+            }
+            // EAGAIN: giá trị đã đổi trước khi ngủ
+        }
+    }
+    
+    return 1;
+}
+
+// Gọi bởi create_email sau khi email mới đã nằm trong mảng
+void notify_mailbox(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    unsigned int* word = user_seq_word(shm_ptr, user_id);
+    if (word != NULL) {
+        __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+        futex_wake_all(word);
+    }
+    
+    __atomic_add_fetch(&shm_ptr->notify.global_seq, 1, __ATOMIC_RELEASE);
+    futex_wake_all(&shm_ptr->notify.global_seq);
+}
+
+unsigned int get_mailbox_event_seq(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    
+    unsigned int* word = user_seq_word(shm_ptr, user_id);
+    return word ? __atomic_load_n(word, __ATOMIC_ACQUIRE) : 0;
+}
+
+unsigned int get_global_event_seq(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&shm_ptr->notify.global_seq, __ATOMIC_ACQUIRE);
+}
+
+// Block đến khi mailbox của user_id có mail mới (timeout_ms < 0: chờ mãi)
+int wait_for_mailbox_event(SharedMemoryData* shm_ptr, int user_id, unsigned int seen_seq, int timeout_ms) {
+    if (shm_ptr == NULL) {
+        return -1;
+    }
+    
+    unsigned int* word = user_seq_word(shm_ptr, user_id);
+    if (word == NULL) {
+        return -1;
+    }
+    
+    return wait_word_change(word, seen_seq, timeout_ms);
+}
+
+// Chờ nhiều mailbox cùng lúc (dùng cho dashboard): ngủ trên bộ đếm chung,
+// thức dậy thì so từng user với seen_seqs. Trả về số mailbox đã thay đổi
+// (seen_seqs được cập nhật), 0 nếu hết thời gian, -1 nếu lỗi/bị ngắt.
+int wait_for_mailbox_events(SharedMemoryData* shm_ptr, const int* user_ids, unsigned int* seen_seqs,
+                            int n, int timeout_ms) {
+    if (shm_ptr == NULL || user_ids == NULL || seen_seqs == NULL || n <= 0) {
+        return -1;
+    }
+    
+    long long deadline = (timeout_ms >= 0) ? now_ms() + timeout_ms : -1;
+    
+    while (1) {
+        unsigned int global = get_global_event_seq(shm_ptr);
+        
+        int changed = 0;
+        for (int i = 0; i < n; i++) {
+            unsigned int seq = get_mailbox_event_seq(shm_ptr, user_ids[i]);
+            if (seq != seen_seqs[i]) {
+                seen_seqs[i] = seq;
+                changed++;
+            }
+        }
+        if (changed > 0) {
+            return changed;
+        }
+        
+        int left = -1;
+        if (deadline >= 0) {
+            left = (int)(deadline - now_ms());
+            if (left <= 0) {
+                return 0;
+            }
+        }
+        
+        int rc = wait_word_change(&shm_ptr->notify.global_seq, global, left);
+        if (rc <= 0) {
+            return rc;
+        }
+    }
+}
@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <signal.h>
+
+// Replica chỉ cho báo cáo / màn hình admin. Feeder (mail_replica) đọc change
+// log của segment chính theo lô: dưới store lock chỉ copy các slot email vừa
+// đổi ra buffer, rồi áp dụng vào segment replica dưới lock riêng của replica.
+// Công cụ báo cáo quét replica dưới lock replica, không bao giờ tranh store
+// lock với traffic mail. Thứ tự khóa luôn là replica -> store.
+
+static int replica_shm_id = -1;
+static int replica_sem_id = -1;
+
+union semun {
+    int val;
+    struct semid_ds* buf;
+    unsigned short* array;
+};
+
+// Buffer của feeder (một feeder mỗi process)
+static Email g_staged[REPLICA_BATCH];
+static int g_staged_slots[REPLICA_BATCH];
+static User g_staged_users[MAX_USERS];
+
+// create = 1 cho feeder; công cụ báo cáo dùng 0 và nhận NULL nếu chưa có
+// replica. Attach đọc-ghi vì các hàm CRUD ghi stats vào segment (ở replica
+// thì đó là stats của công cụ báo cáo, không lẫn với stats của primary).
+SharedMemoryData* attach_replica(int create) {
+    key_t key = ftok(".", SHM_KEY_REPLICA);
+    if (key == -1) {
+        return NULL;
+    }
+    
+    replica_shm_id = shmget(key, sizeof(SharedMemoryData), create ? (IPC_CREAT | 0666) : 0666);
+    if (replica_shm_id == -1) {
+        return NULL;
+    }
+    
+    SharedMemoryData* shm_ptr = (SharedMemoryData*) shmat(replica_shm_id, NULL, 0);
+    if (shm_ptr == (SharedMemoryData*) -1) {
+        return NULL;
+    }
+    return shm_ptr;
+}
+
+static int open_replica_semaphore() {
+    if (replica_sem_id != -1) {
+        return replica_sem_id;
+    }
+    
+    key_t key = ftok(".", SEM_KEY_REPLICA);
+    if (key == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    replica_sem_id = semget(key, 1, IPC_CREAT | IPC_EXCL | 0666);
+    if (replica_sem_id != -1) {
+        union semun arg;
+        arg.val = 1;
+        semctl(replica_sem_id, 0, SETVAL, arg);
+        return replica_sem_id;
+    }
+    
+    if (errno != EEXIST) {
+        return MS_ERR_SYS;
+    }
+    
+    replica_sem_id = semget(key, 1, 0666);
+    return (replica_sem_id == -1) ? MS_ERR_SYS : replica_sem_id;
+}
+
+int destroy_replica() {
+    if (replica_shm_id == -1) {
+        return MS_ERR_NOT_FOUND;
+    }
+    if (shmctl(replica_shm_id, IPC_RMID, NULL) == -1) {
+        return MS_ERR_SYS;
+    }
+    replica_shm_id = -1;
+    
+    if (open_replica_semaphore() >= 0) {
+        semctl(replica_sem_id, 0, IPC_RMID);
+        replica_sem_id = -1;
+    }
+    return MS_OK;
+}
+
+int lock_replica() {
+    if (open_replica_semaphore() < 0) {
+        return MS_ERR_SYS;
+    }
+    
+    struct sembuf sb = {0, -1, SEM_UNDO};
+    while (semop(replica_sem_id, &sb, 1) == -1) {
+        if (errno != EINTR) {
+            return MS_ERR_SYS;
+        }
+    }
+    return MS_OK;
+}
+
+int unlock_replica() {
+    if (replica_sem_id == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    struct sembuf sb = {0, 1, SEM_UNDO};
+    return (semop(replica_sem_id, &sb, 1) == -1) ? MS_ERR_SYS : MS_OK;
+}
+
+// Copy trạng thái không thuộc mảng users/emails mà màn hình admin hiển thị
+static void copy_summary(SharedMemoryData* replica, const SharedMemoryData* primary) {
+    replica->control = primary->control;
+    replica->queue.count = primary->queue.count;
+    replica->queue.delivered = primary->queue.delivered;
+    replica->queue.rejected = primary->queue.rejected;
+    replica->changelog.base_modseq = primary->changelog.base_modseq;
+    replica->changelog.persisted_modseq = primary->changelog.persisted_modseq;
+}
+
+static void publish(SharedMemoryData* primary, SharedMemoryData* replica, unsigned long long applied) {
+    ReplicaState* state = &replica->replica;
+    state->is_replica = 1;
+    state->feeder_pid = getpid();
+    state->applied_modseq = applied;
+    state->updated_ns = stats_now();
+    replica->changelog.highest_modseq = applied;
+    
+    __atomic_store_n(&primary->replica.feeder_pid, state->feeder_pid, __ATOMIC_RELAXED);
+    __atomic_store_n(&primary->replica.updated_ns, state->updated_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&primary->replica.applied_modseq, applied, __ATOMIC_RELEASE);
+}
+
+// Thay đổi của email cold (slot -1): cập nhật entry trong bản copy index của
+// replica (full_resync). Email vừa hạ xuống mà replica chưa copy lại index thì
+// bản của nó vẫn nằm ở slot cũ.
+static void apply_cold_change(SharedMemoryData* replica, const Email* staged) {
+    TierState* tier = &replica->tier;
+    for (int i = 0; i < tier->count && i < TIER_INDEX_SIZE; i++) {
+        ColdEntry* entry = &tier->index[i];
+        if (entry->email_id == staged->email_id && !entry->is_deleted) {
+            entry->is_read = staged->is_read;
+            entry->is_deleted = staged->is_deleted;
+            entry->modseq = staged->modseq;
+            return;
+        }
+    }
+    for (int i = 0; i < replica->control.email_count && i < MAX_EMAILS; i++) {
+        Email* email = &replica->emails[i];
+        if (email->email_id == staged->email_id && !email->is_deleted) {
+            email->is_read = staged->is_read;
+            email->is_deleted = staged->is_deleted;
+            email->modseq = staged->modseq;
+            return;
+        }
+    }
+}
+
+// Copy lại toàn bộ: replica mới, primary vừa khởi tạo lại, feeder tụt khỏi
+// change log, primary vừa hạ mail xuống file cold hoặc vừa nạp lazy thêm
+// mailbox (cả hai không đi qua change log). Mailbox chưa nạp được nạp hết
+// trước. Giữ store lock trong một lần memcpy users + emails + index cold; công
+// cụ báo cáo chạy trong thư mục primary nên đọc subject/content của mail cold
+// từ cùng file emails.cold.
+static int full_resync(SharedMemoryData* primary, SharedMemoryData* replica) {
+    lazy_load_all(primary);
+    lock_replica();
+    lock_store();
+    memcpy(replica->users, primary->users, sizeof(primary->users));
+    memcpy(replica->emails, primary->emails, sizeof(primary->emails));
+    memcpy(&replica->tier, &primary->tier, sizeof(primary->tier));
+    copy_summary(replica, primary);
+    unsigned long long applied = get_global_modseq(primary);
+    replica->replica.users_version = primary->control.users_version;
+    replica->replica.tier_demoted = primary->tier.demoted;
+    replica->replica.lazy_generation = primary->lazy.generation;
+    unlock_store();
+    
+    replica->replica.resyncs++;
+    publish(primary, replica, applied);
+    unlock_replica();
+    return MS_OK;
+}
+
+// Một bước của feeder. Trả về số thay đổi đã áp dụng (0 = replica đã theo kịp).
+int replica_sync(SharedMemoryData* primary, SharedMemoryData* replica) {
+    if (primary == NULL || replica == NULL || primary == replica) {
+        return MS_ERR_INVALID;
+    }
+    
+    ReplicaState* state = &replica->replica;
+    if (!state->is_replica) {
+        full_resync(primary, replica);
+        return MAX_EMAILS;
+    }
+    
+    // Hạ xuống tier và nạp lazy không đi qua change log
+    if (__atomic_load_n(&primary->tier.demoted, __ATOMIC_RELAXED) != state->tier_demoted ||
+        __atomic_load_n(&primary->lazy.generation, __ATOMIC_ACQUIRE) != state->lazy_generation) {
+        full_resync(primary, replica);
+        return MAX_EMAILS;
+    }
+    
+    // Không có gì mới thì không đụng store lock
+    if (get_global_modseq(primary) == state->applied_modseq &&
+        __atomic_load_n(&primary->control.users_version, __ATOMIC_RELAXED) == state->users_version) {
+        return 0;
+    }
+    
+    EmailChange changes[REPLICA_BATCH];
+    unsigned long long next = state->applied_modseq;
+    
+    lock_store();
+    unsigned int users_version = primary->control.users_version;
+    int users_changed = (users_version != state->users_version);
+    if (users_changed) {
+        memcpy(g_staged_users, primary->users, sizeof(g_staged_users));
+    }
+    
+    int n = get_changes_since(primary, 0, state->applied_modseq, changes, REPLICA_BATCH, &next);
+    if (n < 0) {
+        unlock_store();
+        full_resync(primary, replica);
+        return MAX_EMAILS;
+    }
+    
+    // Xóa cũng copy slot: slot mang trạng thái hiện tại (is_deleted hoặc email
+    // mới tái dùng slot, bản ghi create của nó sẽ đến sau)
+    for (int i = 0; i < n; i++) {
+        g_staged_slots[i] = changes[i].slot;
+        if (changes[i].slot >= 0) {
+            g_staged[i] = primary->emails[changes[i].slot];
+        } else if (changes[i].email != NULL) {
+            g_staged[i] = *changes[i].email;
+        } else {
+            memset(&g_staged[i], 0, sizeof(Email));
+            g_staged[i].email_id = changes[i].email_id;
+            g_staged[i].is_deleted = 1;
+            g_staged[i].modseq = changes[i].modseq;
+        }
+    }
+    ControlData control = primary->control;
+    int queued = primary->queue.count;
+    int delivered = primary->queue.delivered;
+    int rejected = primary->queue.rejected;
+    unsigned long long base = primary->changelog.base_modseq;
+    unsigned long long persisted = primary->changelog.persisted_modseq;
+    unlock_store();
+    
+    lock_replica();
+    if (users_changed) {
+        memcpy(replica->users, g_staged_users, sizeof(g_staged_users));
+        state->users_version = users_version;
+    }
+    for (int i = 0; i < n; i++) {
+        if (g_staged_slots[i] >= 0) {
+            replica->emails[g_staged_slots[i]] = g_staged[i];
+        } else {
+            apply_cold_change(replica, &g_staged[i]);
+        }
+    }
+    replica->control = control;
+    replica->queue.count = queued;
+    replica->queue.delivered = delivered;
+    replica->queue.rejected = rejected;
+    replica->changelog.base_modseq = base;
+    replica->changelog.persisted_modseq = persisted;
+    state->applied += n;
+    publish(primary, replica, next);
+    unlock_replica();
+    
+    return n + users_changed;
+}
+
+// Dùng được trên cả segment chính (pid feeder công bố) lẫn segment replica
+int is_replica_running(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    
+    pid_t pid = __atomic_load_n(&shm_ptr->replica.feeder_pid, __ATOMIC_RELAXED);
+    if (pid <= 0) {
+        return 0;
+    }
+    return !(kill(pid, 0) == -1 && errno == ESRCH);
+}
+
+// Số thay đổi primary có mà replica chưa áp dụng. replica == NULL: dùng mức
+// feeder đã công bố trong segment chính.
+unsigned long long replica_lag(SharedMemoryData* primary, SharedMemoryData* replica) {
+    if (primary == NULL) {
+        return 0;
+    }
+    
+    const ReplicaState* state = (replica != NULL) ? &replica->replica : &primary->replica;
+    unsigned long long applied = __atomic_load_n(&state->applied_modseq, __ATOMIC_ACQUIRE);
+    unsigned long long highest = get_global_modseq(primary);
+    return (highest > applied) ? highest - applied : 0;
+}
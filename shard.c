@@ -0,0 +1,598 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// Sharding: store được chia thành N segment, mỗi shard có thư mục riêng
+// (<dir>/shard<i>/ chứa users.txt, emails.txt; key ftok theo thư mục đó),
+// semaphore lock riêng và được lưu riêng, nên ghi vào các shard khác nhau
+// không tranh nhau một lock. User được đặt theo hash địa chỉ email (hoặc
+// domain); id do shard i cấp là i+1, i+1+N, ... nên từ id suy ra shard.
+//
+// Email nằm ở shard của người nhận (mailbox Sent được gom từ mọi shard). Gửi
+// sang shard khác không bao giờ giữ hai lock một lúc và không chờ shard nhận:
+// nếu lock shard nhận đang bận, một bản ghi giao (SendRequest) được đặt vào
+// queue của shard người gửi và shard_deliver giao sau. Segment shard không
+// dùng semaphore hàng đợi của mail_deliveryd: queue chỉ được đụng tới dưới
+// lock của shard đó.
+
+union semun {
+    int val;
+    struct semid_ds* buf;
+    unsigned short* array;
+};
+
+static void shard_path(const ShardSet* set, int shard, const char* file, char* out, size_t size) {
+    if (file != NULL) {
+        snprintf(out, size, "%s/shard%d/%s", set->dir, shard, file);
+    } else {
+        snprintf(out, size, "%s/shard%d", set->dir, shard);
+    }
+}
+
+static unsigned int hash_text(const char* s, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)tolower((unsigned char)s[i])) * 16777619u;
+    }
+    return h;
+}
+
+int shard_for_address(const ShardSet* set, const char* email) {
+    if (set == NULL || email == NULL || set->count <= 0) {
+        return MS_ERR_INVALID;
+    }
+    const char* key = email;
+    if (set->route == SHARD_ROUTE_DOMAIN) {
+        const char* at = strrchr(email, '@');
+        if (at != NULL) {
+            key = at + 1;
+        }
+    }
+    return (int)(hash_text(key, strlen(key)) % (unsigned int)set->count);
+}
+
+int shard_for_id(const ShardSet* set, int id) {
+    if (set == NULL || id <= 0 || set->count <= 0) {
+        return MS_ERR_INVALID;
+    }
+    return SHARD_OF_ID(id, set->count);
+}
+
+static int sem_op(int sem_id, int op, int flags) {
+    struct sembuf sb = {0, op, flags};
+    while (semop(sem_id, &sb, 1) == -1) {
+        if (errno == EAGAIN) {
+            return MS_ERR_FULL;
+        }
+        if (errno != EINTR) {
+            return MS_ERR_SYS;
+        }
+    }
+    return MS_OK;
+}
+
+int shard_lock(ShardSet* set, int shard) {
+    if (set == NULL || shard < 0 || shard >= set->count) {
+        return MS_ERR_INVALID;
+    }
+    return sem_op(set->sem_ids[shard], -1, SEM_UNDO);
+}
+
+int shard_unlock(ShardSet* set, int shard) {
+    if (set == NULL || shard < 0 || shard >= set->count) {
+        return MS_ERR_INVALID;
+    }
+    return sem_op(set->sem_ids[shard], 1, SEM_UNDO);
+}
+
+// Không chờ: MS_ERR_FULL nếu shard đang bị process khác giữ
+static int shard_trylock(ShardSet* set, int shard) {
+    return sem_op(set->sem_ids[shard], -1, SEM_UNDO | IPC_NOWAIT);
+}
+
+// Số shard và cách route được ghi một lần vào manifest: id đã cấp phụ thuộc
+// vào số shard nên không được đổi sau đó
+static int read_manifest(ShardSet* set, int* count, int* route) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", set->dir, SHARD_MANIFEST);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return MS_ERR_NOT_FOUND;
+    }
+    
+    char line[128], value[32];
+    *count = 0;
+    *route = SHARD_ROUTE_HASH;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "count %d", count) == 1) {
+            continue;
+        }
+        if (sscanf(line, "route %31s", value) == 1) {
+            *route = (strcmp(value, "domain") == 0) ? SHARD_ROUTE_DOMAIN : SHARD_ROUTE_HASH;
+        }
+    }
+    fclose(file);
+    return (*count >= 1 && *count <= MAX_SHARDS) ? MS_OK : MS_ERR_CORRUPT;
+}
+
+static int write_manifest(ShardSet* set) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", set->dir, SHARD_MANIFEST);
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return MS_ERR_IO;
+    }
+    fprintf(file, "# Mail store shards - không sửa: id user/email phụ thuộc vào count\n");
+    fprintf(file, "count %d\n", set->count);
+    fprintf(file, "route %s\n", set->route == SHARD_ROUTE_DOMAIN ? "domain" : "hash");
+    return (fclose(file) == 0) ? MS_OK : MS_ERR_IO;
+}
+
+static int open_shard_sem(const char* path) {
+    key_t key = ftok(path, SEM_KEY_MAIL);
+    if (key == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    int id = semget(key, 1, IPC_CREAT | IPC_EXCL | 0666);
+    if (id != -1) {
+        union semun arg;
+        arg.val = 1;
+        semctl(id, 0, SETVAL, arg);
+        return id;
+    }
+    if (errno != EEXIST) {
+        return MS_ERR_SYS;
+    }
+    id = semget(key, 1, 0666);
+    return (id == -1) ? MS_ERR_SYS : id;
+}
+
+// Khởi tạo segment của shard lần đầu (caller giữ lock shard)
+static void init_shard_segment(ShardSet* set, int shard) {
+    SharedMemoryData* shm_ptr = set->shards[shard];
+    if (shm_ptr->control.next_user_id != 0) {
+        return;
+    }
+    
+    shm_ptr->control.shard_index = shard;
+    shm_ptr->control.shard_count = set->count;
+    shm_ptr->control.next_user_id = shard + 1;
+    shm_ptr->control.next_email_id = shard + 1;
+    shm_ptr->stats.started_at = time(NULL);
+    
+    char path[512];
+    shard_path(set, shard, USER_DB_FILE, path, sizeof(path));
+    load_users_from_path(shm_ptr, path);
+    shard_path(set, shard, EMAIL_DB_FILE, path, sizeof(path));
+    load_emails_from_path(shm_ptr, path);
+}
+
+// Mở (tạo nếu chưa có) tập shard trong dir. count/route chỉ dùng khi dir chưa
+// có manifest; count = 0 nghĩa là dùng manifest có sẵn.
+int shard_open(ShardSet* set, const char* dir, int count, int route) {
+    if (set == NULL || dir == NULL) {
+        return MS_ERR_INVALID;
+    }
+    memset(set, 0, sizeof(ShardSet));
+    snprintf(set->dir, sizeof(set->dir), "%s", dir);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        return MS_ERR_IO;
+    }
+    
+    int saved_count, saved_route;
+    int rc = read_manifest(set, &saved_count, &saved_route);
+    if (rc == MS_OK) {
+        if (count > 0 && count != saved_count) {
+            return MS_ERR_INVALID;
+        }
+        set->count = saved_count;
+        set->route = saved_route;
+    } else if (rc == MS_ERR_NOT_FOUND) {
+        if (count < 1 || count > MAX_SHARDS) {
+            return MS_ERR_INVALID;
+        }
+        set->count = count;
+        set->route = route;
+        if (write_manifest(set) != MS_OK) {
+            return MS_ERR_IO;
+        }
+    } else {
+        return rc;
+    }
+    
+    for (int i = 0; i < set->count; i++) {
+        char path[512];
+        shard_path(set, i, NULL, path, sizeof(path));
+        if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+            shard_close(set);
+            return MS_ERR_IO;
+        }
+        
+        key_t key = ftok(path, SHM_KEY_USERS);
+        set->shm_ids[i] = (key == -1) ? -1 : shmget(key, sizeof(SharedMemoryData), IPC_CREAT | 0666);
+        set->sem_ids[i] = open_shard_sem(path);
+        void* addr = (set->shm_ids[i] == -1) ? (void*)-1 : shmat(set->shm_ids[i], NULL, 0);
+        if (addr == (void*)-1 || set->sem_ids[i] < 0) {
+            shard_close(set);
+            return MS_ERR_SYS;
+        }
+        set->shards[i] = addr;
+        
+        shard_lock(set, i);
+        init_shard_segment(set, i);
+        int ok = (set->shards[i]->control.shard_index == i &&
+                  set->shards[i]->control.shard_count == set->count);
+        shard_unlock(set, i);
+        if (!ok) {
+            shard_close(set);
+            return MS_ERR_CORRUPT;
+        }
+    }
+    return MS_OK;
+}
+
+void shard_close(ShardSet* set) {
+    if (set == NULL) {
+        return;
+    }
+    for (int i = 0; i < MAX_SHARDS; i++) {
+        if (set->shards[i] != NULL) {
+            shmdt(set->shards[i]);
+            set->shards[i] = NULL;
+        }
+    }
+}
+
+// Xóa segment và semaphore của mọi shard (file trên đĩa giữ nguyên)
+int shard_destroy(ShardSet* set) {
+    if (set == NULL) {
+        return MS_ERR_INVALID;
+    }
+    int count = set->count;
+    shard_close(set);
+    int rc = MS_OK;
+    for (int i = 0; i < count; i++) {
+        if (shmctl(set->shm_ids[i], IPC_RMID, NULL) == -1 ||
+            semctl(set->sem_ids[i], 0, IPC_RMID) == -1) {
+            rc = MS_ERR_SYS;
+        }
+    }
+    return rc;
+}
+
+// ===== Users =====
+
+int shard_create_user(ShardSet* set, const char* name, const char* email, const char* password, int age) {
+    int shard = shard_for_address(set, email);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int result = create_user(set->shards[shard], name, email, password, age);
+    shard_unlock(set, shard);
+    return result;
+}
+
+static int copy_user(User* user, User* out) {
+    if (user == NULL) {
+        return MS_ERR_NOT_FOUND;
+    }
+    if (out != NULL) {
+        *out = *user;
+    }
+    return MS_OK;
+}
+
+int shard_find_user(ShardSet* set, const char* email, User* out) {
+    int shard = shard_for_address(set, email);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int rc = copy_user(find_user_by_email(set->shards[shard], email), out);
+    shard_unlock(set, shard);
+    return rc;
+}
+
+int shard_read_user(ShardSet* set, int user_id, User* out) {
+    int shard = shard_for_id(set, user_id);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int rc = copy_user(read_user(set->shards[shard], user_id), out);
+    shard_unlock(set, shard);
+    return rc;
+}
+
+int shard_verify_user(ShardSet* set, const char* email, const char* password, User* out) {
+    int shard = shard_for_address(set, email);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int rc = copy_user(verify_user_credentials(set->shards[shard], email, password), out);
+    shard_unlock(set, shard);
+    return rc;
+}
+
+// ===== Emails =====
+
+// Đặt bản ghi giao vào queue của shard người gửi (caller giữ lock shard đó)
+static int queue_delivery(SharedMemoryData* shm_ptr, int sender_id, int receiver_id,
+                          const char* subject, const char* content) {
+    DeliveryQueue* queue = &shm_ptr->queue;
+    if (queue->count >= DELIVERY_QUEUE_SIZE) {
+        return MS_ERR_FULL;
+    }
+    
+    SendRequest* request = &queue->requests[queue->in];
+    request->sender_id = sender_id;
+    request->receiver_id = receiver_id;
+    snprintf(request->subject, MAX_SUBJECT_LENGTH, "%s", subject);
+    snprintf(request->content, MAX_CONTENT_LENGTH, "%s", content);
+    request->enqueued_at = time(NULL);
+    queue->in = (queue->in + 1) % DELIVERY_QUEUE_SIZE;
+    queue->count++;
+    return MS_OK;
+}
+
+// Gửi email. Trả về email_id khi đã nằm trong mailbox người nhận, 0 nếu đã
+// thành bản ghi giao chờ shard_deliver (shard người nhận đang bận).
+int shard_send_email(ShardSet* set, int sender_id, int receiver_id, const char* subject, const char* content) {
+    int from = shard_for_id(set, sender_id);
+    int to = shard_for_id(set, receiver_id);
+    if (from < 0 || to < 0 || subject == NULL || content == NULL) {
+        return MS_ERR_INVALID;
+    }
+    
+    if (from == to) {
+        shard_lock(set, to);
+        int result = create_email(set->shards[to], sender_id, receiver_id, subject, content);
+        shard_unlock(set, to);
+        return result;
+    }
+    
+    if (shard_read_user(set, sender_id, NULL) != MS_OK) {
+        return MS_ERR_NOT_FOUND;
+    }
+    if (shard_trylock(set, to) == MS_OK) {
+        int result = create_email(set->shards[to], sender_id, receiver_id, subject, content);
+        shard_unlock(set, to);
+        if (result > 0 && set->shards[from]->queue.count > 0) {
+            shard_deliver(set, from);
+        }
+        return result;
+    }
+    
+    // Shard nhận bận: không chờ, để lại bản ghi giao
+    while (1) {
+        shard_lock(set, from);
+        int rc = queue_delivery(set->shards[from], sender_id, receiver_id, subject, content);
+        shard_unlock(set, from);
+        if (rc != MS_ERR_FULL) {
+            return rc;
+        }
+        shard_deliver(set, from);
+    }
+}
+
+// Giao các bản ghi trong queue của shard: mỗi lô lấy ra dưới lock shard nguồn,
+// rồi nhập vào từng shard nhận dưới lock của shard đó (import_emails giữ thời
+// điểm gửi). Trả về số email đã giao.
+int shard_deliver(ShardSet* set, int shard) {
+    if (set == NULL || shard < 0 || shard >= set->count) {
+        return MS_ERR_INVALID;
+    }
+    
+    SendRequest* batch = malloc(sizeof(SendRequest) * SHARD_DELIVER_BATCH);
+    EmailImport* items = malloc(sizeof(EmailImport) * SHARD_DELIVER_BATCH);
+    if (batch == NULL || items == NULL) {
+        free(batch);
+        free(items);
+        return MS_ERR_SYS;
+    }
+    
+    int total = 0;
+    while (1) {
+        SharedMemoryData* source = set->shards[shard];
+        shard_lock(set, shard);
+        int n = 0;
+        while (n < SHARD_DELIVER_BATCH && source->queue.count > 0) {
+            batch[n++] = source->queue.requests[source->queue.out];
+            source->queue.out = (source->queue.out + 1) % DELIVERY_QUEUE_SIZE;
+            source->queue.count--;
+        }
+        shard_unlock(set, shard);
+        if (n == 0) {
+            break;
+        }
+        
+        int delivered = 0;
+        for (int target = 0; target < set->count; target++) {
+            int k = 0;
+            for (int i = 0; i < n; i++) {
+                if (SHARD_OF_ID(batch[i].receiver_id, set->count) != target) {
+                    continue;
+                }
+                EmailImport* item = &items[k++];
+                memset(item, 0, sizeof(EmailImport));
+                item->sender_id = batch[i].sender_id;
+                item->receiver_id = batch[i].receiver_id;
+                item->subject = batch[i].subject;
+                item->subject_len = strlen(batch[i].subject);
+                item->content = batch[i].content;
+                item->content_len = strlen(batch[i].content);
+                item->sent_at = batch[i].enqueued_at;
+            }
+            if (k == 0) {
+                continue;
+            }
+            
+            shard_lock(set, target);
+            int rc = import_emails(set->shards[target], items, k);
+            if (rc == MS_ERR_NOT_FOUND) {
+                // Người nhận đã bị xóa: giao từng email để các email khác vẫn đi
+                rc = 0;
+                for (int i = 0; i < k; i++) {
+                    if (import_emails(set->shards[target], &items[i], 1) == 1) {
+                        rc++;
+                    }
+                }
+            }
+            shard_unlock(set, target);
+            delivered += (rc > 0) ? rc : 0;
+        }
+        
+        shard_lock(set, shard);
+        source->queue.delivered += delivered;
+        source->queue.rejected += n - delivered;
+        shard_unlock(set, shard);
+        total += delivered;
+    }
+    
+    free(batch);
+    free(items);
+    return total;
+}
+
+int shard_read_email(ShardSet* set, int email_id, Email* out) {
+    int shard = shard_for_id(set, email_id);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    Email* email = read_email(set->shards[shard], email_id);
+    if (email != NULL && out != NULL) {
+        *out = *email;
+    }
+    shard_unlock(set, shard);
+    return email ? MS_OK : MS_ERR_NOT_FOUND;
+}
+
+int shard_update_email_status(ShardSet* set, int email_id, int is_read) {
+    int shard = shard_for_id(set, email_id);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int rc = update_email_status(set->shards[shard], email_id, is_read);
+    shard_unlock(set, shard);
+    return rc;
+}
+
+int shard_delete_email(ShardSet* set, int email_id) {
+    int shard = shard_for_id(set, email_id);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int rc = delete_email(set->shards[shard], email_id);
+    shard_unlock(set, shard);
+    return rc;
+}
+
+// Inbox chỉ nằm ở shard của user (bản ghi giao chưa giao chưa được tính)
+int shard_unread_count(ShardSet* set, int user_id) {
+    int shard = shard_for_id(set, user_id);
+    if (shard < 0) {
+        return MS_ERR_INVALID;
+    }
+    shard_lock(set, shard);
+    int count = get_unread_email_count(set->shards[shard], user_id);
+    shard_unlock(set, shard);
+    return count;
+}
+
+static int compare_sent_at(const void* a, const void* b) {
+    const Email* x = a;
+    const Email* y = b;
+    if (x->sent_at != y->sent_at) {
+        return (x->sent_at > y->sent_at) - (x->sent_at < y->sent_at);
+    }
+    return (x->email_id > y->email_id) - (x->email_id < y->email_id);
+}
+
+// Copy tối đa max email của mailbox vào out, theo thời gian gửi. Received chỉ
+// đọc shard của user; Sent/Both gom từ mọi shard, mỗi shard khóa một lần.
+int shard_list_mailbox(ShardSet* set, int user_id, int type, Email* out, int max) {
+    int home = shard_for_id(set, user_id);
+    if (home < 0 || out == NULL || max < 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    int count = 0;
+    for (int shard = 0; shard < set->count && count < max; shard++) {
+        if (type == MAILBOX_RECEIVED && shard != home) {
+            continue;
+        }
+        shard_lock(set, shard);
+        EmailIterator it;
+        email_iter_init(&it, user_id, type);
+        Email* email;
+        while (count < max && (email = email_iter_next(set->shards[shard], &it)) != NULL) {
+            out[count++] = *email;
+        }
+        shard_unlock(set, shard);
+    }
+    
+    qsort(out, count, sizeof(Email), compare_sent_at);
+    return count;
+}
+
+// ===== Persistence =====
+
+// Lưu users.txt và emails.txt của một shard (chỉ giữ lock của shard đó)
+int shard_save(ShardSet* set, int shard) {
+    if (set == NULL || shard < 0 || shard >= set->count) {
+        return MS_ERR_INVALID;
+    }
+    
+    SharedMemoryData* shm_ptr = set->shards[shard];
+    char path[512], tmp_path[600];
+    int rc = MS_OK;
+    
+    shard_lock(set, shard);
+    unsigned int seq = ++shm_ptr->control.save_seq;
+    unsigned long long modseq = shm_ptr->changelog.highest_modseq;
+    
+    shard_path(set, shard, USER_DB_FILE, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, getpid());
+    if (write_users_file(shm_ptr, tmp_path) != MS_OK ||
+        install_db_file(tmp_path, path, &shm_ptr->control.users_saved_seq, seq) < 0) {
+        unlink(tmp_path);
+        rc = MS_ERR_IO;
+    }
+    
+    shard_path(set, shard, EMAIL_DB_FILE, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, getpid());
+    if (write_emails_file(shm_ptr, tmp_path) != MS_OK) {
+        unlink(tmp_path);
+        rc = MS_ERR_IO;
+    } else {
+        int installed = install_db_file(tmp_path, path, &shm_ptr->control.emails_saved_seq, seq);
+        if (installed > 0) {
+            shm_ptr->changelog.persisted_modseq = modseq;
+        } else if (installed < 0) {
+            rc = MS_ERR_IO;
+        }
+    }
+    shard_unlock(set, shard);
+    return rc;
+}
+
+int shard_save_all(ShardSet* set) {
+    if (set == NULL) {
+        return MS_ERR_INVALID;
+    }
+    int rc = MS_OK;
+    for (int i = 0; i < set->count; i++) {
+        if (shard_save(set, i) != MS_OK) {
+            rc = MS_ERR_IO;
+        }
+    }
+    return rc;
+}
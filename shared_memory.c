@@ -1,73 +1,222 @@
-#include "mail_system.h"
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <sys/mman.h>
 
 static int shm_id = -1;
+static int sem_id = -1;
+static __thread int g_lock_held = 0;   // store lock của thread này
+
+union semun {
+    int val;
+    struct semid_ds* buf;
+    unsigned short* array;
+};
+
+// Tạo/mở semaphore set dùng chung: store lock + hàng đợi gửi mail
+int open_mail_semaphores() {
+    if (sem_id != -1) {
+        return sem_id;
+    }
+    
+    key_t key = ftok(".", SEM_KEY_MAIL);
+    if (key == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    sem_id = semget(key, MAIL_SEM_COUNT, IPC_CREAT | IPC_EXCL | 0666);
+    if (sem_id != -1) {
+        // Process đầu tiên khởi tạo giá trị semaphore
+        reset_mail_semaphores();
+        return sem_id;
+    }
+    
+    if (errno != EEXIST) {
+        return MS_ERR_SYS;
+    }
+    
+    sem_id = semget(key, MAIL_SEM_COUNT, 0666);
+    return (sem_id == -1) ? MS_ERR_SYS : sem_id;
+}
+
+int reset_mail_semaphores() {
+    if (sem_id == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    unsigned short values[MAIL_SEM_COUNT];
+    values[SEM_STORE_LOCK] = 1;
+    values[SEM_QUEUE_MUTEX] = 1;
+    values[SEM_QUEUE_EMPTY] = DELIVERY_QUEUE_SIZE;
+    values[SEM_QUEUE_FULL] = 0;
+    
+    union semun arg;
+    arg.array = values;
+    return (semctl(sem_id, 0, SETALL, arg) == -1) ? MS_ERR_SYS : MS_OK;
+}
+
+// Khóa toàn bộ store trước khi thay đổi dữ liệu trong shared memory.
+// SEM_UNDO để kernel tự nhả khóa nếu process bị kill khi đang giữ khóa.
+int lock_store() {
+    if (open_mail_semaphores() < 0) {
+        return MS_ERR_SYS;
+    }
+    
+    struct sembuf sb = {SEM_STORE_LOCK, -1, SEM_UNDO};
+    while (semop(sem_id, &sb, 1) == -1) {
+        if (errno != EINTR) {
+            return MS_ERR_SYS;
+        }
+    }
+    g_lock_held = 1;
+    return MS_OK;
+}
+
+int unlock_store() {
+    if (sem_id == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    // Buffer cờ journal đã đủ cũ thì ghi khi còn giữ khóa (offset cấp từ tail)
+    journal_flush_flags(0);
+    
+    struct sembuf sb = {SEM_STORE_LOCK, 1, SEM_UNDO};
+    g_lock_held = 0;
+    if (semop(sem_id, &sb, 1) == -1) {
+        return MS_ERR_SYS;
+    }
+    
+    // Gửi các ghi journal đã xếp hàng trong lúc giữ khóa (không chờ đĩa)
+    journal_kick();
+    return MS_OK;
+}
+
+// Thread này đang giữ store lock (semaphore không đệ quy: hàm tự lấy khóa
+// như lazy_fault_in dùng để biết có được lock_store hay không)
+int store_lock_held() {
+    return g_lock_held;
+}
+
+// Kích thước huge page mặc định của kernel (Hugepagesize trong /proc/meminfo)
+size_t get_huge_page_size() {
+    size_t size = 2 * 1024 * 1024;
+    FILE* file = fopen("/proc/meminfo", "r");
+    if (file == NULL) {
+        return size;
+    }
+    
+    char line[128];
+    unsigned long kb;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+            size = (size_t)kb * 1024;
+            break;
+        }
+    }
+    fclose(file);
+    return size;
+}
+
+// MAILSTORE_HUGEPAGES=1: segment dùng huge page để các vòng quét mảng emails
+// không làm tràn TLB. Thử SHM_HUGETLB trước (cần vm.nr_hugepages đủ lớn);
+// không được thì tạo segment thường và xin THP khi attach (chỉ có tác dụng
+// khi shmem_enabled của THP là advise/always).
+static int want_huge_pages() {
+    const char* value = getenv("MAILSTORE_HUGEPAGES");
+    return value != NULL && strcmp(value, "0") != 0;
+}
 
 int create_shared_memory() {
     key_t key = ftok(".", SHM_KEY_USERS);
     if (key == -1) {
-        perror("ftok failed");
-        return -1;
+        return MS_ERR_SYS;
     }
     
-    shm_id = shmget(key, sizeof(SharedMemoryData), IPC_CREAT | 0666);
-    if (shm_id == -1) {
-        perror("shmget failed");
-        return -1;
+    if (want_huge_pages()) {
+        size_t huge = get_huge_page_size();
+        size_t size = (sizeof(SharedMemoryData) + huge - 1) / huge * huge;
+        shm_id = shmget(key, size, IPC_CREAT | SHM_HUGETLB | 0666);
+        if (shm_id != -1) {
+            return shm_id;
+        }
     }
     
-    printf("Shared memory created successfully with ID: %d\n", shm_id);
-    return shm_id;
+    shm_id = shmget(key, sizeof(SharedMemoryData), IPC_CREAT | 0666);
+    return (shm_id == -1) ? MS_ERR_SYS : shm_id;
 }
 
 SharedMemoryData* attach_shared_memory() {
     key_t key = ftok(".", SHM_KEY_USERS);
     if (key == -1) {
-        perror("ftok failed");
         return NULL;
     }
     
     shm_id = shmget(key, sizeof(SharedMemoryData), 0666);
     if (shm_id == -1) {
-        shm_id = create_shared_memory();
-        if (shm_id == -1) {
+        if (create_shared_memory() < 0) {
+            shm_id = -1;
             return NULL;
         }
     }
     
     SharedMemoryData* shm_ptr = (SharedMemoryData*) shmat(shm_id, NULL, 0);
     if (shm_ptr == (SharedMemoryData*) -1) {
-        perror("shmat failed");
         return NULL;
     }
     
+    if (want_huge_pages()) {
+        // Segment hugetlb trả về EINVAL, không sao
+        madvise(shm_ptr, sizeof(SharedMemoryData), MADV_HUGEPAGE);
+    }
     return shm_ptr;
 }
 
-void detach_shared_memory(SharedMemoryData* shm_ptr) {
-    if (shm_ptr != NULL) {
-        if (shmdt(shm_ptr) == -1) {
-            perror("shmdt failed");
-        } else {
-            printf("Successfully detached from shared memory\n");
-        }
+// Attach chỉ đọc cho công cụ giám sát: không tạo segment nếu chưa có. Không
+// được gọi các hàm CRUD trên con trỏ này (chúng ghi vào stats region).
+SharedMemoryData* attach_shared_memory_readonly() {
+    key_t key = ftok(".", SHM_KEY_USERS);
+    if (key == -1) {
+        return NULL;
+    }
+    
+    shm_id = shmget(key, sizeof(SharedMemoryData), 0);
+    if (shm_id == -1) {
+        return NULL;
     }
+    
+    SharedMemoryData* shm_ptr = (SharedMemoryData*) shmat(shm_id, NULL, SHM_RDONLY);
+    if (shm_ptr == (SharedMemoryData*) -1) {
+        return NULL;
+    }
+    
+    return shm_ptr;
 }
 
-void destroy_shared_memory() {
-    if (shm_id != -1) {
-        if (shmctl(shm_id, IPC_RMID, NULL) == -1) {
-            perror("shmctl IPC_RMID failed");
-        } else {
-            printf("Shared memory destroyed successfully\n");
-            shm_id = -1;
-        }
+int detach_shared_memory(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return MS_ERR_INVALID;
+    }
+    // Cờ journal còn gom trong process trỏ vào segment, ghi trước khi gỡ
+    journal_flush_flags(1);
+    return (shmdt(shm_ptr) == -1) ? MS_ERR_SYS : MS_OK;
+}
+
+int destroy_shared_memory() {
+    if (shm_id == -1) {
+        return MS_ERR_NOT_FOUND;
+    }
+    if (shmctl(shm_id, IPC_RMID, NULL) == -1) {
+        return MS_ERR_SYS;
     }
+    shm_id = -1;
+    return MS_OK;
 }
 
-void init_shared_memory(SharedMemoryData* shm_ptr) {
+// Khởi tạo segment mới và nạp dữ liệu từ file. Trả về 1 nếu vừa khởi tạo,
+// 0 nếu segment đã được process khác khởi tạo trước đó.
+int init_shared_memory(SharedMemoryData* shm_ptr) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory pointer is NULL\n");
-        return;
+        return MS_ERR_INVALID;
     }
     
     if (shm_ptr->control.next_user_id == 0) {
@@ -75,99 +224,96 @@ void init_shared_memory(SharedMemoryData* shm_ptr) {
         shm_ptr->control.email_count = 0;
         shm_ptr->control.next_user_id = 1;
         shm_ptr->control.next_email_id = 1;
+        shm_ptr->control.deliveryd_pid = 0;
         
         memset(shm_ptr->users, 0, sizeof(shm_ptr->users));
         memset(shm_ptr->emails, 0, sizeof(shm_ptr->emails));
+        memset(&shm_ptr->queue, 0, sizeof(shm_ptr->queue));
+        memset(&shm_ptr->stats, 0, sizeof(shm_ptr->stats));
+        shm_ptr->stats.started_at = time(NULL);
+        memset(&shm_ptr->trace, 0, sizeof(shm_ptr->trace));
+        memset(&shm_ptr->journal, 0, sizeof(shm_ptr->journal));
+        shm_ptr->journal.enabled = (getenv("MAILSTORE_JOURNAL") != NULL);
+        memset(&shm_ptr->tier, 0, sizeof(shm_ptr->tier));
+        shm_ptr->tier.enabled = (getenv("MAILSTORE_TIER") != NULL);
         
-        printf("Shared memory initialized successfully\n");
+        // Segment mới => hàng đợi rỗng, semaphore phải khớp lại
+        if (open_mail_semaphores() >= 0) {
+            reset_mail_semaphores();
+        }
+        
+        memset(&shm_ptr->lazy, 0, sizeof(shm_ptr->lazy));
         
         load_users_from_file(shm_ptr);
-        load_emails_from_file(shm_ptr);
+        // Lazy: chỉ đọc manifest, mail được nạp theo mailbox (lazy.c). Journal
+        // cần store đầy đủ để áp record, tier_load cần biết email nào đã có
+        // trong segment (bản trùng trong file cold bị bỏ), nên khi bật một
+        // trong hai vẫn nạp hết.
+        const char* lazy = getenv("MAILSTORE_LAZY");
+        if (lazy == NULL || shm_ptr->journal.enabled || shm_ptr->tier.enabled ||
+            lazy_open(shm_ptr, strcmp(lazy, "prefetch") == 0) < 0) {
+            load_emails_from_file(shm_ptr);
+        }
+        journal_recover(shm_ptr);
+        tier_load(shm_ptr);
+        return 1;
     }
+    return 0;
 }
 
-void display_shared_memory_info(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Shared memory not available\n");
-        return;
-    }
-    
-    printf("\n╔════════════════════════════════════════════════════════╗\n");
-    printf("║         SHARED MEMORY - REAL-TIME DATA VIEW           ║\n");
-    printf("╚════════════════════════════════════════════════════════╝\n");
-    
-    // Control Information
-    printf("\n📊 CONTROL INFORMATION:\n");
-    printf("├─ Shared Memory ID: %d\n", shm_id);
-    printf("├─ Memory Size: %.2f MB (%lu bytes)\n", 
-           sizeof(SharedMemoryData) / (1024.0 * 1024.0),
-           sizeof(SharedMemoryData));
-    printf("├─ Total Users: %d / %d\n", shm_ptr->control.user_count, MAX_USERS);
-    printf("├─ Total Emails: %d / %d\n", shm_ptr->control.email_count, MAX_EMAILS);
-    printf("├─ Next User ID: %d\n", shm_ptr->control.next_user_id);
-    printf("└─ Next Email ID: %d\n", shm_ptr->control.next_email_id);
-    
-    // Users in Memory
-    printf("\n👥 USERS IN SHARED MEMORY:\n");
-    if (shm_ptr->control.user_count == 0) {
-        printf("   (No users in memory)\n");
-    } else {
-        printf("┌─────┬──────────────────────┬────────────────────────────┬─────┬────────┐\n");
-        printf("│ ID  │ Name                 │ Email                      │ Age │ Status │\n");
-        printf("├─────┼──────────────────────┼────────────────────────────┼─────┼────────┤\n");
-        for (int i = 0; i < MAX_USERS && shm_ptr->control.user_count > 0; i++) {
-            if (shm_ptr->users[i].is_active) {
-                printf("│ %-3d │ %-20.20s │ %-26.26s │ %-3d │ %-6s │\n",
-                       shm_ptr->users[i].user_id,
-                       shm_ptr->users[i].name,
-                       shm_ptr->users[i].email,
-                       shm_ptr->users[i].age,
-                       shm_ptr->users[i].is_active ? "Active" : "Inact");
+// Tìm mapping chứa addr trong /proc/self/smaps và cho biết trang nó đang dùng
+int get_page_info(const void* addr, PageInfo* info) {
+    if (addr == NULL || info == NULL) {
+        return MS_ERR_INVALID;
+    }
+    memset(info, 0, sizeof(PageInfo));
+    
+    FILE* file = fopen("/proc/self/smaps", "r");
+    if (file == NULL) {
+        return MS_ERR_SYS;
+    }
+    
+    char line[512];
+    int found = 0;
+    unsigned long kb;
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            if (found) {
+                break;   // hết phần của mapping cần tìm
             }
-        }
-        printf("└─────┴──────────────────────┴────────────────────────────┴─────┴────────┘\n");
-    }
-    
-    // Emails in Memory
-    printf("\n📧 EMAILS IN SHARED MEMORY:\n");
-    if (shm_ptr->control.email_count == 0) {
-        printf("   (No emails in memory)\n");
-    } else {
-        printf("┌─────┬──────┬──────┬─────────────────────────────┬────────┬─────────┐\n");
-        printf("│ ID  │ From │ To   │ Subject                     │ Status │ Deleted │\n");
-        printf("├─────┼──────┼──────┼─────────────────────────────┼────────┼─────────┤\n");
-        int count = 0;
-        for (int i = 0; i < MAX_EMAILS && count < shm_ptr->control.email_count; i++) {
-            if (shm_ptr->emails[i].email_id > 0) {
-                printf("│ %-3d │ %-4d │ %-4d │ %-27.27s │ %-6s │ %-7s │\n",
-                       shm_ptr->emails[i].email_id,
-                       shm_ptr->emails[i].sender_id,
-                       shm_ptr->emails[i].receiver_id,
-                       shm_ptr->emails[i].subject,
-                       shm_ptr->emails[i].is_read ? "Read" : "Unread",
-                       shm_ptr->emails[i].is_deleted ? "Yes" : "No");
-                count++;
+            if ((unsigned long)addr >= start && (unsigned long)addr < end) {
+                found = 1;
+                info->mapped_bytes = end - start;
             }
+            continue;
+        }
+        if (!found) {
+            continue;
+        }
+        if (sscanf(line, "KernelPageSize: %lu kB", &kb) == 1) {
+            info->page_size = (size_t)kb * 1024;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                   sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+                   sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1) {
+            info->huge_bytes += (size_t)kb * 1024;
         }
-        printf("└─────┴──────┴──────┴─────────────────────────────┴────────┴─────────┘\n");
     }
+    fclose(file);
     
-    // Memory Usage
-    printf("\n💾 MEMORY USAGE:\n");
-    size_t used_user_memory = shm_ptr->control.user_count * sizeof(User);
-    size_t used_email_memory = shm_ptr->control.email_count * sizeof(Email);
-    size_t total_used = sizeof(ControlData) + used_user_memory + used_email_memory;
-    size_t total_allocated = sizeof(SharedMemoryData);
-    
-    printf("├─ Control Data: %lu bytes\n", sizeof(ControlData));
-    printf("├─ Users: %lu bytes (%d active)\n", used_user_memory, shm_ptr->control.user_count);
-    printf("├─ Emails: %lu bytes (%d active)\n", used_email_memory, shm_ptr->control.email_count);
-    printf("├─ Total Used: %.2f KB / %.2f MB\n", 
-           total_used / 1024.0, 
-           total_allocated / (1024.0 * 1024.0));
-    printf("└─ Usage: %.1f%%\n", (total_used * 100.0) / total_allocated);
-    
-    printf("\n════════════════════════════════════════════════════════\n");
+    if (!found) {
+        return MS_ERR_NOT_FOUND;
+    }
+    if (info->page_size > (size_t)sysconf(_SC_PAGESIZE)) {
+        info->hugetlb = 1;
+        info->huge_bytes = info->mapped_bytes;
+    }
+    return MS_OK;
+}
+
+// ID của segment đã attach (-1 nếu chưa), dùng cho màn hình debug
+int get_shared_memory_id() {
+    return shm_id;
 }
 
 int check_shared_memory_status() {
@@ -179,19 +325,3 @@ int check_shared_memory_status() {
     int temp_shm_id = shmget(key, sizeof(SharedMemoryData), 0666);
     return (temp_shm_id != -1) ? 1 : 0;
 }
-
-void cleanup_shared_memory() {
-    if (shm_id != -1) {
-        printf("Cleaning up shared memory...\n");
-        
-        SharedMemoryData* shm_ptr = attach_shared_memory();
-        if (shm_ptr != NULL) {
-            save_users_to_file(shm_ptr);
-            save_emails_to_file(shm_ptr);
-            detach_shared_memory(shm_ptr);
-        }
-        
-        // Không destroy shared memory ở đây để các process khác có thể sử dụng
-        // destroy_shared_memory();
-    }
-}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+
+// Thống kê hot path: mỗi process nhận một shard riêng trong stats region
+// (owner_pid), nên bình thường không có hai process cùng ghi một cache line.
+// Khi hết shard thì dùng chung theo pid % STATS_SHARDS; mọi cộng dồn đều là
+// atomic relaxed nên vẫn đúng, chỉ chậm hơn. Không cần store lock.
+// Thời gian là inclusive: create_email gọi read_user nên cả hai đều được đếm.
+
+static const char* g_op_names[STAT_OP_COUNT] = {
+    "user_create", "user_read", "user_find", "user_verify", "user_update", "user_delete",
+    "email_create", "email_read", "email_update", "email_delete", "email_unread",
+    "email_mark_all", "email_delete_read", "email_search",
+    "save_users", "save_emails", "load_users", "load_emails", "email_import"
+};
+
+static int g_shard = -1;
+static pthread_once_t g_atfork_once = PTHREAD_ONCE_INIT;
+
+// Process con (fork) phải tự nhận shard mới
+static void forget_shard() {
+    g_shard = -1;
+}
+
+static void register_atfork() {
+    pthread_atfork(NULL, NULL, forget_shard);
+}
+
+static int process_alive(pid_t pid) {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Nhận shard trống, hoặc shard của process đã chết (giữ nguyên số liệu cũ)
+static int claim_shard(StatsRegion* stats) {
+    pthread_once(&g_atfork_once, register_atfork);
+    
+    pid_t pid = getpid();
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        pid_t owner = __atomic_load_n(&stats->shards[i].owner_pid, __ATOMIC_RELAXED);
+        if (owner == pid) {
+            return i;
+        }
+        if ((owner == 0 || !process_alive(owner)) &&
+            __sync_bool_compare_and_swap(&stats->shards[i].owner_pid, owner, pid)) {
+            return i;
+        }
+    }
+    return pid % STATS_SHARDS;
+}
+
+static int latency_bucket(unsigned long long ns) {
+    int bucket = (ns == 0) ? 0 : 64 - __builtin_clzll(ns);
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+long long stats_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Shard (và trace ring) của process này, nhận ở lần dùng đầu tiên
+int stats_shard_index(SharedMemoryData* shm_ptr) {
+    if (g_shard < 0) {
+        g_shard = claim_shard(&shm_ptr->stats);
+    }
+    return g_shard;
+}
+
+// Ghi một lần gọi thao tác op bắt đầu lúc start_ns (lấy từ stats_now())
+void stats_record(SharedMemoryData* shm_ptr, int op, long long start_ns, int ok) {
+    if (shm_ptr == NULL || op < 0 || op >= STAT_OP_COUNT) {
+        return;
+    }
+    
+    int shard = stats_shard_index(shm_ptr);
+    long long elapsed = stats_now() - start_ns;
+    unsigned long long ns = elapsed > 0 ? (unsigned long long)elapsed : 0;
+    OpStats* s = &shm_ptr->stats.shards[shard].ops[op];
+    
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->hist[latency_bucket(ns)], 1, __ATOMIC_RELAXED);
+    if (!ok) {
+        __atomic_fetch_add(&s->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Cộng tất cả shard vào out[STAT_OP_COUNT]
+void stats_merge(const SharedMemoryData* shm_ptr, OpStats* out) {
+    memset(out, 0, sizeof(OpStats) * STAT_OP_COUNT);
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        for (int op = 0; op < STAT_OP_COUNT; op++) {
+            const OpStats* s = &shm_ptr->stats.shards[i].ops[op];
+            out[op].count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+            out[op].failed += __atomic_load_n(&s->failed, __ATOMIC_RELAXED);
+            out[op].total_ns += __atomic_load_n(&s->total_ns, __ATOMIC_RELAXED);
+            for (int b = 0; b < STATS_BUCKETS; b++) {
+                out[op].hist[b] += __atomic_load_n(&s->hist[b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+// Xóa số liệu (giữ owner_pid để các process đang chạy vẫn dùng shard cũ)
+void stats_reset(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        memset(shm_ptr->stats.shards[i].ops, 0, sizeof(shm_ptr->stats.shards[i].ops));
+    }
+    shm_ptr->stats.started_at = time(NULL);
+}
+
+const char* stats_op_name(int op) {
+    return (op >= 0 && op < STAT_OP_COUNT) ? g_op_names[op] : "unknown";
+}
+
+// Cận trên (ns) của bucket chứa phân vị q (0..1)
+unsigned long long stats_percentile(const OpStats* op, double q) {
+    if (op == NULL || op->count == 0) {
+        return 0;
+    }
+    
+    unsigned long long rank = (unsigned long long)(q * (op->count - 1)) + 1;
+    unsigned long long seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += op->hist[b];
+        if (seen >= rank) {
+            return 1ULL << b;
+        }
+    }
+    return 1ULL << (STATS_BUCKETS - 1);
+}
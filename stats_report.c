@@ -0,0 +1,115 @@
+#include "mail_system.h"
+
+// In số liệu của stats region (xem stats.c): bảng text cho người đọc, JSON
+// (kèm histogram) cho script, hoặc dòng ROW| cho batch mode / mail_server.
+
+static int active_shards(SharedMemoryData* shm_ptr) {
+    int count = 0;
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        if (shm_ptr->stats.shards[i].owner_pid != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void print_stats_text(SharedMemoryData* shm_ptr, const OpStats* ops, FILE* out) {
+    char since[32];
+    time_t started_at = shm_ptr->stats.started_at;
+    strftime(since, sizeof(since), "%Y-%m-%d %H:%M:%S", localtime(&started_at));
+    
+    fprintf(out, "Operation stats since %s (%d process shards)\n", since, active_shards(shm_ptr));
+    fprintf(out, "%-18s %10s %8s %10s %10s %10s %12s\n",
+            "operation", "count", "failed", "avg ns", "p50 ns", "p99 ns", "max ns");
+    fprintf(out, "----------------------------------------------------------------------------------\n");
+    
+    int printed = 0;
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        if (ops[op].count == 0) {
+            continue;
+        }
+        fprintf(out, "%-18s %10llu %8llu %10llu %10llu %10llu %12llu\n",
+                stats_op_name(op), ops[op].count, ops[op].failed,
+                ops[op].total_ns / ops[op].count,
+                stats_percentile(&ops[op], 0.50),
+                stats_percentile(&ops[op], 0.99),
+                stats_percentile(&ops[op], 1.0));
+        printed++;
+    }
+    if (printed == 0) {
+        fprintf(out, "   (No operations recorded)\n");
+    }
+    fprintf(out, "Latencies are log2 bucket upper bounds.\n");
+    
+    const StandbyState* standby = &shm_ptr->standby;
+    if (standby->shipper_pid > 0) {
+        unsigned long long highest = get_global_modseq(shm_ptr);
+        fprintf(out, "Standby: %s, acked modseq %llu of %llu (%llu changes, %.1f ms behind), %.1f KB shipped\n",
+                standby->connected ? "connected" : "disconnected", standby->acked_modseq, highest,
+                highest > standby->acked_modseq ? highest - standby->acked_modseq : 0,
+                standby->lag_ns / 1e6, standby->bytes / 1024.0);
+    }
+    if (shm_ptr->lazy.enabled) {
+        fprintf(out, "Lazy loading: %d mailboxes pending, %llu faulted in, %llu emails loaded in %.1f ms\n",
+                shm_ptr->lazy.pending, shm_ptr->lazy.faults, shm_ptr->lazy.loaded,
+                shm_ptr->lazy.load_ns / 1e6);
+    }
+    if (shm_ptr->tier.enabled) {
+        fprintf(out, "Cold tier: %d emails in %s (%.1f KB), %llu demoted, %llu paged in\n",
+                tier_live_count(shm_ptr), TIER_COLD_FILE, shm_ptr->tier.file_size / 1024.0,
+                shm_ptr->tier.demoted, shm_ptr->tier.paged_in);
+    }
+}
+
+static void print_stats_json(SharedMemoryData* shm_ptr, const OpStats* ops, FILE* out) {
+    fprintf(out, "{\n  \"started_at\": %ld,\n  \"shards\": %d,\n  \"ops\": [\n",
+            (long)shm_ptr->stats.started_at, active_shards(shm_ptr));
+    
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        fprintf(out, "    {\"name\": \"%s\", \"count\": %llu, \"failed\": %llu, \"total_ns\": %llu, "
+                     "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, \"hist\": [",
+                stats_op_name(op), ops[op].count, ops[op].failed, ops[op].total_ns,
+                stats_percentile(&ops[op], 0.50),
+                stats_percentile(&ops[op], 0.90),
+                stats_percentile(&ops[op], 0.99),
+                stats_percentile(&ops[op], 1.0));
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            fprintf(out, "%s%llu", b ? ", " : "", ops[op].hist[b]);
+        }
+        fprintf(out, "]}%s\n", op + 1 < STAT_OP_COUNT ? "," : "");
+    }
+    const StandbyState* standby = &shm_ptr->standby;
+    fprintf(out, "  ],\n  \"standby\": {\"running\": %d, \"connected\": %d, \"shipped_modseq\": %llu, "
+                 "\"acked_modseq\": %llu, \"lag_ns\": %lld, \"bytes\": %llu, \"snapshots\": %u}\n}\n",
+            standby->shipper_pid > 0, standby->connected, standby->shipped_modseq,
+            standby->acked_modseq, standby->lag_ns, standby->bytes, standby->snapshots);
+}
+
+// format: STATS_FORMAT_TEXT / STATS_FORMAT_JSON / STATS_FORMAT_ROWS
+void print_store_stats(SharedMemoryData* shm_ptr, FILE* out, int format) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    OpStats ops[STAT_OP_COUNT];
+    stats_merge(shm_ptr, ops);
+    
+    if (format == STATS_FORMAT_JSON) {
+        print_stats_json(shm_ptr, ops, out);
+        return;
+    }
+    if (format == STATS_FORMAT_TEXT) {
+        print_stats_text(shm_ptr, ops, out);
+        return;
+    }
+    
+    // ROW|name|count|failed|avg_ns|p50_ns|p99_ns|max_ns
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        fprintf(out, "ROW|%s|%llu|%llu|%llu|%llu|%llu|%llu\n",
+                stats_op_name(op), ops[op].count, ops[op].failed,
+                ops[op].count ? ops[op].total_ns / ops[op].count : 0,
+                stats_percentile(&ops[op], 0.50),
+                stats_percentile(&ops[op], 0.99),
+                stats_percentile(&ops[op], 1.0));
+    }
+}
@@ -0,0 +1,567 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Tiered storage: mail mới hoặc chưa đọc nằm trong mảng emails của segment,
+// mail đã đọc cũ được hạ xuống emails.cold. File cold chỉ ghi thêm, mỗi email
+// là một record CHANGE_CREATE của journal (có checksum); đổi cờ / xóa sau đó
+// là record CHANGE_FLAGS / CHANGE_DELETE ghi nối tiếp. Segment chỉ giữ index
+// (ColdEntry ~40 byte thay vì một slot Email ~2.3 KB), nên dung lượng lịch sử
+// bị giới hạn bởi đĩa và TIER_INDEX_SIZE thay vì MAX_EMAILS.
+//
+// Mỗi process đọc file qua mmap (map lại khi file lớn hơn phần đã map); email
+// cold được dựng lại trong buffer riêng của process, read_email và iterator
+// trả về con trỏ tới buffer đó (hợp lệ tới lần đọc cold tiếp theo). Offset ghi
+// được cấp từ tier.file_size dưới store lock, như journal.tail.
+//
+// Việc hạ xuống không đi qua change log: với journal đó không phải thay đổi
+// của email. Replica copy lại segment (kèm index) khi tier.demoted đổi; snapshot
+// của standby gửi cả mail cold (tier_materialize). Đổi cờ / xóa email cold thì
+// đi qua change log: sau khi ghi vào file cold, thay đổi được đóng dấu qua
+// record_email_change (slot -1) nên delta sync, replica, standby và journal
+// đều thấy. Lúc khởi tạo, email có trong cả emails.txt lẫn file cold (crash
+// trước lần lưu kế tiếp) được giữ bản trong segment; journal_recover đã áp
+// các thay đổi cold lên bản đó.
+
+static int g_fd = -1;
+static const char* g_map = NULL;
+static size_t g_map_size = 0;
+static Email g_read_view;       // kết quả tier_read
+static Email g_iter_view;       // kết quả tier_iter_next
+
+typedef struct {
+    time_t sent_at;
+    int slot;
+} DemoteCandidate;
+
+static DemoteCandidate g_candidates[MAX_EMAILS];
+
+static int open_cold_file() {
+    if (g_fd != -1) {
+        return MS_OK;
+    }
+    g_fd = open(TIER_COLD_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    return (g_fd == -1) ? MS_ERR_IO : MS_OK;
+}
+
+// Bảo đảm mapping phủ [0, end); trả về NULL nếu file ngắn hơn end
+static const char* map_cold(unsigned long long end) {
+    if (g_map != NULL && end <= g_map_size) {
+        return g_map;
+    }
+    if (open_cold_file() != MS_OK) {
+        return NULL;
+    }
+    
+    struct stat st;
+    if (fstat(g_fd, &st) == -1 || (unsigned long long)st.st_size < end || st.st_size == 0) {
+        return NULL;
+    }
+    if (g_map != NULL) {
+        munmap((void*)g_map, g_map_size);
+        g_map = NULL;
+    }
+    
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, g_fd, 0);
+    if (map == MAP_FAILED) {
+        g_map_size = 0;
+        return NULL;
+    }
+    g_map = map;
+    g_map_size = (size_t)st.st_size;
+    return g_map;
+}
+
+static ColdEntry* find_cold(SharedMemoryData* shm_ptr, int email_id) {
+    TierState* tier = &shm_ptr->tier;
+    for (int i = 0; i < tier->count; i++) {
+        if (tier->index[i].email_id == email_id && !tier->index[i].is_deleted) {
+            return &tier->index[i];
+        }
+    }
+    return NULL;
+}
+
+static int find_hot(SharedMemoryData* shm_ptr, int email_id) {
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        if (shm_ptr->emails[i].email_id == email_id && !shm_ptr->emails[i].is_deleted) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Entry trống tiếp theo từ *cursor (entry đã xóa được dùng lại)
+static ColdEntry* next_free_entry(SharedMemoryData* shm_ptr, int* cursor) {
+    TierState* tier = &shm_ptr->tier;
+    for (; *cursor < TIER_INDEX_SIZE; (*cursor)++) {
+        ColdEntry* entry = &tier->index[*cursor];
+        if (*cursor >= tier->count || entry->email_id == 0 || entry->is_deleted) {
+            (*cursor)++;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Dựng lại email từ record CHANGE_CREATE trong file
+static int materialize(const ColdEntry* entry, Email* out) {
+    const char* map = map_cold(entry->offset + entry->length);
+    if (map == NULL) {
+        return MS_ERR_IO;
+    }
+    
+    const JournalRecord* rec = (const JournalRecord*)(map + entry->offset);
+    if (journal_check_record(rec, entry->length, 0) != MS_OK || rec->email_id != entry->email_id) {
+        return MS_ERR_CORRUPT;
+    }
+    
+    const char* text = (const char*)(rec + 1);
+    size_t subject_len = rec->subject_len < MAX_SUBJECT_LENGTH ? rec->subject_len : MAX_SUBJECT_LENGTH - 1;
+    size_t content_len = rec->content_len < MAX_CONTENT_LENGTH ? rec->content_len : MAX_CONTENT_LENGTH - 1;
+    out->email_id = entry->email_id;
+    out->sender_id = entry->sender_id;
+    out->receiver_id = entry->receiver_id;
+    memcpy(out->subject, text, subject_len);
+    out->subject[subject_len] = '\0';
+    memcpy(out->content, text + rec->subject_len, content_len);
+    out->content[content_len] = '\0';
+    out->sent_at = (time_t)entry->sent_at;
+    out->is_read = entry->is_read;
+    out->is_deleted = 0;
+    out->modseq = entry->modseq;
+    return MS_OK;
+}
+
+// Ghi thêm len byte vào cuối file cold (caller giữ store lock), sync = 1 thì
+// fdatasync trước khi coi là đã ghi
+static int append_cold(SharedMemoryData* shm_ptr, const void* buf, size_t len, int sync) {
+    if (open_cold_file() != MS_OK) {
+        return MS_ERR_IO;
+    }
+    
+    TierState* tier = &shm_ptr->tier;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(g_fd, (const char*)buf + done, len - done, (off_t)(tier->file_size + done));
+        if (n <= 0) {
+            return MS_ERR_IO;
+        }
+        done += (size_t)n;
+    }
+    if (sync && fdatasync(g_fd) == -1) {
+        return MS_ERR_IO;
+    }
+    tier->file_size += len;
+    return MS_OK;
+}
+
+// Email tạm (không subject/content) mang cờ hiện tại của entry
+static void cold_email(const ColdEntry* entry, Email* email) {
+    memset(email, 0, sizeof(*email));
+    email->email_id = entry->email_id;
+    email->sender_id = entry->sender_id;
+    email->receiver_id = entry->receiver_id;
+    email->sent_at = (time_t)entry->sent_at;
+    email->is_read = entry->is_read;
+    email->is_deleted = entry->is_deleted;
+    email->modseq = entry->modseq;
+}
+
+// Đóng dấu thay đổi đã ghi vào file cold trong change log (và journal)
+static void stamp_change(SharedMemoryData* shm_ptr, ColdEntry* entry, int op) {
+    Email email;
+    cold_email(entry, &email);
+    entry->modseq = record_email_change(shm_ptr, &email, op);
+    touch_mailbox(shm_ptr, entry->sender_id, entry->receiver_id);
+}
+
+// Record đổi cờ cho một email cold, ghi vào buf (đủ sizeof(JournalRecord))
+static size_t put_flag_record(char* buf, const ColdEntry* entry, int op, int is_read) {
+    Email email;
+    cold_email(entry, &email);
+    email.is_read = is_read;
+    
+    JournalRecord* rec = journal_build_record(&email, op);
+    if (rec == NULL) {
+        return 0;
+    }
+    size_t length = rec->length;
+    memcpy(buf, rec, length);
+    free(rec);
+    return length;
+}
+
+// Dựng index từ file cold (caller là process khởi tạo segment, sau khi nạp
+// emails.txt). Dừng ở record hỏng đầu tiên và cắt file ở đó. Trả về số email
+// cold còn hiệu lực.
+int tier_load(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled) {
+        return 0;
+    }
+    if (open_cold_file() != MS_OK) {
+        return MS_ERR_IO;
+    }
+    
+    TierState* tier = &shm_ptr->tier;
+    tier->count = 0;
+    tier->file_size = 0;
+    
+    struct stat st;
+    if (fstat(g_fd, &st) == -1) {
+        return MS_ERR_IO;
+    }
+    unsigned long long size = (unsigned long long)st.st_size;
+    const char* map = (size > 0) ? map_cold(size) : NULL;
+    if (size > 0 && map == NULL) {
+        return MS_ERR_IO;
+    }
+    
+    unsigned long long offset = 0;
+    while (offset + sizeof(JournalRecord) <= size) {
+        const JournalRecord* rec = (const JournalRecord*)(map + offset);
+        if (journal_check_record(rec, size - offset, 1) != MS_OK) {
+            break;
+        }
+        
+        ColdEntry* entry = find_cold(shm_ptr, rec->email_id);
+        if (rec->op == CHANGE_CREATE && entry == NULL && tier->count < TIER_INDEX_SIZE) {
+            entry = &tier->index[tier->count++];
+            entry->email_id = rec->email_id;
+            entry->sender_id = rec->sender_id;
+            entry->receiver_id = rec->receiver_id;
+            entry->is_read = rec->is_read;
+            entry->is_deleted = 0;
+            entry->length = rec->length;
+            entry->sent_at = rec->sent_at;
+            entry->offset = offset;
+            entry->modseq = rec->modseq;
+            while (shm_ptr->control.next_email_id <= rec->email_id) {
+                shm_ptr->control.next_email_id += ID_STRIDE(shm_ptr);
+            }
+        } else if (rec->op == CHANGE_FLAGS && entry != NULL) {
+            entry->is_read = rec->is_read;
+            entry->modseq = rec->modseq;
+        } else if (rec->op == CHANGE_DELETE && entry != NULL) {
+            entry->is_deleted = 1;
+        }
+        offset += rec->length;
+    }
+    
+    if (offset < size && ftruncate(g_fd, (off_t)offset) == -1) {
+        return MS_ERR_IO;
+    }
+    tier->file_size = offset;
+    
+    int live = 0;
+    for (int i = 0; i < tier->count; i++) {
+        ColdEntry* entry = &tier->index[i];
+        if (!entry->is_deleted && find_hot(shm_ptr, entry->email_id)) {
+            entry->is_deleted = 1;
+        }
+        if (!entry->is_deleted) {
+            live++;
+        }
+    }
+    return live;
+}
+
+static int compare_candidates(const void* a, const void* b) {
+    const DemoteCandidate* x = a;
+    const DemoteCandidate* y = b;
+    return (x->sent_at > y->sent_at) - (x->sent_at < y->sent_at);
+}
+
+// Hạ tối đa max email đã đọc (cũ nhất trước) có sent_at < older_than xuống
+// file cold; older_than = 0: không xét tuổi (store đầy). Slot được giải phóng
+// cho create_email. Trả về số email đã hạ.
+int tier_demote(SharedMemoryData* shm_ptr, time_t older_than, int max) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled || max <= 0) {
+        return 0;
+    }
+    
+    int n = 0;
+    for (int i = 0; i < shm_ptr->control.email_count && i < MAX_EMAILS; i++) {
+        Email* email = &shm_ptr->emails[i];
+        if (email->email_id != 0 && !email->is_deleted && email->is_read &&
+            (older_than == 0 || email->sent_at < older_than)) {
+            g_candidates[n].sent_at = email->sent_at;
+            g_candidates[n].slot = i;
+            n++;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+    qsort(g_candidates, n, sizeof(DemoteCandidate), compare_candidates);
+    if (n > max) {
+        n = max;
+    }
+    
+    // Gom các record thành một lần ghi. Không fdatasync: bản hot còn trong
+    // emails.txt tới lần lưu sau, lần lưu đó gọi tier_sync trước (create_email
+    // hạ xuống khi store đầy, trong store lock)
+    JournalRecord* recs[TIER_DEMOTE_BATCH];
+    ColdEntry* entries[TIER_DEMOTE_BATCH];
+    int done = 0;
+    int cursor = 0;
+    int status = MS_OK;
+    while (done < n && status == MS_OK) {
+        int batch = 0;
+        size_t total = 0;
+        while (done + batch < n && batch < TIER_DEMOTE_BATCH) {
+            entries[batch] = next_free_entry(shm_ptr, &cursor);
+            if (entries[batch] == NULL) {
+                break;
+            }
+            recs[batch] = journal_build_record(&shm_ptr->emails[g_candidates[done + batch].slot], CHANGE_CREATE);
+            if (recs[batch] == NULL) {
+                break;
+            }
+            total += recs[batch]->length;
+            batch++;
+        }
+        if (batch == 0) {
+            break;
+        }
+        
+        char* buf = malloc(total);
+        status = (buf == NULL) ? MS_ERR_SYS : MS_OK;
+        size_t pos = 0;
+        for (int i = 0; i < batch && buf != NULL; i++) {
+            memcpy(buf + pos, recs[i], recs[i]->length);
+            pos += recs[i]->length;
+        }
+        unsigned long long offset = shm_ptr->tier.file_size;
+        if (status == MS_OK) {
+            status = append_cold(shm_ptr, buf, total, 0);
+        }
+        free(buf);
+        
+        for (int i = 0; i < batch; i++) {
+            if (status == MS_OK) {
+                Email* email = &shm_ptr->emails[g_candidates[done + i].slot];
+                ColdEntry* entry = entries[i];
+                entry->email_id = email->email_id;
+                entry->sender_id = email->sender_id;
+                entry->receiver_id = email->receiver_id;
+                entry->is_read = email->is_read;
+                entry->is_deleted = 0;
+                entry->length = recs[i]->length;
+                entry->sent_at = email->sent_at;
+                entry->offset = offset;
+                entry->modseq = email->modseq;
+                offset += recs[i]->length;
+                if (entry - shm_ptr->tier.index >= shm_ptr->tier.count) {
+                    shm_ptr->tier.count = (int)(entry - shm_ptr->tier.index) + 1;
+                }
+                memset(email, 0, sizeof(Email));
+            }
+            free(recs[i]);
+        }
+        if (status == MS_OK) {
+            done += batch;
+        }
+    }
+    
+    shm_ptr->tier.demoted += done;
+    return done;
+}
+
+// fdatasync file cold. Gọi trước khi ghi emails.txt (có thể là bản chụp của
+// lưu nền): mail hạ xuống từ lần lưu trước chỉ còn trong file cold sau lần này.
+int tier_sync(const SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled || shm_ptr->tier.file_size == 0) {
+        return MS_OK;
+    }
+    if (open_cold_file() != MS_OK) {
+        return MS_ERR_IO;
+    }
+    return (fdatasync(g_fd) == -1) ? MS_ERR_IO : MS_OK;
+}
+
+// Email cold theo ID, dựng lại từ file (NULL nếu không có hoặc lỗi đọc)
+Email* tier_read(SharedMemoryData* shm_ptr, int email_id) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled) {
+        return NULL;
+    }
+    
+    ColdEntry* entry = find_cold(shm_ptr, email_id);
+    if (entry == NULL || materialize(entry, &g_read_view) != MS_OK) {
+        return NULL;
+    }
+    __atomic_add_fetch(&shm_ptr->tier.paged_in, 1, __ATOMIC_RELAXED);
+    return &g_read_view;
+}
+
+// Đổi cờ của email cold (update_email_status / delete_email), fdatasync ngay:
+// journal không áp được thay đổi lên email chỉ có trong file cold. Trả về
+// MS_ERR_NOT_FOUND nếu email không nằm trong file cold.
+int tier_set_flags(SharedMemoryData* shm_ptr, int email_id, int is_read, int is_deleted) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled) {
+        return MS_ERR_NOT_FOUND;
+    }
+    
+    ColdEntry* entry = find_cold(shm_ptr, email_id);
+    if (entry == NULL) {
+        return MS_ERR_NOT_FOUND;
+    }
+    
+    char buf[sizeof(JournalRecord)];
+    size_t len = put_flag_record(buf, entry, is_deleted ? CHANGE_DELETE : CHANGE_FLAGS,
+                                 is_deleted ? entry->is_read : is_read);
+    if (len == 0) {
+        return MS_ERR_SYS;
+    }
+    int status = append_cold(shm_ptr, buf, len, 1);
+    if (status != MS_OK) {
+        return status;
+    }
+    
+    if (is_deleted) {
+        entry->is_deleted = 1;
+    } else {
+        entry->is_read = is_read;
+    }
+    stamp_change(shm_ptr, entry, is_deleted ? CHANGE_DELETE : CHANGE_FLAGS);
+    return MS_OK;
+}
+
+int tier_unread_count(SharedMemoryData* shm_ptr, int user_id) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled) {
+        return 0;
+    }
+    
+    int count = 0;
+    TierState* tier = &shm_ptr->tier;
+    for (int i = 0; i < tier->count; i++) {
+        const ColdEntry* entry = &tier->index[i];
+        if (entry->email_id != 0 && !entry->is_deleted &&
+            entry->receiver_id == user_id && !entry->is_read) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int matches_bulk(const ColdEntry* entry, int user_id, int op) {
+    if (entry->email_id == 0 || entry->is_deleted) {
+        return 0;
+    }
+    if (op == CHANGE_FLAGS) {
+        return entry->receiver_id == user_id && !entry->is_read;
+    }
+    return (entry->sender_id == user_id || entry->receiver_id == user_id) && entry->is_read;
+}
+
+// Đổi cờ mọi entry khớp trong một lần ghi: op = CHANGE_FLAGS (đánh dấu đã đọc
+// mail nhận) hoặc CHANGE_DELETE (xóa mail đã đọc, gửi hoặc nhận)
+static int update_matching(SharedMemoryData* shm_ptr, int user_id, int op) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled) {
+        return 0;
+    }
+    
+    TierState* tier = &shm_ptr->tier;
+    int n = 0;
+    for (int i = 0; i < tier->count; i++) {
+        if (matches_bulk(&tier->index[i], user_id, op)) {
+            n++;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+    
+    char* buf = malloc((size_t)n * sizeof(JournalRecord));
+    if (buf == NULL) {
+        return MS_ERR_SYS;
+    }
+    size_t pos = 0;
+    for (int i = 0; i < tier->count; i++) {
+        if (matches_bulk(&tier->index[i], user_id, op)) {
+            pos += put_flag_record(buf + pos, &tier->index[i], op, 1);
+        }
+    }
+    
+    int status = append_cold(shm_ptr, buf, pos, 1);
+    free(buf);
+    if (status != MS_OK) {
+        return status;
+    }
+    
+    for (int i = 0; i < tier->count; i++) {
+        ColdEntry* entry = &tier->index[i];
+        if (!matches_bulk(entry, user_id, op)) {
+            continue;
+        }
+        if (op == CHANGE_FLAGS) {
+            entry->is_read = 1;
+        } else {
+            entry->is_deleted = 1;
+        }
+        stamp_change(shm_ptr, entry, op);
+    }
+    return n;
+}
+
+int tier_mark_all_read(SharedMemoryData* shm_ptr, int user_id) {
+    return update_matching(shm_ptr, user_id, CHANGE_FLAGS);
+}
+
+int tier_delete_read(SharedMemoryData* shm_ptr, int user_id) {
+    return update_matching(shm_ptr, user_id, CHANGE_DELETE);
+}
+
+// Phần cold của email_iter_next: chạy sau khi đã duyệt hết mảng trong segment
+Email* tier_iter_next(SharedMemoryData* shm_ptr, EmailIterator* it) {
+    if (shm_ptr == NULL || !shm_ptr->tier.enabled || it->cold_pos < 0) {
+        return NULL;
+    }
+    
+    TierState* tier = &shm_ptr->tier;
+    while (it->cold_pos < tier->count) {
+        const ColdEntry* entry = &tier->index[it->cold_pos++];
+        if (entry->email_id == 0 || entry->is_deleted) {
+            continue;
+        }
+        if (it->user_id > 0) {
+            int received = (entry->receiver_id == it->user_id);
+            int sent = (entry->sender_id == it->user_id);
+            if (!((it->type == MAILBOX_RECEIVED && received) ||
+                  (it->type == MAILBOX_SENT && sent) ||
+                  (it->type == MAILBOX_BOTH && (received || sent)))) {
+                continue;
+            }
+        }
+        if (materialize(entry, &g_iter_view) == MS_OK) {
+            return &g_iter_view;
+        }
+    }
+    return NULL;
+}
+
+// Dựng lại email từ một entry đã copy khỏi index (không cần store lock): file
+// cold chỉ ghi thêm nên offset của entry vẫn đọc được sau khi nhả lock
+int tier_materialize(const ColdEntry* entry, Email* out) {
+    if (entry == NULL || out == NULL) {
+        return MS_ERR_INVALID;
+    }
+    return materialize(entry, out);
+}
+
+// Số email cold còn hiệu lực (màn hình debug / stats)
+int tier_live_count(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return 0;
+    }
+    
+    int count = 0;
+    for (int i = 0; i < shm_ptr->tier.count; i++) {
+        if (shm_ptr->tier.index[i].email_id != 0 && !shm_ptr->tier.index[i].is_deleted) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <sys/syscall.h>
+
+// Trace ring: mỗi process ghi vào ring riêng (cùng chỉ số shard với stats.c)
+// trong trace region của segment. Không có khóa: người ghi lấy slot bằng
+// fetch_add trên head (an toàn cho nhiều thread), xóa seq, ghi dữ liệu rồi
+// đặt seq với release. Người đọc bỏ qua slot có seq = 0 hoặc seq thay đổi
+// trong lúc copy. Ring đầy thì event cũ nhất bị ghi đè.
+
+static const char* g_span_names[] = {
+    "compose_mail", "batch_command", "bgsave_fork", "bgsave_write"
+};
+
+static int current_tid() {
+    return (int)syscall(SYS_gettid);
+}
+
+// Gọi qua TRACE_OP để không tốn gì khi tracing tắt
+void trace_record(SharedMemoryData* shm_ptr, int op, long long start_ns, int id1, int id2, int result) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    TraceRing* ring = &shm_ptr->trace.rings[stats_shard_index(shm_ptr)];
+    unsigned long long n = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceEvent* ev = &ring->events[n % TRACE_RING_SIZE];
+    
+    __atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    ev->start_ns = start_ns;
+    ev->end_ns = stats_now();
+    ev->pid = getpid();
+    ev->tid = current_tid();
+    ev->op = op;
+    ev->id1 = id1;
+    ev->id2 = id2;
+    ev->result = result;
+    
+    __atomic_store_n(&ev->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_enabled(SharedMemoryData* shm_ptr, int enabled) {
+    if (shm_ptr != NULL) {
+        __atomic_store_n(&shm_ptr->trace.enabled, enabled ? 1 : 0, __ATOMIC_RELAXED);
+    }
+}
+
+// Xóa mọi ring. Event đang được ghi đồng thời có thể vẫn còn lại.
+void trace_clear(SharedMemoryData* shm_ptr) {
+    if (shm_ptr == NULL) {
+        return;
+    }
+    
+    for (int r = 0; r < STATS_SHARDS; r++) {
+        TraceRing* ring = &shm_ptr->trace.rings[r];
+        for (int i = 0; i < TRACE_RING_SIZE; i++) {
+            __atomic_store_n(&ring->events[i].seq, 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static int compare_events(const void* a, const void* b) {
+    const TraceEvent* x = (const TraceEvent*)a;
+    const TraceEvent* y = (const TraceEvent*)b;
+    if (x->start_ns != y->start_ns) {
+        return x->start_ns < y->start_ns ? -1 : 1;
+    }
+    // Span ngoài (dài hơn) đứng trước span lồng bên trong
+    return (x->end_ns > y->end_ns) ? -1 : (x->end_ns < y->end_ns);
+}
+
+// Copy các event hoàn chỉnh của mọi ring vào out (tối đa max), sắp theo
+// start_ns. Dùng được trên segment attach chỉ đọc. Trả về số event.
+int trace_collect(const SharedMemoryData* shm_ptr, TraceEvent* out, int max) {
+    if (shm_ptr == NULL || out == NULL || max <= 0) {
+        return MS_ERR_INVALID;
+    }
+    
+    int count = 0;
+    for (int r = 0; r < STATS_SHARDS && count < max; r++) {
+        const TraceRing* ring = &shm_ptr->trace.rings[r];
+        for (int i = 0; i < TRACE_RING_SIZE && count < max; i++) {
+            const TraceEvent* ev = &ring->events[i];
+            unsigned long long seq = __atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE);
+            if (seq == 0) {
+                continue;
+            }
+            
+            out[count] = *ev;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&ev->seq, __ATOMIC_RELAXED) != seq) {
+                continue;                // bị ghi đè trong lúc copy
+            }
+            out[count].seq = seq;
+            count++;
+        }
+    }
+    
+    qsort(out, count, sizeof(TraceEvent), compare_events);
+    return count;
+}
+
+const char* trace_op_name(int op) {
+    if (op >= 0 && op < STAT_OP_COUNT) {
+        return stats_op_name(op);
+    }
+    if (op >= TRACE_COMPOSE_MAIL && op <= TRACE_BGSAVE_WRITE) {
+        return g_span_names[op - TRACE_COMPOSE_MAIL];
+    }
+    return "unknown";
+}
@@ -1,23 +1,9 @@
-#include "mail_system.h"
+#include "mailstore.h"
 
-// Global variable to track logged-in user
-static int g_current_user_id = -1;
+// Hàm public = bản *_impl + đo thời gian qua stats_record (xem stats.c)
+static User* find_user_by_email_impl(SharedMemoryData* shm_ptr, const char* email);
 
-// Authentication helper functions
-int is_user_logged_in() {
-    return g_current_user_id > 0;
-}
-
-int get_current_user_id() {
-    return g_current_user_id;
-}
-
-void logout_user() {
-    g_current_user_id = -1;
-    printf("Logged out successfully!\n");
-}
-
-User* verify_user_credentials(SharedMemoryData* shm_ptr, const char* email, const char* password) {
+static User* verify_user_credentials_impl(SharedMemoryData* shm_ptr, const char* email, const char* password) {
     if (shm_ptr == NULL || email == NULL || password == NULL) {
         return NULL;
     }
@@ -33,80 +19,26 @@ User* verify_user_credentials(SharedMemoryData* shm_ptr, const char* email, cons
     return NULL;
 }
 
-void show_login_menu() {
-    printf("\n" "===============================================\n");
-    printf("      MAIL SYSTEM - LOGIN/REGISTER\n");
-    printf("===============================================\n");
-    printf("1. Login\n");
-    printf("2. Register New Account\n");
-    printf("3. Exit\n");
-    printf("===============================================\n");
-}
-
-int handle_authentication(SharedMemoryData* shm_ptr) {
-    int choice;
-    
-    while (1) {
-        clear_screen();
-        show_login_menu();
-        choice = get_user_choice();
-        
-        switch (choice) {
-            case 1: {
-                // Login
-                char email[MAX_EMAIL_LENGTH];
-                char password[MAX_PASSWORD_LENGTH];
-                
-                printf("\n=== LOGIN ===\n");
-                printf("Email: ");
-                fgets(email, sizeof(email), stdin);
-                email[strcspn(email, "\n")] = 0;
-                
-                printf("Password: ");
-                fgets(password, sizeof(password), stdin);
-                password[strcspn(password, "\n")] = 0;
-                
-                User* user = verify_user_credentials(shm_ptr, email, password);
-                if (user != NULL) {
-                    g_current_user_id = user->user_id;
-                    printf("\nLogin successful! Welcome, %s!\n", user->name);
-                    pause_system();
-                    return 1;
-                } else {
-                    printf("\nInvalid email or password!\n");
-                    pause_system();
-                }
-                break;
-            }
-            case 2: {
-                // Register
-                register_user(shm_ptr);
-                pause_system();
-                break;
-            }
-            case 3:
-                return 0;
-            default:
-                printf("Invalid choice! Please try again.\n");
-                pause_system();
-        }
-    }
+User* verify_user_credentials(SharedMemoryData* shm_ptr, const char* email, const char* password) {
+    capture_record(CAP_LOGIN, 0, 0, email, NULL, password);
+    long long start = stats_now();
+    User* result = verify_user_credentials_impl(shm_ptr, email, password);
+    stats_record(shm_ptr, STAT_USER_VERIFY, start, result != NULL);
+    TRACE_OP(shm_ptr, STAT_USER_VERIFY, start, result ? result->user_id : 0, 0, result ? MS_OK : MS_ERR_NOT_FOUND);
+    return result;
 }
 
-int create_user(SharedMemoryData* shm_ptr, const char* name, const char* email, const char* password, int age) {
+static int create_user_impl(SharedMemoryData* shm_ptr, const char* name, const char* email, const char* password, int age) {
     if (shm_ptr == NULL || name == NULL || email == NULL || password == NULL) {
-        printf("Error: Invalid parameters\n");
-        return -1;
+        return MS_ERR_INVALID;
     }
     
     if (shm_ptr->control.user_count >= MAX_USERS) {
-        printf("Error: Maximum number of users reached\n");
-        return -1;
+        return MS_ERR_FULL;
     }
     
-    if (find_user_by_email(shm_ptr, email) != NULL) {
-        printf("Error: Email already exists\n");
-        return -1;
+    if (find_user_by_email_impl(shm_ptr, email) != NULL) {
+        return MS_ERR_EXISTS;
     }
     
     int index = -1;
@@ -118,12 +50,12 @@ int create_user(SharedMemoryData* shm_ptr, const char* name, const char* email,
     }
     
     if (index == -1) {
-        printf("Error: No available slot for new user\n");
-        return -1;
+        return MS_ERR_FULL;
     }
     
     User* new_user = &shm_ptr->users[index];
-    new_user->user_id = shm_ptr->control.next_user_id++;
+    new_user->user_id = shm_ptr->control.next_user_id;
+    shm_ptr->control.next_user_id += ID_STRIDE(shm_ptr);
     strncpy(new_user->name, name, MAX_NAME_LENGTH - 1);
     new_user->name[MAX_NAME_LENGTH - 1] = '\0';
     strncpy(new_user->email, email, MAX_EMAIL_LENGTH - 1);
@@ -135,12 +67,21 @@ int create_user(SharedMemoryData* shm_ptr, const char* name, const char* email,
     new_user->created_at = time(NULL);
     
     shm_ptr->control.user_count++;
+    shm_ptr->control.users_version++;
     
-    printf("User created successfully with ID: %d\n", new_user->user_id);
     return new_user->user_id;
 }
 
-User* read_user(SharedMemoryData* shm_ptr, int user_id) {
+int create_user(SharedMemoryData* shm_ptr, const char* name, const char* email, const char* password, int age) {
+    capture_record(CAP_CREATE_USER, age, 0, name, email, password);
+    long long start = stats_now();
+    int result = create_user_impl(shm_ptr, name, email, password, age);
+    stats_record(shm_ptr, STAT_USER_CREATE, start, result > 0);
+    TRACE_OP(shm_ptr, STAT_USER_CREATE, start, result > 0 ? result : 0, 0, result);
+    return result;
+}
+
+static User* read_user_impl(SharedMemoryData* shm_ptr, int user_id) {
     if (shm_ptr == NULL || user_id <= 0) {
         return NULL;
     }
@@ -154,7 +95,23 @@ User* read_user(SharedMemoryData* shm_ptr, int user_id) {
     return NULL;
 }
 
-User* find_user_by_email(SharedMemoryData* shm_ptr, const char* email) {
+// Vị trí của user trong mảng users (-1 nếu không có). Dùng cho các bảng theo
+// slot user (notify, change log, lazy, cache view): không ghi stats/trace như
+// read_user nên không làm nhiễu histogram user_read.
+int user_slot_of(SharedMemoryData* shm_ptr, int user_id) {
+    User* user = read_user_impl(shm_ptr, user_id);
+    return user ? (int)(user - shm_ptr->users) : -1;
+}
+
+User* read_user(SharedMemoryData* shm_ptr, int user_id) {
+    long long start = stats_now();
+    User* result = read_user_impl(shm_ptr, user_id);
+    stats_record(shm_ptr, STAT_USER_READ, start, result != NULL);
+    TRACE_OP(shm_ptr, STAT_USER_READ, start, user_id, 0, result ? MS_OK : MS_ERR_NOT_FOUND);
+    return result;
+}
+
+static User* find_user_by_email_impl(SharedMemoryData* shm_ptr, const char* email) {
     if (shm_ptr == NULL || email == NULL) {
         return NULL;
     }
@@ -169,22 +126,27 @@ User* find_user_by_email(SharedMemoryData* shm_ptr, const char* email) {
     return NULL;
 }
 
-int update_user(SharedMemoryData* shm_ptr, int user_id, const char* name, const char* email, const char* password, int age) {
+User* find_user_by_email(SharedMemoryData* shm_ptr, const char* email) {
+    long long start = stats_now();
+    User* result = find_user_by_email_impl(shm_ptr, email);
+    stats_record(shm_ptr, STAT_USER_FIND, start, result != NULL);
+    TRACE_OP(shm_ptr, STAT_USER_FIND, start, result ? result->user_id : 0, 0, result ? MS_OK : MS_ERR_NOT_FOUND);
+    return result;
+}
+
+static int update_user_impl(SharedMemoryData* shm_ptr, int user_id, const char* name, const char* email, const char* password, int age) {
     if (shm_ptr == NULL || name == NULL || email == NULL) {
-        printf("Error: Invalid parameters\n");
-        return 0;
+        return MS_ERR_INVALID;
     }
     
-    User* user = read_user(shm_ptr, user_id);
+    User* user = read_user_impl(shm_ptr, user_id);
     if (user == NULL) {
-        printf("Error: User not found\n");
-        return 0;
+        return MS_ERR_NOT_FOUND;
     }
     
-    User* existing_user = find_user_by_email(shm_ptr, email);
+    User* existing_user = find_user_by_email_impl(shm_ptr, email);
     if (existing_user != NULL && existing_user->user_id != user_id) {
-        printf("Error: Email already exists for another user\n");
-        return 0;
+        return MS_ERR_EXISTS;
     }
     
     strncpy(user->name, name, MAX_NAME_LENGTH - 1);
@@ -198,260 +160,59 @@ int update_user(SharedMemoryData* shm_ptr, int user_id, const char* name, const
     }
     
     user->age = age;
+    shm_ptr->control.users_version++;
     
-    printf("User updated successfully\n");
-    return 1;
+    return MS_OK;
 }
 
-int delete_user(SharedMemoryData* shm_ptr, int user_id) {
+int update_user(SharedMemoryData* shm_ptr, int user_id, const char* name, const char* email, const char* password, int age) {
+    long long start = stats_now();
+    int result = update_user_impl(shm_ptr, user_id, name, email, password, age);
+    stats_record(shm_ptr, STAT_USER_UPDATE, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_USER_UPDATE, start, user_id, 0, result);
+    return result;
+}
+
+static int delete_user_impl(SharedMemoryData* shm_ptr, int user_id) {
     if (shm_ptr == NULL || user_id <= 0) {
-        printf("Error: Invalid parameters\n");
-        return 0;
+        return MS_ERR_INVALID;
     }
     
-    User* user = read_user(shm_ptr, user_id);
+    User* user = read_user_impl(shm_ptr, user_id);
     if (user == NULL) {
-        printf("Error: User not found\n");
-        return 0;
+        return MS_ERR_NOT_FOUND;
     }
     
     user->is_active = 0;
     shm_ptr->control.user_count--;
+    shm_ptr->control.users_version++;
     
-    printf("User deleted successfully\n");
-    return 1;
-}
-
-void display_all_users(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    printf("\n=== ALL USERS ===\n");
-    printf("%-5s %-20s %-30s %-5s %-20s\n", "ID", "Name", "Email", "Age", "Created");
-    printf("--------------------------------------------------------------------------------\n");
-    
-    int count = 0;
-    for (int i = 0; i < MAX_USERS; i++) {
-        if (shm_ptr->users[i].is_active) {
-            User* user = &shm_ptr->users[i];
-            
-            char created_time[20];
-            struct tm* tm_info = localtime(&user->created_at);
-            strftime(created_time, sizeof(created_time), "%Y-%m-%d %H:%M", tm_info);
-            
-            printf("%-5d %-20.20s %-30.30s %-5d %-20s\n", 
-                   user->user_id, user->name, user->email, user->age, created_time);
-            count++;
-        }
-    }
-    
-    if (count == 0) {
-        printf("No users found.\n");
-    } else {
-        printf("\nTotal: %d users\n", count);
-    }
+    return MS_OK;
 }
 
-void search_users(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    char keyword[100];
-    printf("\n=== SEARCH USERS ===\n");
-    printf("Enter search keyword (name or email): ");
-    fgets(keyword, sizeof(keyword), stdin);
-    keyword[strcspn(keyword, "\n")] = 0;
-    
-    printf("\nSearch results for '%s':\n", keyword);
-    printf("%-5s %-20s %-30s %-5s\n", "ID", "Name", "Email", "Age");
-    printf("----------------------------------------------------------------\n");
-    
-    int count = 0;
-    for (int i = 0; i < MAX_USERS; i++) {
-        if (shm_ptr->users[i].is_active) {
-            User* user = &shm_ptr->users[i];
-            if (strstr(user->name, keyword) != NULL || 
-                strstr(user->email, keyword) != NULL) {
-                printf("%-5d %-20.20s %-30.30s %-5d\n", 
-                       user->user_id, user->name, user->email, user->age);
-                count++;
-            }
-        }
-    }
-    
-    if (count == 0) {
-        printf("No users found matching '%s'.\n", keyword);
-    } else {
-        printf("\nFound %d users\n", count);
-    }
+int delete_user(SharedMemoryData* shm_ptr, int user_id) {
+    long long start = stats_now();
+    int result = delete_user_impl(shm_ptr, user_id);
+    stats_record(shm_ptr, STAT_USER_DELETE, start, result == MS_OK);
+    TRACE_OP(shm_ptr, STAT_USER_DELETE, start, user_id, 0, result);
+    return result;
 }
 
-void register_user(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    char name[MAX_NAME_LENGTH];
-    char email[MAX_EMAIL_LENGTH];
-    char password[MAX_PASSWORD_LENGTH];
-    int age;
-    
-    printf("\n=== USER REGISTRATION ===\n");
-    
-    printf("Enter name: ");
-    fgets(name, sizeof(name), stdin);
-    name[strcspn(name, "\n")] = 0;
-    
-    printf("Enter email: ");
-    fgets(email, sizeof(email), stdin);
-    email[strcspn(email, "\n")] = 0;
-    
-    printf("Enter password: ");
-    fgets(password, sizeof(password), stdin);
-    password[strcspn(password, "\n")] = 0;
-    
-    printf("Enter age: ");
-    scanf("%d", &age);
-    getchar(); 
-    
-    if (strlen(name) == 0) {
-        printf("Error: Name cannot be empty\n");
-        return;
-    }
-    
-    if (strlen(email) == 0 || strchr(email, '@') == NULL) {
-        printf("Error: Invalid email format\n");
-        return;
-    }
-    
-    if (strlen(password) < 4) {
-        printf("Error: Password must be at least 4 characters\n");
-        return;
-    }
-    
-    if (age <= 0 || age > 150) {
-        printf("Error: Invalid age\n");
-        return;
-    }
-    
-    int user_id = create_user(shm_ptr, name, email, password, age);
-    if (user_id > 0) {
-        save_users_to_file(shm_ptr);
-        printf("Registration successful! Your User ID is: %d\n", user_id);
-        printf("Please login with your credentials.\n");
-    }
+// Duyệt các user đang active
+void user_iter_init(UserIterator* it) {
+    it->pos = 0;
 }
 
-void edit_user(SharedMemoryData* shm_ptr) {
+User* user_iter_next(SharedMemoryData* shm_ptr, UserIterator* it) {
     if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    int user_id;
-    
-    if (is_user_logged_in()) {
-        user_id = get_current_user_id();
-        printf("\n=== UPDATE YOUR PROFILE ===\n");
-    } else {
-        printf("\n=== EDIT USER ===\n");
-        printf("Enter User ID to edit: ");
-        scanf("%d", &user_id);
-        getchar(); 
-    }
-    
-    User* user = read_user(shm_ptr, user_id);
-    if (user == NULL) {
-        printf("User not found!\n");
-        return;
-    }
-    
-    printf("\nCurrent information:\n");
-    printf("Name: %s\n", user->name);
-    printf("Email: %s\n", user->email);
-    printf("Age: %d\n", user->age);
-    
-    char name[MAX_NAME_LENGTH];
-    char email[MAX_EMAIL_LENGTH];
-    char password[MAX_PASSWORD_LENGTH];
-    int age;
-    
-    printf("\nEnter new information (press Enter to keep current value):\n");
-    
-    printf("New name [%s]: ", user->name);
-    fgets(name, sizeof(name), stdin);
-    if (name[0] == '\n') {
-        strcpy(name, user->name);
-    } else {
-        name[strcspn(name, "\n")] = 0;
-    }
-    
-    printf("New email [%s]: ", user->email);
-    fgets(email, sizeof(email), stdin);
-    if (email[0] == '\n') {
-        strcpy(email, user->email);
-    } else {
-        email[strcspn(email, "\n")] = 0;
-    }
-    
-    printf("New password (press Enter to keep current): ");
-    fgets(password, sizeof(password), stdin);
-    password[strcspn(password, "\n")] = 0;
-    
-    printf("New age [%d]: ", user->age);
-    char age_str[10];
-    fgets(age_str, sizeof(age_str), stdin);
-    if (age_str[0] == '\n') {
-        age = user->age;
-    } else {
-        age = atoi(age_str);
-    }
-    
-    if (update_user(shm_ptr, user_id, name, email, strlen(password) > 0 ? password : NULL, age)) {
-        save_users_to_file(shm_ptr);
-        printf("User information updated successfully!\n");
-    }
-}
-
-void remove_user(SharedMemoryData* shm_ptr) {
-    if (shm_ptr == NULL) {
-        printf("Error: Shared memory not available\n");
-        return;
-    }
-    
-    int user_id;
-    printf("\n=== DELETE USER ===\n");
-    printf("Enter User ID to delete: ");
-    scanf("%d", &user_id);
-    getchar(); 
-    
-    User* user = read_user(shm_ptr, user_id);
-    if (user == NULL) {
-        printf("User not found!\n");
-        return;
+        return NULL;
     }
     
-    printf("\nUser to delete:\n");
-    printf("Name: %s\n", user->name);
-    printf("Email: %s\n", user->email);
-    printf("Age: %d\n", user->age);
-    
-    char confirm;
-    printf("\nAre you sure you want to delete this user? (y/n): ");
-    scanf("%c", &confirm);
-    getchar(); 
-    
-    if (confirm == 'y' || confirm == 'Y') {
-        if (delete_user(shm_ptr, user_id)) {
-            save_users_to_file(shm_ptr);
-            printf("User deleted successfully!\n");
+    while (it->pos < MAX_USERS) {
+        User* user = &shm_ptr->users[it->pos++];
+        if (user->is_active) {
+            return user;
         }
-    } else {
-        printf("User deletion cancelled.\n");
     }
-}
\ No newline at end of file
+    return NULL;
+}
@@ -0,0 +1,50 @@
+#include "mail_system.h"
+
+void clear_screen() {
+    system("clear");
+}
+
+void pause_system() {
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+int get_user_choice() {
+    int choice;
+    char buffer[100];
+    
+    while (1) {
+        printf("Enter your choice: ");
+        fflush(stdout);
+        
+        if (fgets(buffer, sizeof(buffer), stdin) != NULL) {
+            buffer[strcspn(buffer, "\n")] = 0;
+            
+            if (strlen(buffer) == 0) {
+                if (feof(stdin)) {
+                    return 10;
+                }
+                printf("Please enter a number.\n");
+                continue;
+            }
+            
+            char* endptr;
+            choice = strtol(buffer, &endptr, 10);
+            
+            if (*endptr == '\0') {
+                return choice;
+            } else {
+                printf("Invalid input! Please enter a valid number.\n");
+                continue;
+            }
+        } else {
+            if (feof(stdin)) {
+                printf("\nEnd of input reached. Exiting...\n");
+                return 10;
+            } else {
+                printf("Error reading input!\n");
+                return 10;
+            }
+        }
+    }
+}
@@ -1,31 +1,20 @@
 #!/bin/bash
 # Script to monitor shared memory in real-time
+# Thin wrapper around mail_top (read-only attach, never takes the store lock).
+# Usage: ./view_shm.sh            one snapshot
+#        ./view_shm.sh -w|--watch live view, refresh every second
 
-echo "╔════════════════════════════════════════════════════════╗"
-echo "║     SHARED MEMORY MONITOR - External View             ║"
-echo "╚════════════════════════════════════════════════════════╝"
-echo ""
+cd "$(dirname "$0")"
 
-# Check if shared memory exists
-echo "📊 SYSTEM SHARED MEMORY SEGMENTS:"
-echo "════════════════════════════════════════════════════════"
-ipcs -m | head -1
-ipcs -m | grep -E "1234|mail_system|lequangchinh" || echo "   (No mail system shared memory found)"
-echo ""
-
-# Show detailed info
-echo "📋 DETAILED INFORMATION:"
-echo "────────────────────────────────────────────────────────"
-ipcs -m -i $(ipcs -m | grep 666 | awk '{print $2}' | head -1) 2>/dev/null || echo "   No accessible shared memory"
-echo ""
-
-echo "💡 TIP: Run './mail_system' to create shared memory"
-echo "💡 TIP: Use option 6 in the program to see live data"
-echo ""
+if [ ! -x ./mail_top ]; then
+    echo "mail_top not built, run 'make' first. Falling back to ipcs:"
+    ipcs -m
+    exit 1
+fi
 
-# Continuous monitoring option
 if [ "$1" == "-w" ] || [ "$1" == "--watch" ]; then
-    echo "🔄 Monitoring mode (Ctrl+C to exit)..."
-    echo "════════════════════════════════════════════════════════"
-    watch -n 2 "ipcs -m | grep -E 'key|666'"
+    shift
+    exec ./mail_top "$@"
 fi
+
+exec ./mail_top -1 "$@"
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include "mailstore.h"
+#include <pthread.h>
+
+// Worker pool nhỏ cho các thao tác hàng loạt trên mảng emails: chia [0, total)
+// thành các đoạn liên tiếp, mỗi worker xử lý một đoạn và ghi kết quả riêng,
+// caller gộp kết quả sau khi tất cả hoàn thành. Caller giữ store lock trong
+// suốt thao tác nên các worker không cần khóa thêm cho mảng emails; những gì
+// worker gọi thêm phải an toàn giữa các thread: record_email_change (modseq và
+// bộ đếm mailbox bằng atomic, mỗi modseq một ô ring), journal_append (mutex của
+// writer), touch_mailbox (atomic, tra slot user không ghi stats/trace).
+// Không gọi hàm public có stats/trace/capture từ worker.
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    pthread_t threads[WORKER_POOL_MAX_THREADS];
+    int thread_count;
+    int initialized;
+    
+    // Job hiện tại
+    unsigned long generation;
+    SharedMemoryData* shm_ptr;
+    range_task_fn fn;
+    void* arg;
+    char* results;
+    size_t result_size;
+    int total;
+    int parts;
+    int next_part;
+    int done_parts;
+} WorkerPool;
+
+static WorkerPool g_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .work_ready = PTHREAD_COND_INITIALIZER,
+    .work_done = PTHREAD_COND_INITIALIZER,
+};
+
+static void run_part(int part) {
+    int chunk = (g_pool.total + g_pool.parts - 1) / g_pool.parts;
+    int begin = part * chunk;
+    int end = begin + chunk;
+    if (end > g_pool.total) {
+        end = g_pool.total;
+    }
+    
+    if (begin < end) {
+        g_pool.fn(g_pool.shm_ptr, begin, end, g_pool.arg,
+                  g_pool.results + (size_t)part * g_pool.result_size);
+    }
+}
+
+static void* worker_main(void* unused) {
+    (void)unused;
+    unsigned long seen = 0;
+    
+    pthread_mutex_lock(&g_pool.mutex);
+    while (1) {
+        while (g_pool.generation == seen) {
+            pthread_cond_wait(&g_pool.work_ready, &g_pool.mutex);
+        }
+        seen = g_pool.generation;
+        
+        while (g_pool.next_part < g_pool.parts) {
+            int part = g_pool.next_part++;
+            pthread_mutex_unlock(&g_pool.mutex);
+            run_part(part);
+            pthread_mutex_lock(&g_pool.mutex);
+            if (++g_pool.done_parts == g_pool.parts) {
+                pthread_cond_signal(&g_pool.work_done);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Process con sau fork() không có các thread của cha: tạo lại pool khi cần
+static void reset_pool_in_child() {
+    pthread_mutex_init(&g_pool.mutex, NULL);
+    pthread_cond_init(&g_pool.work_ready, NULL);
+    pthread_cond_init(&g_pool.work_done, NULL);
+    g_pool.initialized = 0;
+    g_pool.thread_count = 0;
+    g_pool.generation = 0;
+}
+
+static void start_pool() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = (cpus > 1) ? (int)cpus : 1;
+    if (wanted > WORKER_POOL_MAX_THREADS) {
+        wanted = WORKER_POOL_MAX_THREADS;
+    }
+    
+    static int atfork_registered = 0;
+    if (!atfork_registered) {
+        pthread_atfork(NULL, NULL, reset_pool_in_child);
+        atfork_registered = 1;
+    }
+    
+    for (int i = 0; i < wanted; i++) {
+        if (pthread_create(&g_pool.threads[i], NULL, worker_main, NULL) != 0) {
+            break;
+        }
+        pthread_detach(g_pool.threads[i]);
+        g_pool.thread_count++;
+    }
+    g_pool.initialized = 1;
+}
+
+int get_worker_count() {
+    pthread_mutex_lock(&g_pool.mutex);
+    if (!g_pool.initialized) {
+        start_pool();
+    }
+    int count = g_pool.thread_count;
+    pthread_mutex_unlock(&g_pool.mutex);
+    return count;
+}
+
+// Chạy fn trên [0, total) chia thành tối đa get_worker_count() đoạn.
+// results là mảng result_size byte cho mỗi đoạn (đã được caller khởi tạo).
+// Trả về số đoạn đã dùng; với total nhỏ chạy tuần tự trong thread hiện tại.
+int run_parallel_range(SharedMemoryData* shm_ptr, int total, range_task_fn fn, void* arg,
+                       void* results, size_t result_size) {
+    if (fn == NULL || results == NULL || total <= 0) {
+        return 0;
+    }
+    
+    int workers = (total >= PARALLEL_MIN_ITEMS) ? get_worker_count() : 0;
+    if (workers <= 1) {
+        fn(shm_ptr, 0, total, arg, results);
+        return 1;
+    }
+    
+    pthread_mutex_lock(&g_pool.mutex);
+    g_pool.shm_ptr = shm_ptr;
+    g_pool.fn = fn;
+    g_pool.arg = arg;
+    g_pool.results = (char*)results;
+    g_pool.result_size = result_size;
+    g_pool.total = total;
+    g_pool.parts = workers;
+    g_pool.next_part = 0;
+    g_pool.done_parts = 0;
+    g_pool.generation++;
+    pthread_cond_broadcast(&g_pool.work_ready);
+    
+    while (g_pool.done_parts < g_pool.parts) {
+        pthread_cond_wait(&g_pool.work_done, &g_pool.mutex);
+    }
+    pthread_mutex_unlock(&g_pool.mutex);
+    
+    return workers;
+}